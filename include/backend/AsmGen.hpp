@@ -5,6 +5,7 @@
 #include <semantic/Symbol.hpp>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 /**
@@ -80,6 +81,26 @@ private:
    * @param out mips assemble output stream
    */
   void emitFunction(const Function *func, std::ostream &out);
+  /**
+   * @brief emit the runtime printf routine, which interprets the format
+   * byte by byte; only printf calls that CodeGen could not split use it
+   *
+   * @param out mips assemble output stream
+   */
+  void emitPrintfRoutine(std::ostream &out);
+  /**
+   * @brief whether any function still calls the runtime printf
+   *
+   * @param mod ir module view
+   */
+  static bool callsRuntimePrintf(const IRModuleView &mod);
+  /**
+   * @brief syscall number of an output builtin (`putint` -> 1, `putstr` ->
+   * 4), 0 for any other callee
+   *
+   * @param name runtime callee name (Instruction::getCalleeName)
+   */
+  static int outputSyscall(const std::string &name);
 
   /**
    * @brief tranfer a instruction to assembly instructions
@@ -133,6 +154,21 @@ private:
    * @brief reset function state before processing a new function
    */
   void resetFunctionState();
+  /**
+   * @brief find the calls lowered as jumps: the function returns their
+   * result right away, their arguments fit in $a0-$a3 and none points into
+   * the frame the jump releases
+   *
+   * @param func function to be analyzed, after analyzeFunctionLocals
+   */
+  void findTailCalls(const Function *func);
+  /**
+   * @brief restore the callee-saved registers, $ra and $fp, and pop the
+   * frame of the current function
+   *
+   * @param out mips assemble output stream
+   */
+  void emitFrameRelease(std::ostream &out);
 
 private:
   /**
@@ -192,4 +228,18 @@ private:
    * @brief unified epilogue label for current function
    */
   std::string currentEpilogueLabel_;
+  /**
+   * @brief tail calls of the current function and the returns after them
+   */
+  std::unordered_set<const Instruction *> tailCalls_;
+  /**
+   * @brief callee-saved registers the current function saves, stored from
+   * savedRegBase_ up
+   */
+  std::vector<int> calleeSavedRegs_;
+  int savedRegBase_ = 0;
+  /**
+   * @brief the current function keeps $ra, so its frame has no slot for it
+   */
+  bool isLeaf_ = false;
 };
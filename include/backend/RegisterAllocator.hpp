@@ -1,6 +1,7 @@
 #pragma once
 
 #include "codegen/Function.hpp"
+#include "optimize/Liveness.hpp"
 #include <map>
 #include <set>
 #include <vector>
@@ -20,18 +21,13 @@ public:
   std::set<int> getUsedRegs() const;
 
 private:
-  void computeUseDef(Function *func);
-  void computeLiveInOut(Function *func);
   void buildInterferenceGraph(Function *func);
   void doColoring();
 
   // $s0-$s7
   static const int NumRegs = 8;
 
-  std::map<const BasicBlock *, LiveSet> _use;
-  std::map<const BasicBlock *, LiveSet> _def;
-  std::map<const BasicBlock *, LiveSet> _liveIn;
-  std::map<const BasicBlock *, LiveSet> _liveOut;
+  Liveness _liveness;
 
   std::map<int, LiveSet> _interferenceGraph;
   LiveSet _temps;
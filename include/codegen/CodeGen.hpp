@@ -9,6 +9,7 @@
 #include "semantic/SymbolTable.hpp"
 #include <map>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -26,14 +27,33 @@ public:
   const std::vector<std::shared_ptr<Function>> &getFunctions() const {
     return functions_;
   }
+  /**
+   * @brief functions of the module, for passes that remove functions
+   */
+  std::vector<std::shared_ptr<Function>> &getFunctions() { return functions_; }
   const std::vector<std::unique_ptr<Instruction>> &getGlobalsIR() const {
     return globalsIR_;
   }
+  /**
+   * @brief globals of the module, for passes that add tables
+   */
+  std::vector<std::unique_ptr<Instruction>> &getGlobalsIR() {
+    return globalsIR_;
+  }
   const std::unordered_map<std::string, std::shared_ptr<Symbol>> &
   getStringLiteralSymbols() const {
     return stringLiterals_;
   }
 
+  /**
+   * @brief replace the whole module with a main that prints output and
+   * returns exitValue, for programs already executed at compile time
+   *
+   * @param output everything the program prints
+   * @param exitValue value main returns
+   */
+  void replaceProgramWithOutput(const std::string &output, int exitValue);
+
 private:
   void genFunction(FuncDef *funcDef);
   void genMainFuncDef(MainFuncDef *mainDef);
@@ -106,6 +126,27 @@ private:
    */
   std::shared_ptr<Symbol> internStringLiteral(const std::string &literal);
 
+  /**
+   * @brief the symbol of an output builtin (`putstr` / `putint`), created on
+   * first use. These never enter the symbol table, so they cannot clash
+   * with user functions, and AsmGen lowers calls to them to a syscall.
+   *
+   * @param slot member caching the symbol
+   * @param name builtin name
+   */
+  std::shared_ptr<Symbol> &builtinSymbol(std::shared_ptr<Symbol> &slot,
+                                         const char *name);
+
+  /**
+   * @brief split a printf format literal at each `%d`
+   *
+   * @param format the literal, quotes included
+   * @param segments text around the conversions, one more than their count
+   * @return false if the format has a `%` that is not `%d`
+   */
+  static bool splitFormatString(const std::string &format,
+                                std::vector<std::string> &segments);
+
   /**
    * @brief intern a symbol with the given name and type
    *
@@ -142,6 +183,11 @@ private:
    * @brief all string literal symbols
    */
   std::unordered_map<std::string, std::shared_ptr<Symbol>> stringLiterals_;
+  /**
+   * @brief output builtins printf is lowered to
+   */
+  std::shared_ptr<Symbol> putStrSym_;
+  std::shared_ptr<Symbol> putIntSym_;
   /**
    * @brief all constant array values
    */
@@ -58,6 +58,29 @@ public:
    */
   int allocateLabel();
 
+  /**
+   * @brief getter for label count
+   *
+   * @return label count
+   */
+  int getLabelCount() const;
+
+  /**
+   * @brief getter for the next block id
+   *
+   * @return next block id
+   */
+  int getNextBlockId() const;
+
+  /**
+   * @brief restore id counters of a function rebuilt from a binary ir image
+   *
+   * @param nextBlockId next block id
+   * @param nextTempId next temporary id
+   * @param nextLabelId next label id
+   */
+  void restoreCounters(int nextBlockId, int nextTempId, int nextLabelId);
+
   std::shared_ptr<BasicBlock> getBlockSharedPtr(BasicBlock *rawPtr);
 
   /**
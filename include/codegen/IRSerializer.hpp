@@ -0,0 +1,59 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class IRModule
+ * @brief owning storage for an ir module rebuilt from a binary image
+ *
+ */
+struct IRModule {
+  std::vector<std::shared_ptr<Function>> functions;
+  std::vector<std::unique_ptr<Instruction>> globals;
+  std::unordered_map<std::string, std::shared_ptr<Symbol>> stringLiterals;
+};
+
+/**
+ * @class IRSerializer
+ * @brief compact binary ir format (`ir.bin`)
+ *
+ * The image is a sequence of little-endian 32-bit words: a header, then the
+ * type, symbol, string literal, global and function tables. Symbols and types
+ * are interned by address, so sharing between operands survives a round trip.
+ * Loading maps the file read-only and decodes it in place.
+ */
+class IRSerializer {
+public:
+  static constexpr uint32_t MAGIC = 0x5249434c; // "LCIR"
+  static constexpr uint32_t VERSION = 1;
+
+  /**
+   * @brief serialize a whole module to disk
+   *
+   * @param path output file
+   * @param functions functions in emission order
+   * @param globals global ALLOCA/ASSIGN/STORE instructions
+   * @param stringLiterals literal text -> `.fmtN` symbol
+   * @return false if the file cannot be written
+   */
+  static bool
+  write(const std::string &path,
+        const std::vector<std::shared_ptr<Function>> &functions,
+        const std::vector<std::unique_ptr<Instruction>> &globals,
+        const std::unordered_map<std::string, std::shared_ptr<Symbol>>
+            &stringLiterals);
+
+  /**
+   * @brief load a module written by write()
+   *
+   * @param path input file
+   * @param mod module to fill, untouched on failure
+   * @return false if the file is missing, truncated or of another version
+   */
+  static bool read(const std::string &path, IRModule &mod);
+};
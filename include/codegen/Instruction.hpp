@@ -90,6 +90,17 @@ public:
   void setArg2(const Operand &v) { _arg2 = v; }
   void setResult(const Operand &v) { _result = v; }
 
+  /**
+   * @brief runtime name of the function a CALL calls: `fn_<ident>` for user
+   * functions, the bare name for builtins, which have no global name
+   */
+  const std::string &getCalleeName() const;
+  /**
+   * @brief whether a CALL calls an I/O builtin (getint, printf, putint,
+   * putstr), the only functions without a global name
+   */
+  bool callsBuiltin() const;
+
   BasicBlock *getParent() const { return _parent; }
   void setParent(BasicBlock *bb) { _parent = bb; }
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
 #include "optimize/DominatorTree.hpp"
+#include "optimize/ModRef.hpp"
 #include <memory>
 #include <vector>
 
@@ -9,6 +11,13 @@ class QuadPass {
 public:
   virtual ~QuadPass() = default;
   virtual bool run(Function &fn) = 0;
+  /**
+   * @brief analyses still valid after run() returned true; by default a
+   * pass only rewrites instructions and keeps the CFG
+   */
+  virtual PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::cfg();
+  }
 };
 
 class PassManager {
@@ -16,10 +25,17 @@ public:
   void add(std::unique_ptr<QuadPass> pass) {
     passes.emplace_back(std::move(pass));
   }
-  bool run(Function &fn) {
+  /**
+   * @brief run every pass in order, dropping from am whatever a changing
+   * pass did not preserve
+   */
+  bool run(Function &fn, AnalysisManager &am) {
     bool changed = false;
     for (auto &p : passes) {
-      changed |= p->run(fn);
+      if (p->run(fn)) {
+        am.invalidate(fn, p->preservedAnalyses());
+        changed = true;
+      }
     }
     return changed;
   }
@@ -34,7 +50,21 @@ private:
  */
 class CFGSCCPPass : public QuadPass {
 public:
+  /**
+   * @param dt dominator tree to keep in sync with folded branches and
+   * removed blocks, may be null
+   */
+  explicit CFGSCCPPass(DominatorTree *dt = nullptr) : dt(dt) {}
   bool run(Function &fn) override;
+  /**
+   * @brief folding a branch or dropping a block invalidates frontiers and
+   * loops; the dominator tree survives when it was kept in sync
+   */
+  PreservedAnalyses preservedAnalyses() const override;
+
+private:
+  DominatorTree *dt;
+  bool cfgChanged = false;
 };
 
 /**
@@ -81,6 +111,30 @@ public:
   bool run(Function &fn) override;
 };
 
+/**
+ * @class ReassociatePass
+ * @brief reassociate chains of additions or multiplications
+ *
+ * A tree of ADD/SUB (or of MUL) whose inner results are single-use temps of
+ * the same block is flattened into its leaves. Constants are folded, `x`
+ * and `-x` cancel, and the leaves are ranked: constants first, then values
+ * invariant in the innermost loop, then the rest. The tree is rebuilt with
+ * the invariant part computed on its own, so LICM can hoist it:
+ *    t0 = i + n         t3 = n + 8   // invariant
+ *    t1 = t0 + 3   ->   t2 = t3 + i
+ *    t2 = t1 + 5
+ * A tree is only rewritten when the loop-variant part or the whole tree
+ * gets shorter.
+ */
+class ReassociatePass : public QuadPass {
+public:
+  explicit ReassociatePass(AnalysisManager &am) : am(am) {}
+  bool run(Function &fn) override;
+
+private:
+  AnalysisManager &am;
+};
+
 /**
  * @class CopyPropPass
  * @brief copy propagation in function scope
@@ -96,38 +150,69 @@ public:
 };
 
 /**
- * @class CSEPass
- * @brief Common Subexpression Elimination in function scope
- * Eliminates redundant computations of the same expression.
- * Example:
+ * @class GVNPass
+ * @brief Global value numbering over the dominator tree
+ *
+ * Every single-definition temp gets a value number: the first operand seen
+ * to hold its value. Copies take the number of their source, an expression
+ * is looked up by its opcode and the numbers of its operands (commutative
+ * operands sorted, `a > b` as `b < a`), and a phi whose incoming values are
+ * all the same, or that repeats another phi of its block, takes that
+ * number. Redundant instructions become copies of their leader, uses are
+ * rewritten to it and redundant phis are removed. Example:
  *    t0 = a + b
- *    t1 = a + b  // Same expression, can be replaced with t1 = t0
+ *    t1 = t0
+ *    t2 = b + t1  // t2 = t0
+ * Global scalars are read from memory, so expressions over them are only
+ * matched inside one block with no write or call in between.
+ *
+ * A call whose callee writes nothing (see ModRefAnalysis) is an expression
+ * over its callee and arguments; the second of two equal calls becomes a
+ * copy and its ARGs are dropped:
+ *    ARG t0
+ *    t1 = CALL 1, sq
+ *    ARG t0
+ *    t2 = CALL 1, sq  // t2 = t1
+ * Calls that read memory something may write are matched like expressions
+ * over global scalars.
  */
-class CSEPass : public QuadPass {
+class GVNPass : public QuadPass {
 public:
-  explicit CSEPass(DominatorTree &dt) : dt(dt) {}
+  GVNPass(AnalysisManager &am, const ModRefAnalysis &modRef)
+      : am(am), modRef(modRef) {}
   bool run(Function &fn) override;
 
 private:
-  DominatorTree &dt;
-  struct ExpressionHash {
-    size_t operator()(
-        const std::pair<OpCode, std::pair<Operand, Operand>> &expr) const;
-  };
-
-  struct ExpressionEqual {
-    bool
-    operator()(const std::pair<OpCode, std::pair<Operand, Operand>> &lhs,
-               const std::pair<OpCode, std::pair<Operand, Operand>> &rhs) const;
-  };
+  AnalysisManager &am;
+  const ModRefAnalysis &modRef;
 };
 /**
  * @class MemoryLoadElimPass
  * @brief Forward store-load forwarding and redundant load elimination.
+ *
+ * Scalar globals and array elements are tracked across the whole function:
+ * a location is available at a block when every path to it loads or stores
+ * the location without a later write that may clobber it. Loads of an available location become copies of its value, taken
+ * from a dominating block or merged by a new phi:
+ *    B1: t0 = LOAD a, 3        B1: t0 = LOAD a, 3
+ *        IF t9, B3                 IF t9, B3
+ *    B2: STORE 7, a, 3   =>    B2: STORE 7, a, 3
+ *    B3: t1 = LOAD a, 3        B3: t1 = PHI [t0, B1], [7, B2]
+ * A scalar read more than once is loaded into a temp at its first read.
+ * Elements are told apart by AliasAnalysis, so a[i + 1] survives a store
+ * to a[i] until i changes. A call only kills what its callee may write
+ * (see ModRefAnalysis); elements of local arrays whose address never
+ * escapes always survive.
  */
 class MemoryLoadElimPass : public QuadPass {
 public:
+  MemoryLoadElimPass(AnalysisManager &am, const ModRefAnalysis &modRef)
+      : am(am), modRef(modRef) {}
   bool run(Function &fn) override;
+
+private:
+  AnalysisManager &am;
+  const ModRefAnalysis &modRef;
 };
 
 /**
@@ -155,4 +240,5 @@ class CleanupPass : public QuadPass {
 public:
   bool run(Function &fn) override;
 };
-bool runDefaultQuadOptimizations(Function &fn, DominatorTree &dt);
+bool runDefaultQuadOptimizations(Function &fn, AnalysisManager &am,
+                                 const ModRefAnalysis &modRef);
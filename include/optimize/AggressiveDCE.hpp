@@ -0,0 +1,76 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/PostDominatorTree.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @class AggressiveDCEPass
+ * @brief dead code elimination that assumes everything dead until proven
+ * live
+ *
+ * LocalDCE removes an instruction once its result has no use, so it keeps
+ * phi cycles, branches and whole loops computing values nobody reads. This
+ * pass starts from the instructions with an observable effect (calls, stores
+ * to memory that is read or escapes, writes to globals, returns) and marks
+ * live what they read. A live instruction makes the branches its block is
+ * control dependent on live; a live phi makes the branches of its incoming
+ * blocks live. Everything else is removed, and a dead branch becomes a jump
+ * to its immediate post-dominator:
+ *
+ *   before: H: i' = phi(0, i''); IF i' < n, B   B: i'' = i' + 1; GOTO H
+ *   after:  H: GOTO E                            (B unreachable)
+ *
+ * Stores to a local array that is never read are dead too. A loop that does
+ * not reach the exit has no post-dominator; such functions are left alone.
+ */
+class AggressiveDCEPass {
+public:
+  /**
+   * @return whether anything was removed
+   */
+  bool run(Function &func);
+
+  /**
+   * @brief a dead branch turned into a jump changes the CFG
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return _cfgChanged ? PreservedAnalyses::none() : PreservedAnalyses::cfg();
+  }
+
+private:
+  bool _cfgChanged = false;
+
+  PostDominatorTree _PDT;
+  /**
+   * @brief blocks reachable from the entry, in layout order, with the
+   * virtual exit numbered after them
+   */
+  std::vector<BasicBlock *> _blocks;
+  std::unordered_map<const BasicBlock *, int> _index;
+  /**
+   * @brief immediate post-dominator, the virtual exit for returning blocks
+   */
+  std::vector<int> _ipdom;
+  /**
+   * @brief blocks ending in the branches each block is control dependent on
+   */
+  std::vector<std::vector<int>> _controlDeps;
+
+  std::unordered_set<const Instruction *> _live;
+  std::vector<bool> _liveBlock;
+  std::vector<std::pair<Instruction *, int>> _worklist;
+  std::unordered_map<int, std::vector<std::pair<Instruction *, int>>> _defs;
+
+  /**
+   * @return false when some reachable block cannot reach a return
+   */
+  bool buildControlDependence(Function &func);
+  void markLive(Instruction *inst, int block);
+  void markBlock(int block);
+  void markTerminator(int block);
+  void propagate();
+};
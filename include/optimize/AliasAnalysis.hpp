@@ -0,0 +1,147 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+enum class AliasResult { NoAlias, MayAlias, MustAlias };
+
+/**
+ * @brief the word an access reaches: an array object, the pointer temp the
+ * address is computed from, the temp in the index and a constant offset
+ *
+ *   LOAD a, 3            {a, -1, -1, 12}
+ *   t1 = ADD i, 1
+ *   LOAD a, t1           {a, -1, i, 4}
+ *   p1 = ADD p0, 8
+ *   LOAD p1, 1           {object of p0, p0, -1, 12}
+ */
+struct MemoryLocation {
+  /**
+   * @brief base or index not known at all
+   */
+  static constexpr int Unknown = -2;
+
+  /**
+   * @brief array reached, nullptr when the pointer may point anywhere
+   */
+  const Symbol *object = nullptr;
+  /**
+   * @brief pointer temp the address is computed from, -1 for the array
+   * itself
+   */
+  int base = -1;
+  /**
+   * @brief temp in the index, -1 for a constant index
+   */
+  int index = -1;
+  /**
+   * @brief constant part of the address, in bytes
+   */
+  int offset = 0;
+
+  /**
+   * @brief whether two accesses with equal locations reach the same word
+   */
+  bool isExact() const {
+    return base != Unknown && index != Unknown && (object || base >= 0);
+  }
+
+  bool operator==(const MemoryLocation &o) const {
+    return object == o.object && base == o.base && index == o.index &&
+           offset == o.offset;
+  }
+};
+
+struct MemoryLocationHash {
+  size_t operator()(const MemoryLocation &l) const {
+    size_t h = std::hash<const Symbol *>{}(l.object);
+    h = h * 31 + std::hash<int>{}(l.base);
+    h = h * 31 + std::hash<int>{}(l.index);
+    return h * 31 + std::hash<int>{}(l.offset);
+  }
+};
+
+/**
+ * @class AliasAnalysis
+ * @brief which array accesses of a function may reach the same word
+ *
+ * Arrays are local (allocated by this function), parameters (the caller's
+ * array, reached through the pointer in the parameter's slot) or global
+ * (globals and static locals). Addresses flow through copies, pointer
+ * arithmetic and phis into temps. A local array escapes when its address
+ * is used for anything else, such as a call argument; the others are only
+ * reachable through this function's own loads and stores, so calls and
+ * pointers of unknown origin never touch them.
+ *
+ * Distinct arrays never alias, except that a parameter may be any global
+ * array or another parameter's array. Accesses computed from the same
+ * temps compare by their constant offsets: a[i] and a[i + 1] never alias,
+ * a[3] and a[3] always do. That holds while the temps keep their values,
+ * e.g. within one loop iteration; a pass carrying a location past a
+ * redefinition of its base or index temp has to drop it.
+ */
+class AliasAnalysis {
+public:
+  enum class ObjectKind { Local, Parameter, Global };
+
+  /**
+   * @brief runs the analysis for the given function
+   */
+  void run(Function &F);
+
+  /**
+   * @brief location of `base[index]`; an empty index is element 0
+   */
+  MemoryLocation getLocation(const Operand &base, const Operand &index) const;
+
+  AliasResult alias(const MemoryLocation &a, const MemoryLocation &b) const;
+
+  /**
+   * @brief whether the arrays may overlap; nullptr stands for any array
+   * whose address escapes
+   */
+  bool mayAliasObjects(const Symbol *a, const Symbol *b) const;
+
+  /**
+   * @brief array an address operand points into, nullptr if unknown
+   */
+  const Symbol *getUnderlyingObject(const Operand &addr) const;
+
+  ObjectKind getKind(const Symbol *object) const;
+
+  /**
+   * @brief local array whose address never escapes: no call can read or
+   * write it
+   */
+  bool isLocal(const Symbol *object) const {
+    return _local.count(object) > 0;
+  }
+
+  /**
+   * @brief number of elements, 0 when not known (parameters)
+   */
+  int getSize(const Symbol *object) const;
+
+private:
+  /**
+   * @brief single definition of each temp defined once
+   */
+  std::unordered_map<int, const Instruction *> _def;
+  /**
+   * @brief temps holding an address into an array
+   */
+  std::unordered_map<int, const Symbol *> _pointer;
+  std::unordered_set<const Symbol *> _localArrays;
+  std::unordered_set<const Symbol *> _local;
+  std::unordered_set<const Symbol *> _slots;
+  std::unordered_map<const Symbol *, int> _size;
+
+  void findPointers(Function &F, std::unordered_set<const Symbol *> &escaped);
+  void findEscapes(Function &F, std::unordered_set<const Symbol *> &escaped);
+  /**
+   * @brief follows copies and constant additions back to the temp they
+   * start from, adding up the constants
+   */
+  const Instruction *walk(int &temp, int &offset) const;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/DominanceFrontier.hpp"
+#include "optimize/DominatorTree.hpp"
+#include "optimize/Liveness.hpp"
+#include "optimize/LoopAnalysis.hpp"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief analyses cached by AnalysisManager, usable as bit flags
+ */
+enum class AnalysisKind : unsigned {
+  DominatorTree = 1u << 0,
+  DominanceFrontier = 1u << 1,
+  Loops = 1u << 2,
+  Liveness = 1u << 3,
+};
+
+/**
+ * @class PreservedAnalyses
+ * @brief set of analyses a pass left valid after changing a function
+ */
+class PreservedAnalyses {
+public:
+  /**
+   * @brief nothing survives
+   */
+  static PreservedAnalyses none() { return PreservedAnalyses(0); }
+
+  /**
+   * @brief the pass did not change anything
+   */
+  static PreservedAnalyses all() { return PreservedAnalyses(~0u); }
+
+  /**
+   * @brief the pass only rewrote instructions and left the CFG alone:
+   * dominance and loops survive, liveness does not
+   */
+  static PreservedAnalyses cfg() {
+    return none()
+        .preserve(AnalysisKind::DominatorTree)
+        .preserve(AnalysisKind::DominanceFrontier)
+        .preserve(AnalysisKind::Loops);
+  }
+
+  PreservedAnalyses &preserve(AnalysisKind kind) {
+    _mask |= static_cast<unsigned>(kind);
+    return *this;
+  }
+
+  bool isPreserved(AnalysisKind kind) const {
+    return (_mask & static_cast<unsigned>(kind)) != 0;
+  }
+
+private:
+  explicit PreservedAnalyses(unsigned mask) : _mask(mask) {}
+  unsigned _mask;
+};
+
+/**
+ * @class AnalysisManager
+ * @brief per-function cache of the analyses the optimizer shares
+ *
+ * Getters compute an analysis on first use and return the cached result
+ * afterwards. After changing a function a pass reports what it preserved
+ * through invalidate(); only the rest is dropped. Frontiers and loops are
+ * derived from the dominator tree and are dropped with it.
+ */
+class AnalysisManager {
+public:
+  /**
+   * @brief dominator tree of F; passes that edit the CFG may keep it valid
+   * through its update API
+   */
+  DominatorTree &getDominatorTree(Function &F);
+
+  /**
+   * @brief dominance frontiers of F
+   */
+  const DominanceFrontier &getDominanceFrontier(Function &F);
+
+  /**
+   * @brief natural loops of F
+   */
+  const std::vector<LoopInfo> &getLoops(Function &F);
+
+  /**
+   * @brief temporary liveness of F
+   */
+  const Liveness &getLiveness(Function &F);
+
+  /**
+   * @brief drop the analyses of F that are not in PA
+   *
+   * @param F the changed function
+   * @param PA analyses still valid for F
+   */
+  void invalidate(Function &F, const PreservedAnalyses &PA);
+
+  /**
+   * @brief number of analyses computed so far
+   */
+  int getComputeCount() const { return _computeCount; }
+
+private:
+  struct FunctionAnalyses {
+    std::unique_ptr<DominatorTree> domTree;
+    std::unique_ptr<DominanceFrontier> frontier;
+    std::unique_ptr<LoopAnalysis> loops;
+    std::unique_ptr<Liveness> liveness;
+  };
+
+  std::unordered_map<Function *, FunctionAnalyses> _cache;
+  int _computeCount = 0;
+};
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief limits of one compile-time evaluation, so compile time stays bounded
+ */
+struct ProgramEvalBudget {
+  /**
+   * @brief executed bytecode instructions
+   */
+  long long maxSteps = 20000000;
+  /**
+   * @brief live words of globals, arrays and scalars at any time
+   */
+  long long maxMemoryWords = 1 << 22;
+  /**
+   * @brief bytes printed
+   */
+  size_t maxOutputBytes = 1 << 20;
+  /**
+   * @brief nested calls
+   */
+  int maxCallDepth = 1000;
+};
+
+/**
+ * @brief observable behaviour of a program run at compile time
+ */
+struct ProgramEvalResult {
+  /**
+   * @brief everything printed, escapes already decoded
+   */
+  std::string output;
+  /**
+   * @brief return value of main
+   */
+  int exitValue = 0;
+};
+
+/**
+ * @brief hash of an argument list
+ */
+struct ArgListHash {
+  size_t operator()(const std::vector<int> &args) const;
+};
+
+/**
+ * @class ConstEvalMemo
+ * @brief results of compile-time calls, shared by every round of the
+ * optimization loop
+ *
+ * Only pure functions are recorded: they read neither globals nor input and
+ * take no array, so the result depends on the arguments alone and stays valid
+ * however the ir is rewritten between rounds.
+ */
+class ConstEvalMemo {
+public:
+  /**
+   * @brief arguments -> result, ConstEvalVM::UNDEF if evaluation gave up
+   */
+  using Table = std::unordered_map<std::vector<int>, int64_t, ArgListHash>;
+
+  /**
+   * @brief table of one function, created on first use
+   *
+   * @param fn function name
+   */
+  Table &table(const std::string &fn) { return _tables[fn]; }
+
+  /**
+   * @brief evaluation steps left for the whole compilation
+   */
+  long long remainingSteps = 50000000;
+
+private:
+  std::unordered_map<std::string, Table> _tables;
+};
+
+/**
+ * @class ConstEvalVM
+ * @brief compiles ir functions to a register bytecode and runs it
+ *
+ * Every temp, constant and scalar local owns a dense slot of the frame.
+ * Globals and local arrays live in one flat word memory, and an array value
+ * is the byte address of its first word, so addresses flow through temps,
+ * ARG/PARAM and array parameters and take part in arithmetic as on the
+ * target. Slots and words start out as UNDEF, and reading one before it is
+ * written makes the evaluation give up.
+ *
+ * Functions are compiled on first use. The compiled code is a snapshot: build
+ * a new VM after passes have rewritten the ir.
+ */
+class ConstEvalVM {
+public:
+  static constexpr int64_t UNDEF = INT64_MIN;
+
+  ConstEvalVM(const std::vector<std::shared_ptr<Function>> &functions,
+              ConstEvalMemo &memo);
+
+  /**
+   * @brief lay out global memory and string literals; without it any access
+   * to a global makes a function impure
+   *
+   * @param globals global ALLOCA/ASSIGN/STORE instructions
+   * @param stringLiterals literal text -> `.fmtN` symbol
+   * @param maxMemoryWords memory budget
+   * @return false if the globals alone exceed the budget
+   */
+  bool loadGlobals(const std::vector<std::unique_ptr<Instruction>> &globals,
+                   const std::unordered_map<std::string,
+                                            std::shared_ptr<Symbol>>
+                       &stringLiterals,
+                   long long maxMemoryWords);
+
+  /**
+   * @brief whether fn and everything it calls touch no globals and no I/O
+   */
+  bool isPure(Function *fn);
+
+  /**
+   * @brief whether getint is reachable from fn
+   */
+  bool readsInput(Function *fn);
+
+  /**
+   * @brief run fn to completion
+   *
+   * @param fn the function
+   * @param args integer arguments
+   * @param budget limits of this run
+   * @param result return value, UNDEF if fn returns none
+   * @param steps instructions executed, also set on failure
+   * @return false if the budget ran out or fn did something unsupported
+   */
+  bool call(Function *fn, const std::vector<int> &args,
+            const ProgramEvalBudget &budget, int64_t &result,
+            long long &steps);
+
+  /**
+   * @brief everything printed by call() so far
+   */
+  const std::string &getOutput() const { return _output; }
+
+private:
+  enum class Bc : uint8_t {
+    MOV,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    NEG,
+    NOT,
+    EQ,
+    NEQ,
+    LT,
+    LE,
+    GT,
+    GE,
+    AND,
+    OR,
+    LOAD,   // a = mem[b + 4 * c]
+    STORE,  // mem[b + 4 * c] = a
+    JMP,    // pc = a
+    BR,     // if a != 0: pc = b
+    CALL,   // a = call fn b, args at pool c
+    RET,    // return a, no value if a < 0
+    PUTINT, // print a
+    PUTSTR, // print literal b
+    PRINTF, // printf literal b, args at pool c
+    FAIL
+  };
+
+  /**
+   * @brief one bytecode instruction, operands are slots unless noted
+   */
+  struct BcInst {
+    Bc op;
+    int a, b, c;
+  };
+
+  struct CompiledFunction {
+    Function *fn = nullptr;
+    std::vector<BcInst> code;
+    /**
+     * @brief slot values on entry: constants, UNDEF elsewhere
+     */
+    std::vector<int64_t> initialSlots;
+    /**
+     * @brief PARAM index -> slot
+     */
+    std::vector<int> paramSlots;
+    /**
+     * @brief local arrays: slot holding the address, words
+     */
+    std::vector<std::pair<int, int>> localArrays;
+    /**
+     * @brief argc followed by argument slots, for CALL and PRINTF
+     */
+    std::vector<int> argPool;
+    std::vector<int> callees;
+    bool valid = true;
+    bool touchesGlobals = false;
+    bool doesIO = false;
+    bool callsGetint = false;
+    bool hasPointerParams = false;
+    /**
+     * @brief the above, closed over callees
+     */
+    bool pure = false;
+    bool readsInput = false;
+    /**
+     * @brief memo table for pure functions without array parameters
+     */
+    ConstEvalMemo::Table *memo = nullptr;
+  };
+
+  struct Frame {
+    int fn;
+    int pc;
+    size_t slotBase;
+    size_t memTop;
+    /**
+     * @brief caller slot receiving the result, -1 for none
+     */
+    int retSlot;
+    /**
+     * @brief start of the memo key in _keys, -1 if not memoized
+     */
+    long long keyBase;
+  };
+
+  std::unordered_map<std::string, Function *> _functions;
+  ConstEvalMemo &_memo;
+  std::vector<CompiledFunction> _compiled;
+  std::unordered_map<Function *, int> _index;
+
+  std::unordered_map<const Symbol *, int> _globalBase;
+  std::unordered_map<const Symbol *, int> _literalIds;
+  std::vector<std::string> _literals;
+  bool _globalsLoaded = false;
+
+  std::vector<int64_t> _slots;
+  std::vector<int64_t> _mem;
+  std::vector<Frame> _frames;
+  std::vector<int> _keys;
+  std::string _output;
+
+  /**
+   * @brief per-function state of the bytecode compiler
+   */
+  struct Builder;
+
+  /**
+   * @brief index of fn, compiling it and its callees first
+   */
+  int prepare(Function *fn);
+  int require(Function *fn, std::vector<int> &pending);
+  void compile(int idx, std::vector<int> &pending);
+  /**
+   * @brief close purity and input flags over the call graph
+   */
+  void propagateFlags();
+};
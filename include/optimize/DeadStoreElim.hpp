@@ -0,0 +1,74 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/AliasAnalysis.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/ModRef.hpp"
+#include "optimize/PostDominatorTree.hpp"
+
+/**
+ * @class DeadStoreElimPass
+ * @brief removes stores that are overwritten before being read, and stores
+ * to local arrays never read again
+ *
+ * A location is a scalar global (or static local), the slot of an array
+ * parameter, or a constant-index element of an array. A store to it is
+ * dead when every path from it writes the location again before any
+ * instruction may read it, or, for a local array whose address never
+ * leaves the function, returns first:
+ *
+ *   STORE 0, a, 3         // dead: overwritten
+ *   ADD t0, 1, t1
+ *   STORE t1, a, 3
+ *
+ * The rest of the store's block is checked first. Past its end every path
+ * is followed until it writes the location again, which covers a
+ * post-dominating overwrite as well as one split over both arms of a
+ * branch. Functions where some block cannot reach a return (no
+ * post-dominator tree) are only checked within blocks.
+ *
+ * Whether a load may read the location is asked of AliasAnalysis, whether
+ * a call may read it of ModRefAnalysis.
+ */
+class DeadStoreElimPass {
+public:
+  /**
+   * @param modRef memory the callees of the program may read
+   */
+  explicit DeadStoreElimPass(const ModRefAnalysis &modRef)
+      : _modRef(modRef) {}
+
+  /**
+   * @return whether any store was removed
+   */
+  bool run(Function &func);
+
+  /**
+   * @brief only instructions are removed
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::cfg();
+  }
+
+private:
+  /**
+   * @brief element idx of sym, or sym itself when !hasIdx
+   */
+  struct Location {
+    const Symbol *sym;
+    int idx;
+    bool hasIdx;
+    bool operator==(const Location &o) const {
+      return sym == o.sym && idx == o.idx && hasIdx == o.hasIdx;
+    }
+  };
+
+  const ModRefAnalysis &_modRef;
+  PostDominatorTree _PDT;
+  bool _hasPDT = false;
+  AliasAnalysis _AA;
+
+  bool mustWrite(const Instruction &inst, Location &loc) const;
+  bool mayRead(const Instruction &inst, const Location &loc) const;
+  bool isDead(BasicBlock *bb, size_t pos, const Location &loc) const;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "codegen/BasicBlock.hpp"
+#include "codegen/Function.hpp"
+#include "optimize/DominatorTree.hpp"
+#include <set>
+#include <unordered_map>
+
+/**
+ * @class DominanceFrontier
+ * @brief dominance frontier of every block, computed from a dominator tree
+ * with the Cooper-Harvey-Kennedy runner walk
+ */
+class DominanceFrontier {
+public:
+  /**
+   * @brief compute the frontiers of all blocks of F
+   *
+   * @param F the given function
+   * @param DT dominator tree of F
+   */
+  void run(Function &F, const DominatorTree &DT);
+
+  /**
+   * @brief dominance frontier of block B, empty if B has none
+   *
+   * @param B block B
+   */
+  const std::set<BasicBlock *> &getFrontier(BasicBlock *B) const;
+
+private:
+  /**
+   * @brief block -> its dominance frontier
+   */
+  std::unordered_map<BasicBlock *, std::set<BasicBlock *>> _frontiers;
+};
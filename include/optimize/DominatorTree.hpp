@@ -2,10 +2,23 @@
 
 #include "codegen/BasicBlock.hpp"
 #include "codegen/Function.hpp"
-#include <map>
-#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+/**
+ * @class DominatorTree
+ * @brief dominator tree built with the Cooper-Harvey-Kennedy algorithm over
+ * reverse-postorder indices.
+ *
+ * The tree is stored as an idom array indexed by node id, plus DFS
+ * pre/post numbers of the tree, so dominates() is O(1).
+ * Unreachable blocks are not part of the tree.
+ *
+ * CFG-mutating passes keep the tree valid through the update API instead of
+ * calling run() again. Each update must be reported right after the CFG edit
+ * it describes; only the dominator subtree that can change is recomputed.
+ */
 class DominatorTree {
 public:
   /**
@@ -33,35 +46,133 @@ public:
   BasicBlock *getImmediateDominator(BasicBlock *B) const;
 
   /**
-   * @brief get the set of blocks dominated by block B
-   * (include B itself), read only
+   * @brief get the blocks immediately dominated by block B (its children in
+   * the tree), read only
    *
    * @param B block B
    */
-  const std::set<BasicBlock *> &getDominatedBlocks(BasicBlock *B) const;
+  const std::vector<BasicBlock *> &getDominatedBlocks(BasicBlock *B) const;
+
+  /**
+   * @brief reachable blocks in reverse postorder, entry first
+   */
+  const std::vector<BasicBlock *> &getReversePostOrder() const;
+
+  /**
+   * @brief whether B is reachable from the entry block
+   *
+   * @param B block B
+   */
+  bool isReachable(BasicBlock *B) const { return _number.count(B) > 0; }
+
+  /**
+   * @brief nearest common dominator of A and B
+   *
+   * @return nullptr if either block is unreachable
+   */
+  BasicBlock *findNearestCommonDominator(BasicBlock *A, BasicBlock *B) const;
+
+  /**
+   * @brief the edge From -> To has been added to the CFG
+   */
+  void insertEdge(BasicBlock *From, BasicBlock *To);
+
+  /**
+   * @brief the edge From -> To has been removed from the CFG
+   */
+  void deleteEdge(BasicBlock *From, BasicBlock *To);
+
+  /**
+   * @brief BB has been detached from the CFG and is about to be erased
+   */
+  void removeBlock(BasicBlock *BB);
+
+  /**
+   * @brief NewBB has taken over all successors of BB, and BB now only flows
+   * into NewBB
+   */
+  void splitBlock(BasicBlock *BB, BasicBlock *NewBB);
+
+  /**
+   * @brief NewBB has been placed on some incoming edges of Succ and has Succ
+   * as its only successor (a preheader, or a block splitting an edge)
+   */
+  void insertBlockBefore(BasicBlock *NewBB, BasicBlock *Succ);
+
+  /**
+   * @brief debug helper: compare against a tree built from scratch
+   *
+   * @param F the function the tree describes
+   * @return whether every immediate dominator matches
+   */
+  bool verify(Function &F) const;
 
 private:
   /**
-   * @brief Map from a BasicBlock to its set of dominators (including itself).
+   * @brief the function of the last run()
+   */
+  Function *_func = nullptr;
+
+  /**
+   * @brief node id -> block, nullptr once the block leaves the tree
+   */
+  std::vector<BasicBlock *> _nodes;
+
+  /**
+   * @brief block -> node id
+   */
+  std::unordered_map<BasicBlock *, int> _number;
+
+  /**
+   * @brief node id -> node id of the immediate dominator, -1 for entry
    */
-  std::map<BasicBlock *, std::set<BasicBlock *>> _dominators;
+  std::vector<int> _idom;
 
   /**
-   * @brief Map from a BasicBlock to its immediate dominator.
+   * @brief node id -> blocks it immediately dominates
    */
-  std::map<BasicBlock *, BasicBlock *> _idoms;
+  std::vector<std::vector<BasicBlock *>> _children;
 
   /**
-   * @brief Map from a BasicBlock to the set of blocks it immediately dominates.
+   * @brief node id -> DFS pre/post number in the dominator tree, renumbered
+   * lazily after updates
    */
-  std::map<BasicBlock *, std::set<BasicBlock *>> _dominatedBy;
+  mutable std::vector<int> _pre;
+  mutable std::vector<int> _post;
+  mutable bool _dfsValid = false;
 
   /**
-   * @brief helper function to get all predecessors of a basic
-   * block.
+   * @brief cached reverse postorder, rebuilt lazily after updates
+   */
+  mutable std::vector<BasicBlock *> _rpo;
+  mutable bool _rpoValid = false;
+
+  /**
+   * @brief recompute idoms of the blocks in region (the whole CFG when
+   * region is null) with root as the fixed top of the subtree
+   *
+   * @return blocks of region that are no longer reachable
+   */
+  std::vector<BasicBlock *>
+  rebuild(BasicBlock *root, const std::unordered_set<BasicBlock *> *region);
+
+  /**
+   * @brief recompute the dominator subtree of top after a CFG edit
    *
-   * @param BB basicBlock
-   * @param F function
+   * @param top subtree root, keeps its own idom
+   * @param added new block to place in the subtree, may be null
+   * @param removed block leaving the subtree, may be null
+   */
+  void updateSubtree(BasicBlock *top, BasicBlock *added = nullptr,
+                     BasicBlock *removed = nullptr);
+
+  /**
+   * @brief blocks of the dominator subtree rooted at B, B included
+   */
+  std::unordered_set<BasicBlock *> collectSubtree(BasicBlock *B) const;
+
+  /**
+   * @brief number the dominator tree with an iterative DFS
    */
-  std::vector<BasicBlock *> getPredecessors(BasicBlock *BB, Function &F);
+  void numberTree() const;
 };
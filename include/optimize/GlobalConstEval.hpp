@@ -2,18 +2,48 @@
 
 #include "codegen/Function.hpp"
 #include "codegen/QuadOptimizer.hpp"
+#include "optimize/ConstEvalVM.hpp"
 
 class GlobalConstEvalPass : public QuadPass {
 public:
-  static constexpr int MAX_RECURSION_DEPTH = 50;
-  static constexpr int MAX_INSTRUCTIONS = 100000;
+  static constexpr int MAX_RECURSION_DEPTH = 10000;
+  /**
+   * @brief bytecode steps one folded call may take, callees included
+   */
+  static constexpr long long MAX_CALL_STEPS = 2000000;
 
-  explicit GlobalConstEvalPass(
-      const std::vector<std::shared_ptr<Function>> &funcs)
-      : functions(funcs) {}
+  /**
+   * @param funcs all functions of the module
+   * @param memo call results kept across rounds
+   */
+  GlobalConstEvalPass(const std::vector<std::shared_ptr<Function>> &funcs,
+                      ConstEvalMemo &memo)
+      : functions(funcs), memo(memo), vm(funcs, memo) {}
 
   bool run(Function &fn) override;
 
+  /**
+   * @brief module-level mode: run main at compile time with real global
+   * memory, recording what it prints
+   *
+   * Gives up when getint is reachable from main, when the budget runs out,
+   * or on anything the interpreter cannot model (division by zero, access
+   * outside any object).
+   *
+   * @param mainFn the main function
+   * @param globals global ALLOCA/ASSIGN/STORE instructions
+   * @param stringLiterals literal text -> `.fmtN` symbol
+   * @param budget step, memory and output limits
+   * @param result output and exit value, valid only on success
+   * @return whether main ran to completion
+   */
+  bool evaluateProgram(
+      Function &mainFn,
+      const std::vector<std::unique_ptr<Instruction>> &globals,
+      const std::unordered_map<std::string, std::shared_ptr<Symbol>>
+          &stringLiterals,
+      const ProgramEvalBudget &budget, ProgramEvalResult &result);
+
 private:
   /**
    * @brief the reference of global function list
@@ -21,9 +51,14 @@ private:
   const std::vector<std::shared_ptr<Function>> &functions;
 
   /**
-   * @brief memory cache for evaluated functions
+   * @brief results of earlier rounds
+   */
+  ConstEvalMemo &memo;
+
+  /**
+   * @brief functions compiled by this round, callees of folded calls only
    */
-  std::map<std::pair<std::string, std::vector<int>>, int> evalCache;
+  ConstEvalVM vm;
 
   /**
    * @brief find function by name
@@ -34,12 +69,12 @@ private:
   Function *findFunction(const std::string &name);
 
   /**
-   * @brief interpreter
+   * @brief evaluate a call with constant arguments
    *
-   * @param fn object function pointer
+   * @param fn callee, must be pure
    * @param args input arguments
-   * @param depth {success ?, result}
+   * @param value the result on success
+   * @return whether the call folds
    */
-  std::pair<bool, int> evaluate(Function *fn, const std::vector<int> &args,
-                                int depth);
+  bool evaluate(Function *fn, const std::vector<int> &args, int &value);
 };
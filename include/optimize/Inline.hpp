@@ -0,0 +1,110 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/ModRef.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief size limits of inlining, counted in ir instructions of the callee
+ */
+struct InlineBudget {
+  /**
+   * @brief callees no bigger than the call they replace, inlined anywhere
+   */
+  int alwaysSize = 12;
+  /**
+   * @brief callees inlined at a call site outside loops
+   */
+  int baseSize = 30;
+  /**
+   * @brief added for each loop around the call site
+   */
+  int loopBonus = 60;
+  /**
+   * @brief added for each constant argument, which folds in the copy
+   */
+  int constArgBonus = 10;
+  /**
+   * @brief callees with a single call site, removed once inlined
+   */
+  int singleSiteSize = 400;
+  /**
+   * @brief size past which nothing more is inlined into a caller
+   */
+  int maxCallerSize = 2000;
+};
+
+/**
+ * @class InlinePass
+ * @brief copies the body of small or hot callees into their callers
+ *
+ * Functions are visited bottom-up over the call graph, so a callee is
+ * inlined with its own call sites already inlined. Recursive functions are
+ * never inlined. A call site is inlined when the callee fits the budget
+ * for it: bigger callees pay off inside loops and with constant arguments.
+ * Pure calls on constants only are left to GlobalConstEvalPass.
+ *
+ * The block of the call is split after it. The copied blocks go in
+ * between and get fresh temps and labels; PARAMs become copies of the
+ * arguments, array parameters are replaced by the array passed, local
+ * arrays get symbols of their own and returns jump to the second half,
+ * where a phi merges the return values:
+ *
+ *   before: B: ARG x; t = CALL 1, f; use t
+ *   after:  B: t0' = x; (copy of f, returns jump to C)
+ *           C: t = PHI [v1, R1], [v2, R2]; use t
+ *
+ * Functions no longer called afterwards are removed.
+ */
+class InlinePass {
+public:
+  /**
+   * @param modRef which calls are pure
+   */
+  explicit InlinePass(const ModRefAnalysis &modRef, InlineBudget budget = {})
+      : _modRef(modRef), budget(budget) {}
+
+  /**
+   * @param functions all functions of the module; dead callees are erased
+   * @param am analyses of changed callers are dropped
+   * @return whether any call was inlined
+   */
+  bool run(std::vector<std::shared_ptr<Function>> &functions,
+           AnalysisManager &am);
+
+private:
+  const ModRefAnalysis &_modRef;
+  InlineBudget budget;
+  /**
+   * @brief call sites of each function left in the module
+   */
+  std::unordered_map<std::string, int> _callSites;
+  int _nextSymbolId = 0;
+
+  /**
+   * @brief instructions that cost code, labels, phis and allocas excluded
+   */
+  static int sizeOf(const Function &func);
+  /**
+   * @brief whether calls to func can be inlined at all: its entry has no
+   * predecessor and array parameters are only indexed or passed on
+   */
+  static bool isInlinable(const Function &func);
+  /**
+   * @param depth loops around the call
+   * @param loops whether callee has loops of its own
+   */
+  bool shouldInline(const Function &callee, const Instruction &call,
+                    int depth, int callerSize, bool loops) const;
+  /**
+   * @brief replaces call, in caller, with a copy of callee
+   *
+   * @return false, changing nothing, when its ARGs are not all in its block
+   * or an array argument is not an array symbol
+   */
+  bool inlineCall(Function &caller, Instruction *call, const Function &callee);
+};
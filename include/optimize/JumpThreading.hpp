@@ -0,0 +1,86 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/DominatorTree.hpp"
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class JumpThreadingPass
+ * @brief folds branches whose outcome follows from earlier branches, and
+ * threads edges on which a branch is known past it
+ *
+ * A branch `IF c` taken into a block with no other predecessor tells every
+ * block it dominates that c holds, and so does the comparison c was computed
+ * by. Correlated value propagation uses these predicates to decide later
+ * comparisons (`x > 0` then `x >= 0`, `x != 0`, ...) and branches, and
+ * replaces a value pinned by `x == k` with k.
+ *
+ * A small block ending in `IF` whose outcome is known on an edge from one
+ * predecessor, from a constant phi input or from a predicate, is copied for
+ * that edge; the copy ends in a jump to the known successor:
+ *
+ *   before: P1: f = 1; GOTO B   B: f' = phi(f, 0); IF f', T   (next: E)
+ *   after:  P1: GOTO B1         B1: GOTO T                    B: ...
+ *
+ * Values of B used elsewhere are defined in B and in the copy; they go
+ * through a fresh local, which the caller turns back into phis with Mem2Reg.
+ * Loop headers are never threaded, so no loop gains a second entry.
+ */
+class JumpThreadingPass {
+public:
+  /**
+   * @return whether anything changed; new locals need a Mem2Reg run
+   */
+  bool run(Function &func);
+
+  /**
+   * @brief threading adds blocks and edges
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::none();
+  }
+
+private:
+  /**
+   * @brief `a op b` holds, a and b single-def temps or constants
+   */
+  struct Fact {
+    OpCode op;
+    Operand a;
+    Operand b;
+  };
+  using Facts = std::vector<Fact>;
+
+  std::unordered_map<int, int> _defCount;
+  std::unordered_map<int, Instruction *> _defInst;
+  std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> _preds;
+  /**
+   * @brief predicates holding on entry to each reachable block
+   */
+  std::unordered_map<BasicBlock *, Facts> _facts;
+  DominatorTree _DT;
+  int _nextSymbolId = 0;
+
+  void analyze(Function &func);
+  bool isValue(const Operand &op) const;
+  /**
+   * @brief predicates the branch of from adds on its edge to to
+   */
+  void addEdgeFacts(BasicBlock *from, BasicBlock *to, Facts &facts) const;
+  /**
+   * @return 1 or 0 when `a op b` is decided by facts, -1 otherwise
+   */
+  int decide(OpCode op, const Operand &a, const Operand &b,
+             const Facts &facts) const;
+  bool propagate(Function &func);
+  bool threadOne(Function &func);
+  /**
+   * @brief the successor the branch ending bb takes when entered from pred,
+   * or nullptr
+   */
+  BasicBlock *knownSuccessor(BasicBlock *bb, BasicBlock *pred) const;
+  void thread(Function &func, BasicBlock *bb, BasicBlock *pred,
+              BasicBlock *succ);
+};
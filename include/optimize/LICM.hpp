@@ -2,6 +2,9 @@
 
 #include "LoopAnalysis.hpp"
 #include "codegen/BasicBlock.hpp"
+#include "optimize/AliasAnalysis.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/ModRef.hpp"
 #include "codegen/Function.hpp"
 #include <map>
 #include <set>
@@ -12,25 +15,70 @@ class DominatorTree;
 
 class LICMPass {
 public:
+  /**
+   * @param modRef memory the callees of the program may write
+   */
+  explicit LICMPass(const ModRefAnalysis &modRef) : modRef(modRef) {}
+
   /**
    * @brief runs the loop-invariant code motion optimization on the given
    * function.
    *
+   * A load is hoisted when no store in the loop may alias it (see
+   * AliasAnalysis), no call in the loop may write it (see ModRefAnalysis),
+   * and executing it before the loop cannot fault: a constant index within
+   * the array, or a block the loop passes through before every exit. A
+   * global scalar is invariant unless the loop or one of its callees
+   * writes it.
+   *
+   * A call whose callee writes nothing is hoisted with its ARGs when its
+   * arguments are invariant, nothing it reads is written in the loop, and
+   * the loop passes through it before every exit.
+   *
    * @param F fucntion to optimize
    * @param DT Dominator tree of the function
    * @param loops loop information of the function
    */
   void run(Function &F, DominatorTree &DT, const std::vector<LoopInfo> &loops);
 
+  /**
+   * @brief preheaders sit outside every loop and are reported to the
+   * dominator tree; frontiers change with them
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::none()
+        .preserve(AnalysisKind::DominatorTree)
+        .preserve(AnalysisKind::Loops);
+  }
+
 private:
   struct DefInfo {
     Instruction *inst;
     BasicBlock *block;
   };
-  bool isLoopInvariant(const Instruction *inst, const LoopInfo &loop,
+  /**
+   * @brief array elements and calls that may write memory in a loop, and
+   * the blocks it exits from
+   */
+  struct LoopMemory {
+    std::vector<MemoryLocation> stores;
+    std::vector<const Instruction *> calls;
+    std::vector<BasicBlock *> exiting;
+  };
+  const ModRefAnalysis &modRef;
+  AliasAnalysis AA;
+
+  bool isLoopInvariant(const Instruction *inst, BasicBlock *block,
+                       const LoopInfo &loop,
                        const std::map<int, DefInfo> &defMap,
                        const std::set<const Instruction *> &invariants,
-                       const std::set<int> &modifiedVars, bool hasCall,
-                       DominatorTree &DT);
+                       const std::set<int> &modifiedVars,
+                       const LoopMemory &memory, DominatorTree &DT);
+  bool isInvariantCall(const Instruction *call, BasicBlock *block,
+                       const std::vector<Instruction *> &args,
+                       const std::set<int> &modifiedVars,
+                       const LoopMemory &memory, DominatorTree &DT);
+  bool isInvariantLoad(const Instruction *inst, BasicBlock *block,
+                       const LoopMemory &memory, DominatorTree &DT);
   BasicBlock *getOrCreatePreheader(const LoopInfo &loop, Function &F);
 };
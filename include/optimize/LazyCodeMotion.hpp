@@ -0,0 +1,75 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class LazyCodeMotionPass
+ * @brief partial redundancy elimination by lazy code motion
+ *
+ * An expression computed on some paths into a block and again in the block
+ * is partially redundant; GVN only removes it when an earlier computation
+ * dominates. Following Knoop, Rüthing and Steffen in the edge formulation of
+ * Drechsler and Stadel, the pass computes per expression where it is
+ * anticipated and available, inserts it on the latest edges where it is
+ * missing and deletes the computations that become redundant:
+ *
+ *   before: L1: t1 = a / b; ... GOTO L3     after: L1: t1 = a / b; h = t1
+ *           L2: ...                                L2: ...; t4 = a / b; h = t4
+ *           L3: t3 = a / b                         L3: t3 = h
+ *
+ * No path computes the expression more often than before. The value travels
+ * in a fresh ALLOCA'd local h; a following Mem2Reg run turns it into phis.
+ * Insertions are only placed on edges that need no new block, and an
+ * expression whose insertion would need one is left alone.
+ *
+ * Only multiplications and divisions are moved: for a one-cycle operation
+ * the copies the phis of h turn into cost as much as the computation saved.
+ */
+class LazyCodeMotionPass {
+public:
+  /**
+   * @return whether any expression was moved
+   */
+  bool run(Function &func);
+
+  /**
+   * @brief only instructions are inserted and rewritten
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::cfg();
+  }
+
+private:
+  /**
+   * @brief `op a, b` with a and b single-def temps or constants
+   */
+  struct Expression {
+    OpCode op;
+    Operand a;
+    Operand b;
+  };
+
+  /**
+   * @brief blocks reachable from the entry, in layout order
+   */
+  std::vector<BasicBlock *> _blocks;
+  std::unordered_map<const BasicBlock *, int> _index;
+  std::vector<std::vector<int>> _succs;
+  /**
+   * @brief predecessors, -1 standing for the edge entering the function
+   */
+  std::vector<std::vector<int>> _preds;
+  /**
+   * @brief defining block of every single-def temp
+   */
+  std::unordered_map<int, int> _defBlock;
+  int _nextSymbolId = 0;
+
+  void buildCFG(Function &func);
+  void findExpressions(std::vector<Expression> &exprs) const;
+  bool matches(const Instruction &inst, const Expression &e) const;
+  bool moveExpression(Function &func, const Expression &e);
+};
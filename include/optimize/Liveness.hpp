@@ -0,0 +1,54 @@
+#pragma once
+
+#include "codegen/BasicBlock.hpp"
+#include "codegen/Function.hpp"
+#include <set>
+#include <unordered_map>
+
+/**
+ * @class Liveness
+ * @brief block-level live-in/live-out sets of temporaries
+ *
+ * STORE and RETURN read their result operand. A PHI defines its result at
+ * the top of its block, and each incoming value is live out of the matching
+ * predecessor only.
+ */
+class Liveness {
+public:
+  using LiveSet = std::set<int>;
+
+  /**
+   * @brief solve the backward dataflow for F
+   *
+   * @param F the given function
+   */
+  void run(Function &F);
+
+  /**
+   * @brief temporaries live on entry to block B
+   */
+  const LiveSet &getLiveIn(const BasicBlock *B) const;
+
+  /**
+   * @brief temporaries live on exit from block B
+   */
+  const LiveSet &getLiveOut(const BasicBlock *B) const;
+
+  /**
+   * @brief every temporary read or written outside PHI/NOP instructions
+   */
+  const LiveSet &getTemps() const { return _temps; }
+
+private:
+  std::unordered_map<const BasicBlock *, LiveSet> _use;
+  std::unordered_map<const BasicBlock *, LiveSet> _def;
+  /**
+   * @brief temporaries a block's successors read through their PHIs
+   */
+  std::unordered_map<const BasicBlock *, LiveSet> _phiUse;
+  std::unordered_map<const BasicBlock *, LiveSet> _liveIn;
+  std::unordered_map<const BasicBlock *, LiveSet> _liveOut;
+  LiveSet _temps;
+
+  void computeUseDef(Function &F);
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "LoopAnalysis.hpp"
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class LoopRotatePass
+ * @brief turns top-tested loops into guarded do-while loops
+ *
+ * The header test is copied to the end of the latch, which then branches
+ * straight back to the body. The old header runs only once, as the guard in
+ * front of the loop, and the first body block becomes the loop header:
+ *
+ *   before: H: test, IF body   body: ...   latch: step, GOTO H
+ *   after:  H: test, IF body   body: ...   latch: step, test, IF body
+ *
+ * Values of the header get phis in the new header for the body, and phis in
+ * a merge block for code after the loop, which is now reached from the
+ * guard and from the latch.
+ */
+class LoopRotatePass {
+public:
+  /**
+   * @brief rotate every innermost loop of the supported shape
+   *
+   * @param func function containing the loops
+   * @param loops loops of func
+   * @return whether any loop was rotated
+   */
+  bool run(Function &func, const std::vector<LoopInfo> &loops);
+
+  /**
+   * @brief the latch gets new edges and the header changes
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::none();
+  }
+
+private:
+  bool rotateLoop(Function &func, const LoopInfo &loop);
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "LoopAnalysis.hpp"
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/DominatorTree.hpp"
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class LoopStrengthReducePass
+ * @brief replaces array indexing and multiplication by induction variables
+ * with running pointers and additive recurrences
+ *
+ * A basic induction variable is a header phi `i = phi(init, i + step)`; a
+ * derived one is an affine value `scale * i + inv + c` computed from it, with
+ * scale a constant or a loop-invariant temp. Accesses `LOAD a, idx` with an
+ * affine idx share one pointer per (array, i, scale, inv), advanced by
+ * `4 * scale * step` next to `i + step`, and become `LOAD p, c`, so the
+ * backend emits a single `lw c*4(p)` instead of `sll; addu; lw`:
+ *
+ *   before: i = phi(0, i'); t = ADD i, 1; LOAD a, t, x; i' = ADD i, 1
+ *   after:  p = phi(&a, p'); LOAD p, 1, x; p' = ADD p, 4
+ *
+ * A multiplication that is still needed becomes a recurrence in the same way.
+ * When nothing but the exit test reads i any more, the test compares the
+ * pointer against its end value and i is removed.
+ *
+ * Address values in the ir are byte addresses, as on the target.
+ */
+class LoopStrengthReducePass {
+public:
+  /**
+   * @brief reduce every loop with a single latch, inner loops first
+   *
+   * @param func function containing the loops
+   * @param DT dominator tree of func
+   * @param loops loops of func
+   * @return whether anything changed
+   */
+  bool run(Function &func, DominatorTree &DT,
+           const std::vector<LoopInfo> &loops);
+
+  /**
+   * @brief new phis and instructions only, no new blocks or edges
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::cfg();
+  }
+
+private:
+  /**
+   * @brief `i = phi(init, next)` with `next = i + step`
+   */
+  struct InductionVar {
+    Instruction *phi = nullptr;
+    Instruction *next = nullptr;
+    /**
+     * @brief increments from i to next, next last
+     */
+    std::vector<Instruction *> chain;
+    Operand init;
+    int step = 0;
+  };
+
+  /**
+   * @brief `scale * iv + inv + c`; scale is a constant or an invariant temp,
+   * inv is empty or an invariant temp
+   */
+  struct Affine {
+    size_t iv = 0;
+    Operand scale;
+    Operand inv;
+    long long c = 0;
+  };
+
+  /**
+   * @brief a value advanced by a fixed stride on every iteration
+   */
+  struct Recurrence {
+    Operand value;
+    /**
+     * @brief value of the next iteration, defined right after iv.next
+     */
+    Operand next;
+  };
+
+  /**
+   * @brief state of the loop being reduced
+   */
+  struct LoopState {
+    const LoopInfo *loop = nullptr;
+    BasicBlock *preheader = nullptr;
+    BasicBlock *latch = nullptr;
+    std::vector<InductionVar> ivs;
+    std::unordered_map<int, Affine> affine;
+  };
+
+  /**
+   * @brief defining blocks of every temp of the function
+   */
+  std::unordered_map<int, std::vector<BasicBlock *>> _tempDefs;
+  /**
+   * @brief single-def temps with a constant value, such as the counters
+   * unrolled copies leave behind
+   */
+  std::unordered_map<int, int> _constants;
+
+  bool reduceLoop(Function &func, DominatorTree &DT, const LoopInfo &loop);
+  void findConstants(const Function &func);
+  /**
+   * @brief the constant a single-def temp holds, or op itself
+   */
+  Operand constantOf(const Operand &op) const;
+  bool isInvariant(const LoopState &ls, const Operand &op) const;
+  void findInductionVars(LoopState &ls);
+  void computeAffine(LoopState &ls);
+  /**
+   * @brief emit `dst = a op b` before the terminator of the preheader,
+   * folding constants
+   */
+  Operand emitInPreheader(Function &func, LoopState &ls, OpCode op,
+                          const Operand &a, const Operand &b);
+  /**
+   * @brief a new phi starting at start and advanced by stride next to
+   * iv.next
+   */
+  Recurrence makeRecurrence(Function &func, LoopState &ls, size_t iv,
+                            const Operand &start, const Operand &stride);
+};
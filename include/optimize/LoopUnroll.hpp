@@ -2,12 +2,94 @@
 
 #include "LoopAnalysis.hpp"
 #include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include <vector>
+
+/**
+ * @brief size limits of loop unrolling, counted in ir instructions
+ */
+struct UnrollBudget {
+  /**
+   * @brief copies of the body per iteration of a partially unrolled loop
+   */
+  int factor = 4;
+  /**
+   * @brief body size times factor of a partially unrolled loop
+   */
+  int maxUnrolledSize = 160;
+  /**
+   * @brief body size times trip count of a fully unrolled loop
+   */
+  int maxFullUnrollSize = 400;
+  /**
+   * @brief instructions added to one function
+   */
+  int maxGrowth = 2000;
+};
 
 class LoopUnrollPass {
 public:
+  explicit LoopUnrollPass(UnrollBudget budget = {}) : budget(budget) {}
+
+  /**
+   * @brief unroll every innermost loop that fits the budget
+   *
+   * @param func function containing the loops
+   * @param loops loops of func
+   * @return whether any loop was unrolled
+   */
   bool run(Function &func, const std::vector<LoopInfo> &loops);
 
+  /**
+   * @brief copies of a body get new blocks and edges
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::none();
+  }
+
 private:
+  /**
+   * @brief a top-tested loop `for (iv = init; iv op limit; iv += step)`
+   */
+  struct CountedLoop {
+    BasicBlock *preheader = nullptr;
+    BasicBlock *latch = nullptr;
+    /**
+     * @brief in-loop successor of the header
+     */
+    BasicBlock *bodyEntry = nullptr;
+    /**
+     * @brief header phis with their preheader and latch values
+     */
+    std::vector<Instruction *> phis;
+    std::vector<Operand> inits;
+    std::vector<Operand> backs;
+    /**
+     * @brief index of the induction variable in phis
+     */
+    size_t iv = 0;
+    /**
+     * @brief LT/LE/GT/GE, true while the loop continues
+     */
+    OpCode cmp = OpCode::LT;
+    Operand limit;
+    int step = 0;
+    /**
+     * @brief instructions of one iteration
+     */
+    int size = 0;
+    /**
+     * @brief iterations, -1 unless init and limit are constants
+     */
+    long long tripCount = -1;
+  };
+
+  UnrollBudget budget;
+  /**
+   * @brief instructions added to the current function
+   */
+  int growth = 0;
+
   /**
    * @brief try to unroll the given loop
    *
@@ -18,4 +100,20 @@ private:
   bool tryUnrollLoop(Function &func, const LoopInfo &loop);
   bool isSimpleLoop(const LoopInfo &loop, int &tripCount, Operand &iv,
                     int &step, int &initVal);
+
+  /**
+   * @brief unroll a multi-block counted loop, fully if its trip count is a
+   * small constant, by budget.factor otherwise
+   */
+  bool tryUnrollCountedLoop(Function &func, const LoopInfo &loop);
+  bool matchCountedLoop(Function &func, const LoopInfo &loop,
+                        CountedLoop &cl);
+  /**
+   * @brief place copies iterations of the loop in front of its header
+   *
+   * @param guarded whether the copies form a new loop guarded by an
+   * iteration check, with the original loop running the remainder
+   */
+  void unrollCountedLoop(Function &func, const LoopInfo &loop,
+                         const CountedLoop &cl, int copies, bool guarded);
 };
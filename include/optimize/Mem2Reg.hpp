@@ -1,7 +1,10 @@
 #pragma once
 
 #include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/DominanceFrontier.hpp"
 #include "optimize/DominatorTree.hpp"
+#include <map>
 #include <set>
 #include <stack>
 
@@ -14,6 +17,10 @@ struct AllocaInfo {
   Instruction *allocaInst;
   int varId;
   std::set<BasicBlock *> defBlocks;
+  /**
+   * @brief blocks the variable is live into, phis go only here
+   */
+  std::set<BasicBlock *> liveInBlocks;
   std::vector<Instruction *> usingInsts;
   bool isPromotable;
 };
@@ -22,7 +29,22 @@ class Mem2RegPass {
 public:
   Mem2RegPass() = default;
 
-  bool run(Function &F, DominatorTree &DT);
+  /**
+   * @brief promote scalar allocas of F to SSA temporaries
+   *
+   * @param F function to process
+   * @param DT dominator tree of F
+   * @param DF dominance frontiers of F
+   * @return whether anything was promoted
+   */
+  bool run(Function &F, DominatorTree &DT, const DominanceFrontier &DF);
+
+  /**
+   * @brief promotion only rewrites instructions and inserts PHIs
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::cfg();
+  }
 
 private:
   /**
@@ -32,18 +54,18 @@ private:
    */
   void collectPromotableAllocas(Function &F);
   /**
-   * @brief compute dominance frontiers for the function
+   * @brief compute the blocks each promotable variable is live into
    *
    * @param F function to process
-   * @param DT dominator tree of the function
    */
-  void computeDominanceFrontiers(Function &F, DominatorTree &DT);
+  void computeLiveInBlocks(Function &F);
   /**
    * @brief insert phi nodes for variables that need them
    *
    * @param F function to process
+   * @param DF dominance frontiers of the function
    */
-  void insertPhiNodes(Function &F);
+  void insertPhiNodes(Function &F, const DominanceFrontier &DF);
   /**
    * @brief rename variables in the function to use SSA form
    *
@@ -54,7 +76,6 @@ private:
   void renameVariables(BasicBlock *BB, DominatorTree &DT, Function &F);
 
   std::map<int, AllocaInfo> _allocas;
-  std::map<BasicBlock *, std::set<BasicBlock *>> _domFrontiers;
   std::map<Instruction *, int> _phiToVarId;
   std::map<int, std::stack<Operand>> _varStacks;
 };
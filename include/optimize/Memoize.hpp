@@ -0,0 +1,83 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/ModRef.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * @brief size limits and payoff threshold of memoization
+ */
+struct MemoBudget {
+  /**
+   * @brief entries of a function's table, split evenly over its
+   * parameters; 0, the default, turns memoization off
+   */
+  int maxEntries = 0;
+  /**
+   * @brief self calls a function must make to be memoized; with two or
+   * more the number of calls grows exponentially with the argument
+   */
+  int minSelfCalls = 2;
+  /**
+   * @brief most parameters a memoized function may take
+   */
+  int maxParams = 2;
+};
+
+/**
+ * @class MemoizePass
+ * @brief makes pure recursive int functions remember their results in a
+ * table in .data
+ *
+ * A function qualifies when its calls to itself are pure (ModRefAnalysis:
+ * no writes, no I/O, only constant globals read), its parameters are all
+ * scalars, it returns a value, and it pays off: it calls itself at least
+ * minSelfCalls times, or it is called from a loop of another function,
+ * which computes the same values again on every iteration.
+ *
+ * Each parameter p gets a range [0, d); arguments inside all ranges index
+ * the table, others run the function as before. The entry checks the
+ * table and every return fills it:
+ *
+ *   E: k = p; out = (k < 0) || (k >= d); IF out, B
+ *   C: s = LOAD set, k; IF s, H
+ *   B: i = PHI [d, E], [k, C]; (body, each RETURN v stores v at i, 1 at
+ *      set[i])
+ *   H: v = LOAD memo, k; RETURN v
+ *
+ * Out-of-range calls use the extra slot d of the tables, so returns store
+ * without a branch. The tables are global arrays named after the
+ * function, zero meaning not computed yet.
+ */
+class MemoizePass {
+public:
+  /**
+   * @param modRef which calls are pure, computed for the current program
+   */
+  explicit MemoizePass(const ModRefAnalysis &modRef, MemoBudget budget = {})
+      : _modRef(modRef), budget(budget) {}
+
+  /**
+   * @param globals the tables are added here
+   * @return whether any function was memoized
+   */
+  bool run(std::vector<std::shared_ptr<Function>> &functions,
+           std::vector<std::unique_ptr<Instruction>> &globals,
+           AnalysisManager &am);
+
+private:
+  const ModRefAnalysis &_modRef;
+  MemoBudget budget;
+  int _nextSymbolId = 0;
+
+  /**
+   * @brief whether memoizing func pays off
+   *
+   * @param loopCalls whether another function calls it from a loop
+   */
+  bool isCandidate(const Function &func, bool loopCalls) const;
+  void memoize(Function &func,
+               std::vector<std::unique_ptr<Instruction>> &globals);
+};
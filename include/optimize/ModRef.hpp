@@ -0,0 +1,109 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/AliasAnalysis.hpp"
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class ModRefAnalysis
+ * @brief what each function of the program may read and write, closed over
+ * the call graph
+ *
+ * A function touches globals (scalars, arrays and static locals) by name,
+ * the caller's arrays through its array parameters, and the outside world
+ * through the I/O runtime. Its summary includes what its callees do, so
+ * recursive functions are iterated to a fixpoint:
+ *
+ *   void inc() { cnt = cnt + 1; }           reads, writes cnt
+ *   int sum(int a[], int n) { ... a[i] }    reads parameters
+ *   int f(int x) { return tab[x] + sum(g, 4); }
+ *                                           reads tab, parameters
+ *
+ * The optimizer only ever removes memory accesses, and inlining brings in
+ * accesses the caller's summary already has, so summaries computed earlier
+ * stay conservative, just less precise.
+ */
+class ModRefAnalysis {
+public:
+  struct Effects {
+    std::set<const Symbol *> reads;
+    std::set<const Symbol *> writes;
+    /**
+     * @brief loads or stores through an array parameter
+     */
+    bool readsParams = false;
+    bool writesParams = false;
+    /**
+     * @brief calls the I/O runtime
+     */
+    bool io = false;
+    /**
+     * @brief calls a function outside the program, or dereferences a
+     * pointer that may point into more than one array
+     */
+    bool unknown = false;
+  };
+
+  /**
+   * @brief summarizes every function of the program
+   */
+  void run(const std::vector<std::shared_ptr<Function>> &functions);
+
+  /**
+   * @brief summary of the callee of a CALL, unknown for a function outside
+   * the program
+   */
+  const Effects &getEffects(const Instruction &call) const;
+
+  /**
+   * @brief whether the call may read or write object: a scalar or global
+   * array, or nullptr for any array reached through a pointer (array
+   * parameters, and local arrays whose address escapes)
+   */
+  bool mayRead(const Instruction &call, const Symbol *object) const;
+  bool mayWrite(const Instruction &call, const Symbol *object) const;
+
+  /**
+   * @brief the same for an array element of the caller AA was run on
+   */
+  bool mayRead(const Instruction &call, const MemoryLocation &loc,
+               const AliasAnalysis &AA) const;
+  bool mayWrite(const Instruction &call, const MemoryLocation &loc,
+                const AliasAnalysis &AA) const;
+
+  /**
+   * @brief writes no memory and does no I/O: with the same arguments and
+   * the same memory it returns the same value
+   */
+  bool isReadOnly(const Instruction &call) const;
+
+  /**
+   * @brief read-only, and reads nothing the program ever changes: the
+   * result depends on the arguments alone
+   */
+  bool isPure(const Instruction &call) const;
+
+  /**
+   * @brief global no function writes, or passes to a callee that may
+   * write it: it keeps its initial contents
+   */
+  bool isConstant(const Symbol *global) const;
+
+private:
+  std::unordered_map<std::string, Effects> _effects;
+  Effects _unknown;
+  std::set<const Symbol *> _changed;
+  /**
+   * @brief some function stores through a pointer into an unknown array
+   */
+  bool _pointerWrites = false;
+
+  static const Symbol *callerObject(const MemoryLocation &loc,
+                                   const AliasAnalysis &AA);
+  static bool mayTouch(const std::set<const Symbol *> &globals,
+                       bool throughParams, const Symbol *object);
+};
@@ -1,10 +1,19 @@
 #pragma once
 
 #include "codegen/Function.hpp"
+
+class Liveness;
+
 class PhiEliminationPass {
 
 public:
-  void run(Function &F);
+  /**
+   * @brief replace phis with copies in the predecessors
+   *
+   * @param F the given function, in SSA form
+   * @param live liveness of F, decides which critical edges need a block
+   */
+  void run(Function &F, const Liveness &live);
 
 private:
   std::shared_ptr<BasicBlock> getBlockSharedPtr(Function &F,
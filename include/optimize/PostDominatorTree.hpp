@@ -0,0 +1,58 @@
+#pragma once
+
+#include "codegen/BasicBlock.hpp"
+#include "codegen/Function.hpp"
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class PostDominatorTree
+ * @brief post-dominator tree of the blocks reachable from the entry, built
+ * with the Cooper-Harvey-Kennedy algorithm on the reverse CFG.
+ *
+ * Every returning block is a predecessor of a virtual exit, the root of the
+ * tree. A block that cannot reach a return (an infinite loop) has no
+ * post-dominator; run() then reports failure and the tree stays empty.
+ */
+class PostDominatorTree {
+public:
+  /**
+   * @brief runs the analysis for the given function
+   *
+   * @return whether every reachable block reaches a return
+   */
+  bool run(Function &F);
+
+  /**
+   * @brief blocks reachable from the entry, in layout order
+   */
+  const std::vector<BasicBlock *> &getBlocks() const { return _blocks; }
+
+  /**
+   * @brief CFG successors of a reachable block
+   */
+  const std::vector<BasicBlock *> &getSuccessors(BasicBlock *B) const;
+
+  /**
+   * @return immediate post-dominator of B, nullptr for the virtual exit
+   */
+  BasicBlock *getImmediatePostDominator(BasicBlock *B) const;
+
+  /**
+   * @brief check if block A post-dominates block B; nullptr stands for the
+   * virtual exit
+   */
+  bool postDominates(BasicBlock *A, BasicBlock *B) const;
+
+  bool isReachable(BasicBlock *B) const { return _number.count(B) > 0; }
+
+private:
+  std::vector<BasicBlock *> _blocks;
+  std::unordered_map<BasicBlock *, int> _number;
+  std::vector<std::vector<BasicBlock *>> _succs;
+  /**
+   * @brief index -> index of the immediate post-dominator, the virtual exit
+   * being _blocks.size()
+   */
+  std::vector<int> _ipdom;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "LoopAnalysis.hpp"
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/DominatorTree.hpp"
+#include "optimize/ModRef.hpp"
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class ScalarPromotionPass
+ * @brief keeps globals and fixed array elements in registers across a loop
+ *
+ * A memory location the loop reads or writes at a loop-invariant address is
+ * loaded into a fresh scalar local in the preheader, the accesses in the loop
+ * become copies of that local, and it is stored back at every loop exit:
+ *
+ *   before: preheader: ...        loop: LOAD sum, 0, t1 ... STORE t2, sum, 0
+ *   after:  preheader: LOAD sum, 0, p    loop: ASSIGN p, t1 ... ASSIGN t2, p
+ *           exit: STORE p, sum, 0
+ *
+ * The locals get an ALLOCA in the entry block, so a following Mem2Reg run
+ * turns them into phis. A location is promoted only if nothing else in the
+ * loop may touch it: no other access to the same array at an index that is
+ * not provably different, no access through an array parameter to a global
+ * array, and no call that may write it, or read it after the loop wrote it.
+ */
+class ScalarPromotionPass {
+public:
+  /**
+   * @param modRef memory the callees of the program may touch
+   * @param globals global ALLOCA/ASSIGN/STORE instructions
+   */
+  ScalarPromotionPass(const ModRefAnalysis &modRef,
+                      const std::vector<std::unique_ptr<Instruction>> &globals);
+
+  /**
+   * @brief promote locations of every loop of func, outer loops first
+   *
+   * @param func function containing the loops
+   * @param DT dominator tree of func
+   * @param loops loops of func
+   * @return whether anything was promoted
+   */
+  bool run(Function &func, DominatorTree &DT,
+           const std::vector<LoopInfo> &loops);
+
+  /**
+   * @brief only instructions are rewritten and inserted
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::cfg();
+  }
+
+private:
+  /**
+   * @brief a global scalar, or an array element at an invariant index
+   */
+  struct Location {
+    std::shared_ptr<Symbol> base;
+    /**
+     * @brief empty for a scalar
+     */
+    Operand index;
+    bool written = false;
+  };
+
+  const ModRefAnalysis &_modRef;
+  /**
+   * @brief ALLOCA'd symbols and array parameters of the current function
+   */
+  std::set<const Symbol *> _locals;
+  std::set<const Symbol *> _pointerParams;
+  /**
+   * @brief arrays whose address is loaded or copied into a temp
+   */
+  std::set<const Symbol *> _addressTaken;
+  /**
+   * @brief words of every array with a constant size
+   */
+  std::unordered_map<const Symbol *, int> _arrayWords;
+  int _nextSymbolId = 0;
+
+  void classifyLocals(const Function &func);
+  void recordArraySize(const Instruction &inst);
+  bool promoteLoop(Function &func, DominatorTree &DT, const LoopInfo &loop);
+  void promote(Function &func, const LoopInfo &loop, BasicBlock *preheader,
+               const std::vector<BasicBlock *> &exits, const Location &loc);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "codegen/Function.hpp"
+#include "optimize/AnalysisManager.hpp"
+
+/**
+ * @class TailRecursionElimPass
+ * @brief turns calls of a function to itself whose result is returned at
+ * once into jumps back to its start
+ *
+ * The entry block is split after its PARAMs, array parameter slots and
+ * allocas; the second half becomes a loop header with a phi per scalar
+ * parameter, fed by the PARAM on entry and by the argument at each tail
+ * call:
+ *
+ *   before: E: t0 = PARAM 0; ...    B: ARG t5; t6 = CALL 1, f; RETURN t6
+ *   after:  E: t0 = PARAM 0
+ *           H: t0' = PHI [t0, E], [t5, B]; ... (uses of t0 read t0')
+ *           B: GOTO H
+ *
+ * A void function falling off its end after the call is a tail call too.
+ * An array parameter must be passed on unchanged, since the slot it lives
+ * in is left alone.
+ */
+class TailRecursionElimPass {
+public:
+  /**
+   * @return whether any tail call was removed
+   */
+  bool run(Function &func);
+
+  /**
+   * @brief the entry is split and loops appear
+   */
+  PreservedAnalyses preservedAnalyses() const {
+    return PreservedAnalyses::none();
+  }
+};
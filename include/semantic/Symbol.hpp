@@ -3,7 +3,7 @@
 #include <string>
 
 struct Symbol {
-  int id;
+  int id = -1;
   std::string name;
   std::string globalName; // Global unique name
   TypePtr type;
@@ -1,15 +1,28 @@
 #include "backend/AsmGen.hpp"
 #include "codegen/CodeGen.hpp"
+#include "codegen/IRSerializer.hpp"
 #include "codegen/QuadOptimizer.hpp"
 #include "errorReporter/ErrorReporter.hpp"
 #include "lexer/Lexer.hpp"
+#include "optimize/AggressiveDCE.hpp"
+#include "optimize/AnalysisManager.hpp"
+#include "optimize/DeadStoreElim.hpp"
 #include "optimize/DominatorTree.hpp"
 #include "optimize/GlobalConstEval.hpp"
+#include "optimize/Inline.hpp"
+#include "optimize/JumpThreading.hpp"
 #include "optimize/LICM.hpp"
+#include "optimize/LazyCodeMotion.hpp"
 #include "optimize/LoopAnalysis.hpp"
+#include "optimize/LoopRotate.hpp"
+#include "optimize/LoopStrengthReduce.hpp"
 #include "optimize/LoopUnroll.hpp"
 #include "optimize/Mem2Reg.hpp"
+#include "optimize/Memoize.hpp"
+#include "optimize/ModRef.hpp"
 #include "optimize/PhiElimination.hpp"
+#include "optimize/ScalarPromotion.hpp"
+#include "optimize/TailRecursion.hpp"
 #include "parser/Parser.hpp"
 #include "semantic/SemanticAnalyzer.hpp"
 #include <fstream>
@@ -18,12 +31,65 @@
 // Optimization switch: set to true to enable IR optimizations
 constexpr bool ENABLE_OPTIMIZATION = true;
 const int MAX_ROUND = 10;
+// limits for running a whole input-free program at compile time
+const ProgramEvalBudget PROGRAM_EVAL_BUDGET{};
+// unroll factor and code-size limits of loop unrolling
+const UnrollBudget UNROLL_BUDGET{};
+// callee size limits of inlining
+const InlineBudget INLINE_BUDGET{};
+// table size and payoff threshold of memoization, used with --memoize
+const MemoBudget MEMO_BUDGET{4096};
 
-int main() {
+static IRModuleView
+makeModuleView(const std::vector<std::shared_ptr<Function>> &functions,
+               const std::vector<std::unique_ptr<Instruction>> &globals,
+               const std::unordered_map<std::string, std::shared_ptr<Symbol>>
+                   &stringLiterals) {
+  IRModuleView mod;
+  for (const auto &fp : functions) {
+    mod.functions.push_back(fp.get());
+  }
+  for (size_t i = 0; i < globals.size(); ++i) {
+    mod.globals.push_back(globals[i].get());
+  }
+  for (const auto &kv : stringLiterals) {
+    auto &literal = kv.first;
+    auto &label = kv.second;
+    mod.stringLiterals[literal] = label;
+  }
+  return mod;
+}
+
+int main(int argc, char *argv[]) {
   std::ofstream errorfile("error.txt");
   std::streambuf *original_cerr = std::cerr.rdbuf();
   std::cerr.rdbuf(errorfile.rdbuf());
 
+  // backend only: `Compiler --from-ir [ir.bin]` regenerates mips.txt from a
+  // cached binary ir image without running the frontend and the optimizer
+  if (argc >= 2 && std::string(argv[1]) == "--from-ir") {
+    std::string path = argc >= 3 ? argv[2] : "ir.bin";
+    IRModule ir;
+    if (!IRSerializer::read(path, ir)) {
+      std::cerr << "Error loading " << path << std::endl;
+      std::cerr.rdbuf(original_cerr);
+      return 1;
+    }
+    std::ofstream asmout("mips.txt");
+    AsmGen asmgen;
+    asmgen.generate(makeModuleView(ir.functions, ir.globals, ir.stringLiterals),
+                    asmout);
+    std::cerr.rdbuf(original_cerr);
+    return 0;
+  }
+
+  // `Compiler --memoize` also gives pure recursive functions result tables
+  // in .data, trading memory for calls
+  bool enableMemoize = false;
+  for (int i = 1; i < argc; ++i) {
+    enableMemoize |= std::string(argv[i]) == "--memoize";
+  }
+
   std::ofstream parserfile("ir.txt");
   std::streambuf *original_cout = std::cout.rdbuf();
   std::cout.rdbuf(parserfile.rdbuf());
@@ -64,25 +130,101 @@ int main() {
     // Apply IR optimizations if enabled
     if constexpr (ENABLE_OPTIMIZATION) {
       auto &functions = cg.getFunctions();
+      // results of compile-time calls, valid for the whole optimization
+      ConstEvalMemo constMemo;
+      // a program that never reads input prints the same thing on every
+      // run: execute it now and keep only the output
+      for (auto &fp : functions) {
+        if (fp->getName() != "main") {
+          continue;
+        }
+        ProgramEvalResult result;
+        if (GlobalConstEvalPass(functions, constMemo).evaluateProgram(
+                *fp, cg.getGlobalsIR(), cg.getStringLiteralSymbols(),
+                PROGRAM_EVAL_BUDGET, result)) {
+          cg.replaceProgramWithOutput(result.output, result.exitValue);
+        }
+        break;
+      }
+      // dominance, frontiers and loops are computed on demand and dropped
+      // only when a pass does not preserve them
+      AnalysisManager am;
       // build SSA
       for (auto &fp : functions) {
-        DominatorTree dt;
-        dt.run(*fp);
         Mem2RegPass mem2reg;
-        mem2reg.run(*fp, dt);
+        if (mem2reg.run(*fp, am.getDominatorTree(*fp),
+                        am.getDominanceFrontier(*fp))) {
+          am.invalidate(*fp, mem2reg.preservedAnalyses());
+        }
       }
 
+      // what each callee may read and write, refreshed every round: the
+      // optimizer only removes accesses, so older summaries stay safe
+      ModRefAnalysis modRef;
+      modRef.run(functions);
+      // small callees and callees in loops are copied into their callers;
+      // pure calls on constants are left for compile-time evaluation. The
+      // callees are simplified first, so their size and effects are those
+      // of the code actually copied. This cleanup already turns array
+      // accesses into accesses through address temps, which scalar
+      // promotion below must treat as possibly hitting the local array
+      for (auto &fp : functions) {
+        runDefaultQuadOptimizations(*fp, am, modRef);
+        // self tail calls become loops, which the loop passes then see and
+        // which no longer keep the function from being inlined
+        TailRecursionElimPass tailRecursion;
+        if (tailRecursion.run(*fp)) {
+          am.invalidate(*fp, tailRecursion.preservedAnalyses());
+        }
+      }
+      modRef.run(functions);
+      InlinePass inliner(modRef, INLINE_BUDGET);
+      if (inliner.run(functions, am)) {
+        modRef.run(functions);
+      }
+      ScalarPromotionPass promotion(modRef, cg.getGlobalsIR());
       for (auto &fp : functions) {
-        DominatorTree dt;
-        dt.run(*fp);
-        LoopAnalysis loopAnalysis;
-        loopAnalysis.run(*fp, dt);
-        auto &loops = loopAnalysis.getLoops();
+        auto &loops = am.getLoops(*fp);
         if (!loops.empty()) {
-          LICMPass licm;
-          licm.run(*fp, dt, loops);
-          LoopUnrollPass loopUnroll;
-          loopUnroll.run(*fp, loops);
+          // invariant operands of a chain grouped together, so LICM can
+          // hoist their partial result
+          ReassociatePass reassociate(am);
+          if (reassociate.run(*fp)) {
+            am.invalidate(*fp, reassociate.preservedAnalyses());
+          }
+          LICMPass licm(modRef);
+          licm.run(*fp, am.getDominatorTree(*fp), loops);
+          am.invalidate(*fp, licm.preservedAnalyses());
+          // globals and fixed array elements go to locals, which a second
+          // Mem2Reg run turns into phis
+          if (promotion.run(*fp, am.getDominatorTree(*fp), loops)) {
+            am.invalidate(*fp, promotion.preservedAnalyses());
+            Mem2RegPass mem2reg;
+            mem2reg.run(*fp, am.getDominatorTree(*fp),
+                        am.getDominanceFrontier(*fp));
+            am.invalidate(*fp, mem2reg.preservedAnalyses());
+          }
+          LoopUnrollPass loopUnroll(UNROLL_BUDGET);
+          if (loopUnroll.run(*fp, loops)) {
+            am.invalidate(*fp, loopUnroll.preservedAnalyses());
+          }
+          // test at the bottom: one branch per iteration
+          LoopRotatePass loopRotate;
+          if (loopRotate.run(*fp, am.getLoops(*fp))) {
+            am.invalidate(*fp, loopRotate.preservedAnalyses());
+            // a rotated body runs whenever the loop does, so its loads can
+            // be hoisted
+            LICMPass rotatedLicm(modRef);
+            rotatedLicm.run(*fp, am.getDominatorTree(*fp), am.getLoops(*fp));
+            am.invalidate(*fp, rotatedLicm.preservedAnalyses());
+          }
+          // indexing and multiplication by induction variables become
+          // running pointers and additions
+          LoopStrengthReducePass strengthReduce;
+          if (strengthReduce.run(*fp, am.getDominatorTree(*fp),
+                                 am.getLoops(*fp))) {
+            am.invalidate(*fp, strengthReduce.preservedAnalyses());
+          }
         }
       }
       bool changed = true;
@@ -90,24 +232,76 @@ int main() {
       while (changed && round < MAX_ROUND) {
         changed = false;
         round++;
-        GlobalConstEvalPass globalEval(functions);
+        modRef.run(functions);
+        GlobalConstEvalPass globalEval(functions, constMemo);
         for (auto &fp : functions) {
           if (globalEval.run(*fp)) {
+            am.invalidate(*fp, globalEval.preservedAnalyses());
+            changed = true;
+          }
+        }
+        for (auto &fp : functions) {
+          if (runDefaultQuadOptimizations(*fp, am, modRef)) {
+            changed = true;
+          }
+        }
+        // code only feeding dead values, down to whole loops and branches
+        for (auto &fp : functions) {
+          AggressiveDCEPass adce;
+          if (adce.run(*fp)) {
+            am.invalidate(*fp, adce.preservedAnalyses());
+            changed = true;
+          }
+        }
+        // stores overwritten before being read
+        for (auto &fp : functions) {
+          DeadStoreElimPass dse(modRef);
+          if (dse.run(*fp)) {
+            am.invalidate(*fp, dse.preservedAnalyses());
+            changed = true;
+          }
+        }
+        // branches known from earlier branches; values threaded blocks
+        // leave in locals become phis again
+        for (auto &fp : functions) {
+          JumpThreadingPass jumpThreading;
+          if (jumpThreading.run(*fp)) {
+            am.invalidate(*fp, jumpThreading.preservedAnalyses());
+            Mem2RegPass mem2reg;
+            mem2reg.run(*fp, am.getDominatorTree(*fp),
+                        am.getDominanceFrontier(*fp));
+            am.invalidate(*fp, mem2reg.preservedAnalyses());
             changed = true;
           }
         }
+        if (changed) {
+          continue;
+        }
+        // partially redundant computations once the rest has settled; the
+        // values they leave in locals become phis by another Mem2Reg run
         for (auto &fp : functions) {
-          DominatorTree dt;
-          dt.run(*fp);
-          if (runDefaultQuadOptimizations(*fp, dt)) {
+          LazyCodeMotionPass lcm;
+          if (lcm.run(*fp)) {
+            am.invalidate(*fp, lcm.preservedAnalyses());
+            Mem2RegPass mem2reg;
+            mem2reg.run(*fp, am.getDominatorTree(*fp),
+                        am.getDominanceFrontier(*fp));
+            am.invalidate(*fp, mem2reg.preservedAnalyses());
             changed = true;
           }
         }
       }
+      // pure recursive functions remember their results; last, since the
+      // tables are not something the other passes know to leave alone
+      if (enableMemoize) {
+        modRef.run(functions);
+        MemoizePass memoize(modRef, MEMO_BUDGET);
+        memoize.run(functions, cg.getGlobalsIR(), am);
+      }
       // phi elimination
       for (auto &fp : functions) {
         PhiEliminationPass phiElim;
-        phiElim.run(*fp);
+        phiElim.run(*fp, am.getLiveness(*fp));
       }
     }
 
@@ -122,23 +316,15 @@ int main() {
       }
     }
 
-    IRModuleView mod;
-    for (const auto &fp : cg.getFunctions()) {
-      mod.functions.push_back(fp.get());
-    }
-    const auto &globals = cg.getGlobalsIR();
-    for (size_t i = 0; i < globals.size(); ++i) {
-      mod.globals.push_back(globals[i].get());
-    }
-    for (const auto &kv : cg.getStringLiteralSymbols()) {
-      auto &literal = kv.first;
-      auto &label = kv.second;
-      mod.stringLiterals[literal] = label;
-    }
+    // binary image of the same ir, reloadable with --from-ir
+    IRSerializer::write("ir.bin", cg.getFunctions(), cg.getGlobalsIR(),
+                        cg.getStringLiteralSymbols());
 
     std::ofstream asmout("mips.txt");
     AsmGen asmgen;
-    asmgen.generate(mod, asmout);
+    asmgen.generate(makeModuleView(cg.getFunctions(), cg.getGlobalsIR(),
+                                   cg.getStringLiteralSymbols()),
+                    asmout);
   }
 
   std::cerr.rdbuf(original_cerr);
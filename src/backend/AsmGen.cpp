@@ -4,6 +4,7 @@
 #include "codegen/Operand.hpp"
 #include "semantic/Symbol.hpp"
 #include "semantic/Type.hpp"
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
@@ -230,6 +231,40 @@ void AsmGen::emitTextSection(const IRModuleView &mod, std::ostream &out) {
       continue;
     emitFunction(func, out);
   }
+  if (callsRuntimePrintf(mod)) {
+    emitPrintfRoutine(out);
+  }
+  out << "getint:\n";
+  out << "  li $v0, 5\n";
+  out << "  syscall\n";
+  out << "  jr $ra\n\n";
+}
+
+int AsmGen::outputSyscall(const std::string &name) {
+  if (name == "putint") {
+    return 1;
+  }
+  if (name == "putstr") {
+    return 4;
+  }
+  return 0;
+}
+
+bool AsmGen::callsRuntimePrintf(const IRModuleView &mod) {
+  for (auto *func : mod.functions) {
+    for (auto &blk : func->getBlocks()) {
+      for (auto &inst : blk->getInstructions()) {
+        if (inst->getOp() == OpCode::CALL &&
+            inst->getCalleeName() == "printf") {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+void AsmGen::emitPrintfRoutine(std::ostream &out) {
   out << "printf:\n";
   out << "  addiu $sp, $sp, -16\n";
   out << "  sw $a1, 4($sp)\n";
@@ -268,10 +303,6 @@ void AsmGen::emitTextSection(const IRModuleView &mod, std::ostream &out) {
   out << "printf_end:\n";
   out << "  addiu $sp, $sp, 16\n";
   out << "  jr $ra\n\n";
-  out << "getint:\n";
-  out << "  li $v0, 5\n";
-  out << "  syscall\n";
-  out << "  jr $ra\n\n";
 }
 
 void AsmGen::emitFunction(const Function *func, std::ostream &out) {
@@ -286,12 +317,19 @@ void AsmGen::emitFunction(const Function *func, std::ostream &out) {
    */
   curFuncName_ = func->getName();
   resetFunctionState();
+  analyzeFunctionLocals(func);
+  findTailCalls(func);
 
   // detect leaf function
   bool isLeaf = true;
   for (auto &blk : func->getBlocks()) {
     for (auto &inst : blk->getInstructions()) {
-      if (inst->getOp() == OpCode::CALL) {
+      // output builtins become a syscall, which keeps $ra intact, and a
+      // tail call leaves $ra for the callee to return through. User
+      // functions are named fn_<ident>, so one called putint is no builtin
+      if (inst->getOp() == OpCode::CALL &&
+          !outputSyscall(inst->getCalleeName()) &&
+          !tailCalls_.count(inst.get())) {
         isLeaf = false;
         break;
       }
@@ -301,8 +339,7 @@ void AsmGen::emitFunction(const Function *func, std::ostream &out) {
   }
   if (func->getName() == "main")
     isLeaf = false;
-
-  analyzeFunctionLocals(func);
+  isLeaf_ = isLeaf;
 
   // if leaf function, no need to save $ra
   if (isLeaf) {
@@ -315,7 +352,8 @@ void AsmGen::emitFunction(const Function *func, std::ostream &out) {
   _regAllocator.run(const_cast<Function *>(func));
 
   // just save all used callee-saved registers
-  std::vector<int> calleeSavedRegs;
+  std::vector<int> &calleeSavedRegs = calleeSavedRegs_;
+  calleeSavedRegs.clear();
   const std::set<int> &usedRegs = _regAllocator.getUsedRegs();
   for (int r : usedRegs) {
     calleeSavedRegs.push_back(r);
@@ -330,6 +368,7 @@ void AsmGen::emitFunction(const Function *func, std::ostream &out) {
   frameSize_ = spillBaseOffset;
 
   int savedRegBase = frameSize_;
+  savedRegBase_ = savedRegBase;
 
   int savedRegSize = calleeSavedRegs.size() * 4;
   frameSize_ += savedRegSize;
@@ -433,9 +472,23 @@ void AsmGen::emitFunction(const Function *func, std::ostream &out) {
     }
   }
   out << currentEpilogueLabel_ << ":\n";
-  for (size_t i = 0; i < calleeSavedRegs.size(); ++i) {
-    int regId = calleeSavedRegs[i];
-    int offset = savedRegBase + i * 4;
+  emitFrameRelease(out);
+  if (func->getName() == "main") {
+    out << "  move $a0, $v0\n";
+    out << "  li $v0, 17\n";
+    out << "  syscall\n";
+  } else {
+    out << "  jr $ra\n";
+  }
+  out << "\n";
+  curFuncName_.clear();
+  currentEpilogueLabel_.clear();
+}
+
+void AsmGen::emitFrameRelease(std::ostream &out) {
+  for (size_t i = 0; i < calleeSavedRegs_.size(); ++i) {
+    int regId = calleeSavedRegs_[i];
+    int offset = savedRegBase_ + i * 4;
     if (offset >= -32768 && offset <= 32767) {
       out << "  lw " << regs_[regId].name << ", " << offset << "($sp)\n";
     } else {
@@ -445,7 +498,7 @@ void AsmGen::emitFunction(const Function *func, std::ostream &out) {
     }
   }
   // leaf function no need to resume $ra
-  if (isLeaf) {
+  if (isLeaf_) {
     out << "  lw $fp, 0($fp)\n";
   } else {
     out << "  lw $ra, 0($fp)\n";
@@ -457,16 +510,6 @@ void AsmGen::emitFunction(const Function *func, std::ostream &out) {
   } else {
     out << "  addiu $sp, $sp, " << frameSize_ << "\n";
   }
-  if (func->getName() == "main") {
-    out << "  move $a0, $v0\n";
-    out << "  li $v0, 17\n";
-    out << "  syscall\n";
-  } else {
-    out << "  jr $ra\n";
-  }
-  out << "\n";
-  curFuncName_.clear();
-  currentEpilogueLabel_.clear();
 }
 
 void AsmGen::lowerInstruction(const Instruction *inst, std::ostream &out) {
@@ -851,9 +894,10 @@ void AsmGen::lowerInstruction(const Instruction *inst, std::ostream &out) {
     std::string rb = (a1 == a2) ? ra : getRegister(a2, out);
     std::string rd = getResultReg(res);
 
-    out << "  sltu " << rd << ", $zero, " << ra << "\n";
+    // rb first, the result may share its register
     std::string rt = allocateScratch();
     out << "  sltu " << rt << ", $zero, " << rb << "\n";
+    out << "  sltu " << rd << ", $zero, " << ra << "\n";
     if (op == OpCode::AND)
       out << "  and " << rd << ", " << rd << ", " << rt << "\n";
     else
@@ -1169,9 +1213,22 @@ void AsmGen::lowerInstruction(const Instruction *inst, std::ostream &out) {
     }
 
     // Call function
-    std::string fname = a2.asSymbol()->globalName.empty()
-                            ? a2.asSymbol()->name
-                            : a2.asSymbol()->globalName;
+    const std::string &fname = inst->getCalleeName();
+    int syscallNo = outputSyscall(fname);
+    if (syscallNo) {
+      // lowered printf segment, $a0 is already set by its ARG
+      out << "  li $v0, " << syscallNo << "\n";
+      out << "  syscall\n";
+      paramIndex_ = 0;
+      break;
+    }
+    if (tailCalls_.count(inst)) {
+      // the callee returns straight to our caller
+      emitFrameRelease(out);
+      out << "  j " << fname << "\n";
+      paramIndex_ = 0;
+      break;
+    }
     out << "  jal " << fname << "\n";
 
     // Clean up extra arguments from stack
@@ -1190,6 +1247,10 @@ void AsmGen::lowerInstruction(const Instruction *inst, std::ostream &out) {
     break;
   }
   case OpCode::RETURN: {
+    if (tailCalls_.count(inst)) {
+      // the tail call before it has already left
+      break;
+    }
     if (!isEmpty(res)) {
       if (isConst(res)) {
         out << "  li $v0, " << res.asInt() << "\n";
@@ -1387,6 +1448,105 @@ void AsmGen::resetFunctionState() {
   paramIndex_ = 0;
   pendingExtraArgs_.clear();
   _spillOffsets.clear();
+  tailCalls_.clear();
+}
+
+void AsmGen::findTailCalls(const Function *func) {
+  if (func->getName() == "main") {
+    // main ends with the exit syscall, not a return
+    return;
+  }
+  // temps that may hold the address of an array in this frame
+  auto isFrameArray = [&](const Operand &op) {
+    if (op.getType() != OperandType::Variable) {
+      return false;
+    }
+    const Symbol *sym = op.asSymbol().get();
+    return sym->type && sym->type->category == Type::Category::Array &&
+           locals_.count(sym) &&
+           std::find(formalParamByIndex_.begin(), formalParamByIndex_.end(),
+                     sym) == formalParamByIndex_.end();
+  };
+  std::unordered_set<int> frameAddrs;
+  auto inFrame = [&](const Operand &op) {
+    return isFrameArray(op) || (op.getType() == OperandType::Temporary &&
+                                frameAddrs.count(op.asInt()));
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto &blk : func->getBlocks()) {
+      for (auto &inst : blk->getInstructions()) {
+        OpCode op = inst->getOp();
+        const Operand &res = inst->getResult();
+        if (res.getType() != OperandType::Temporary) {
+          continue;
+        }
+        bool derived =
+            ((op == OpCode::ASSIGN || op == OpCode::ADD ||
+              op == OpCode::SUB) &&
+             (inFrame(inst->getArg1()) || inFrame(inst->getArg2()))) ||
+            (op == OpCode::LOAD &&
+             inst->getArg2().getType() == OperandType::Empty &&
+             isFrameArray(inst->getArg1()));
+        if (derived && frameAddrs.insert(res.asInt()).second) {
+          changed = true;
+        }
+      }
+    }
+  }
+
+  const auto &blocks = func->getBlocks();
+  for (auto &blk : blocks) {
+    auto &insts = blk->getInstructions();
+    for (size_t i = 0; i < insts.size(); ++i) {
+      const Instruction *call = insts[i].get();
+      if (call->getOp() != OpCode::CALL ||
+          outputSyscall(call->getCalleeName()) ||
+          call->getArg1().asInt() > 4) {
+        continue;
+      }
+      // the function must return the call's result right after it, or
+      // fall off its end
+      size_t next = i + 1;
+      while (next < insts.size() && insts[next]->getOp() == OpCode::NOP) {
+        ++next;
+      }
+      const Instruction *ret = nullptr;
+      if (next < insts.size()) {
+        ret = insts[next].get();
+        const Operand &value = ret->getResult();
+        bool returnsCall =
+            value.getType() == OperandType::Empty ||
+            (value.getType() == OperandType::Temporary &&
+             call->getResult().getType() == OperandType::Temporary &&
+             value.asInt() == call->getResult().asInt());
+        if (ret->getOp() != OpCode::RETURN || !returnsCall) {
+          continue;
+        }
+      } else if (blk != blocks.back() || blk->next || blk->jumpTarget) {
+        continue;
+      }
+      bool argsOk = true;
+      int argc = call->getArg1().asInt();
+      for (size_t j = i; j-- > 0 && argc > 0;) {
+        if (insts[j]->getOp() == OpCode::CALL) {
+          break;
+        }
+        if (insts[j]->getOp() == OpCode::ARG) {
+          argsOk &= !inFrame(insts[j]->getArg1());
+          --argc;
+        }
+      }
+      if (!argsOk || argc > 0) {
+        continue;
+      }
+      tailCalls_.insert(call);
+      if (ret) {
+        tailCalls_.insert(ret);
+      }
+    }
+  }
 }
 
 void AsmGen::analyzeFunctionLocals(const Function *func) {
@@ -10,8 +10,8 @@ RegisterAllocator::RegisterAllocator() {}
 RegisterAllocator::~RegisterAllocator() {}
 
 void RegisterAllocator::run(Function *func) {
-  computeUseDef(func);
-  computeLiveInOut(func);
+  _liveness.run(*func);
+  _temps = _liveness.getTemps();
   buildInterferenceGraph(func);
   doColoring();
 }
@@ -40,90 +40,6 @@ std::set<int> RegisterAllocator::getUsedRegs() const {
   return usedRegs;
 }
 
-void RegisterAllocator::computeUseDef(Function *func) {
-  _temps.clear();
-  for (auto &block : func->getBlocks()) {
-    LiveSet definedInBlock;
-    _use[block.get()] = LiveSet();
-    _def[block.get()] = LiveSet();
-
-    for (auto &inst : block->getInstructions()) {
-      if (inst->getOp() == OpCode::NOP || inst->getOp() == OpCode::PHI) {
-        continue;
-      }
-      auto checkUse = [&](const Operand &op) {
-        if (op.getType() == OperandType::Temporary) {
-          _temps.insert(op.asInt());
-          if (definedInBlock.find(op.asInt()) == definedInBlock.end()) {
-            _use[block.get()].insert(op.asInt());
-          }
-        }
-      };
-
-      checkUse(inst->getArg1());
-      checkUse(inst->getArg2());
-      if (inst->getOp() == OpCode::STORE || inst->getOp() == OpCode::RETURN) {
-        // result of STORE is index, is use, not def
-        checkUse(inst->getResult());
-      } else {
-        if (inst->getResult().getType() == OperandType::Temporary) {
-          int tempId = inst->getResult().asInt();
-          _def[block.get()].insert(tempId);
-          definedInBlock.insert(tempId);
-          _temps.insert(tempId);
-        }
-      }
-    }
-  }
-}
-
-void RegisterAllocator::computeLiveInOut(Function *func) {
-  for (auto &block : func->getBlocks()) {
-    _liveIn[block.get()] = LiveSet();
-    _liveOut[block.get()] = LiveSet();
-  }
-
-  bool changed = true;
-  while (changed) {
-    changed = false;
-
-    std::vector<BasicBlock *> blocks;
-    for (auto &block : func->getBlocks()) {
-      blocks.push_back(block.get());
-    }
-    std::reverse(blocks.begin(), blocks.end());
-
-    for (auto *block : blocks) {
-      LiveSet newLiveOut;
-      if (block->next) {
-        newLiveOut.insert(_liveIn[block->next.get()].begin(),
-                          _liveIn[block->next.get()].end());
-      }
-      if (block->jumpTarget) {
-        newLiveOut.insert(_liveIn[block->jumpTarget.get()].begin(),
-                          _liveIn[block->jumpTarget.get()].end());
-      }
-
-      if (newLiveOut != _liveOut[block]) {
-        _liveOut[block] = newLiveOut;
-        changed = true;
-      }
-
-      LiveSet newLiveIn = _use[block];
-      LiveSet diff;
-      std::set_difference(_liveOut[block].begin(), _liveOut[block].end(),
-                          _def[block].begin(), _def[block].end(),
-                          std::inserter(diff, diff.begin()));
-      newLiveIn.insert(diff.begin(), diff.end());
-
-      if (newLiveIn != _liveIn[block]) {
-        _liveIn[block] = newLiveIn;
-        changed = true;
-      }
-    }
-  }
-}
-
 void RegisterAllocator::buildInterferenceGraph(Function *func) {
   _interferenceGraph.clear();
   for (int temp : _temps) {
@@ -131,7 +47,7 @@ void RegisterAllocator::buildInterferenceGraph(Function *func) {
   }
 
   for (auto &block : func->getBlocks()) {
-    LiveSet live = _liveOut[block.get()];
+    LiveSet live = _liveness.getLiveOut(block.get());
 
     for (auto it = block->getInstructions().rbegin();
          it != block->getInstructions().rend(); ++it) {
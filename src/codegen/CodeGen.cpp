@@ -14,6 +14,8 @@ void CodeGen::reset() {
   constValues_.clear();
   constArrayValues_.clear();
   stringLiterals_.clear();
+  putStrSym_.reset();
+  putIntSym_.reset();
   nextStringId_ = 0;
   nextStaticId_ = 0;
   globalsIR_.clear();
@@ -376,6 +378,44 @@ void CodeGen::genMainFuncDef(MainFuncDef *mainDef) {
   ctx_.func = savedFunc;
   ctx_.curBlk = savedBlk;
 }
+
+void CodeGen::replaceProgramWithOutput(const std::string &output,
+                                       int exitValue) {
+  auto funcPtr = std::make_shared<Function>("main");
+  // nothing of the old module is referenced any more
+  functions_.clear();
+  globalsIR_.clear();
+  stringLiterals_.clear();
+
+  ctx_.func = funcPtr.get();
+  ctx_.curBlk = funcPtr->createBlock();
+  if (!output.empty()) {
+    std::string literal = "\"";
+    for (char c : output) {
+      if (c == '\n') {
+        literal += "\\n";
+      } else if (c == '\\' || c == '"') {
+        literal += '\\';
+        literal += c;
+      } else {
+        literal += c;
+      }
+    }
+    literal += '"';
+    emit(std::make_unique<Instruction>(Instruction::MakeArg(
+        Operand::Variable(internStringLiteral(literal)))));
+    emit(std::make_unique<Instruction>(Instruction::MakeCall(
+        Operand::Variable(builtinSymbol(putStrSym_, "putstr")), 1,
+        newTemp())));
+  }
+  emit(std::make_unique<Instruction>(
+      Instruction::MakeReturn(Operand::ConstantInt(exitValue))));
+  funcPtr->buildCFG();
+
+  functions_.push_back(funcPtr);
+  ctx_.func = nullptr;
+  ctx_.curBlk.reset();
+}
 void CodeGen::genBlock(Block *block) {
   if (!block)
     return;
@@ -545,16 +585,71 @@ void CodeGen::genReturn(ReturnStmt *stmt) {
   emit(std::make_unique<Instruction>(Instruction::MakeReturn(result)));
 }
 
+std::shared_ptr<Symbol> &CodeGen::builtinSymbol(std::shared_ptr<Symbol> &slot,
+                                                const char *name) {
+  if (!slot) {
+    slot = std::make_shared<Symbol>(-1, name, nullptr, 0);
+  }
+  return slot;
+}
+
+bool CodeGen::splitFormatString(const std::string &format,
+                                std::vector<std::string> &segments) {
+  size_t start = 0, end = format.size();
+  if (end >= 2 && format.front() == '"' && format.back() == '"') {
+    start = 1;
+    end -= 1;
+  }
+  segments.assign(1, std::string());
+  for (size_t i = start; i < end; ++i) {
+    if (format[i] != '%') {
+      segments.back() += format[i];
+      continue;
+    }
+    if (i + 1 >= end || format[i + 1] != 'd') {
+      return false;
+    }
+    segments.emplace_back();
+    ++i;
+  }
+  return true;
+}
+
 void CodeGen::genPrintf(PrintfStmt *stmt) {
   if (!stmt)
     return;
 
-  auto fmtSym = internStringLiteral(stmt->formatString);
   std::vector<Operand> vals;
   vals.reserve(stmt->args.size());
   for (auto &e : stmt->args) {
     vals.push_back(genExp(e.get()));
   }
+
+  // split the literal format at each %d: text segments print with
+  // syscall 4, integers with syscall 1, no runtime interpretation needed
+  std::vector<std::string> segments;
+  if (splitFormatString(stmt->formatString, segments) &&
+      segments.size() == vals.size() + 1) {
+    auto emitPut = [&](const std::shared_ptr<Symbol> &fn, const Operand &arg) {
+      emit(std::make_unique<Instruction>(Instruction::MakeArg(arg)));
+      emit(std::make_unique<Instruction>(
+          Instruction::MakeCall(Operand::Variable(fn), 1, newTemp())));
+    };
+    for (size_t i = 0; i < segments.size(); ++i) {
+      if (!segments[i].empty()) {
+        auto segSym = internStringLiteral("\"" + segments[i] + "\"");
+        emitPut(builtinSymbol(putStrSym_, "putstr"),
+                Operand::Variable(segSym));
+      }
+      if (i < vals.size()) {
+        emitPut(builtinSymbol(putIntSym_, "putint"), vals[i]);
+      }
+    }
+    return;
+  }
+
+  // fallback: the runtime printf routine interprets the format
+  auto fmtSym = internStringLiteral(stmt->formatString);
   emit(std::make_unique<Instruction>(
       Instruction::MakeArg(Operand::Variable(fmtSym))));
   int argc = 1;
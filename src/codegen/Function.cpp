@@ -158,6 +158,15 @@ void Function::buildCFG() {
 int Function::allocateTemp() { return _nextTempId++; }
 int Function::getTempCount() const { return _nextTempId; }
 int Function::allocateLabel() { return _nextLabelId++; }
+int Function::getLabelCount() const { return _nextLabelId; }
+int Function::getNextBlockId() const { return _nextBlockId; }
+
+void Function::restoreCounters(int nextBlockId, int nextTempId,
+                               int nextLabelId) {
+  _nextBlockId = nextBlockId;
+  _nextTempId = nextTempId;
+  _nextLabelId = nextLabelId;
+}
 
 std::shared_ptr<BasicBlock> Function::getBlockSharedPtr(BasicBlock *rawPtr) {
   for (const auto &blk : _blocks) {
@@ -0,0 +1,423 @@
+#include "codegen/IRSerializer.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Layout (every field is one 32-bit word, strings are length-prefixed and
+ * padded to a word boundary):
+ *
+ *   header   : MAGIC VERSION
+ *   types    : count { category base const static arraySize elem ret
+ *                      paramCount params... }        (type refs are indices)
+ *   symbols  : count { id name globalName type line }
+ *   literals : count { text symbol }
+ *   globals  : count { instruction }
+ *   functions: count { name nextBlockId nextTempId nextLabelId
+ *                      blockCount { blockId }
+ *                      { next jumpTarget instCount { instruction } } }
+ *   instruction: op arg1 arg2 result phiCount { operand block }
+ *   operand  : kind value       (value is a symbol index for Variable)
+ *
+ * Types and symbols are emitted before anything refers to them, so the
+ * reader rebuilds every table in a single forward pass.
+ */
+
+struct IRImageWriter {
+  std::string buf;
+  std::unordered_map<const Type *, int> typeIds;
+  std::vector<const Type *> types;
+  std::unordered_map<const Symbol *, int> symbolIds;
+  std::vector<const Symbol *> symbols;
+
+  void word(int32_t v) {
+    uint32_t u = static_cast<uint32_t>(v);
+    char b[4] = {static_cast<char>(u & 0xff), static_cast<char>(u >> 8),
+                 static_cast<char>(u >> 16), static_cast<char>(u >> 24)};
+    buf.append(b, 4);
+  }
+  void str(const std::string &s) {
+    word(static_cast<int32_t>(s.size()));
+    buf.append(s);
+    buf.append((4 - s.size() % 4) % 4, '\0');
+  }
+
+  int internType(const TypePtr &t) {
+    if (!t)
+      return -1;
+    auto it = typeIds.find(t.get());
+    if (it != typeIds.end())
+      return it->second;
+    // children first, so the reader never meets a forward reference
+    internType(t->array_element_type);
+    internType(t->return_type);
+    for (auto &p : t->params)
+      internType(p);
+    int id = static_cast<int>(types.size());
+    typeIds[t.get()] = id;
+    types.push_back(t.get());
+    return id;
+  }
+  int typeRef(const TypePtr &t) const {
+    return t ? typeIds.at(t.get()) : -1;
+  }
+  void internSymbol(const std::shared_ptr<Symbol> &s) {
+    if (!s || symbolIds.count(s.get()))
+      return;
+    internType(s->type);
+    symbolIds[s.get()] = static_cast<int>(symbols.size());
+    symbols.push_back(s.get());
+  }
+  void internOperand(const Operand &op) {
+    if (op.getType() == OperandType::Variable)
+      internSymbol(op.asSymbol());
+  }
+  void internInstruction(const Instruction &inst) {
+    internOperand(inst.getArg1());
+    internOperand(inst.getArg2());
+    internOperand(inst.getResult());
+    for (auto &pa : inst.getPhiArgs())
+      internOperand(pa.first);
+  }
+
+  void operand(const Operand &op) {
+    word(static_cast<int32_t>(op.getType()));
+    switch (op.getType()) {
+    case OperandType::Empty:
+      word(0);
+      break;
+    case OperandType::Variable:
+      word(symbolIds.at(op.asSymbol().get()));
+      break;
+    default:
+      word(op.asInt());
+      break;
+    }
+  }
+  void
+  instruction(const Instruction &inst,
+              const std::unordered_map<const BasicBlock *, int> &blockIdx) {
+    word(static_cast<int32_t>(inst.getOp()));
+    operand(inst.getArg1());
+    operand(inst.getArg2());
+    operand(inst.getResult());
+    word(static_cast<int32_t>(inst.getPhiArgs().size()));
+    for (auto &pa : inst.getPhiArgs()) {
+      operand(pa.first);
+      auto it = blockIdx.find(pa.second);
+      word(it == blockIdx.end() ? -1 : it->second);
+    }
+  }
+};
+
+struct IRImageReader {
+  const unsigned char *cur;
+  const unsigned char *end;
+  bool ok = true;
+  std::vector<TypePtr> types;
+  std::vector<std::shared_ptr<Symbol>> symbols;
+
+  int32_t word() {
+    if (end - cur < 4) {
+      ok = false;
+      return 0;
+    }
+    uint32_t u = static_cast<uint32_t>(cur[0]) |
+                 (static_cast<uint32_t>(cur[1]) << 8) |
+                 (static_cast<uint32_t>(cur[2]) << 16) |
+                 (static_cast<uint32_t>(cur[3]) << 24);
+    cur += 4;
+    return static_cast<int32_t>(u);
+  }
+  // element counts are bounded by the remaining bytes, which keeps a corrupt
+  // image from triggering huge allocations
+  int count() {
+    int32_t n = word();
+    if (n < 0 || n > (end - cur) / 4) {
+      ok = false;
+      return 0;
+    }
+    return n;
+  }
+  std::string str() {
+    int32_t n = word();
+    size_t padded = (static_cast<size_t>(n) + 3) & ~static_cast<size_t>(3);
+    if (n < 0 || static_cast<size_t>(end - cur) < padded) {
+      ok = false;
+      return {};
+    }
+    std::string s(reinterpret_cast<const char *>(cur), n);
+    cur += padded;
+    return s;
+  }
+  TypePtr typeRef() {
+    int32_t id = word();
+    if (id == -1)
+      return nullptr;
+    if (id < 0 || id >= static_cast<int32_t>(types.size())) {
+      ok = false;
+      return nullptr;
+    }
+    return types[id];
+  }
+
+  Operand operand() {
+    int32_t kind = word();
+    int32_t value = word();
+    switch (static_cast<OperandType>(kind)) {
+    case OperandType::Empty:
+      return Operand();
+    case OperandType::Variable:
+      if (value < 0 || value >= static_cast<int32_t>(symbols.size())) {
+        ok = false;
+        return Operand();
+      }
+      return Operand::Variable(symbols[value]);
+    case OperandType::Temporary:
+      return Operand::Temporary(value);
+    case OperandType::ConstantInt:
+      return Operand::ConstantInt(value);
+    case OperandType::Label:
+      return Operand::Label(value);
+    }
+    ok = false;
+    return Operand();
+  }
+  std::unique_ptr<Instruction>
+  instruction(const std::vector<std::shared_ptr<BasicBlock>> &blocks) {
+    int32_t op = word();
+    if (op < 0 || op > static_cast<int32_t>(OpCode::NOP))
+      ok = false;
+    Operand a1 = operand();
+    Operand a2 = operand();
+    Operand res = operand();
+    auto inst = std::make_unique<Instruction>(static_cast<OpCode>(op), a1, a2,
+                                              res);
+    int phiCount = count();
+    for (int i = 0; i < phiCount && ok; ++i) {
+      Operand val = operand();
+      int32_t b = word();
+      if (b < -1 || b >= static_cast<int32_t>(blocks.size())) {
+        ok = false;
+        break;
+      }
+      inst->addPhiArg(val, b == -1 ? nullptr : blocks[b].get());
+    }
+    return inst;
+  }
+};
+
+bool IRSerializer::write(
+    const std::string &path,
+    const std::vector<std::shared_ptr<Function>> &functions,
+    const std::vector<std::unique_ptr<Instruction>> &globals,
+    const std::unordered_map<std::string, std::shared_ptr<Symbol>>
+        &stringLiterals) {
+  IRImageWriter w;
+
+  // literals are written in label order so identical modules give identical
+  // images regardless of hash map iteration order
+  std::vector<std::pair<std::string, std::shared_ptr<Symbol>>> literals(
+      stringLiterals.begin(), stringLiterals.end());
+  std::sort(literals.begin(), literals.end(),
+            [](const auto &a, const auto &b) {
+              return a.second->name < b.second->name;
+            });
+
+  for (auto &kv : literals)
+    w.internSymbol(kv.second);
+  for (auto &g : globals)
+    if (g)
+      w.internInstruction(*g);
+  for (auto &fn : functions)
+    for (auto &bb : fn->getBlocks())
+      for (auto &inst : bb->getInstructions())
+        if (inst)
+          w.internInstruction(*inst);
+
+  w.word(static_cast<int32_t>(MAGIC));
+  w.word(static_cast<int32_t>(VERSION));
+
+  w.word(static_cast<int32_t>(w.types.size()));
+  for (const Type *t : w.types) {
+    w.word(static_cast<int32_t>(t->category));
+    w.word(static_cast<int32_t>(t->base_type));
+    w.word(t->is_const);
+    w.word(t->is_static);
+    w.word(t->array_size);
+    w.word(w.typeRef(t->array_element_type));
+    w.word(w.typeRef(t->return_type));
+    w.word(static_cast<int32_t>(t->params.size()));
+    for (auto &p : t->params)
+      w.word(w.typeRef(p));
+  }
+
+  w.word(static_cast<int32_t>(w.symbols.size()));
+  for (const Symbol *s : w.symbols) {
+    w.word(s->id);
+    w.str(s->name);
+    w.str(s->globalName);
+    w.word(w.typeRef(s->type));
+    w.word(s->line);
+  }
+
+  w.word(static_cast<int32_t>(literals.size()));
+  for (auto &kv : literals) {
+    w.str(kv.first);
+    w.word(w.symbolIds.at(kv.second.get()));
+  }
+
+  const std::unordered_map<const BasicBlock *, int> noBlocks;
+  int globalCount = 0;
+  for (auto &g : globals)
+    globalCount += g ? 1 : 0;
+  w.word(globalCount);
+  for (auto &g : globals)
+    if (g)
+      w.instruction(*g, noBlocks);
+
+  w.word(static_cast<int32_t>(functions.size()));
+  for (auto &fn : functions) {
+    const auto &blocks = fn->getBlocks();
+    std::unordered_map<const BasicBlock *, int> blockIdx;
+    for (size_t i = 0; i < blocks.size(); ++i)
+      blockIdx[blocks[i].get()] = static_cast<int>(i);
+    auto ref = [&](const std::shared_ptr<BasicBlock> &bb) {
+      auto it = blockIdx.find(bb.get());
+      return bb && it != blockIdx.end() ? it->second : -1;
+    };
+
+    w.str(fn->getName());
+    w.word(fn->getNextBlockId());
+    w.word(fn->getTempCount());
+    w.word(fn->getLabelCount());
+    w.word(static_cast<int32_t>(blocks.size()));
+    for (auto &bb : blocks)
+      w.word(bb->getId());
+    for (auto &bb : blocks) {
+      w.word(ref(bb->next));
+      w.word(ref(bb->jumpTarget));
+      int instCount = 0;
+      for (auto &inst : bb->getInstructions())
+        instCount += inst ? 1 : 0;
+      w.word(instCount);
+      for (auto &inst : bb->getInstructions())
+        if (inst)
+          w.instruction(*inst, blockIdx);
+    }
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return false;
+  out.write(w.buf.data(), static_cast<std::streamsize>(w.buf.size()));
+  return static_cast<bool>(out);
+}
+
+bool IRSerializer::read(const std::string &path, IRModule &mod) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size < 8) {
+    ::close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED)
+    return false;
+
+  IRImageReader r;
+  r.cur = static_cast<const unsigned char *>(base);
+  r.end = r.cur + size;
+
+  IRModule loaded;
+  if (static_cast<uint32_t>(r.word()) != MAGIC ||
+      static_cast<uint32_t>(r.word()) != VERSION)
+    r.ok = false;
+
+  int typeCount = r.ok ? r.count() : 0;
+  for (int i = 0; i < typeCount && r.ok; ++i) {
+    auto t = std::make_shared<Type>(static_cast<Type::Category>(r.word()));
+    t->base_type = static_cast<BaseType>(r.word());
+    t->is_const = r.word() != 0;
+    t->is_static = r.word() != 0;
+    t->array_size = r.word();
+    t->array_element_type = r.typeRef();
+    t->return_type = r.typeRef();
+    int paramCount = r.count();
+    for (int p = 0; p < paramCount && r.ok; ++p)
+      t->params.push_back(r.typeRef());
+    r.types.push_back(t);
+  }
+
+  int symbolCount = r.ok ? r.count() : 0;
+  for (int i = 0; i < symbolCount && r.ok; ++i) {
+    int id = r.word();
+    std::string name = r.str();
+    std::string globalName = r.str();
+    TypePtr type = r.typeRef();
+    int line = r.word();
+    auto sym = std::make_shared<Symbol>(id, std::move(name), type, line);
+    sym->globalName = std::move(globalName);
+    r.symbols.push_back(sym);
+  }
+
+  int literalCount = r.ok ? r.count() : 0;
+  for (int i = 0; i < literalCount && r.ok; ++i) {
+    std::string text = r.str();
+    int32_t s = r.word();
+    if (s < 0 || s >= static_cast<int32_t>(r.symbols.size())) {
+      r.ok = false;
+      break;
+    }
+    loaded.stringLiterals[text] = r.symbols[s];
+  }
+
+  int globalCount = r.ok ? r.count() : 0;
+  for (int i = 0; i < globalCount && r.ok; ++i)
+    loaded.globals.push_back(r.instruction({}));
+
+  int functionCount = r.ok ? r.count() : 0;
+  for (int i = 0; i < functionCount && r.ok; ++i) {
+    auto fn = std::make_shared<Function>(r.str());
+    int nextBlockId = r.word();
+    int nextTempId = r.word();
+    int nextLabelId = r.word();
+    fn->restoreCounters(nextBlockId, nextTempId, nextLabelId);
+
+    // block ids come first, so edges and phi args may refer forward
+    int blockCount = r.count();
+    auto &blocks = fn->getBlocks();
+    for (int b = 0; b < blockCount && r.ok; ++b)
+      blocks.push_back(std::make_shared<BasicBlock>(r.word()));
+    auto link = [&](int32_t idx) -> std::shared_ptr<BasicBlock> {
+      if (idx < -1 || idx >= static_cast<int32_t>(blocks.size())) {
+        r.ok = false;
+        return nullptr;
+      }
+      return idx == -1 ? nullptr : blocks[idx];
+    };
+    for (size_t b = 0; b < blocks.size() && r.ok; ++b) {
+      blocks[b]->next = link(r.word());
+      blocks[b]->jumpTarget = link(r.word());
+      int instCount = r.count();
+      for (int k = 0; k < instCount && r.ok; ++k)
+        blocks[b]->addInstruction(r.instruction(blocks));
+    }
+    loaded.functions.push_back(fn);
+  }
+
+  if (r.ok && r.cur != r.end)
+    r.ok = false;
+  ::munmap(base, size);
+  if (!r.ok)
+    return false;
+  mod = std::move(loaded);
+  return true;
+}
@@ -9,6 +9,15 @@ Instruction::Instruction(OpCode op, Operand a1, Operand res)
     : _op(op), _arg1(std::move(a1)), _arg2(Operand()), _result(std::move(res)),
       _parent(nullptr) {}
 
+const std::string &Instruction::getCalleeName() const {
+  const Symbol *sym = _arg2.asSymbol().get();
+  return sym->globalName.empty() ? sym->name : sym->globalName;
+}
+
+bool Instruction::callsBuiltin() const {
+  return _arg2.asSymbol()->globalName.empty();
+}
+
 Instruction::Instruction(OpCode op, Operand res)
     : _op(op), _arg1(Operand()), _arg2(Operand()), _result(std::move(res)),
       _parent(nullptr) {}
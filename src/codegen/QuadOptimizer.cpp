@@ -1,11 +1,15 @@
 #include "codegen/QuadOptimizer.hpp"
 #include "codegen/Instruction.hpp"
 #include "codegen/Operand.hpp"
+#include "optimize/AliasAnalysis.hpp"
 #include "optimize/DominatorTree.hpp"
 #include "optimize/LICM.hpp"
 #include "optimize/LoopAnalysis.hpp"
+#include <algorithm>
 #include <functional>
+#include <map>
 #include <set>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -132,6 +136,7 @@ bool CFGSCCPPass::run(Function &fn) {
     return false;
 
   bool anyChange = false;
+  cfgChanged = false;
 
   std::unordered_map<int, LatticeVal> lattice;
   std::unordered_set<BasicBlock *> reachable;
@@ -272,6 +277,30 @@ bool CFGSCCPPass::run(Function &fn) {
   // Rewrite stage
   for (auto &bbPtr : fn.getBlocks()) {
     BasicBlock *bb = bbPtr.get();
+    // every removed edge is reported right away, so the dominator tree only
+    // recomputes the subtree below the folded branch
+    auto dropEdge = [&](std::shared_ptr<BasicBlock> &edge) {
+      BasicBlock *succ = edge.get();
+      edge = nullptr;
+      cfgChanged |= succ != nullptr;
+      if (dt && succ) {
+        dt->deleteEdge(bb, succ);
+      }
+      // a successor that stays reachable keeps its phis, minus this edge
+      if (succ && bb->next.get() != succ && bb->jumpTarget.get() != succ) {
+        for (auto &inst : succ->getInstructions()) {
+          if (inst->getOp() != OpCode::PHI) {
+            continue;
+          }
+          auto &args = inst->getPhiArgs();
+          args.erase(std::remove_if(args.begin(), args.end(),
+                                    [&](const auto &arg) {
+                                      return arg.second == bb;
+                                    }),
+                     args.end());
+        }
+      }
+    };
     if (!reachable.count(bb)) {
       anyChange = true;
       continue;
@@ -356,14 +385,14 @@ bool CFGSCCPPass::run(Function &fn) {
             inst->setOp(OpCode::GOTO);
             inst->setArg1(Operand());
             inst->setArg2(Operand());
-            bb->next = nullptr;
+            dropEdge(bb->next);
             anyChange = true;
           } else {
             inst->setOp(OpCode::NOP);
             inst->setArg1(Operand());
             inst->setArg2(Operand());
             inst->setResult(Operand());
-            bb->jumpTarget = nullptr;
+            dropEdge(bb->jumpTarget);
             anyChange = true;
           }
         }
@@ -375,7 +404,7 @@ bool CFGSCCPPass::run(Function &fn) {
           inst->setArg1(Operand());
           inst->setArg2(Operand());
           inst->setResult(Operand());
-          bb->jumpTarget = nullptr;
+          dropEdge(bb->jumpTarget);
           anyChange = true;
         }
       }
@@ -384,11 +413,11 @@ bool CFGSCCPPass::run(Function &fn) {
     }
 
     if (bb->next && !reachable.count(bb->next.get())) {
-      bb->next = nullptr;
+      dropEdge(bb->next);
       anyChange = true;
     }
     if (bb->jumpTarget && !reachable.count(bb->jumpTarget.get())) {
-      bb->jumpTarget = nullptr;
+      dropEdge(bb->jumpTarget);
       anyChange = true;
     }
   }
@@ -399,15 +428,29 @@ bool CFGSCCPPass::run(Function &fn) {
     for (auto &bbPtr : fn.getBlocks()) {
       if (reachable.count(bbPtr.get())) {
         kept.push_back(bbPtr);
+      } else if (dt) {
+        dt->removeBlock(bbPtr.get());
       }
     }
     fn.getBlocks() = std::move(kept);
     anyChange = true;
+    cfgChanged = true;
   }
 
   return anyChange;
 }
 
+PreservedAnalyses CFGSCCPPass::preservedAnalyses() const {
+  if (!cfgChanged) {
+    return PreservedAnalyses::cfg();
+  }
+  auto PA = PreservedAnalyses::none();
+  if (dt) {
+    PA.preserve(AnalysisKind::DominatorTree);
+  }
+  return PA;
+}
+
 bool LocalDCEPass::run(Function &fn) {
   bool changed = false;
 
@@ -685,6 +728,351 @@ bool AlgebraicPass::run(Function &fn) {
   return changed;
 }
 
+// Reassociation
+namespace {
+
+/**
+ * @brief a value of a rebuilt tree: an operand, or the result of a step;
+ * negated values still have to be subtracted
+ */
+struct ReassocValue {
+  Operand op;
+  int step = -1;
+  bool negated = false;
+};
+
+/**
+ * @brief one instruction of a rebuilt tree
+ */
+struct ReassocStep {
+  OpCode op;
+  ReassocValue a;
+  ReassocValue b;
+  bool variant;
+};
+
+struct ReassocLeaf {
+  Operand op;
+  bool negative;
+  bool variant;
+  std::tuple<int, int, int, long long> rank;
+};
+
+bool isAdditive(OpCode op) { return op == OpCode::ADD || op == OpCode::SUB; }
+
+} // namespace
+
+bool ReassociatePass::run(Function &fn) {
+  auto &blocks = fn.getBlocks();
+  if (blocks.empty())
+    return false;
+
+  // innermost loop and nesting depth of every block
+  std::unordered_map<const BasicBlock *, const LoopInfo *> innermost;
+  std::unordered_map<const BasicBlock *, int> depth;
+  std::unordered_map<const BasicBlock *, int> order;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    order[blocks[i].get()] = static_cast<int>(i);
+  }
+  for (const auto &loop : am.getLoops(fn)) {
+    for (BasicBlock *bb : loop.blocks) {
+      depth[bb]++;
+      const LoopInfo *&inner = innermost[bb];
+      if (!inner || loop.blocks.size() < inner->blocks.size()) {
+        inner = &loop;
+      }
+    }
+  }
+
+  std::unordered_map<int, int> defCount;
+  std::unordered_map<int, int> useCount;
+  std::unordered_map<int, Instruction *> defInst;
+  std::unordered_map<int, BasicBlock *> defBlock;
+  std::unordered_map<const Instruction *, size_t> position;
+  auto addUse = [&](const Operand &op) {
+    if (op.getType() == OperandType::Temporary)
+      useCount[op.asInt()]++;
+  };
+  for (auto &bb : blocks) {
+    auto &insts = bb->getInstructions();
+    for (size_t i = 0; i < insts.size(); ++i) {
+      Instruction *inst = insts[i].get();
+      OpCode op = inst->getOp();
+      position[inst] = i;
+      if (op == OpCode::PHI) {
+        for (auto &pair : inst->getPhiArgs()) {
+          addUse(pair.first);
+        }
+      } else {
+        addUse(inst->getArg1());
+        addUse(inst->getArg2());
+      }
+      if (op == OpCode::STORE || op == OpCode::RETURN ||
+          op == OpCode::ALLOCA) {
+        addUse(inst->getResult());
+      } else if (inst->getResult().getType() == OperandType::Temporary) {
+        defCount[inst->getResult().asInt()]++;
+        defInst[inst->getResult().asInt()] = inst;
+        defBlock[inst->getResult().asInt()] = bb.get();
+      }
+    }
+  }
+  // the same value wherever it is read; an array name is its address
+  auto isValue = [&](const Operand &op) {
+    switch (op.getType()) {
+    case OperandType::ConstantInt:
+      return true;
+    case OperandType::Variable:
+      return isArraySymbol(op);
+    case OperandType::Temporary:
+      return defCount[op.asInt()] == 1;
+    default:
+      return false;
+    }
+  };
+
+  bool changed = false;
+  for (auto &bb : blocks) {
+    auto &insts = bb->getInstructions();
+    const LoopInfo *loop = innermost.count(bb.get()) ? innermost[bb.get()]
+                                                     : nullptr;
+    auto isVariant = [&](const Operand &op) {
+      if (!loop || op.getType() == OperandType::ConstantInt ||
+          isArraySymbol(op)) {
+        return false;
+      }
+      if (op.getType() != OperandType::Temporary ||
+          defCount[op.asInt()] != 1) {
+        return true;
+      }
+      return loop->blocks.count(defBlock[op.asInt()]) > 0;
+    };
+    std::unordered_set<const Instruction *> consumed;
+    // roots last: a tree is collected from its last instruction
+    for (size_t i = insts.size(); i-- > 0;) {
+      Instruction *root = insts[i].get();
+      OpCode rootOp = root->getOp();
+      if ((!isAdditive(rootOp) && rootOp != OpCode::MUL) ||
+          root->getResult().getType() != OperandType::Temporary ||
+          consumed.count(root)) {
+        continue;
+      }
+      bool additive = isAdditive(rootOp);
+      auto inTree = [&](const Operand &op) -> Instruction * {
+        if (op.getType() != OperandType::Temporary ||
+            useCount[op.asInt()] != 1 || defCount[op.asInt()] != 1) {
+          return nullptr;
+        }
+        Instruction *def = defInst[op.asInt()];
+        bool sameFamily = additive ? isAdditive(def->getOp())
+                                   : def->getOp() == OpCode::MUL;
+        if (!sameFamily || consumed.count(def) ||
+            defBlock[op.asInt()] != bb.get() ||
+            position[def] >= position[root] || !isValue(def->getArg1()) ||
+            !isValue(def->getArg2())) {
+          return nullptr;
+        }
+        return def;
+      };
+
+      // flatten: leaves with signs, constants folded as they are found
+      std::vector<ReassocLeaf> leaves;
+      std::vector<Instruction *> interior;
+      uint32_t constant = additive ? 0 : 1;
+      int nodes = 0;
+      int variantNodes = 0;
+      std::function<bool(Instruction *, bool)> flatten =
+          [&](Instruction *inst, bool negative) -> bool {
+        bool variant = false;
+        for (int k = 0; k < 2; ++k) {
+          const Operand &op = k == 0 ? inst->getArg1() : inst->getArg2();
+          bool neg = negative != (k == 1 && inst->getOp() == OpCode::SUB);
+          if (Instruction *def = inTree(op)) {
+            interior.push_back(def);
+            variant = flatten(def, neg) || variant;
+          } else if (op.getType() == OperandType::ConstantInt) {
+            uint32_t c = static_cast<uint32_t>(op.asInt());
+            if (!additive) {
+              constant *= c;
+            } else {
+              constant += neg ? 0u - c : c;
+            }
+          } else {
+            bool v = isVariant(op);
+            std::tuple<int, int, int, long long> rank{0, 0, 0, 0};
+            if (op.getType() == OperandType::Temporary) {
+              const BasicBlock *def =
+                  defCount[op.asInt()] == 1 ? defBlock[op.asInt()] : bb.get();
+              rank = {depth[def], order[def], 1, op.asInt()};
+            } else if (!isArraySymbol(op)) {
+              rank = {depth[bb.get()], order[bb.get()], 2,
+                      op.asSymbol()->id};
+            }
+            leaves.push_back({op, neg, v, rank});
+            variant = variant || v;
+          }
+        }
+        nodes++;
+        if (variant) {
+          variantNodes++;
+        }
+        return variant;
+      };
+      flatten(root, false);
+      for (Instruction *inst : interior) {
+        consumed.insert(inst);
+      }
+      if (additive) {
+        // x - x
+        for (size_t a = 0; a < leaves.size(); ++a) {
+          for (size_t b = a + 1; b < leaves.size(); ++b) {
+            if (leaves[a].op == leaves[b].op &&
+                leaves[a].negative != leaves[b].negative) {
+              leaves.erase(leaves.begin() + b);
+              leaves.erase(leaves.begin() + a);
+              --a;
+              break;
+            }
+          }
+        }
+      } else if (constant == 0) {
+        leaves.clear();
+      }
+      std::stable_sort(leaves.begin(), leaves.end(),
+                       [](const ReassocLeaf &x, const ReassocLeaf &y) {
+                         return x.rank < y.rank;
+                       });
+
+      // rebuild: invariant part first, then the variant part
+      std::vector<ReassocStep> steps;
+      auto emit = [&](OpCode op, const ReassocValue &a, const ReassocValue &b,
+                      bool variant) {
+        steps.push_back({op, a, b, variant});
+        ReassocValue v;
+        v.step = static_cast<int>(steps.size()) - 1;
+        return v;
+      };
+      auto isConst = [](const ReassocValue &v) {
+        return v.step < 0 && v.op.getType() == OperandType::ConstantInt;
+      };
+      Operand c = Operand::ConstantInt(static_cast<int>(constant));
+      auto group = [&](bool variant, bool withConstant, bool &present) {
+        std::vector<ReassocValue> pos, neg;
+        for (const auto &leaf : leaves) {
+          if (leaf.variant == variant) {
+            (leaf.negative ? neg : pos).push_back({leaf.op});
+          }
+        }
+        bool hasConst = withConstant && constant != (additive ? 0u : 1u);
+        present = !pos.empty() || !neg.empty() || hasConst;
+        ReassocValue acc{c};
+        size_t p = 0;
+        size_t n = 0;
+        if (!additive) {
+          if (!pos.empty()) {
+            acc = pos[p++];
+            if (hasConst) {
+              acc = emit(OpCode::MUL, acc, {c}, variant);
+            }
+          }
+          for (; p < pos.size(); ++p) {
+            acc = emit(OpCode::MUL, acc, pos[p], variant);
+          }
+          return acc;
+        }
+        bool negated = false;
+        if (!pos.empty()) {
+          acc = pos[p++];
+          if (hasConst) {
+            acc = emit(OpCode::ADD, acc, {c}, variant);
+          }
+        } else if (hasConst && !neg.empty()) {
+          acc = emit(OpCode::SUB, {c}, neg[n++], variant);
+        } else if (!neg.empty()) {
+          acc = neg[n++];
+          negated = true;
+        }
+        for (; p < pos.size(); ++p) {
+          acc = emit(OpCode::ADD, acc, pos[p], variant);
+        }
+        for (; n < neg.size(); ++n) {
+          acc = emit(negated ? OpCode::ADD : OpCode::SUB, acc, neg[n], variant);
+        }
+        acc.negated = negated;
+        return acc;
+      };
+      bool hasInvariant = false;
+      bool hasVariant = false;
+      ReassocValue inv = group(false, true, hasInvariant);
+      ReassocValue var = group(true, false, hasVariant);
+      ReassocValue result;
+      if (!hasVariant) {
+        result = hasInvariant ? inv : ReassocValue{c};
+      } else if (!hasInvariant) {
+        result = var;
+      } else if (!additive) {
+        result = isConst(inv) ? emit(OpCode::MUL, var, inv, true)
+                              : emit(OpCode::MUL, inv, var, true);
+      } else if (!inv.negated && !var.negated) {
+        result = isConst(inv) ? emit(OpCode::ADD, var, inv, true)
+                              : emit(OpCode::ADD, inv, var, true);
+      } else if (!inv.negated) {
+        result = emit(OpCode::SUB, inv, var, true);
+      } else if (!var.negated) {
+        result = emit(OpCode::SUB, var, inv, true);
+      } else {
+        result = emit(OpCode::ADD, inv, var, true);
+        result.negated = true;
+      }
+      if (result.negated) {
+        result = emit(OpCode::NEG, result, {}, hasVariant);
+      }
+
+      int newVariant = 0;
+      for (const auto &step : steps) {
+        newVariant += step.variant ? 1 : 0;
+      }
+      int total = static_cast<int>(steps.size());
+      if (newVariant > variantNodes ||
+          (newVariant == variantNodes && total >= nodes)) {
+        continue;
+      }
+
+      std::vector<Operand> results(steps.size());
+      auto operandOf = [&](const ReassocValue &v) {
+        return v.step < 0 ? v.op : results[v.step];
+      };
+      std::vector<std::unique_ptr<Instruction>> code;
+      for (size_t s = 0; s + 1 < steps.size(); ++s) {
+        results[s] = Operand::Temporary(fn.allocateTemp());
+        code.push_back(std::make_unique<Instruction>(
+            steps[s].op, operandOf(steps[s].a), operandOf(steps[s].b),
+            results[s]));
+      }
+      if (result.step < 0) {
+        root->setOp(OpCode::ASSIGN);
+        root->setArg1(result.op);
+        root->setArg2(Operand());
+      } else {
+        const ReassocStep &last = steps.back();
+        root->setOp(last.op);
+        root->setArg1(operandOf(last.a));
+        root->setArg2(operandOf(last.b));
+      }
+      for (Instruction *inst : interior) {
+        inst->setOp(OpCode::NOP);
+        inst->setArg1(Operand());
+        inst->setArg2(Operand());
+        inst->setResult(Operand());
+      }
+      insts.insert(insts.begin() + i, std::make_move_iterator(code.begin()),
+                   std::make_move_iterator(code.end()));
+      changed = true;
+    }
+  }
+  return changed;
+}
+
 bool CopyPropPass::run(Function &fn) {
   bool changed = false;
   std::unordered_map<int, Operand> copyMap;
@@ -709,6 +1097,8 @@ bool CopyPropPass::run(Function &fn) {
       return a.asInt() == b.asInt();
     case OperandType::Variable:
       return a.asSymbol() == b.asSymbol();
+    case OperandType::Empty:
+      return true;
     default:
       return false;
     }
@@ -768,94 +1158,601 @@ bool CopyPropPass::run(Function &fn) {
   return changed;
 }
 
-bool MemoryLoadElimPass::run(Function &fn) {
-  bool changed = false;
+// Load forwarding
+namespace {
+
+/**
+ * @brief a scalar variable, or an array element when scalar is null
+ */
+struct MemLoc {
+  const Symbol *scalar;
+  MemoryLocation element;
+  bool operator==(const MemLoc &o) const {
+    return scalar == o.scalar && element == o.element;
+  }
+};
 
-  struct AddrKey {
-    const Symbol *sym;
-    int idx;
-    bool hasIdx;
-    bool operator==(const AddrKey &o) const {
-      return sym == o.sym && idx == o.idx && hasIdx == o.hasIdx;
+struct MemLocHash {
+  size_t operator()(const MemLoc &k) const {
+    return std::hash<const Symbol *>{}(k.scalar) ^
+           (MemoryLocationHash{}(k.element) << 1);
+  }
+};
+
+/**
+ * @brief available locations and the operand holding each one; an empty
+ * operand stands for the value the location had on entry to the block
+ */
+using MemValues = std::unordered_map<MemLoc, Operand, MemLocHash>;
+
+std::vector<BasicBlock *> cfgSuccessors(BasicBlock *bb) {
+  std::vector<BasicBlock *> succs;
+  auto &insts = bb->getInstructions();
+  OpCode last = insts.empty() ? OpCode::NOP : insts.back()->getOp();
+  if (last == OpCode::RETURN) {
+    return succs;
+  }
+  if ((last == OpCode::GOTO || last == OpCode::IF) && bb->jumpTarget) {
+    succs.push_back(bb->jumpTarget.get());
+  }
+  if (last != OpCode::GOTO && bb->next &&
+      std::find(succs.begin(), succs.end(), bb->next.get()) == succs.end()) {
+    succs.push_back(bb->next.get());
+  }
+  return succs;
+}
+
+/**
+ * @brief a scalar variable; string literals have no type
+ */
+bool isMemScalar(const Operand &op) {
+  if (op.getType() != OperandType::Variable) {
+    return false;
+  }
+  const auto &sym = op.asSymbol();
+  return sym && sym->type && sym->type->category == Type::Category::Basic;
+}
+
+bool isForwardable(const Operand &op) {
+  return op.getType() == OperandType::Temporary ||
+         op.getType() == OperandType::ConstantInt;
+}
+
+/**
+ * @class LoadForwarding
+ * @brief available loads over the CFG of one function, then the rewrite
+ *
+ * A first pass computes which locations are available on entry to each
+ * block (intersection over the predecessors). The rewrite then walks the
+ * blocks in reverse postorder and asks for the value of a location on
+ * entry lazily: a single predecessor passes on its own value, a merge
+ * whose predecessors agree takes that value, and any other merge gets a
+ * phi. Phi arguments from back edges are filled in once every block has
+ * been walked.
+ */
+class LoadForwarding {
+public:
+  LoadForwarding(Function &fn, const std::vector<BasicBlock *> &rpo,
+                 const ModRefAnalysis &modRef)
+      : fn(fn), rpo(rpo), modRef(modRef) {}
+
+  bool run() {
+    aa.run(fn);
+    for (BasicBlock *bb : rpo) {
+      for (BasicBlock *succ : cfgSuccessors(bb)) {
+        preds[succ].push_back(bb);
+      }
     }
-  };
-  struct AddrHash {
-    size_t operator()(const AddrKey &k) const {
-      return std::hash<const Symbol *>{}(k.sym) ^
-             (std::hash<int>{}(k.idx) << 1) ^ (k.hasIdx ? 0x9e3779b1 : 0);
+    analyze();
+    computeAvailable();
+
+    rewriting = true;
+    out.clear();
+    for (BasicBlock *bb : rpo) {
+      MemValues state = in[bb];
+      transfer(bb, state);
+      out[bb] = std::move(state);
+      done.insert(bb);
     }
+    for (size_t i = 0; i < pending.size(); ++i) {
+      auto [phi, pred, loc] = pending[i];
+      phi->addPhiArg(endValue(pred, loc), pred);
+    }
+    finishPhis();
+    unloadSingleUses();
+    return rewrites > 0;
+  }
+
+private:
+  Function &fn;
+  const std::vector<BasicBlock *> &rpo;
+  const ModRefAnalysis &modRef;
+  std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> preds;
+  AliasAnalysis aa;
+  /**
+   * @brief locations of the accesses, taken before loads become copies
+   */
+  std::unordered_map<const Instruction *, MemoryLocation> locations;
+  /**
+   * @brief scalars read more than once, worth keeping in a temp
+   */
+  std::unordered_set<const Symbol *> shared;
+
+  std::unordered_map<BasicBlock *, MemValues> in;
+  std::unordered_map<BasicBlock *, MemValues> out;
+  std::unordered_set<BasicBlock *> done;
+  std::unordered_map<BasicBlock *, MemValues> entry;
+  std::unordered_map<BasicBlock *, std::vector<std::unique_ptr<Instruction>>>
+      phis;
+  std::vector<std::tuple<Instruction *, BasicBlock *, MemLoc>> pending;
+  std::unordered_map<int, Operand> replaced;
+  /**
+   * @brief scalar loads put in front of a read, and that read
+   */
+  struct Loaded {
+    BasicBlock *bb;
+    Instruction *load;
+    Instruction *user;
+    int pos;
   };
+  std::vector<Loaded> loaded;
+  bool rewriting = false;
+  int rewrites = 0;
 
-  for (auto &blk : fn.getBlocks()) {
-    std::unordered_map<AddrKey, Operand, AddrHash> avail;
+  void analyze() {
+    std::unordered_map<const Symbol *, int> reads;
+    for (auto &bb : fn.getBlocks()) {
+      for (auto &inst : bb->getInstructions()) {
+        for (int pos : readPositions(*inst)) {
+          if (isMemScalar(operandAt(*inst, pos))) {
+            ++reads[operandAt(*inst, pos).asSymbol().get()];
+          }
+        }
+      }
+    }
+    for (auto &[sym, n] : reads) {
+      if (n > 1) {
+        shared.insert(sym);
+      }
+    }
+  }
 
-    auto killBase = [&](const Symbol *sym) {
-      for (auto it = avail.begin(); it != avail.end();) {
-        if (it->first.sym == sym) {
-          it = avail.erase(it);
-        } else {
-          ++it;
+  static bool resultIsUse(OpCode op) {
+    return op == OpCode::STORE || op == OpCode::RETURN;
+  }
+
+  static const Operand &operandAt(const Instruction &inst, int pos) {
+    return pos == 0 ? inst.getArg1() : pos == 1 ? inst.getArg2()
+                                                : inst.getResult();
+  }
+
+  static void setOperandAt(Instruction &inst, int pos, const Operand &v) {
+    if (pos == 0) {
+      inst.setArg1(v);
+    } else if (pos == 1) {
+      inst.setArg2(v);
+    } else {
+      inst.setResult(v);
+    }
+  }
+
+  /**
+   * @brief operand positions an instruction reads as values; array names
+   * there are addresses, any other variable a scalar read
+   */
+  static std::vector<int> readPositions(const Instruction &inst) {
+    switch (inst.getOp()) {
+    case OpCode::LOAD:
+      return {1};
+    case OpCode::STORE:
+      return {0, 2};
+    case OpCode::RETURN:
+      return {2};
+    case OpCode::ALLOCA:
+    case OpCode::LABEL:
+    case OpCode::GOTO:
+    case OpCode::PARAM:
+    case OpCode::CALL:
+    case OpCode::PHI:
+    case OpCode::NOP:
+      return {};
+    default:
+      return {0, 1};
+    }
+  }
+
+  MemoryLocation locationOf(const Instruction &inst, const Operand &base,
+                            const Operand &idx) {
+    auto it = locations.find(&inst);
+    if (it == locations.end()) {
+      it = locations.emplace(&inst, aa.getLocation(base, idx)).first;
+    }
+    return it->second;
+  }
+
+  template <typename Pred> static void killIf(MemValues &state, Pred pred) {
+    for (auto it = state.begin(); it != state.end();) {
+      if (pred(it->first)) {
+        it = state.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  static void record(MemValues &state, const MemLoc &loc, const Operand &v) {
+    if (isForwardable(v)) {
+      state[loc] = v;
+    } else {
+      state.erase(loc);
+    }
+  }
+
+  void computeAvailable() {
+    bool more = true;
+    while (more) {
+      more = false;
+      for (BasicBlock *bb : rpo) {
+        MemValues state;
+        bool first = true;
+        if (bb != rpo.front()) {
+          for (BasicBlock *pred : preds[bb]) {
+            auto it = out.find(pred);
+            if (it == out.end()) {
+              continue;
+            }
+            if (first) {
+              state = it->second;
+              first = false;
+            } else {
+              killIf(state, [&](const MemLoc &loc) {
+                return !it->second.count(loc);
+              });
+            }
+          }
+        }
+        for (auto &entry : state) {
+          entry.second = Operand();
+        }
+        in[bb] = state;
+        transfer(bb, state);
+        auto it = out.find(bb);
+        if (it == out.end() || it->second.size() != state.size()) {
+          out[bb] = std::move(state);
+          more = true;
         }
       }
-    };
+    }
+  }
 
-    for (auto &instPtr : blk->getInstructions()) {
-      Instruction *inst = instPtr.get();
+  void transfer(BasicBlock *bb, MemValues &state) {
+    auto &insts = bb->getInstructions();
+    for (size_t i = 0; i < insts.size(); ++i) {
+      Instruction *inst = insts[i].get();
       OpCode op = inst->getOp();
-
-      if (op == OpCode::STORE) {
-        const Operand &base = inst->getArg2();
-        const Operand &idx = inst->getResult();
-        if (base.getType() == OperandType::Variable) {
-          auto sym = base.asSymbol().get();
-          if (idx.getType() == OperandType::Empty ||
-              (idx.getType() == OperandType::ConstantInt)) {
-            AddrKey k{sym,
-                      idx.getType() == OperandType::ConstantInt ? idx.asInt()
-                                                                : 0,
-                      idx.getType() == OperandType::ConstantInt};
-            avail[k] = inst->getArg1();
-          } else {
-            killBase(sym);
+      const Operand &res = inst->getResult();
+      if (res.getType() == OperandType::Temporary && !resultIsUse(op)) {
+        // elements addressed through the old value are out of reach
+        killIf(state, [&](const MemLoc &loc) {
+          return !loc.scalar && (loc.element.base == res.asInt() ||
+                                 loc.element.index == res.asInt());
+        });
+      }
+      if (op == OpCode::LABEL || op == OpCode::PHI) {
+        continue;
+      }
+      // a copy out of a scalar is its load
+      if (op == OpCode::ASSIGN && isMemScalar(inst->getArg1()) &&
+          inst->getResult().getType() == OperandType::Temporary) {
+        MemLoc loc{inst->getArg1().asSymbol().get(), {}};
+        if (state.count(loc)) {
+          if (rewriting) {
+            inst->setArg1(valueOf(bb, state, loc));
+            ++rewrites;
           }
+        } else {
+          state[loc] = inst->getResult();
         }
         continue;
       }
+      for (int pos : readPositions(*inst)) {
+        const Operand &o = operandAt(*inst, pos);
+        if (!isMemScalar(o)) {
+          continue;
+        }
+        MemLoc loc{o.asSymbol().get(), {}};
+        if (!state.count(loc)) {
+          if (!shared.count(loc.scalar)) {
+            continue;
+          }
+          // read again later: load it once into a temp
+          Operand t;
+          if (rewriting) {
+            t = Operand::Temporary(fn.allocateTemp());
+            insts.insert(insts.begin() + i,
+                         std::make_unique<Instruction>(
+                             Instruction::MakeAssign(o, t)));
+            loaded.push_back({bb, insts[i].get(), inst, pos});
+            ++i;
+            // only a change once another read takes the temp
+            --rewrites;
+          }
+          state[loc] = t;
+        }
+        if (rewriting) {
+          setOperandAt(*inst, pos, valueOf(bb, state, loc));
+          ++rewrites;
+        }
+      }
 
-      if (op == OpCode::LOAD) {
-        const Operand &base = inst->getArg1();
+      switch (op) {
+      case OpCode::LOAD: {
         const Operand &idx = inst->getArg2();
-        if (base.getType() == OperandType::Variable) {
-          auto sym = base.asSymbol().get();
-          if (idx.getType() == OperandType::Empty ||
-              idx.getType() == OperandType::ConstantInt) {
-            AddrKey k{sym,
-                      idx.getType() == OperandType::ConstantInt ? idx.asInt()
-                                                                : 0,
-                      idx.getType() == OperandType::ConstantInt};
-            auto it = avail.find(k);
-            if (it != avail.end()) {
-              Operand val = it->second;
-              inst->setOp(OpCode::ASSIGN);
-              inst->setArg1(val);
-              inst->setArg2(Operand());
-              changed = true;
-              continue;
-            }
+        MemLoc loc{};
+        if (isMemScalar(inst->getArg1()) &&
+            idx.getType() == OperandType::Empty) {
+          loc = {inst->getArg1().asSymbol().get(), {}};
+        } else if (isArraySymbol(inst->getArg1()) &&
+                   idx.getType() == OperandType::Empty) {
+          // an address, or the pointer of an array parameter
+          break;
+        } else {
+          loc = {nullptr, locationOf(*inst, inst->getArg1(), idx)};
+          if (!loc.element.isExact()) {
+            break;
+          }
+        }
+        if (state.count(loc)) {
+          if (rewriting) {
+            inst->setOp(OpCode::ASSIGN);
+            inst->setArg1(valueOf(bb, state, loc));
+            inst->setArg2(Operand());
+            ++rewrites;
           }
-          killBase(sym);
+        } else if (inst->getResult().getType() == OperandType::Temporary) {
+          state[loc] = inst->getResult();
+        }
+        break;
+      }
+      case OpCode::STORE: {
+        const Operand &base = inst->getArg2();
+        const Operand &idx = inst->getResult();
+        if (isMemScalar(base)) {
+          record(state, {base.asSymbol().get(), {}}, inst->getArg1());
+          break;
+        }
+        if (isArraySymbol(base) && idx.getType() == OperandType::Empty) {
+          // the slot of an array parameter being set
+          const Symbol *sym = base.asSymbol().get();
+          killIf(state, [&](const MemLoc &loc) {
+            return !loc.scalar && (loc.element.object == sym ||
+                                   !loc.element.object);
+          });
+          break;
         }
+        MemoryLocation stored = locationOf(*inst, base, idx);
+        killIf(state, [&](const MemLoc &loc) {
+          return !loc.scalar && !(loc.element == stored) &&
+                 aa.alias(loc.element, stored) != AliasResult::NoAlias;
+        });
+        if (stored.isExact()) {
+          record(state, {nullptr, stored}, inst->getArg1());
+        }
+        break;
+      }
+      case OpCode::CALL:
+        killIf(state, [&](const MemLoc &loc) {
+          return loc.scalar ? modRef.mayWrite(*inst, loc.scalar)
+                            : modRef.mayWrite(*inst, loc.element, aa);
+        });
+        break;
+      default:
+        break;
+      }
+      if (op != OpCode::STORE && op != OpCode::RETURN &&
+          isMemScalar(inst->getResult())) {
+        MemLoc loc{inst->getResult().asSymbol().get(), {}};
+        if (op == OpCode::ASSIGN) {
+          record(state, loc, inst->getArg1());
+        } else {
+          state.erase(loc);
+        }
+      }
+    }
+  }
+
+  Operand valueOf(BasicBlock *bb, MemValues &state, const MemLoc &loc) {
+    Operand &v = state[loc];
+    if (v.getType() == OperandType::Empty) {
+      v = entryValue(bb, loc);
+    }
+    return v;
+  }
+
+  Operand endValue(BasicBlock *bb, const MemLoc &loc) {
+    Operand &v = out[bb][loc];
+    if (v.getType() == OperandType::Empty) {
+      v = entryValue(bb, loc);
+    }
+    return v;
+  }
+
+  Operand entryValue(BasicBlock *bb, const MemLoc &loc) {
+    auto &memo = entry[bb];
+    auto it = memo.find(loc);
+    if (it != memo.end()) {
+      return it->second;
+    }
+    const auto &ps = preds[bb];
+    if (ps.size() == 1 && done.count(ps[0])) {
+      Operand v = endValue(ps[0], loc);
+      entry[bb][loc] = v;
+      return v;
+    }
+    // the phi is known before its arguments, which may lead back here
+    Operand t = Operand::Temporary(fn.allocateTemp());
+    auto phi = std::make_unique<Instruction>(Instruction::MakePhi(t));
+    Instruction *raw = phi.get();
+    phis[bb].push_back(std::move(phi));
+    memo[loc] = t;
+    bool complete = true;
+    for (BasicBlock *pred : ps) {
+      if (done.count(pred)) {
+        raw->addPhiArg(endValue(pred, loc), pred);
+      } else {
+        pending.push_back({raw, pred, loc});
+        complete = false;
+      }
+    }
+    if (complete) {
+      Operand same = trivialValue(*raw);
+      if (same.getType() != OperandType::Empty) {
+        replaced[t.asInt()] = same;
+        entry[bb][loc] = same;
+        return same;
+      }
+    }
+    return t;
+  }
+
+  /**
+   * @brief the one value a phi merges apart from itself, if any
+   */
+  static Operand trivialValue(const Instruction &phi) {
+    Operand same;
+    for (const auto &pair : phi.getPhiArgs()) {
+      if (pair.first == phi.getResult() || pair.first == same) {
         continue;
       }
+      if (same.getType() != OperandType::Empty) {
+        return Operand();
+      }
+      same = pair.first;
+    }
+    return same;
+  }
 
-      if (op == OpCode::CALL) {
-        avail.clear();
+  Operand substitute(const Operand &op) const {
+    Operand v = op;
+    while (v.getType() == OperandType::Temporary) {
+      auto it = replaced.find(v.asInt());
+      if (it == replaced.end()) {
+        break;
+      }
+      v = it->second;
+    }
+    return v;
+  }
+
+  /**
+   * @brief a scalar loaded for a single read goes back into that read, so
+   * the next run sees the same code
+   */
+  void unloadSingleUses() {
+    std::unordered_map<int, int> uses;
+    for (const Loaded &l : loaded) {
+      uses[l.load->getResult().asInt()] = 0;
+    }
+    auto count = [&](const Operand &o) {
+      if (o.getType() == OperandType::Temporary) {
+        auto it = uses.find(o.asInt());
+        if (it != uses.end()) {
+          ++it->second;
+        }
+      }
+    };
+    for (auto &bb : fn.getBlocks()) {
+      for (auto &inst : bb->getInstructions()) {
+        for (const auto &pair : inst->getPhiArgs()) {
+          count(pair.first);
+        }
+        count(inst->getArg1());
+        count(inst->getArg2());
+        if (resultIsUse(inst->getOp())) {
+          count(inst->getResult());
+        }
+      }
+    }
+    for (const Loaded &l : loaded) {
+      if (uses[l.load->getResult().asInt()] != 1) {
         continue;
       }
+      setOperandAt(*l.user, l.pos, l.load->getArg1());
+      auto &insts = l.bb->getInstructions();
+      insts.erase(std::find_if(insts.begin(), insts.end(), [&](auto &inst) {
+        return inst.get() == l.load;
+      }));
     }
   }
 
-  return changed;
+  /**
+   * @brief drop phis that merge one value, then place the rest after the
+   * phis already in their blocks
+   */
+  void finishPhis() {
+    for (auto &[bb, list] : phis) {
+      for (auto &phi : list) {
+        if (replaced.count(phi->getResult().asInt())) {
+          continue;
+        }
+        for (auto &pair : phi->getPhiArgs()) {
+          pair.first = substitute(pair.first);
+        }
+        Operand same = trivialValue(*phi);
+        if (same.getType() != OperandType::Empty) {
+          replaced[phi->getResult().asInt()] = same;
+        }
+      }
+    }
+    if (!replaced.empty()) {
+      for (auto &bb : fn.getBlocks()) {
+        for (auto &inst : bb->getInstructions()) {
+          if (inst->getOp() == OpCode::PHI) {
+            for (auto &pair : inst->getPhiArgs()) {
+              pair.first = substitute(pair.first);
+            }
+            continue;
+          }
+          for (int pos = 0; pos < 3; ++pos) {
+            const Operand &o = operandAt(*inst, pos);
+            if (o.getType() == OperandType::Temporary &&
+                replaced.count(o.asInt()) &&
+                (pos < 2 || resultIsUse(inst->getOp()))) {
+              setOperandAt(*inst, pos, substitute(o));
+            }
+          }
+        }
+      }
+    }
+    for (auto &[bb, list] : phis) {
+      auto &insts = bb->getInstructions();
+      auto pos = insts.begin();
+      while (pos != insts.end() && ((*pos)->getOp() == OpCode::LABEL ||
+                                    (*pos)->getOp() == OpCode::PHI)) {
+        ++pos;
+      }
+      for (auto &phi : list) {
+        if (replaced.count(phi->getResult().asInt())) {
+          continue;
+        }
+        for (auto &pair : phi->getPhiArgs()) {
+          pair.first = substitute(pair.first);
+        }
+        pos = insts.insert(pos, std::move(phi)) + 1;
+      }
+    }
+  }
+};
+
+} // namespace
+
+bool MemoryLoadElimPass::run(Function &fn) {
+  if (fn.getBlocks().empty()) {
+    return false;
+  }
+  return LoadForwarding(fn, am.getDominatorTree(fn).getReversePostOrder(),
+                        modRef)
+      .run();
 }
 
 // Helper to check if an operand is loop-invariant
@@ -879,228 +1776,373 @@ isOperandInvariant(const Operand &op,
   return false;
 }
 
-// CSE Pass implementation
-size_t CSEPass::ExpressionHash::operator()(
-    const std::pair<OpCode, std::pair<Operand, Operand>> &expr) const {
-  size_t h1 = std::hash<int>{}(static_cast<int>(expr.first));
-
-  auto hashOperand = [](const Operand &op) {
-    switch (op.getType()) {
-    case OperandType::ConstantInt:
-      return std::hash<int>{}(op.asInt());
-    case OperandType::Temporary:
-      return std::hash<int>{}(op.asInt() +
-                              1000000); // Offset to distinguish from constants
-    case OperandType::Variable:
-      return std::hash<void *>{}(op.asSymbol().get());
-    default:
-      return std::hash<int>{}(0);
-    }
-  };
-
-  size_t h2 = hashOperand(expr.second.first);
-  size_t h3 = hashOperand(expr.second.second);
+// GVN Pass implementation
+namespace {
+
+/**
+ * @brief an operand as plain integers, for keys
+ */
+void appendOperand(std::vector<long long> &key, const Operand &op) {
+  key.push_back(static_cast<long long>(op.getType()));
+  switch (op.getType()) {
+  case OperandType::ConstantInt:
+  case OperandType::Temporary:
+    key.push_back(op.asInt());
+    break;
+  case OperandType::Variable:
+    key.push_back(reinterpret_cast<intptr_t>(op.asSymbol().get()));
+    break;
+  default:
+    key.push_back(0);
+    break;
+  }
+}
 
-  return h1 ^ (h2 << 1) ^ (h3 << 2);
+bool isCommutative(OpCode op) {
+  return op == OpCode::ADD || op == OpCode::MUL || op == OpCode::EQ ||
+         op == OpCode::NEQ || op == OpCode::AND || op == OpCode::OR;
 }
 
-bool CSEPass::ExpressionEqual::operator()(
-    const std::pair<OpCode, std::pair<Operand, Operand>> &lhs,
-    const std::pair<OpCode, std::pair<Operand, Operand>> &rhs) const {
-  if (lhs.first != rhs.first) {
+bool isNumberedOp(OpCode op) {
+  switch (op) {
+  case OpCode::ADD:
+  case OpCode::SUB:
+  case OpCode::MUL:
+  case OpCode::DIV:
+  case OpCode::MOD:
+  case OpCode::NEG:
+  case OpCode::EQ:
+  case OpCode::NEQ:
+  case OpCode::LT:
+  case OpCode::LE:
+  case OpCode::GT:
+  case OpCode::GE:
+  case OpCode::AND:
+  case OpCode::OR:
+  case OpCode::NOT:
+    return true;
+  default:
     return false;
   }
-
-  auto operandsEqual = [](const Operand &op1, const Operand &op2) {
-    if (op1.getType() != op2.getType()) {
-      return false;
-    }
-    switch (op1.getType()) {
-    case OperandType::ConstantInt:
-    case OperandType::Temporary:
-      return op1.asInt() == op2.asInt();
-    case OperandType::Variable:
-      return op1.asSymbol() == op2.asSymbol();
-    default:
-      return true;
-    }
-  };
-
-  return operandsEqual(lhs.second.first, rhs.second.first) &&
-         operandsEqual(lhs.second.second, rhs.second.second);
 }
 
-class ScopedExprMap {
+/**
+ * @brief expression table whose entries are dropped when the dominator
+ * subtree that added them is left
+ */
+class ScopedValueTable {
 public:
-  using ExprKey = std::pair<OpCode, std::pair<Operand, Operand>>;
-
-  struct Hash {
-    size_t operator()(const ExprKey &k) const {
-      size_t h1 = std::hash<int>{}(static_cast<int>(k.first));
-      auto hashOp = [](const Operand &op) -> size_t {
-        size_t h = std::hash<int>{}(static_cast<int>(op.getType()));
-        switch (op.getType()) {
-        case OperandType::Temporary:
-        case OperandType::ConstantInt:
-          h ^= std::hash<size_t>{}(op.asInt() << 1);
-          break;
-        case OperandType::Variable:
-          h ^= (std::hash<void *>{}(op.asSymbol().get()) << 1);
-          break;
-        default:
-          break;
-        }
-        return h;
-      };
-      size_t h2 = hashOp(k.second.first);
-      size_t h3 = hashOp(k.second.second);
-      bool commutative = (k.first == OpCode::ADD || k.first == OpCode::MUL ||
-                          k.first == OpCode::EQ || k.first == OpCode::NEQ ||
-                          k.first == OpCode::AND || k.first == OpCode::OR);
-      if (commutative && h2 > h3)
-        std::swap(h2, h3);
-      return h1 ^ (h2 << 1) ^ (h3 << 2);
-    }
-  };
-
-  struct Equal {
-    bool operator()(const ExprKey &lhs, const ExprKey &rhs) const {
-      if (lhs.first != rhs.first)
-        return false;
-
-      const Operand &l1 = lhs.second.first;
-      const Operand &l2 = lhs.second.second;
-      const Operand &r1 = rhs.second.first;
-      const Operand &r2 = rhs.second.second;
-
-      bool commutative =
-          (lhs.first == OpCode::ADD || lhs.first == OpCode::MUL ||
-           lhs.first == OpCode::EQ || lhs.first == OpCode::NEQ ||
-           lhs.first == OpCode::AND || lhs.first == OpCode::OR);
-
-      if (commutative) {
-        return (l1 == r1 && l2 == r2) || (l1 == r2 && l2 == r1);
-      } else {
-        return l1 == r1 && l2 == r2;
-      }
-    }
-  };
-
   void enterScope() { scopeStack.push_back(history.size()); }
   void exitScope() {
     size_t limit = scopeStack.back();
     scopeStack.pop_back();
     while (history.size() > limit) {
-      auto &kv = history.back();
-      map.erase(kv.first);
+      table.erase(history.back());
       history.pop_back();
     }
   }
-  void insert(ExprKey k, int temp) {
-    if (map.find(k) == map.end()) {
-      map[k] = temp;
-      history.push_back({k, temp});
-    }
+  const Operand *lookup(const std::vector<long long> &key) const {
+    auto it = table.find(key);
+    return it == table.end() ? nullptr : &it->second;
   }
-  int lookup(ExprKey k) {
-    auto it = map.find(k);
-    return it != map.end() ? it->second : -1;
+  void insert(const std::vector<long long> &key, const Operand &value) {
+    if (table.emplace(key, value).second) {
+      history.push_back(key);
+    }
   }
 
 private:
-  std::unordered_map<ExprKey, int, Hash, Equal> map;
-  std::vector<std::pair<ExprKey, int>> history;
+  std::map<std::vector<long long>, Operand> table;
+  std::vector<std::vector<long long>> history;
   std::vector<size_t> scopeStack;
 };
 
-bool CSEPass::run(Function &fn) {
+} // namespace
+
+bool GVNPass::run(Function &fn) {
   if (fn.getBlocks().empty())
     return false;
 
-  bool changed = false;
-  std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> domChildren;
-  BasicBlock *root = fn.getBlocks().front().get();
-
-  for (auto &bb_ptr : fn.getBlocks()) {
-    BasicBlock *bb = bb_ptr.get();
-    if (bb == root)
-      continue;
-
-    BasicBlock *idom = dt.getImmediateDominator(bb);
-    if (idom) {
-      domChildren[idom].push_back(bb);
+  // only single-definition temps carry one value everywhere
+  std::unordered_map<int, int> defCount;
+  for (auto &bb : fn.getBlocks()) {
+    for (auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op != OpCode::STORE && op != OpCode::RETURN &&
+          inst->getResult().getType() == OperandType::Temporary) {
+        defCount[inst->getResult().asInt()]++;
+      }
     }
   }
+  // value number of a temp: the first operand found to hold its value
+  std::unordered_map<int, Operand> leader;
+  auto numberOf = [&](const Operand &op) -> Operand {
+    if (op.getType() != OperandType::Temporary) {
+      return op;
+    }
+    auto it = leader.find(op.asInt());
+    return it == leader.end() ? op : it->second;
+  };
+  auto isScalarVar = [](const Operand &op) {
+    return op.getType() == OperandType::Variable && !isArraySymbol(op);
+  };
+  // the same value wherever it is read; an array name is its address
+  auto isValue = [&](const Operand &op) {
+    if (op.getType() == OperandType::Temporary) {
+      return defCount[op.asInt()] == 1;
+    }
+    return op.getType() == OperandType::ConstantInt ||
+           op.getType() == OperandType::Empty ||
+           (op.getType() == OperandType::Variable && !isScalarVar(op));
+  };
 
-  ScopedExprMap exprMap;
+  bool changed = false;
+  std::vector<std::pair<BasicBlock *, Instruction *>> deadPhis;
+  const DominatorTree &dt = am.getDominatorTree(fn);
+  ScopedValueTable table;
+  // global scalars read as operands are only numbered within one stretch
+  // without writes or calls
+  long long memoryEpoch = 0;
   std::function<void(BasicBlock *)> visit = [&](BasicBlock *bb) {
-    exprMap.enterScope();
+    table.enterScope();
+    ++memoryEpoch;
+    std::vector<Instruction *> pendingArgs;
 
-    for (auto &inst : bb->getInstructions()) {
-      if (!inst)
-        continue;
+    for (auto &instPtr : bb->getInstructions()) {
+      Instruction *inst = instPtr.get();
       OpCode op = inst->getOp();
+      const Operand &res = inst->getResult();
+      bool numbered = res.getType() == OperandType::Temporary &&
+                      defCount[res.asInt()] == 1;
 
-      if (op == OpCode::ADD || op == OpCode::SUB || op == OpCode::MUL ||
-          op == OpCode::DIV || op == OpCode::MOD || op == OpCode::EQ ||
-          op == OpCode::NEQ || op == OpCode::LT || op == OpCode::LE ||
-          op == OpCode::GT || op == OpCode::GE || op == OpCode::AND ||
-          op == OpCode::OR) {
-
-        if (inst->getArg1().getType() == OperandType::Variable ||
-            inst->getArg2().getType() == OperandType::Variable) {
+      if (op == OpCode::ARG) {
+        pendingArgs.push_back(inst);
+        continue;
+      }
+      if (op == OpCode::CALL) {
+        std::vector<Instruction *> args;
+        args.swap(pendingArgs);
+        if (!modRef.isReadOnly(*inst)) {
+          ++memoryEpoch;
           continue;
         }
-        std::pair<OpCode, std::pair<Operand, Operand>> key = {
-            op, {inst->getArg1(), inst->getArg2()}};
-        int existing = exprMap.lookup(key);
-
-        if (existing != -1) {
+        if (!numbered ||
+            args.size() != static_cast<size_t>(inst->getArg1().asInt())) {
+          continue;
+        }
+        // a call that writes nothing is an expression over its callee and
+        // arguments; one that reads changing memory only within a stretch
+        std::vector<long long> key{static_cast<long long>(OpCode::CALL)};
+        appendOperand(key, inst->getArg2());
+        bool readsMemory = !modRef.isPure(*inst);
+        bool valid = true;
+        for (Instruction *arg : args) {
+          Operand a = numberOf(arg->getArg1());
+          if (!isValue(a) && !isScalarVar(a)) {
+            valid = false;
+            break;
+          }
+          readsMemory |= isScalarVar(a);
+          appendOperand(key, a);
+        }
+        if (!valid) {
+          continue;
+        }
+        key.push_back(readsMemory ? memoryEpoch : -1);
+        if (const Operand *found = table.lookup(key)) {
+          leader[res.asInt()] = *found;
           inst->setOp(OpCode::ASSIGN);
-          inst->setArg1(Operand::Temporary(existing));
+          inst->setArg1(*found);
           inst->setArg2(Operand());
+          for (Instruction *arg : args) {
+            arg->setOp(OpCode::NOP);
+            arg->setArg1(Operand());
+          }
           changed = true;
         } else {
-          if (inst->getResult().getType() == OperandType::Temporary) {
-            exprMap.insert(key, inst->getResult().asInt());
+          table.insert(key, res);
+        }
+        continue;
+      }
+
+      if (op == OpCode::PHI) {
+        if (!numbered) {
+          continue;
+        }
+        // all incoming values equal, ignoring the phi itself
+        std::vector<std::pair<BasicBlock *, Operand>> args;
+        Operand same;
+        bool allSame = true;
+        for (const auto &pair : inst->getPhiArgs()) {
+          Operand v = numberOf(pair.first);
+          args.push_back({pair.second, v});
+          if (v == res) {
+            continue;
+          }
+          if (same.getType() == OperandType::Empty) {
+            same = v;
+          } else if (v != same) {
+            allSame = false;
+          }
+        }
+        if (allSame && same.getType() != OperandType::Empty &&
+            isValue(same)) {
+          leader[res.asInt()] = same;
+          deadPhis.push_back({bb, inst});
+          continue;
+        }
+        std::sort(args.begin(), args.end(),
+                  [](const std::pair<BasicBlock *, Operand> &a,
+                     const std::pair<BasicBlock *, Operand> &b) {
+                    return std::less<BasicBlock *>()(a.first, b.first);
+                  });
+        std::vector<long long> key{static_cast<long long>(OpCode::PHI),
+                                   reinterpret_cast<intptr_t>(bb)};
+        for (auto &arg : args) {
+          key.push_back(reinterpret_cast<intptr_t>(arg.first));
+          appendOperand(key, arg.second);
+        }
+        if (const Operand *found = table.lookup(key)) {
+          leader[res.asInt()] = *found;
+          deadPhis.push_back({bb, inst});
+        } else {
+          table.insert(key, res);
+        }
+        continue;
+      }
+
+      if (op == OpCode::ASSIGN && numbered && !isScalarVar(inst->getArg1()) &&
+          isValue(inst->getArg1())) {
+        leader[res.asInt()] = numberOf(inst->getArg1());
+        continue;
+      }
+
+      if (numbered && isNumberedOp(op)) {
+        Operand a = numberOf(inst->getArg1());
+        Operand b = numberOf(inst->getArg2());
+        if ((isValue(a) || isScalarVar(a)) && (isValue(b) || isScalarVar(b))) {
+          OpCode keyOp = op;
+          // a > b is b < a
+          if (op == OpCode::GT || op == OpCode::GE) {
+            keyOp = op == OpCode::GT ? OpCode::LT : OpCode::LE;
+            std::swap(a, b);
+          }
+          std::vector<long long> lhs, rhs;
+          appendOperand(lhs, a);
+          appendOperand(rhs, b);
+          if (isCommutative(keyOp) && rhs < lhs) {
+            std::swap(lhs, rhs);
+          }
+          std::vector<long long> key{static_cast<long long>(keyOp)};
+          key.insert(key.end(), lhs.begin(), lhs.end());
+          key.insert(key.end(), rhs.begin(), rhs.end());
+          key.push_back(isScalarVar(a) || isScalarVar(b) ? memoryEpoch : -1);
+          if (const Operand *found = table.lookup(key)) {
+            leader[res.asInt()] = *found;
+            inst->setOp(OpCode::ASSIGN);
+            inst->setArg1(*found);
+            inst->setArg2(Operand());
+            changed = true;
+          } else {
+            table.insert(key, res);
           }
         }
+        continue;
+      }
+
+      if (op == OpCode::STORE ||
+          (op != OpCode::RETURN &&
+           res.getType() == OperandType::Variable)) {
+        ++memoryEpoch;
       }
     }
 
-    for (BasicBlock *child : domChildren[bb]) {
+    for (BasicBlock *child : dt.getDominatedBlocks(bb)) {
       visit(child);
     }
-
-    exprMap.exitScope();
+    table.exitScope();
   };
-
-  visit(root);
-  return changed;
-}
-
-bool runDefaultQuadOptimizations(Function &fn, DominatorTree &dt) {
-  bool changed = false;
-
-  CFGSCCPPass sccp;
-  if (sccp.run(fn)) {
+  visit(fn.getBlocks().front().get());
+
+  // uses read the leader, which dominates them; constants are left to
+  // ConstPropPass
+  auto resolve = [&](Operand op) {
+    for (size_t hops = 0; hops < leader.size(); ++hops) {
+      Operand next = numberOf(op);
+      if (next == op) {
+        break;
+      }
+      op = next;
+    }
+    return op;
+  };
+  auto rewrite = [&](const Operand &op, auto set) {
+    Operand value = resolve(op);
+    if (value != op && value.getType() == OperandType::Temporary) {
+      set(value);
+      changed = true;
+    }
+  };
+  for (auto &bb : fn.getBlocks()) {
+    for (auto &inst : bb->getInstructions()) {
+      if (inst->getOp() == OpCode::PHI) {
+        for (auto &pair : inst->getPhiArgs()) {
+          rewrite(pair.first, [&](const Operand &v) { pair.first = v; });
+        }
+        continue;
+      }
+      rewrite(inst->getArg1(),
+              [&](const Operand &v) { inst->setArg1(v); });
+      rewrite(inst->getArg2(),
+              [&](const Operand &v) { inst->setArg2(v); });
+      if (inst->getOp() == OpCode::STORE || inst->getOp() == OpCode::RETURN) {
+        rewrite(inst->getResult(),
+                [&](const Operand &v) { inst->setResult(v); });
+      }
+    }
+  }
+  // a phi equal to a constant keeps its value as a copy after the phis
+  for (auto &entry : deadPhis) {
+    Instruction *phi = entry.second;
+    auto &insts = entry.first->getInstructions();
+    auto it = std::find_if(insts.begin(), insts.end(),
+                           [&](const std::unique_ptr<Instruction> &inst) {
+                             return inst.get() == phi;
+                           });
+    Operand value = resolve(phi->getResult());
+    Operand res = phi->getResult();
+    insts.erase(it);
+    if (value.getType() != OperandType::Temporary) {
+      auto pos = insts.begin();
+      while (pos != insts.end() && ((*pos)->getOp() == OpCode::LABEL ||
+                                    (*pos)->getOp() == OpCode::PHI)) {
+        ++pos;
+      }
+      insts.insert(pos, std::make_unique<Instruction>(
+                            Instruction::MakeAssign(value, res)));
+    }
     changed = true;
-    dt.run(fn); // CFG may change; refresh dominance
   }
+  return changed;
+}
 
+bool runDefaultQuadOptimizations(Function &fn, AnalysisManager &am,
+                                 const ModRefAnalysis &modRef) {
   PassManager pm;
+  // keeps the cached dominator tree in sync with the CFG it folds
+  pm.add(std::make_unique<CFGSCCPPass>(&am.getDominatorTree(fn)));
   pm.add(std::make_unique<CopyPropPass>());
   pm.add(std::make_unique<ConstPropPass>());
   pm.add(std::make_unique<AlgebraicPass>());
-  pm.add(std::make_unique<MemoryLoadElimPass>());
-  pm.add(std::make_unique<CSEPass>(dt));
+  pm.add(std::make_unique<ReassociatePass>(am));
+  pm.add(std::make_unique<MemoryLoadElimPass>(am, modRef));
+  pm.add(std::make_unique<GVNPass>(am, modRef));
   pm.add(std::make_unique<LocalDCEPass>());
 
   pm.add(std::make_unique<ArrayBaseHoistPass>());
   pm.add(std::make_unique<CleanupPass>());
 
-  changed |= pm.run(fn);
-  return changed;
+  return pm.run(fn, am);
 }
 
 bool CleanupPass::run(Function &fn) {
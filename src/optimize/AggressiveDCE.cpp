@@ -0,0 +1,285 @@
+#include "optimize/AggressiveDCE.hpp"
+#include "codegen/Instruction.hpp"
+#include <algorithm>
+
+namespace {
+
+/**
+ * @brief operands an instruction reads
+ */
+std::vector<const Operand *> usesOf(const Instruction &inst) {
+  std::vector<const Operand *> uses;
+  if (inst.getOp() == OpCode::PHI) {
+    for (const auto &pair : inst.getPhiArgs()) {
+      uses.push_back(&pair.first);
+    }
+    return uses;
+  }
+  uses.push_back(&inst.getArg1());
+  uses.push_back(&inst.getArg2());
+  OpCode op = inst.getOp();
+  if (op == OpCode::STORE || op == OpCode::RETURN || op == OpCode::ALLOCA) {
+    uses.push_back(&inst.getResult());
+  }
+  return uses;
+}
+
+} // namespace
+
+bool AggressiveDCEPass::run(Function &func) {
+  _cfgChanged = false;
+  if (func.getBlocks().empty() || !buildControlDependence(func)) {
+    return false;
+  }
+  int n = static_cast<int>(_blocks.size());
+  _live.clear();
+  _liveBlock.assign(n, false);
+  _worklist.clear();
+  _defs.clear();
+
+  // local arrays only ever written are not observable
+  std::unordered_map<const Symbol *, bool> writeOnly;
+  for (BasicBlock *bb : _blocks) {
+    for (const auto &inst : bb->getInstructions()) {
+      if (inst->getOp() == OpCode::ALLOCA &&
+          inst->getArg1().getType() == OperandType::Variable) {
+        writeOnly.emplace(inst->getArg1().asSymbol().get(), true);
+      }
+    }
+  }
+  for (BasicBlock *bb : _blocks) {
+    for (const auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      std::vector<const Operand *> ops = usesOf(*inst);
+      ops.push_back(&inst->getResult());
+      for (const Operand *o : ops) {
+        if (o->getType() != OperandType::Variable) {
+          continue;
+        }
+        // a store without index fills the slot of an array parameter, whose
+        // element stores reach the caller's array
+        bool allowed = (op == OpCode::ALLOCA && o == &inst->getArg1()) ||
+                       (op == OpCode::STORE && o == &inst->getArg2() &&
+                        inst->getResult().getType() != OperandType::Empty);
+        auto it = writeOnly.find(o->asSymbol().get());
+        if (it != writeOnly.end() && !allowed) {
+          it->second = false;
+        }
+      }
+    }
+  }
+  auto isWriteOnly = [&](const Operand &o) {
+    if (o.getType() != OperandType::Variable) {
+      return false;
+    }
+    auto it = writeOnly.find(o.asSymbol().get());
+    return it != writeOnly.end() && it->second;
+  };
+
+  for (int b = 0; b < n; ++b) {
+    for (const auto &inst : _blocks[b]->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (inst->getResult().getType() == OperandType::Temporary &&
+          op != OpCode::STORE && op != OpCode::RETURN) {
+        _defs[inst->getResult().asInt()].push_back({inst.get(), b});
+      }
+    }
+  }
+  for (int b = 0; b < n; ++b) {
+    for (const auto &inst : _blocks[b]->getInstructions()) {
+      bool root = false;
+      switch (inst->getOp()) {
+      case OpCode::CALL:
+      case OpCode::ARG:
+      case OpCode::RETURN:
+      case OpCode::PARAM:
+        root = true;
+        break;
+      case OpCode::STORE:
+        root = !isWriteOnly(inst->getArg2());
+        break;
+      case OpCode::ALLOCA:
+        root = !isWriteOnly(inst->getArg1());
+        break;
+      case OpCode::LABEL:
+      case OpCode::GOTO:
+      case OpCode::IF:
+      case OpCode::PHI:
+      case OpCode::NOP:
+        break;
+      default:
+        // writes to globals
+        root = inst->getResult().getType() == OperandType::Variable;
+        break;
+      }
+      if (root) {
+        markLive(inst.get(), b);
+      }
+    }
+  }
+  propagate();
+
+  // a dead branch jumps to its post-dominator; keep it where that would
+  // leave the exit or feed a live phi of the target
+  bool more = true;
+  while (more) {
+    more = false;
+    for (int b = 0; b < n; ++b) {
+      auto &insts = _blocks[b]->getInstructions();
+      Instruction *term = insts.empty() ? nullptr : insts.back().get();
+      if (!term || term->getOp() != OpCode::IF || _live.count(term)) {
+        continue;
+      }
+      int target = _ipdom[b];
+      bool keep = target == n;
+      if (!keep) {
+        for (const auto &inst : _blocks[target]->getInstructions()) {
+          keep = keep ||
+                 (inst->getOp() == OpCode::PHI && _live.count(inst.get()));
+        }
+      }
+      if (keep) {
+        markLive(term, b);
+        propagate();
+        more = true;
+      }
+    }
+  }
+
+  bool changed = false;
+  for (int b = 0; b < n; ++b) {
+    BasicBlock *bb = _blocks[b];
+    auto &insts = bb->getInstructions();
+    Instruction *term = insts.empty() ? nullptr : insts.back().get();
+    if (term && term->getOp() == OpCode::IF && !_live.count(term)) {
+      BasicBlock *target = _blocks[_ipdom[b]];
+      for (BasicBlock *succ : _PDT.getSuccessors(bb)) {
+        if (succ == target) {
+          continue;
+        }
+        for (auto &inst : succ->getInstructions()) {
+          if (inst->getOp() != OpCode::PHI) {
+            continue;
+          }
+          auto &args = inst->getPhiArgs();
+          args.erase(std::remove_if(args.begin(), args.end(),
+                                    [&](const auto &arg) {
+                                      return arg.second == bb;
+                                    }),
+                     args.end());
+        }
+      }
+      if (target->getLabelId() < 0) {
+        target->getInstructions().insert(
+            target->getInstructions().begin(),
+            std::make_unique<Instruction>(
+                Instruction::MakeLabel(Operand::Label(func.allocateLabel()))));
+      }
+      insts.back() = std::make_unique<Instruction>(
+          Instruction::MakeGoto(Operand::Label(target->getLabelId())));
+      _live.insert(insts.back().get());
+      bb->jumpTarget = func.getBlockSharedPtr(target);
+      bb->next = nullptr;
+      _cfgChanged = true;
+      changed = true;
+    }
+    for (auto it = insts.begin(); it != insts.end();) {
+      OpCode op = (*it)->getOp();
+      if (op == OpCode::LABEL || op == OpCode::GOTO || op == OpCode::IF ||
+          _live.count(it->get())) {
+        ++it;
+        continue;
+      }
+      it = insts.erase(it);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool AggressiveDCEPass::buildControlDependence(Function &func) {
+  if (!_PDT.run(func)) {
+    return false;
+  }
+  _blocks = _PDT.getBlocks();
+  _index.clear();
+  int n = static_cast<int>(_blocks.size());
+  int exit = n;
+  for (int b = 0; b < n; ++b) {
+    _index[_blocks[b]] = b;
+  }
+  _ipdom.assign(n + 1, exit);
+  for (int b = 0; b < n; ++b) {
+    BasicBlock *p = _PDT.getImmediatePostDominator(_blocks[b]);
+    _ipdom[b] = p ? _index.at(p) : exit;
+  }
+
+  // b is control dependent on x when b post-dominates a successor of x but
+  // not x itself
+  _controlDeps.assign(n + 1, {});
+  for (int x = 0; x < n; ++x) {
+    const auto &succs = _PDT.getSuccessors(_blocks[x]);
+    if (succs.size() < 2) {
+      continue;
+    }
+    for (BasicBlock *s : succs) {
+      for (int r = _index.at(s); r != _ipdom[x] && r != exit; r = _ipdom[r]) {
+        _controlDeps[r].push_back(x);
+      }
+    }
+  }
+  return true;
+}
+
+void AggressiveDCEPass::markLive(Instruction *inst, int block) {
+  if (_live.insert(inst).second) {
+    _worklist.push_back({inst, block});
+  }
+}
+
+void AggressiveDCEPass::markBlock(int block) {
+  if (_liveBlock[block]) {
+    return;
+  }
+  _liveBlock[block] = true;
+  for (int x : _controlDeps[block]) {
+    markTerminator(x);
+  }
+}
+
+void AggressiveDCEPass::markTerminator(int block) {
+  auto &insts = _blocks[block]->getInstructions();
+  if (!insts.empty() && insts.back()->getOp() == OpCode::IF) {
+    markLive(insts.back().get(), block);
+  }
+  markBlock(block);
+}
+
+void AggressiveDCEPass::propagate() {
+  while (!_worklist.empty()) {
+    auto [inst, block] = _worklist.back();
+    _worklist.pop_back();
+    markBlock(block);
+    for (const Operand *o : usesOf(*inst)) {
+      if (o->getType() != OperandType::Temporary) {
+        continue;
+      }
+      auto it = _defs.find(o->asInt());
+      if (it == _defs.end()) {
+        continue;
+      }
+      for (auto &def : it->second) {
+        markLive(def.first, def.second);
+      }
+    }
+    // which value a phi takes depends on how its block was entered
+    if (inst->getOp() == OpCode::PHI) {
+      for (const auto &pair : inst->getPhiArgs()) {
+        auto it = _index.find(pair.second);
+        if (it != _index.end()) {
+          markTerminator(it->second);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,313 @@
+#include "optimize/AliasAnalysis.hpp"
+#include "codegen/Instruction.hpp"
+
+namespace {
+
+bool isArraySymbol(const Operand &op) {
+  if (op.getType() != OperandType::Variable) {
+    return false;
+  }
+  const auto &sym = op.asSymbol();
+  return sym && sym->type && sym->type->category == Type::Category::Array;
+}
+
+int elementCount(const Type &type) {
+  if (type.category != Type::Category::Array) {
+    return 1;
+  }
+  if (type.array_size <= 0) {
+    return 0;
+  }
+  return type.array_size *
+         (type.array_element_type ? elementCount(*type.array_element_type)
+                                  : 1);
+}
+
+} // namespace
+
+void AliasAnalysis::run(Function &F) {
+  _def.clear();
+  _pointer.clear();
+  _localArrays.clear();
+  _local.clear();
+  _slots.clear();
+  _size.clear();
+
+  std::unordered_map<int, int> defCount;
+  for (const auto &bb : F.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      const Operand &res = inst->getResult();
+      if (op == OpCode::ALLOCA && isArraySymbol(inst->getArg1())) {
+        const Symbol *sym = inst->getArg1().asSymbol().get();
+        _localArrays.insert(sym);
+        if (res.getType() == OperandType::ConstantInt) {
+          _size[sym] = res.asInt();
+        }
+      } else if (op == OpCode::STORE && isArraySymbol(inst->getArg2()) &&
+                 res.getType() == OperandType::Empty) {
+        _slots.insert(inst->getArg2().asSymbol().get());
+      }
+      if (res.getType() == OperandType::Temporary && op != OpCode::STORE &&
+          op != OpCode::RETURN) {
+        if (++defCount[res.asInt()] == 1) {
+          _def[res.asInt()] = inst.get();
+        } else {
+          _def.erase(res.asInt());
+        }
+      }
+    }
+  }
+  for (const Symbol *slot : _slots) {
+    _localArrays.erase(slot);
+    _size.erase(slot);
+  }
+
+  std::unordered_set<const Symbol *> escaped;
+  findPointers(F, escaped);
+  findEscapes(F, escaped);
+  for (const Symbol *sym : _localArrays) {
+    if (!escaped.count(sym)) {
+      _local.insert(sym);
+    }
+  }
+}
+
+void AliasAnalysis::findPointers(Function &F,
+                                 std::unordered_set<const Symbol *> &escaped) {
+  // a temp that may point into two arrays points into neither, and both
+  // arrays escape through it
+  std::unordered_set<int> conflicting;
+  auto merge = [&](int t, const Symbol *sym, bool &changed) {
+    if (conflicting.count(t)) {
+      escaped.insert(sym);
+      return;
+    }
+    auto it = _pointer.find(t);
+    if (it == _pointer.end()) {
+      _pointer[t] = sym;
+      changed = true;
+    } else if (it->second != sym) {
+      escaped.insert(it->second);
+      escaped.insert(sym);
+      conflicting.insert(t);
+      _pointer.erase(it);
+      changed = true;
+    }
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto &bb : F.getBlocks()) {
+      for (const auto &inst : bb->getInstructions()) {
+        OpCode op = inst->getOp();
+        const Operand &res = inst->getResult();
+        if (res.getType() != OperandType::Temporary) {
+          continue;
+        }
+        if (op == OpCode::LOAD && isArraySymbol(inst->getArg1()) &&
+            inst->getArg2().getType() == OperandType::Empty) {
+          merge(res.asInt(), inst->getArg1().asSymbol().get(), changed);
+        } else if (op == OpCode::ASSIGN || op == OpCode::ADD ||
+                   op == OpCode::SUB) {
+          for (const Operand *o : {&inst->getArg1(), &inst->getArg2()}) {
+            if (const Symbol *sym = getUnderlyingObject(*o)) {
+              merge(res.asInt(), sym, changed);
+            }
+          }
+        } else if (op == OpCode::PHI) {
+          for (const auto &pair : inst->getPhiArgs()) {
+            if (const Symbol *sym = getUnderlyingObject(pair.first)) {
+              merge(res.asInt(), sym, changed);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void AliasAnalysis::findEscapes(Function &F,
+                                std::unordered_set<const Symbol *> &escaped) {
+  // an address escapes when used other than to index, or to derive
+  // another address
+  auto escape = [&](const Operand &op) {
+    if (const Symbol *sym = getUnderlyingObject(op)) {
+      escaped.insert(sym);
+    }
+  };
+  for (const auto &bb : F.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      const Operand &res = inst->getResult();
+      switch (op) {
+      case OpCode::LOAD:
+        escape(inst->getArg2());
+        break;
+      case OpCode::STORE:
+        escape(inst->getArg1());
+        escape(res);
+        break;
+      case OpCode::ASSIGN:
+      case OpCode::ADD:
+      case OpCode::SUB:
+        if (res.getType() != OperandType::Temporary ||
+            !_pointer.count(res.asInt())) {
+          escape(inst->getArg1());
+          escape(inst->getArg2());
+        }
+        break;
+      case OpCode::PHI:
+        if (res.getType() != OperandType::Temporary ||
+            !_pointer.count(res.asInt())) {
+          for (const auto &pair : inst->getPhiArgs()) {
+            escape(pair.first);
+          }
+        }
+        break;
+      case OpCode::ALLOCA:
+      case OpCode::LABEL:
+        break;
+      default:
+        escape(inst->getArg1());
+        escape(inst->getArg2());
+        if (op == OpCode::RETURN) {
+          escape(res);
+        }
+        break;
+      }
+    }
+  }
+}
+
+const Instruction *AliasAnalysis::walk(int &temp, int &offset) const {
+  while (true) {
+    auto it = _def.find(temp);
+    if (it == _def.end()) {
+      return nullptr;
+    }
+    const Instruction *def = it->second;
+    const Operand &a = def->getArg1();
+    const Operand &b = def->getArg2();
+    OpCode op = def->getOp();
+    if (op == OpCode::ASSIGN && a.getType() == OperandType::Temporary) {
+      temp = a.asInt();
+    } else if (op == OpCode::ADD && a.getType() == OperandType::Temporary &&
+               b.getType() == OperandType::ConstantInt) {
+      offset += b.asInt();
+      temp = a.asInt();
+    } else if (op == OpCode::ADD && b.getType() == OperandType::Temporary &&
+               a.getType() == OperandType::ConstantInt) {
+      offset += a.asInt();
+      temp = b.asInt();
+    } else if (op == OpCode::SUB && a.getType() == OperandType::Temporary &&
+               b.getType() == OperandType::ConstantInt) {
+      offset -= b.asInt();
+      temp = a.asInt();
+    } else {
+      return def;
+    }
+  }
+}
+
+MemoryLocation AliasAnalysis::getLocation(const Operand &base,
+                                          const Operand &index) const {
+  MemoryLocation loc;
+  if (isArraySymbol(base)) {
+    loc.object = base.asSymbol().get();
+  } else if (base.getType() == OperandType::Temporary) {
+    int t = base.asInt();
+    const Instruction *def = walk(t, loc.offset);
+    if (def && def->getOp() == OpCode::LOAD && isArraySymbol(def->getArg1()) &&
+        def->getArg2().getType() == OperandType::Empty) {
+      loc.object = def->getArg1().asSymbol().get();
+    } else {
+      loc.base = t;
+      loc.object = getUnderlyingObject(base);
+    }
+  } else {
+    loc.base = MemoryLocation::Unknown;
+  }
+
+  if (index.getType() == OperandType::ConstantInt) {
+    loc.offset += 4 * index.asInt();
+  } else if (index.getType() == OperandType::Temporary) {
+    int t = index.asInt();
+    int elements = 0;
+    const Instruction *def = walk(t, elements);
+    if (def && def->getOp() == OpCode::ASSIGN &&
+        def->getArg1().getType() == OperandType::ConstantInt) {
+      elements += def->getArg1().asInt();
+    } else {
+      loc.index = t;
+    }
+    loc.offset += 4 * elements;
+  } else if (index.getType() != OperandType::Empty) {
+    loc.index = MemoryLocation::Unknown;
+  }
+  return loc;
+}
+
+AliasResult AliasAnalysis::alias(const MemoryLocation &a,
+                                 const MemoryLocation &b) const {
+  if (!mayAliasObjects(a.object, b.object)) {
+    return AliasResult::NoAlias;
+  }
+  if (a.isExact() && b.isExact() && a.object == b.object &&
+      a.base == b.base && a.index == b.index) {
+    return a.offset == b.offset ? AliasResult::MustAlias
+                                : AliasResult::NoAlias;
+  }
+  return AliasResult::MayAlias;
+}
+
+bool AliasAnalysis::mayAliasObjects(const Symbol *a, const Symbol *b) const {
+  if (a == b) {
+    return true;
+  }
+  if (!a || !b) {
+    return !_local.count(a ? a : b);
+  }
+  // a parameter is never an array of the activation it was passed to
+  if (_slots.count(a)) {
+    return !_localArrays.count(b);
+  }
+  if (_slots.count(b)) {
+    return !_localArrays.count(a);
+  }
+  return false;
+}
+
+const Symbol *AliasAnalysis::getUnderlyingObject(const Operand &addr) const {
+  if (isArraySymbol(addr)) {
+    return addr.asSymbol().get();
+  }
+  if (addr.getType() == OperandType::Temporary) {
+    auto it = _pointer.find(addr.asInt());
+    if (it != _pointer.end()) {
+      return it->second;
+    }
+  }
+  return nullptr;
+}
+
+AliasAnalysis::ObjectKind AliasAnalysis::getKind(const Symbol *object) const {
+  if (_slots.count(object)) {
+    return ObjectKind::Parameter;
+  }
+  if (_localArrays.count(object)) {
+    return ObjectKind::Local;
+  }
+  return ObjectKind::Global;
+}
+
+int AliasAnalysis::getSize(const Symbol *object) const {
+  if (!object || _slots.count(object)) {
+    return 0;
+  }
+  auto it = _size.find(object);
+  if (it != _size.end()) {
+    return it->second;
+  }
+  return object->type ? elementCount(*object->type) : 0;
+}
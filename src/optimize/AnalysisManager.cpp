@@ -0,0 +1,64 @@
+#include "optimize/AnalysisManager.hpp"
+
+DominatorTree &AnalysisManager::getDominatorTree(Function &F) {
+  auto &entry = _cache[&F];
+  if (!entry.domTree) {
+    entry.domTree = std::make_unique<DominatorTree>();
+    entry.domTree->run(F);
+    ++_computeCount;
+  }
+  return *entry.domTree;
+}
+
+const DominanceFrontier &AnalysisManager::getDominanceFrontier(Function &F) {
+  DominatorTree &DT = getDominatorTree(F);
+  auto &entry = _cache[&F];
+  if (!entry.frontier) {
+    entry.frontier = std::make_unique<DominanceFrontier>();
+    entry.frontier->run(F, DT);
+    ++_computeCount;
+  }
+  return *entry.frontier;
+}
+
+const std::vector<LoopInfo> &AnalysisManager::getLoops(Function &F) {
+  DominatorTree &DT = getDominatorTree(F);
+  auto &entry = _cache[&F];
+  if (!entry.loops) {
+    entry.loops = std::make_unique<LoopAnalysis>();
+    entry.loops->run(F, DT);
+    ++_computeCount;
+  }
+  return entry.loops->getLoops();
+}
+
+const Liveness &AnalysisManager::getLiveness(Function &F) {
+  auto &entry = _cache[&F];
+  if (!entry.liveness) {
+    entry.liveness = std::make_unique<Liveness>();
+    entry.liveness->run(F);
+    ++_computeCount;
+  }
+  return *entry.liveness;
+}
+
+void AnalysisManager::invalidate(Function &F, const PreservedAnalyses &PA) {
+  auto it = _cache.find(&F);
+  if (it == _cache.end()) {
+    return;
+  }
+  auto &entry = it->second;
+  bool domTreeKept = PA.isPreserved(AnalysisKind::DominatorTree);
+  if (!domTreeKept) {
+    entry.domTree.reset();
+  }
+  if (!domTreeKept || !PA.isPreserved(AnalysisKind::DominanceFrontier)) {
+    entry.frontier.reset();
+  }
+  if (!domTreeKept || !PA.isPreserved(AnalysisKind::Loops)) {
+    entry.loops.reset();
+  }
+  if (!PA.isPreserved(AnalysisKind::Liveness)) {
+    entry.liveness.reset();
+  }
+}
@@ -0,0 +1,980 @@
+#include "optimize/ConstEvalVM.hpp"
+#include "codegen/BasicBlock.hpp"
+#include "codegen/Instruction.hpp"
+#include "codegen/Operand.hpp"
+#include "semantic/Type.hpp"
+#include <unordered_set>
+
+namespace {
+
+/**
+ * @brief wrap a 64-bit intermediate to a 32-bit MIPS word
+ */
+int64_t wrapWord(int64_t v) {
+  return static_cast<int32_t>(static_cast<uint32_t>(v));
+}
+
+/**
+ * @brief decode the escapes of a source string literal, quotes included
+ */
+std::string decodeLiteral(const std::string &literal) {
+  size_t start = 0, end = literal.size();
+  if (end >= 2 && literal.front() == '"' && literal.back() == '"') {
+    start = 1;
+    end -= 1;
+  }
+  std::string text;
+  for (size_t i = start; i < end; ++i) {
+    if (literal[i] == '\\' && i + 1 < end) {
+      char c = literal[++i];
+      text += c == 'n' ? '\n' : c;
+    } else {
+      text += literal[i];
+    }
+  }
+  return text;
+}
+
+bool isArray(const Symbol *sym) {
+  return sym->type && sym->type->category == Type::Category::Array;
+}
+
+} // namespace
+
+size_t ArgListHash::operator()(const std::vector<int> &args) const {
+  size_t h = args.size();
+  for (int a : args) {
+    h ^= std::hash<int>()(a) + 0x9e3779b9 + (h << 6) + (h >> 2);
+  }
+  return h;
+}
+
+/**
+ * @class ConstEvalVM::Builder
+ * @brief compiles one function
+ *
+ * Scalar locals and array parameters become plain slots: SysY cannot take
+ * their address, so LOAD/STORE of them turn into moves. A PHI becomes moves
+ * on each incoming edge, staged through fresh slots so they act in parallel.
+ */
+struct ConstEvalVM::Builder {
+  ConstEvalVM &vm;
+  std::vector<int> &pending;
+  CompiledFunction cf;
+
+  std::unordered_map<int, int> temps;
+  std::unordered_map<int64_t, int> consts;
+  /**
+   * @brief scalar locals and array parameters -> slot
+   */
+  std::unordered_map<const Symbol *, int> regs;
+  std::unordered_set<const Symbol *> pointerParams;
+  /**
+   * @brief local arrays -> slot holding the address
+   */
+  std::unordered_map<const Symbol *, int> arrays;
+
+  std::unordered_map<const BasicBlock *, int> blockPc;
+  /**
+   * @brief JMP instructions waiting for the pc of their block
+   */
+  std::vector<std::pair<size_t, const BasicBlock *>> jumps;
+  struct Stub {
+    size_t branch;
+    const BasicBlock *from, *to;
+  };
+  /**
+   * @brief taken edges of BR, emitted after the body
+   */
+  std::vector<Stub> stubs;
+  /**
+   * @brief slot, or -1 with a literal id
+   */
+  std::vector<std::pair<int, int>> args;
+
+  Builder(ConstEvalVM &vm, std::vector<int> &pending, Function *fn)
+      : vm(vm), pending(pending) {
+    cf.fn = fn;
+  }
+
+  int newSlot(int64_t init = UNDEF) {
+    cf.initialSlots.push_back(init);
+    return static_cast<int>(cf.initialSlots.size()) - 1;
+  }
+
+  int constSlot(int64_t v) {
+    auto it = consts.find(v);
+    if (it != consts.end()) {
+      return it->second;
+    }
+    return consts[v] = newSlot(v);
+  }
+
+  int tempSlot(int id) {
+    auto it = temps.find(id);
+    if (it != temps.end()) {
+      return it->second;
+    }
+    return temps[id] = newSlot();
+  }
+
+  void emit(Bc op, int a = 0, int b = 0, int c = 0) {
+    cf.code.push_back({op, a, b, c});
+  }
+
+  /**
+   * @brief mark the function unsupported, the slot keeps building going
+   */
+  int invalid() {
+    cf.valid = false;
+    return 0;
+  }
+
+  int globalBase(const Symbol *sym) {
+    auto it = vm._globalBase.find(sym);
+    if (it == vm._globalBase.end()) {
+      return -1;
+    }
+    cf.touchesGlobals = true;
+    return it->second * 4;
+  }
+
+  /**
+   * @brief slot holding the value of an operand
+   */
+  int read(const Operand &o) {
+    switch (o.getType()) {
+    case OperandType::ConstantInt:
+      return constSlot(o.asInt());
+    case OperandType::Temporary:
+      return tempSlot(o.asInt());
+    case OperandType::Variable: {
+      const Symbol *sym = o.asSymbol().get();
+      auto rit = regs.find(sym);
+      if (rit != regs.end()) {
+        return rit->second;
+      }
+      auto ait = arrays.find(sym);
+      if (ait != arrays.end()) {
+        return ait->second;
+      }
+      int base = globalBase(sym);
+      if (base < 0) {
+        return invalid();
+      }
+      if (isArray(sym)) {
+        return constSlot(base);
+      }
+      int slot = newSlot();
+      emit(Bc::LOAD, slot, constSlot(base), constSlot(0));
+      return slot;
+    }
+    default:
+      return invalid();
+    }
+  }
+
+  /**
+   * @brief slot of an index operand, 0 when empty
+   */
+  int index(const Operand &o) {
+    return o.getType() == OperandType::Empty ? constSlot(0) : read(o);
+  }
+
+  static bool isScalarIndex(const Operand &o) {
+    return o.getType() == OperandType::Empty ||
+           (o.getType() == OperandType::ConstantInt && o.asInt() == 0);
+  }
+
+  /**
+   * @brief emit `dst = op b, c`, spilling to memory for global scalars
+   */
+  void assign(const Operand &dst, Bc op, int b, int c = 0) {
+    if (dst.getType() == OperandType::Temporary) {
+      emit(op, tempSlot(dst.asInt()), b, c);
+      return;
+    }
+    if (dst.getType() == OperandType::Variable) {
+      const Symbol *sym = dst.asSymbol().get();
+      auto rit = regs.find(sym);
+      if (rit != regs.end() && !pointerParams.count(sym)) {
+        emit(op, rit->second, b, c);
+        return;
+      }
+      int base = rit == regs.end() && !arrays.count(sym) && !isArray(sym)
+                     ? globalBase(sym)
+                     : -1;
+      if (base >= 0) {
+        int slot = newSlot();
+        emit(op, slot, b, c);
+        emit(Bc::STORE, slot, constSlot(base), constSlot(0));
+        return;
+      }
+    }
+    invalid();
+  }
+
+  /**
+   * @brief emit the PHI moves of from -> to, then jump unless to is next
+   */
+  void edge(const BasicBlock *from, const BasicBlock *to,
+            const BasicBlock *next) {
+    std::vector<std::pair<int, int>> moves;
+    for (auto &inst : to->getInstructions()) {
+      if (inst->getOp() != OpCode::PHI) {
+        continue;
+      }
+      int src = constSlot(UNDEF);
+      for (auto &arg : inst->getPhiArgs()) {
+        if (arg.second == from) {
+          src = read(arg.first);
+          break;
+        }
+      }
+      const Operand &res = inst->getResult();
+      int dst = res.getType() == OperandType::Temporary ? tempSlot(res.asInt())
+                                                        : invalid();
+      moves.push_back({dst, src});
+    }
+    if (moves.size() == 1) {
+      emit(Bc::MOV, moves[0].first, moves[0].second);
+    } else if (!moves.empty()) {
+      std::vector<int> staged;
+      for (auto &m : moves) {
+        staged.push_back(newSlot());
+        emit(Bc::MOV, staged.back(), m.second);
+      }
+      for (size_t i = 0; i < moves.size(); ++i) {
+        emit(Bc::MOV, moves[i].first, staged[i]);
+      }
+    }
+    if (to != next || !moves.empty()) {
+      jumps.push_back({cf.code.size(), to});
+      emit(Bc::JMP);
+    }
+  }
+
+  /**
+   * @brief sort locals into slots and arrays before any code is emitted
+   */
+  void classifyLocals() {
+    std::unordered_set<int> paramTemps;
+    std::vector<std::pair<const Symbol *, int>> arrayAllocas;
+    for (auto &bb : cf.fn->getBlocks()) {
+      for (auto &inst : bb->getInstructions()) {
+        const Operand &a1 = inst->getArg1();
+        const Operand &res = inst->getResult();
+        if (inst->getOp() == OpCode::ALLOCA &&
+            a1.getType() == OperandType::Variable) {
+          const Symbol *sym = a1.asSymbol().get();
+          if (isArray(sym)) {
+            int size =
+                res.getType() == OperandType::ConstantInt ? res.asInt() : -1;
+            arrayAllocas.push_back({sym, size});
+          } else {
+            regs[sym] = newSlot();
+          }
+        } else if (inst->getOp() == OpCode::PARAM &&
+                   res.getType() == OperandType::Temporary) {
+          paramTemps.insert(res.asInt());
+        } else if (inst->getOp() == OpCode::STORE &&
+                   a1.getType() == OperandType::Temporary &&
+                   paramTemps.count(a1.asInt()) &&
+                   inst->getArg2().getType() == OperandType::Variable &&
+                   isArray(inst->getArg2().asSymbol().get())) {
+          pointerParams.insert(inst->getArg2().asSymbol().get());
+        }
+      }
+    }
+    for (auto &alloca : arrayAllocas) {
+      if (pointerParams.count(alloca.first)) {
+        regs[alloca.first] = newSlot();
+      } else if (alloca.second < 0) {
+        invalid();
+      } else if (!arrays.count(alloca.first)) {
+        arrays[alloca.first] = newSlot();
+        cf.localArrays.push_back({arrays[alloca.first], alloca.second});
+      }
+    }
+    cf.hasPointerParams = !pointerParams.empty();
+  }
+
+  void compileLoad(const Instruction &inst) {
+    const Operand &base = inst.getArg1();
+    const Operand &idx = inst.getArg2();
+    const Operand &dst = inst.getResult();
+    bool noIndex = idx.getType() == OperandType::Empty;
+    if (base.getType() != OperandType::Variable) {
+      assign(dst, Bc::LOAD, read(base), index(idx));
+      return;
+    }
+    const Symbol *sym = base.asSymbol().get();
+    auto rit = regs.find(sym);
+    if (rit != regs.end()) {
+      if (pointerParams.count(sym)) {
+        // the address of the slot itself is never used by codegen
+        assign(dst, Bc::LOAD, noIndex ? invalid() : rit->second, index(idx));
+      } else {
+        assign(dst, Bc::MOV, isScalarIndex(idx) ? rit->second : invalid());
+      }
+      return;
+    }
+    auto ait = arrays.find(sym);
+    if (ait != arrays.end()) {
+      if (noIndex) {
+        assign(dst, Bc::MOV, ait->second);
+      } else {
+        assign(dst, Bc::LOAD, ait->second, read(idx));
+      }
+      return;
+    }
+    int gbase = globalBase(sym);
+    if (gbase < 0) {
+      invalid();
+    } else if (noIndex && isArray(sym)) {
+      assign(dst, Bc::MOV, constSlot(gbase));
+    } else {
+      assign(dst, Bc::LOAD, constSlot(gbase), index(idx));
+    }
+  }
+
+  void compileStore(const Instruction &inst) {
+    int value = read(inst.getArg1());
+    const Operand &base = inst.getArg2();
+    const Operand &idx = inst.getResult();
+    if (base.getType() != OperandType::Variable) {
+      emit(Bc::STORE, value, read(base), index(idx));
+      return;
+    }
+    const Symbol *sym = base.asSymbol().get();
+    auto rit = regs.find(sym);
+    if (rit != regs.end()) {
+      if (pointerParams.count(sym) && idx.getType() != OperandType::Empty) {
+        emit(Bc::STORE, value, rit->second, read(idx));
+      } else if (pointerParams.count(sym) || isScalarIndex(idx)) {
+        emit(Bc::MOV, rit->second, value);
+      } else {
+        invalid();
+      }
+      return;
+    }
+    auto ait = arrays.find(sym);
+    if (ait != arrays.end()) {
+      emit(Bc::STORE, value, ait->second, index(idx));
+      return;
+    }
+    int gbase = globalBase(sym);
+    if (gbase < 0) {
+      invalid();
+      return;
+    }
+    emit(Bc::STORE, value, constSlot(gbase), index(idx));
+  }
+
+  void compileArg(const Instruction &inst) {
+    const Operand &a1 = inst.getArg1();
+    if (a1.getType() == OperandType::Variable) {
+      auto lit = vm._literalIds.find(a1.asSymbol().get());
+      if (lit != vm._literalIds.end()) {
+        args.push_back({-1, lit->second});
+        return;
+      }
+    }
+    int slot = read(a1);
+    if (a1.getType() == OperandType::Variable &&
+        regs.count(a1.asSymbol().get())) {
+      // a local may still change before the CALL
+      int copy = newSlot();
+      emit(Bc::MOV, copy, slot);
+      slot = copy;
+    }
+    args.push_back({slot, -1});
+  }
+
+  /**
+   * @brief argc and argument slots into the pool, the first skip of them
+   * excluded
+   *
+   * @return pool offset
+   */
+  int poolArgs(size_t skip) {
+    int offset = static_cast<int>(cf.argPool.size());
+    cf.argPool.push_back(static_cast<int>(args.size() - skip));
+    for (size_t i = skip; i < args.size(); ++i) {
+      cf.argPool.push_back(args[i].first >= 0 ? args[i].first : invalid());
+    }
+    return offset;
+  }
+
+  void compileCall(const Instruction &inst) {
+    const Operand &callee = inst.getArg2();
+    const Operand &dst = inst.getResult();
+    if (callee.getType() != OperandType::Variable) {
+      invalid();
+      return;
+    }
+    const std::string &name = inst.getCalleeName();
+    bool literalFirst = !args.empty() && args[0].first < 0;
+    bool builtin = inst.callsBuiltin();
+    if (builtin &&
+        (name == "putint" || name == "putstr" || name == "printf")) {
+      cf.doesIO = true;
+      if (name == "putint" && args.size() == 1 && !literalFirst) {
+        emit(Bc::PUTINT, args[0].first);
+      } else if (name == "putstr" && args.size() == 1 && literalFirst) {
+        emit(Bc::PUTSTR, 0, args[0].second);
+      } else if (name == "printf" && literalFirst) {
+        emit(Bc::PRINTF, 0, args[0].second, poolArgs(1));
+      } else {
+        invalid();
+      }
+    } else if (builtin && name == "getint") {
+      // input is never known at compile time
+      cf.callsGetint = true;
+      emit(Bc::FAIL);
+    } else {
+      auto fit = vm._functions.find(name);
+      if (fit == vm._functions.end()) {
+        invalid();
+      } else {
+        int idx = vm.require(fit->second, pending);
+        cf.callees.push_back(idx);
+        int pool = poolArgs(0);
+        if (dst.getType() == OperandType::Empty) {
+          emit(Bc::CALL, -1, idx, pool);
+        } else {
+          assign(dst, Bc::CALL, idx, pool);
+        }
+      }
+    }
+    args.clear();
+  }
+
+  void compileInstruction(const Instruction &inst) {
+    const Operand &a1 = inst.getArg1();
+    const Operand &res = inst.getResult();
+    switch (inst.getOp()) {
+    case OpCode::PARAM: {
+      if (a1.getType() != OperandType::ConstantInt || a1.asInt() < 0 ||
+          res.getType() != OperandType::Temporary) {
+        invalid();
+        return;
+      }
+      size_t idx = a1.asInt();
+      if (cf.paramSlots.size() <= idx) {
+        cf.paramSlots.resize(idx + 1, -1);
+      }
+      cf.paramSlots[idx] = tempSlot(res.asInt());
+      return;
+    }
+    case OpCode::ASSIGN:
+      assign(res, Bc::MOV, read(a1));
+      return;
+    case OpCode::LOAD:
+      compileLoad(inst);
+      return;
+    case OpCode::STORE:
+      compileStore(inst);
+      return;
+    case OpCode::ARG:
+      compileArg(inst);
+      return;
+    case OpCode::CALL:
+      compileCall(inst);
+      return;
+    case OpCode::NEG:
+    case OpCode::NOT:
+      assign(res, inst.getOp() == OpCode::NEG ? Bc::NEG : Bc::NOT, read(a1),
+             constSlot(0));
+      return;
+    default:
+      break;
+    }
+    static const std::unordered_map<OpCode, Bc> binaries = {
+        {OpCode::ADD, Bc::ADD}, {OpCode::SUB, Bc::SUB}, {OpCode::MUL, Bc::MUL},
+        {OpCode::DIV, Bc::DIV}, {OpCode::MOD, Bc::MOD}, {OpCode::EQ, Bc::EQ},
+        {OpCode::NEQ, Bc::NEQ}, {OpCode::LT, Bc::LT},   {OpCode::LE, Bc::LE},
+        {OpCode::GT, Bc::GT},   {OpCode::GE, Bc::GE},   {OpCode::AND, Bc::AND},
+        {OpCode::OR, Bc::OR}};
+    auto it = binaries.find(inst.getOp());
+    if (it == binaries.end()) {
+      invalid();
+      return;
+    }
+    assign(res, it->second, read(a1), read(inst.getArg2()));
+  }
+
+  void build() {
+    classifyLocals();
+    auto &blocks = cf.fn->getBlocks();
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      BasicBlock *bb = blocks[i].get();
+      const BasicBlock *next =
+          i + 1 < blocks.size() ? blocks[i + 1].get() : nullptr;
+      blockPc[bb] = static_cast<int>(cf.code.size());
+      bool terminated = false;
+      for (auto &inst : bb->getInstructions()) {
+        OpCode op = inst->getOp();
+        if (op == OpCode::PHI || op == OpCode::LABEL || op == OpCode::NOP ||
+            op == OpCode::ALLOCA) {
+          continue;
+        }
+        if (op == OpCode::GOTO) {
+          if (!bb->jumpTarget) {
+            invalid();
+          } else {
+            edge(bb, bb->jumpTarget.get(), next);
+          }
+          terminated = true;
+          break;
+        }
+        if (op == OpCode::IF) {
+          if (!bb->jumpTarget) {
+            invalid();
+          } else {
+            stubs.push_back({cf.code.size(), bb, bb->jumpTarget.get()});
+            emit(Bc::BR, read(inst->getArg1()));
+          }
+          continue;
+        }
+        if (op == OpCode::RETURN) {
+          const Operand &res = inst->getResult();
+          emit(Bc::RET, res.getType() == OperandType::Empty ? -1 : read(res));
+          terminated = true;
+          break;
+        }
+        compileInstruction(*inst);
+      }
+      if (!args.empty()) {
+        invalid();
+      }
+      if (!terminated) {
+        if (bb->next) {
+          edge(bb, bb->next.get(), next);
+        } else {
+          // falling off the end returns nothing
+          emit(Bc::RET, -1);
+        }
+      }
+    }
+    for (auto &stub : stubs) {
+      cf.code[stub.branch].b = static_cast<int>(cf.code.size());
+      edge(stub.from, stub.to, nullptr);
+    }
+    for (auto &jump : jumps) {
+      auto it = blockPc.find(jump.second);
+      cf.code[jump.first].a = it != blockPc.end() ? it->second : invalid();
+    }
+    if (!cf.valid) {
+      cf.code = {{Bc::FAIL, 0, 0, 0}};
+    }
+  }
+};
+
+ConstEvalVM::ConstEvalVM(const std::vector<std::shared_ptr<Function>> &functions,
+                         ConstEvalMemo &memo)
+    : _memo(memo) {
+  for (const auto &fn : functions) {
+    _functions[fn->getName()] = fn.get();
+  }
+}
+
+bool ConstEvalVM::loadGlobals(
+    const std::vector<std::unique_ptr<Instruction>> &globals,
+    const std::unordered_map<std::string, std::shared_ptr<Symbol>>
+        &stringLiterals,
+    long long maxMemoryWords) {
+  for (auto &inst : globals) {
+    const Operand &a1 = inst->getArg1();
+    const Operand &res = inst->getResult();
+    if (inst->getOp() == OpCode::ALLOCA &&
+        a1.getType() == OperandType::Variable &&
+        res.getType() == OperandType::ConstantInt) {
+      if (static_cast<long long>(_mem.size()) + res.asInt() > maxMemoryWords) {
+        return false;
+      }
+      _globalBase[a1.asSymbol().get()] = static_cast<int>(_mem.size());
+      // the data section is zero filled
+      _mem.resize(_mem.size() + res.asInt(), 0);
+    }
+  }
+  for (auto &inst : globals) {
+    const Operand &a1 = inst->getArg1();
+    if (inst->getOp() == OpCode::ASSIGN &&
+        a1.getType() == OperandType::ConstantInt &&
+        inst->getResult().getType() == OperandType::Variable) {
+      auto it = _globalBase.find(inst->getResult().asSymbol().get());
+      if (it != _globalBase.end()) {
+        _mem[it->second] = a1.asInt();
+      }
+    } else if (inst->getOp() == OpCode::STORE &&
+               a1.getType() == OperandType::ConstantInt &&
+               inst->getArg2().getType() == OperandType::Variable &&
+               inst->getResult().getType() == OperandType::ConstantInt) {
+      auto it = _globalBase.find(inst->getArg2().asSymbol().get());
+      if (it != _globalBase.end()) {
+        _mem[it->second + inst->getResult().asInt()] = a1.asInt();
+      }
+    }
+  }
+  for (const auto &kv : stringLiterals) {
+    _literalIds[kv.second.get()] = static_cast<int>(_literals.size());
+    _literals.push_back(decodeLiteral(kv.first));
+  }
+  _globalsLoaded = true;
+  return true;
+}
+
+int ConstEvalVM::require(Function *fn, std::vector<int> &pending) {
+  auto it = _index.find(fn);
+  if (it != _index.end()) {
+    return it->second;
+  }
+  int idx = static_cast<int>(_compiled.size());
+  _compiled.emplace_back();
+  _compiled.back().fn = fn;
+  _index[fn] = idx;
+  pending.push_back(idx);
+  return idx;
+}
+
+void ConstEvalVM::compile(int idx, std::vector<int> &pending) {
+  Builder builder(*this, pending, _compiled[idx].fn);
+  builder.build();
+  _compiled[idx] = std::move(builder.cf);
+}
+
+int ConstEvalVM::prepare(Function *fn) {
+  auto it = _index.find(fn);
+  if (it != _index.end()) {
+    return it->second;
+  }
+  std::vector<int> pending;
+  int idx = require(fn, pending);
+  while (!pending.empty()) {
+    int next = pending.back();
+    pending.pop_back();
+    compile(next, pending);
+  }
+  propagateFlags();
+  return idx;
+}
+
+void ConstEvalVM::propagateFlags() {
+  for (auto &cf : _compiled) {
+    cf.pure = cf.valid && !cf.touchesGlobals && !cf.doesIO && !cf.callsGetint;
+    cf.readsInput = cf.callsGetint;
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto &cf : _compiled) {
+      for (int callee : cf.callees) {
+        if (cf.pure && !_compiled[callee].pure) {
+          cf.pure = false;
+          changed = true;
+        }
+        if (!cf.readsInput && _compiled[callee].readsInput) {
+          cf.readsInput = true;
+          changed = true;
+        }
+      }
+    }
+  }
+  for (auto &cf : _compiled) {
+    cf.memo = cf.pure && !cf.hasPointerParams ? &_memo.table(cf.fn->getName())
+                                              : nullptr;
+  }
+}
+
+bool ConstEvalVM::isPure(Function *fn) { return _compiled[prepare(fn)].pure; }
+
+bool ConstEvalVM::readsInput(Function *fn) {
+  return _compiled[prepare(fn)].readsInput;
+}
+
+bool ConstEvalVM::call(Function *fn, const std::vector<int> &args,
+                       const ProgramEvalBudget &budget, int64_t &result,
+                       long long &steps) {
+  steps = 0;
+  result = UNDEF;
+  int entry = prepare(fn);
+  if (!_globalsLoaded && !_compiled[entry].pure) {
+    return false;
+  }
+  _frames.clear();
+  _slots.clear();
+  _keys.clear();
+  size_t memBase = _mem.size();
+  std::vector<int64_t> argBuf(args.begin(), args.end());
+  std::vector<int> key;
+
+  auto enter = [&](int fi, int retSlot, long long keyBase) {
+    const CompiledFunction &callee = _compiled[fi];
+    if (static_cast<int>(_frames.size()) >= budget.maxCallDepth ||
+        argBuf.size() < callee.paramSlots.size()) {
+      return false;
+    }
+    size_t base = _slots.size();
+    _slots.insert(_slots.end(), callee.initialSlots.begin(),
+                  callee.initialSlots.end());
+    for (size_t i = 0; i < callee.paramSlots.size(); ++i) {
+      if (callee.paramSlots[i] >= 0) {
+        _slots[base + callee.paramSlots[i]] = argBuf[i];
+      }
+    }
+    size_t memTop = _mem.size();
+    for (auto &arr : callee.localArrays) {
+      if (static_cast<long long>(_mem.size()) + arr.second >
+          budget.maxMemoryWords) {
+        return false;
+      }
+      _slots[base + arr.first] = static_cast<int64_t>(_mem.size()) * 4;
+      _mem.resize(_mem.size() + arr.second, UNDEF);
+    }
+    _frames.push_back({fi, 0, base, memTop, retSlot, keyBase});
+    return true;
+  };
+
+  const CompiledFunction *cf = nullptr;
+  const BcInst *code = nullptr;
+  int64_t *R = nullptr;
+  int pc = 0;
+  auto reload = [&]() {
+    const Frame &f = _frames.back();
+    cf = &_compiled[f.fn];
+    code = cf->code.data();
+    R = _slots.data() + f.slotBase;
+    pc = f.pc;
+  };
+  auto fail = [&]() {
+    _mem.resize(memBase);
+    return false;
+  };
+
+  if (!enter(entry, -1, -1)) {
+    return fail();
+  }
+  reload();
+  for (;;) {
+    if (++steps > budget.maxSteps) {
+      return fail();
+    }
+    const BcInst &I = code[pc++];
+    switch (I.op) {
+    case Bc::MOV:
+      // undefined values may be copied around, only using them fails
+      R[I.a] = R[I.b];
+      break;
+    case Bc::ADD:
+    case Bc::SUB:
+    case Bc::MUL:
+    case Bc::DIV:
+    case Bc::MOD:
+    case Bc::NEG:
+    case Bc::NOT:
+    case Bc::EQ:
+    case Bc::NEQ:
+    case Bc::LT:
+    case Bc::LE:
+    case Bc::GT:
+    case Bc::GE:
+    case Bc::AND:
+    case Bc::OR: {
+      int64_t x = R[I.b], y = R[I.c];
+      if (x == UNDEF || y == UNDEF) {
+        return fail();
+      }
+      int64_t r = 0;
+      switch (I.op) {
+      case Bc::ADD:
+        r = wrapWord(x + y);
+        break;
+      case Bc::SUB:
+        r = wrapWord(x - y);
+        break;
+      case Bc::MUL:
+        r = wrapWord(x * y);
+        break;
+      case Bc::DIV:
+      case Bc::MOD:
+        if (y == 0) {
+          return fail();
+        }
+        // no overflow trap on INT_MIN / -1, like the target
+        if (y == -1) {
+          r = I.op == Bc::DIV ? wrapWord(-x) : 0;
+        } else {
+          r = I.op == Bc::DIV ? x / y : x % y;
+        }
+        break;
+      case Bc::NEG:
+        r = wrapWord(-x);
+        break;
+      case Bc::NOT:
+        r = !x;
+        break;
+      case Bc::EQ:
+        r = x == y;
+        break;
+      case Bc::NEQ:
+        r = x != y;
+        break;
+      case Bc::LT:
+        r = x < y;
+        break;
+      case Bc::LE:
+        r = x <= y;
+        break;
+      case Bc::GT:
+        r = x > y;
+        break;
+      case Bc::GE:
+        r = x >= y;
+        break;
+      case Bc::AND:
+        r = x && y;
+        break;
+      default:
+        r = x || y;
+        break;
+      }
+      R[I.a] = r;
+      break;
+    }
+    case Bc::LOAD:
+    case Bc::STORE: {
+      int64_t base = R[I.b], off = R[I.c];
+      if (base == UNDEF || off == UNDEF) {
+        return fail();
+      }
+      // byte address of a word, as on the target
+      int64_t addr = base + off * 4;
+      if (addr < 0 || addr % 4 != 0 ||
+          addr / 4 >= static_cast<int64_t>(_mem.size())) {
+        return fail();
+      }
+      addr /= 4;
+      if (I.op == Bc::STORE) {
+        _mem[addr] = R[I.a];
+      } else if (_mem[addr] == UNDEF) {
+        return fail();
+      } else {
+        R[I.a] = _mem[addr];
+      }
+      break;
+    }
+    case Bc::JMP:
+      pc = I.a;
+      break;
+    case Bc::BR: {
+      int64_t v = R[I.a];
+      if (v == UNDEF) {
+        return fail();
+      }
+      if (v != 0) {
+        pc = I.b;
+      }
+      break;
+    }
+    case Bc::CALL: {
+      const CompiledFunction &callee = _compiled[I.b];
+      int argc = cf->argPool[I.c];
+      argBuf.resize(argc);
+      for (int k = 0; k < argc; ++k) {
+        argBuf[k] = R[cf->argPool[I.c + 1 + k]];
+        if (argBuf[k] == UNDEF) {
+          return fail();
+        }
+      }
+      long long keyBase = -1;
+      if (callee.memo) {
+        key.assign(argBuf.begin(), argBuf.end());
+        auto it = callee.memo->find(key);
+        if (it != callee.memo->end()) {
+          if (it->second == UNDEF) {
+            return fail();
+          }
+          if (I.a >= 0) {
+            R[I.a] = it->second;
+          }
+          break;
+        }
+        keyBase = static_cast<long long>(_keys.size());
+        _keys.insert(_keys.end(), key.begin(), key.end());
+      }
+      _frames.back().pc = pc;
+      if (!enter(I.b, I.a, keyBase)) {
+        return fail();
+      }
+      reload();
+      break;
+    }
+    case Bc::RET: {
+      int64_t v = I.a >= 0 ? R[I.a] : UNDEF;
+      Frame f = _frames.back();
+      _frames.pop_back();
+      if (f.keyBase >= 0) {
+        if (v != UNDEF) {
+          _compiled[f.fn].memo->emplace(
+              std::vector<int>(_keys.begin() + f.keyBase, _keys.end()), v);
+        }
+        _keys.resize(f.keyBase);
+      }
+      _mem.resize(f.memTop);
+      _slots.resize(f.slotBase);
+      if (_frames.empty()) {
+        result = v;
+        _mem.resize(memBase);
+        return true;
+      }
+      reload();
+      if (f.retSlot >= 0) {
+        R[f.retSlot] = v;
+      }
+      break;
+    }
+    case Bc::PUTINT:
+      if (R[I.a] == UNDEF) {
+        return fail();
+      }
+      _output += std::to_string(R[I.a]);
+      if (_output.size() > budget.maxOutputBytes) {
+        return fail();
+      }
+      break;
+    case Bc::PUTSTR:
+      _output += _literals[I.b];
+      if (_output.size() > budget.maxOutputBytes) {
+        return fail();
+      }
+      break;
+    case Bc::PRINTF: {
+      // the runtime routine: `%d` takes the next argument, any other `%c`
+      // prints c
+      const std::string &format = _literals[I.b];
+      int argc = cf->argPool[I.c];
+      int next = 0;
+      for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] != '%' || i + 1 >= format.size()) {
+          _output += format[i];
+        } else if (format[++i] != 'd') {
+          _output += format[i];
+        } else {
+          int64_t v = next < argc ? R[cf->argPool[I.c + 1 + next++]] : UNDEF;
+          if (v == UNDEF) {
+            return fail();
+          }
+          _output += std::to_string(v);
+        }
+      }
+      if (_output.size() > budget.maxOutputBytes) {
+        return fail();
+      }
+      break;
+    }
+    case Bc::FAIL:
+      return fail();
+    }
+  }
+}
@@ -0,0 +1,171 @@
+#include "optimize/DeadStoreElim.hpp"
+#include "codegen/Instruction.hpp"
+#include <unordered_set>
+#include <vector>
+
+bool DeadStoreElimPass::run(Function &func) {
+  if (func.getBlocks().empty()) {
+    return false;
+  }
+  _hasPDT = _PDT.run(func);
+  _AA.run(func);
+
+  std::vector<BasicBlock *> blocks;
+  if (_hasPDT) {
+    blocks = _PDT.getBlocks();
+  } else {
+    for (const auto &bb : func.getBlocks()) {
+      blocks.push_back(bb.get());
+    }
+  }
+  bool changed = false;
+  for (BasicBlock *bb : blocks) {
+    auto &insts = bb->getInstructions();
+    for (size_t i = 0; i < insts.size();) {
+      Location loc{};
+      if (mustWrite(*insts[i], loc) && isDead(bb, i, loc)) {
+        insts.erase(insts.begin() + i);
+        changed = true;
+        continue;
+      }
+      ++i;
+    }
+  }
+  return changed;
+}
+
+bool DeadStoreElimPass::mustWrite(const Instruction &inst,
+                                  Location &loc) const {
+  OpCode op = inst.getOp();
+  if (op == OpCode::STORE) {
+    const Operand &idx = inst.getResult();
+    if (idx.getType() == OperandType::Empty &&
+        inst.getArg2().getType() == OperandType::Variable) {
+      loc = {inst.getArg2().asSymbol().get(), 0, false};
+      return true;
+    }
+    MemoryLocation m = _AA.getLocation(inst.getArg2(), idx);
+    if (m.object && m.base == -1 && m.index == -1) {
+      loc = {m.object, m.offset / 4, true};
+      return true;
+    }
+    return false;
+  }
+  if (op == OpCode::ALLOCA || op == OpCode::CALL || op == OpCode::PARAM ||
+      op == OpCode::RETURN || op == OpCode::LOAD) {
+    return false;
+  }
+  if (inst.getResult().getType() == OperandType::Variable) {
+    loc = {inst.getResult().asSymbol().get(), 0, false};
+    return true;
+  }
+  return false;
+}
+
+bool DeadStoreElimPass::mayRead(const Instruction &inst,
+                                const Location &loc) const {
+  auto readsVariable = [&](const Operand &op) {
+    return op.getType() == OperandType::Variable && !loc.hasIdx &&
+           op.asSymbol().get() == loc.sym;
+  };
+  OpCode op = inst.getOp();
+  switch (op) {
+  case OpCode::CALL:
+    if (loc.hasIdx) {
+      return _modRef.mayRead(inst, MemoryLocation{loc.sym, -1, -1, 4 * loc.idx},
+                             _AA);
+    }
+    // no callee sees the slot of an array parameter
+    return _AA.getKind(loc.sym) != AliasAnalysis::ObjectKind::Parameter &&
+           _modRef.mayRead(inst, loc.sym);
+  case OpCode::ALLOCA:
+  case OpCode::LABEL:
+  case OpCode::GOTO:
+  case OpCode::NOP:
+  case OpCode::PARAM:
+    return false;
+  case OpCode::PHI:
+    for (const auto &pair : inst.getPhiArgs()) {
+      if (readsVariable(pair.first)) {
+        return true;
+      }
+    }
+    return false;
+  case OpCode::STORE:
+    return readsVariable(inst.getArg1()) || readsVariable(inst.getArg2()) ||
+           readsVariable(inst.getResult());
+  case OpCode::LOAD: {
+    // the base variable itself is read: the slot of an array parameter, or
+    // a scalar
+    if (readsVariable(inst.getArg1()) || readsVariable(inst.getArg2())) {
+      return true;
+    }
+    const Operand &idx = inst.getArg2();
+    if (!loc.hasIdx || (idx.getType() == OperandType::Empty &&
+                        inst.getArg1().getType() == OperandType::Variable)) {
+      return false;
+    }
+    MemoryLocation stored{loc.sym, -1, -1, 4 * loc.idx};
+    return _AA.alias(_AA.getLocation(inst.getArg1(), idx), stored) !=
+           AliasResult::NoAlias;
+  }
+  default:
+    return readsVariable(inst.getArg1()) || readsVariable(inst.getArg2()) ||
+           (op == OpCode::RETURN && readsVariable(inst.getResult()));
+  }
+}
+
+bool DeadStoreElimPass::isDead(BasicBlock *bb, size_t pos,
+                               const Location &loc) const {
+  auto &insts = bb->getInstructions();
+  for (size_t i = pos + 1; i < insts.size(); ++i) {
+    Location other{};
+    if (mayRead(*insts[i], loc)) {
+      return false;
+    }
+    if (mustWrite(*insts[i], other) && other == loc) {
+      return true;
+    }
+  }
+  // leaving the function ends the life of a local array only
+  if (!_hasPDT) {
+    return !insts.empty() && insts.back()->getOp() == OpCode::RETURN &&
+           _AA.isLocal(loc.sym);
+  }
+  if (_PDT.getSuccessors(bb).empty()) {
+    return _AA.isLocal(loc.sym);
+  }
+
+  // every path must write loc again before reading it
+  std::vector<BasicBlock *> stack(_PDT.getSuccessors(bb).begin(),
+                                  _PDT.getSuccessors(bb).end());
+  std::unordered_set<BasicBlock *> seen(stack.begin(), stack.end());
+  while (!stack.empty()) {
+    BasicBlock *cur = stack.back();
+    stack.pop_back();
+    bool writes = false;
+    for (const auto &inst : cur->getInstructions()) {
+      Location other{};
+      if (mayRead(*inst, loc)) {
+        return false;
+      }
+      if (mustWrite(*inst, other) && other == loc) {
+        writes = true;
+        break;
+      }
+    }
+    if (writes) {
+      continue;
+    }
+    const auto &succs = _PDT.getSuccessors(cur);
+    if (succs.empty() && !_AA.isLocal(loc.sym)) {
+      return false;
+    }
+    for (BasicBlock *succ : succs) {
+      if (seen.insert(succ).second) {
+        stack.push_back(succ);
+      }
+    }
+  }
+  return true;
+}
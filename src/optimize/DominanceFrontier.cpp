@@ -0,0 +1,39 @@
+#include "optimize/DominanceFrontier.hpp"
+#include <vector>
+
+void DominanceFrontier::run(Function &F, const DominatorTree &DT) {
+  _frontiers.clear();
+  std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> preds;
+  for (auto &bb_ptr : F.getBlocks()) {
+    BasicBlock *bb = bb_ptr.get();
+    if (bb->jumpTarget) {
+      preds[bb->jumpTarget.get()].push_back(bb);
+    }
+    if (bb->next) {
+      preds[bb->next.get()].push_back(bb);
+    }
+  }
+  // only join points have a frontier entry: walk up from every predecessor
+  // until the idom of the join point
+  for (auto &bb_ptr : F.getBlocks()) {
+    BasicBlock *bb = bb_ptr.get();
+    auto &bbPreds = preds[bb];
+    if (bbPreds.size() < 2) {
+      continue;
+    }
+    BasicBlock *idom = DT.getImmediateDominator(bb);
+    for (BasicBlock *runner : bbPreds) {
+      while (runner && runner != idom) {
+        _frontiers[runner].insert(bb);
+        runner = DT.getImmediateDominator(runner);
+      }
+    }
+  }
+}
+
+const std::set<BasicBlock *> &
+DominanceFrontier::getFrontier(BasicBlock *B) const {
+  static const std::set<BasicBlock *> empty;
+  auto it = _frontiers.find(B);
+  return it == _frontiers.end() ? empty : it->second;
+}
@@ -1,194 +1,418 @@
 #include "optimize/DominatorTree.hpp"
 #include <algorithm>
 
+/**
+ * @brief CFG successors of a block. The fallthrough edge only counts when
+ * the block has no GOTO/RETURN, and the jump edge only counts when it has a
+ * GOTO/IF.
+ */
+static std::vector<BasicBlock *> getSuccessors(BasicBlock *BB) {
+  std::vector<BasicBlock *> succs;
+  bool hasJump = false;
+  bool hasBarrier = false;
+  for (auto &inst : BB->getInstructions()) {
+    OpCode op = inst->getOp();
+    if (op == OpCode::GOTO) {
+      hasJump = true;
+      hasBarrier = true;
+    } else if (op == OpCode::IF) {
+      hasJump = true;
+    } else if (op == OpCode::RETURN) {
+      hasBarrier = true;
+    }
+  }
+  if (hasJump && BB->jumpTarget) {
+    succs.push_back(BB->jumpTarget.get());
+  }
+  if (!hasBarrier && BB->next && BB->next != BB->jumpTarget) {
+    succs.push_back(BB->next.get());
+  }
+  return succs;
+}
+
 void DominatorTree::run(Function &F) {
-  _dominators.clear();
-  _idoms.clear();
-  _dominatedBy.clear();
+  _func = &F;
+  _nodes.clear();
+  _number.clear();
+  _idom.clear();
+  _children.clear();
+  _pre.clear();
+  _post.clear();
+  _rpo.clear();
+  _dfsValid = false;
+  _rpoValid = false;
 
   const auto &blocks = F.getBlocks();
   if (blocks.empty()) {
+    _dfsValid = true;
+    _rpoValid = true;
     return;
   }
+  rebuild(blocks.front().get(), nullptr);
+}
 
-  std::vector<BasicBlock *> rawBlocks;
-  for (const auto &b_ptr : blocks) {
-    rawBlocks.push_back(b_ptr.get());
+std::vector<BasicBlock *>
+DominatorTree::rebuild(BasicBlock *root,
+                       const std::unordered_set<BasicBlock *> *region) {
+  // postorder DFS from the root, iterative so deep CFGs do not overflow
+  std::unordered_map<BasicBlock *, int> local;
+  std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> succs;
+  std::vector<std::pair<BasicBlock *, size_t>> stack;
+  std::vector<BasicBlock *> postorder;
+  auto enter = [&](BasicBlock *bb) {
+    local[bb] = -1;
+    auto &out = succs[bb];
+    for (BasicBlock *s : getSuccessors(bb)) {
+      if (!region || region->count(s)) {
+        out.push_back(s);
+      }
+    }
+    stack.push_back({bb, 0});
+  };
+  enter(root);
+  while (!stack.empty()) {
+    BasicBlock *bb = stack.back().first;
+    size_t &next = stack.back().second;
+    auto &out = succs[bb];
+    if (next < out.size()) {
+      BasicBlock *s = out[next++];
+      if (!local.count(s)) {
+        enter(s);
+      }
+    } else {
+      postorder.push_back(bb);
+      stack.pop_back();
+    }
+  }
+  std::vector<BasicBlock *> rpo(postorder.rbegin(), postorder.rend());
+  int n = static_cast<int>(rpo.size());
+  for (int i = 0; i < n; ++i) {
+    local[rpo[i]] = i;
   }
 
-  BasicBlock *entryBlock = rawBlocks[0];
-
-  // The entry block dominates only itself.
-  _dominators[entryBlock].insert(entryBlock);
-  // All other blocks initially are dominated by all blocks.
-  for (BasicBlock *bb : rawBlocks) {
-    if (bb != entryBlock) {
-      for (BasicBlock *otherBb : rawBlocks) {
-        _dominators[bb].insert(otherBb);
-      }
+  std::vector<std::vector<int>> preds(n);
+  for (int i = 0; i < n; ++i) {
+    for (BasicBlock *s : succs[rpo[i]]) {
+      preds[local[s]].push_back(i);
     }
   }
 
-  // Dom(entry) = {entry}
-  // Dom(b) = b + intersection of Dom(p) for all predecessors p of b, b != entry
+  // Cooper, Harvey, Kennedy: "A Simple, Fast Dominance Algorithm".
+  // idom[b] is refined to the nearest common ancestor of its processed
+  // predecessors until nothing changes; with RPO this converges in a few
+  // passes for reducible graphs.
+  std::vector<int> idom(n, -2);
+  idom[0] = 0;
+  auto intersect = [&](int a, int b) {
+    while (a != b) {
+      while (a > b)
+        a = idom[a];
+      while (b > a)
+        b = idom[b];
+    }
+    return a;
+  };
   bool changed = true;
   while (changed) {
     changed = false;
-    for (BasicBlock *bb : rawBlocks) {
-
-      if (bb == entryBlock)
-        continue; // entry block no need to be processed
-
-      std::vector<BasicBlock *> preds = getPredecessors(bb, F);
-      if (preds.empty()) { // Unreachable block
-        if (!_dominators[bb].empty()) {
-          _dominators[bb].clear(); // Clear dominators for unreachable block
-          changed = true;
-        }
-        continue;
-      }
-
-      // Compute intersection of dominators of predecessors
-      std::set<BasicBlock *> newDominators;
-      bool firstValidPred = true;
-
-      for (BasicBlock *pred : preds) {
-        if (_dominators[pred].empty()) {
+    for (int b = 1; b < n; ++b) {
+      int newIdom = -2;
+      for (int p : preds[b]) {
+        if (idom[p] == -2)
           continue;
-        }
-        if (firstValidPred) {
-          newDominators = _dominators[pred];
-          firstValidPred = false;
-        } else {
-          std::set<BasicBlock *> intersection;
-          std::set_intersection(
-              newDominators.begin(), newDominators.end(),
-              _dominators[pred].begin(), _dominators[pred].end(),
-              std::inserter(intersection, intersection.begin()));
-          newDominators = intersection;
-        }
+        newIdom = newIdom == -2 ? p : intersect(p, newIdom);
       }
-
-      if (firstValidPred) {
-        if (!_dominators[bb].empty()) {
-          _dominators[bb].clear(); // Clear dominators for unreachable block
-          changed = true;
-        }
-        continue;
-      }
-      // Add current block itself
-      newDominators.insert(bb);
-
-      if (newDominators != _dominators[bb]) {
-        _dominators[bb] = newDominators;
+      if (newIdom != idom[b]) {
+        idom[b] = newIdom;
         changed = true;
       }
     }
   }
 
-  /*
-   * defination of immediate dominator:
-   * 1. A dominates B
-   * 2. A != B
-   * 3. A is not dominated by any other dominator of B(the closest to B)
-   */
-
-  // Compute immediate dominators (_idoms) and dominatedBy sets (_dominatedBy)
-  for (BasicBlock *bb : rawBlocks) {
-    if (bb == entryBlock) {
-      _idoms[bb] = nullptr;
-      continue;
+  std::vector<BasicBlock *> dropped;
+  if (region) {
+    // blocks of the old subtree that the root no longer reaches have become
+    // unreachable
+    for (BasicBlock *bb : *region) {
+      auto it = _number.find(bb);
+      if (it != _number.end() && !local.count(bb)) {
+        _nodes[it->second] = nullptr;
+        _children[it->second].clear();
+        _number.erase(it);
+        dropped.push_back(bb);
+      }
     }
+  }
+  for (BasicBlock *bb : rpo) {
+    if (!_number.count(bb)) {
+      _number[bb] = static_cast<int>(_nodes.size());
+      _nodes.push_back(bb);
+      _idom.push_back(-1);
+      _children.emplace_back();
+    }
+    _children[_number[bb]].clear();
+  }
+  for (int b = 1; b < n; ++b) {
+    int id = _number[rpo[b]];
+    int parent = _number[rpo[idom[b]]];
+    _idom[id] = parent;
+    _children[parent].push_back(rpo[b]);
+  }
+  if (!region) {
+    _idom[_number[root]] = -1;
+    _rpo = std::move(rpo);
+    _rpoValid = true;
+  } else {
+    _rpoValid = false;
+  }
+  _dfsValid = false;
+  return dropped;
+}
 
-    BasicBlock *idom = nullptr;
-
-    // Simplified idom computation:
-    // The immediate dominator of B is the dominator A (A!=B) with the largest
-    // dominator set.
-    size_t maxDoms = 0;
-    BasicBlock *bestIdom = nullptr;
-    for (BasicBlock *dom : _dominators[bb]) {
-      if (dom == bb)
-        continue;
-      if (_dominators[dom].size() > maxDoms) {
-        maxDoms = _dominators[dom].size();
-        bestIdom = dom;
+void DominatorTree::updateSubtree(BasicBlock *top, BasicBlock *added,
+                                  BasicBlock *removed) {
+  std::vector<BasicBlock *> work = {top};
+  while (!work.empty()) {
+    BasicBlock *root = work.back();
+    work.pop_back();
+    if (!isReachable(root)) {
+      continue; // dropped by an earlier round
+    }
+    auto region = collectSubtree(root);
+    if (added) {
+      region.insert(added);
+      added = nullptr;
+    }
+    if (removed && region.erase(removed)) {
+      auto it = _number.find(removed);
+      _nodes[it->second] = nullptr;
+      _children[it->second].clear();
+      _number.erase(it);
+      removed = nullptr;
+    }
+    // a block that just became unreachable no longer counts as a
+    // predecessor of the blocks it jumps to; for those outside the region
+    // this is an edge deletion, handled below their common dominator
+    for (BasicBlock *dead : rebuild(root, &region)) {
+      for (BasicBlock *s : getSuccessors(dead)) {
+        if (isReachable(s) && !region.count(s)) {
+          work.push_back(findNearestCommonDominator(root, s));
+        }
       }
     }
-    _idoms[bb] = bestIdom;
-    if (bestIdom) {
-      _dominatedBy[bestIdom].insert(bb);
+  }
+}
+
+std::unordered_set<BasicBlock *>
+DominatorTree::collectSubtree(BasicBlock *B) const {
+  std::unordered_set<BasicBlock *> result;
+  std::vector<BasicBlock *> work = {B};
+  while (!work.empty()) {
+    BasicBlock *bb = work.back();
+    work.pop_back();
+    result.insert(bb);
+    for (BasicBlock *c : _children[_number.at(bb)]) {
+      work.push_back(c);
+    }
+  }
+  return result;
+}
+
+void DominatorTree::numberTree() const {
+  _pre.assign(_nodes.size(), 0);
+  _post.assign(_nodes.size(), 0);
+  _dfsValid = true;
+  if (!_func || _func->getBlocks().empty())
+    return;
+  auto rootIt = _number.find(_func->getBlocks().front().get());
+  if (rootIt == _number.end())
+    return;
+  int clock = 0;
+  std::vector<std::pair<int, size_t>> stack;
+  _pre[rootIt->second] = clock++;
+  stack.push_back({rootIt->second, 0});
+  while (!stack.empty()) {
+    int b = stack.back().first;
+    size_t &next = stack.back().second;
+    if (next < _children[b].size()) {
+      int c = _number.at(_children[b][next++]);
+      _pre[c] = clock++;
+      stack.push_back({c, 0});
+    } else {
+      _post[b] = clock++;
+      stack.pop_back();
     }
   }
 }
 
 bool DominatorTree::dominates(BasicBlock *A, BasicBlock *B) const {
-  auto it = _dominators.find(B);
-  if (it != _dominators.end()) {
-    return it->second.count(A) > 0;
+  auto a = _number.find(A);
+  auto b = _number.find(B);
+  if (a == _number.end() || b == _number.end()) {
+    return false;
   }
-  return false;
+  if (!_dfsValid) {
+    numberTree();
+  }
+  return _pre[a->second] <= _pre[b->second] &&
+         _post[b->second] <= _post[a->second];
 }
 
 BasicBlock *DominatorTree::getImmediateDominator(BasicBlock *B) const {
-  auto it = _idoms.find(B);
-  if (it != _idoms.end()) {
-    return it->second;
+  auto it = _number.find(B);
+  if (it == _number.end() || _idom[it->second] < 0) {
+    return nullptr;
   }
-  return nullptr;
+  return _nodes[_idom[it->second]];
 }
 
-const std::set<BasicBlock *> &
+const std::vector<BasicBlock *> &
 DominatorTree::getDominatedBlocks(BasicBlock *B) const {
-  auto it = _dominatedBy.find(B);
-  if (it != _dominatedBy.end()) {
-    return it->second;
+  auto it = _number.find(B);
+  if (it != _number.end()) {
+    return _children[it->second];
   }
-  // Return an empty set if B does not dominate any other block
-  static const std::set<BasicBlock *> emptySet;
-  return emptySet;
+  // Return an empty list if B is not in the tree
+  static const std::vector<BasicBlock *> empty;
+  return empty;
 }
 
-std::vector<BasicBlock *> DominatorTree::getPredecessors(BasicBlock *BB,
-                                                         Function &F) {
-  std::vector<BasicBlock *> predecessors;
-  const auto &blocks = F.getBlocks();
-
-  for (const auto &b_ptr : blocks) {
-    BasicBlock *currentBlock = b_ptr.get();
-    auto &insts = currentBlock->getInstructions();
-    auto goesToBB = false;
-    bool hasBarrier = false;
-    if (insts.empty()) {
-      if (currentBlock->next.get() == BB) {
-        goesToBB = true;
+const std::vector<BasicBlock *> &DominatorTree::getReversePostOrder() const {
+  if (_rpoValid) {
+    return _rpo;
+  }
+  _rpo.clear();
+  _rpoValid = true;
+  if (!_func || _func->getBlocks().empty()) {
+    return _rpo;
+  }
+  std::unordered_set<BasicBlock *> visited;
+  std::vector<std::pair<BasicBlock *, std::vector<BasicBlock *>>> stack;
+  BasicBlock *entry = _func->getBlocks().front().get();
+  visited.insert(entry);
+  stack.push_back({entry, getSuccessors(entry)});
+  while (!stack.empty()) {
+    auto &succs = stack.back().second;
+    if (!succs.empty()) {
+      BasicBlock *s = succs.front();
+      succs.erase(succs.begin());
+      if (visited.insert(s).second) {
+        stack.push_back({s, getSuccessors(s)});
       }
     } else {
-      for (auto &inst_ptr : insts) {
-        Instruction *inst = inst_ptr.get();
-        OpCode op = inst->getOp();
-        if (op == OpCode::GOTO) {
-          if (currentBlock->jumpTarget.get() == BB) {
-            goesToBB = true;
-          }
-          hasBarrier = true;
-        } else if (op == OpCode::IF) {
-          if (currentBlock->jumpTarget.get() == BB) {
-            goesToBB = true;
-          }
-        } else if (op == OpCode::RETURN) {
-          hasBarrier = true;
-        }
-      }
-      if (!hasBarrier) {
-        if (currentBlock->next.get() == BB) {
-          goesToBB = true;
-        }
-      }
+      _rpo.push_back(stack.back().first);
+      stack.pop_back();
+    }
+  }
+  std::reverse(_rpo.begin(), _rpo.end());
+  return _rpo;
+}
+
+BasicBlock *DominatorTree::findNearestCommonDominator(BasicBlock *A,
+                                                      BasicBlock *B) const {
+  if (!isReachable(A) || !isReachable(B)) {
+    return nullptr;
+  }
+  std::unordered_set<BasicBlock *> ancestors;
+  for (BasicBlock *x = A; x; x = getImmediateDominator(x)) {
+    ancestors.insert(x);
+  }
+  for (BasicBlock *y = B; y; y = getImmediateDominator(y)) {
+    if (ancestors.count(y)) {
+      return y;
     }
-    if (goesToBB) {
-      predecessors.push_back(currentBlock);
+  }
+  return nullptr;
+}
+
+void DominatorTree::insertEdge(BasicBlock *From, BasicBlock *To) {
+  if (!_func || !isReachable(From)) {
+    return; // an edge out of dead code changes nothing
+  }
+  if (!isReachable(To)) {
+    // a whole region may have become reachable; rare enough to rebuild
+    run(*_func);
+    return;
+  }
+  // only blocks below the nearest common dominator can get a new idom;
+  // a back edge to a dominator changes nothing
+  BasicBlock *ncd = findNearestCommonDominator(From, To);
+  if (ncd == To) {
+    return;
+  }
+  updateSubtree(ncd);
+}
+
+void DominatorTree::deleteEdge(BasicBlock *From, BasicBlock *To) {
+  if (!_func || !isReachable(From) || !isReachable(To)) {
+    return;
+  }
+  auto succs = getSuccessors(From);
+  if (std::find(succs.begin(), succs.end(), To) != succs.end()) {
+    return; // a parallel edge is still there
+  }
+  BasicBlock *ncd = findNearestCommonDominator(From, To);
+  if (ncd == To) {
+    return;
+  }
+  updateSubtree(ncd);
+}
+
+void DominatorTree::removeBlock(BasicBlock *BB) {
+  auto it = _number.find(BB);
+  if (it == _number.end()) {
+    return;
+  }
+  BasicBlock *parent = getImmediateDominator(BB);
+  if (!parent) {
+    run(*_func);
+    return;
+  }
+  updateSubtree(parent, nullptr, BB);
+}
+
+void DominatorTree::splitBlock(BasicBlock *BB, BasicBlock *NewBB) {
+  auto it = _number.find(BB);
+  if (it == _number.end()) {
+    return;
+  }
+  int bbId = it->second;
+  int newId = static_cast<int>(_nodes.size());
+  _number[NewBB] = newId;
+  _nodes.push_back(NewBB);
+  _idom.push_back(bbId);
+  _children.push_back(std::move(_children[bbId]));
+  _children[bbId] = {NewBB};
+  for (BasicBlock *c : _children[newId]) {
+    _idom[_number[c]] = newId;
+  }
+  _dfsValid = false;
+  _rpoValid = false;
+}
+
+void DominatorTree::insertBlockBefore(BasicBlock *NewBB, BasicBlock *Succ) {
+  if (!_func || !isReachable(Succ)) {
+    return;
+  }
+  // every reachable predecessor of Succ sits below idom(Succ), so NewBB and
+  // Succ both get their idom from that subtree
+  BasicBlock *top = getImmediateDominator(Succ);
+  if (!top) {
+    run(*_func);
+    return;
+  }
+  updateSubtree(top, NewBB);
+}
+
+bool DominatorTree::verify(Function &F) const {
+  DominatorTree fresh;
+  fresh.run(F);
+  for (auto &bb : F.getBlocks()) {
+    BasicBlock *b = bb.get();
+    if (isReachable(b) != fresh.isReachable(b) ||
+        getImmediateDominator(b) != fresh.getImmediateDominator(b)) {
+      return false;
     }
   }
-  return predecessors;
+  return true;
 }
@@ -0,0 +1,591 @@
+#include "optimize/Inline.hpp"
+#include "codegen/Instruction.hpp"
+#include "optimize/LoopAnalysis.hpp"
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+namespace {
+
+bool isArraySymbol(const Operand &op) {
+  if (op.getType() != OperandType::Variable) {
+    return false;
+  }
+  const auto &sym = op.asSymbol();
+  return sym && sym->type && sym->type->category == Type::Category::Array;
+}
+
+/**
+ * @brief the slots of array parameters: `PARAM i, t; STORE t, a` makes a
+ * the slot of parameter i
+ */
+std::unordered_map<const Symbol *, int> findParamSlots(const Function &func) {
+  std::unordered_map<int, int> paramOf;
+  std::unordered_map<const Symbol *, int> slots;
+  for (const auto &bb : func.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      if (inst->getOp() == OpCode::PARAM &&
+          inst->getResult().getType() == OperandType::Temporary) {
+        paramOf[inst->getResult().asInt()] = inst->getArg1().asInt();
+      } else if (inst->getOp() == OpCode::STORE &&
+                 inst->getResult().getType() == OperandType::Empty &&
+                 inst->getArg1().getType() == OperandType::Temporary &&
+                 isArraySymbol(inst->getArg2()) &&
+                 paramOf.count(inst->getArg1().asInt())) {
+        slots[inst->getArg2().asSymbol().get()] =
+            paramOf[inst->getArg1().asInt()];
+      }
+    }
+  }
+  return slots;
+}
+
+/**
+ * @brief blocks reachable from the entry, in layout order
+ */
+std::vector<const BasicBlock *> reachableBlocks(const Function &func) {
+  std::unordered_set<const BasicBlock *> seen;
+  std::vector<const BasicBlock *> stack{func.getBlocks().front().get()};
+  seen.insert(stack.back());
+  while (!stack.empty()) {
+    const BasicBlock *bb = stack.back();
+    stack.pop_back();
+    for (const BasicBlock *succ : {bb->next.get(), bb->jumpTarget.get()}) {
+      if (succ && seen.insert(succ).second) {
+        stack.push_back(succ);
+      }
+    }
+  }
+  std::vector<const BasicBlock *> order;
+  for (const auto &bb : func.getBlocks()) {
+    if (seen.count(bb.get())) {
+      order.push_back(bb.get());
+    }
+  }
+  return order;
+}
+
+/**
+ * @brief the ARGs of a call, in order; false when they are not all in its
+ * block
+ */
+bool getCallArgs(const Instruction *call, std::vector<size_t> &positions) {
+  const auto &insts = call->getParent()->getInstructions();
+  size_t pos = 0;
+  while (insts[pos].get() != call) {
+    ++pos;
+  }
+  size_t argc = call->getArg1().asInt();
+  positions.clear();
+  for (size_t i = pos; i-- > 0 && positions.size() < argc;) {
+    if (insts[i]->getOp() == OpCode::CALL) {
+      break;
+    }
+    if (insts[i]->getOp() == OpCode::ARG) {
+      positions.push_back(i);
+    }
+  }
+  std::reverse(positions.begin(), positions.end());
+  return positions.size() == argc;
+}
+
+} // namespace
+
+int InlinePass::sizeOf(const Function &func) {
+  int size = 0;
+  for (const auto &bb : func.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op != OpCode::LABEL && op != OpCode::PHI && op != OpCode::NOP &&
+          op != OpCode::ALLOCA) {
+        ++size;
+      }
+    }
+  }
+  return size;
+}
+
+bool InlinePass::isInlinable(const Function &func) {
+  const auto &blocks = func.getBlocks();
+  if (blocks.empty()) {
+    return false;
+  }
+  // the copied entry is entered from the call block only
+  for (const auto &bb : blocks) {
+    if (bb->next == blocks.front() || bb->jumpTarget == blocks.front()) {
+      return false;
+    }
+  }
+  // an array parameter stands for the array passed in, which works for
+  // element accesses and for passing it on, not for reading its slot
+  auto slots = findParamSlots(func);
+  auto isSlot = [&](const Operand &op) {
+    return op.getType() == OperandType::Variable &&
+           slots.count(op.asSymbol().get());
+  };
+  for (const auto &bb : blocks) {
+    for (const auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      const Operand &a1 = inst->getArg1();
+      const Operand &a2 = inst->getArg2();
+      const Operand &res = inst->getResult();
+      bool indexed = false;
+      if (op == OpCode::LOAD) {
+        indexed = a2.getType() != OperandType::Empty;
+        if (isSlot(a2) || isSlot(res) || (isSlot(a1) && !indexed)) {
+          return false;
+        }
+      } else if (op == OpCode::STORE) {
+        // filling the slot, or an element
+        if (isSlot(a1) || isSlot(res)) {
+          return false;
+        }
+      } else if (op == OpCode::ASSIGN || op == OpCode::ADD ||
+                 op == OpCode::SUB) {
+        // taking the address, to pass it on or to offset it
+        if (isSlot(res)) {
+          return false;
+        }
+      } else if (op != OpCode::ALLOCA && op != OpCode::ARG &&
+                 (isSlot(a1) || isSlot(a2) || isSlot(res))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool InlinePass::shouldInline(const Function &callee, const Instruction &call,
+                              int depth, int callerSize, bool loops) const {
+  int size = sizeOf(callee);
+  if (callerSize + size > budget.maxCallerSize) {
+    return false;
+  }
+  std::vector<size_t> positions;
+  if (!getCallArgs(&call, positions)) {
+    return false;
+  }
+  int constArgs = 0;
+  for (size_t i : positions) {
+    const Operand &arg = call.getParent()->getInstructions()[i]->getArg1();
+    constArgs += arg.getType() == OperandType::ConstantInt;
+  }
+  // a pure call on constants is folded at compile time instead, and one
+  // running a loop may still be once unrolling folds its arguments
+  if (_modRef.isPure(call) &&
+      (loops || (!positions.empty() &&
+                 constArgs == static_cast<int>(positions.size())))) {
+    return false;
+  }
+  // a call run once saves little against the loops of its callee, while
+  // the copy adds to the register pressure of the caller, unless constant
+  // arguments let those loops fold
+  if (loops && depth == 0 && constArgs == 0) {
+    return false;
+  }
+  // the only call of a function: inlining it removes the function
+  auto sites = _callSites.find(callee.getName());
+  if (sites != _callSites.end() && sites->second == 1 &&
+      size <= budget.singleSiteSize) {
+    return true;
+  }
+  return size <= budget.alwaysSize ||
+         size <= budget.baseSize + depth * budget.loopBonus +
+                     constArgs * budget.constArgBonus;
+}
+
+bool InlinePass::inlineCall(Function &caller, Instruction *call,
+                            const Function &callee) {
+  BasicBlock *block = call->getParent();
+  std::vector<size_t> argPos;
+  if (!getCallArgs(call, argPos)) {
+    return false;
+  }
+  auto &insts = block->getInstructions();
+  std::vector<Operand> args;
+  for (size_t i : argPos) {
+    args.push_back(insts[i]->getArg1());
+  }
+
+  // arrays are passed as copies of their address
+  std::unordered_map<int, Operand> addressOf;
+  for (const auto &bb : caller.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      if (inst->getOp() == OpCode::ASSIGN &&
+          inst->getResult().getType() == OperandType::Temporary &&
+          isArraySymbol(inst->getArg1())) {
+        addressOf[inst->getResult().asInt()] = inst->getArg1();
+      }
+    }
+  }
+  for (Operand &arg : args) {
+    if (arg.getType() == OperandType::Temporary &&
+        addressOf.count(arg.asInt())) {
+      arg = addressOf[arg.asInt()];
+    }
+  }
+
+  // array parameters become the arrays passed, local arrays new symbols
+  auto slots = findParamSlots(callee);
+  std::unordered_set<int> arrayParams;
+  std::unordered_map<const Symbol *, Operand> symbols;
+  for (const auto &entry : slots) {
+    if (static_cast<size_t>(entry.second) >= args.size() ||
+        !isArraySymbol(args[entry.second])) {
+      return false;
+    }
+    arrayParams.insert(entry.second);
+    symbols[entry.first] = args[entry.second];
+  }
+  for (const auto &bb : callee.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      if (inst->getOp() != OpCode::ALLOCA ||
+          inst->getArg1().getType() != OperandType::Variable) {
+        continue;
+      }
+      const auto &sym = inst->getArg1().asSymbol();
+      if (!symbols.count(sym.get())) {
+        symbols[sym.get()] = Operand::Variable(std::make_shared<Symbol>(
+            _nextSymbolId++, sym->name, sym->type, sym->line));
+      }
+    }
+  }
+
+  std::unordered_map<int, Operand> temps;
+  std::unordered_map<int, int> labels;
+  std::unordered_map<const BasicBlock *, BasicBlock *> clones;
+  auto mapOp = [&](const Operand &op) -> Operand {
+    switch (op.getType()) {
+    case OperandType::Temporary: {
+      auto it = temps.find(op.asInt());
+      if (it == temps.end()) {
+        Operand fresh = Operand::Temporary(caller.allocateTemp());
+        it = temps.emplace(op.asInt(), fresh).first;
+      }
+      return it->second;
+    }
+    case OperandType::Label: {
+      auto it = labels.find(op.asInt());
+      return it == labels.end() ? op : Operand::Label(it->second);
+    }
+    case OperandType::Variable: {
+      auto it = symbols.find(op.asSymbol().get());
+      return it == symbols.end() ? op : it->second;
+    }
+    default:
+      return op;
+    }
+  };
+
+  // the copies and the second half of the call block go in right after it
+  auto &blocks = caller.getBlocks();
+  size_t firstNew = blocks.size();
+  std::vector<const BasicBlock *> order = reachableBlocks(callee);
+  for (const BasicBlock *bb : order) {
+    BasicBlock *clone = caller.createBlock().get();
+    int label = caller.allocateLabel();
+    clone->addInstruction(std::make_unique<Instruction>(
+        Instruction::MakeLabel(Operand::Label(label))));
+    if (bb->getLabelId() != -1) {
+      labels[bb->getLabelId()] = label;
+    }
+    clones[bb] = clone;
+  }
+  BasicBlock *cont = caller.createBlock().get();
+  cont->addInstruction(std::make_unique<Instruction>(
+      Instruction::MakeLabel(Operand::Label(caller.allocateLabel()))));
+
+  std::vector<std::pair<Operand, BasicBlock *>> returns;
+  std::vector<std::unique_ptr<Instruction>> allocas;
+  for (const BasicBlock *bb : order) {
+    BasicBlock *clone = clones[bb];
+    bool returned = false;
+    for (const auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      const Operand &a1 = inst->getArg1();
+      const Operand &a2 = inst->getArg2();
+      const Operand &res = inst->getResult();
+      if (op == OpCode::LABEL || op == OpCode::NOP) {
+        continue;
+      }
+      if (op == OpCode::RETURN) {
+        returns.push_back({mapOp(res), clone});
+        returned = true;
+        break;
+      }
+      if (op == OpCode::PARAM) {
+        if (!arrayParams.count(a1.asInt()) &&
+            static_cast<size_t>(a1.asInt()) < args.size()) {
+          clone->addInstruction(std::make_unique<Instruction>(
+              Instruction::MakeAssign(args[a1.asInt()], mapOp(res))));
+        }
+        continue;
+      }
+      bool slot = a2.getType() == OperandType::Variable &&
+                  slots.count(a2.asSymbol().get());
+      if (op == OpCode::STORE && slot &&
+          res.getType() == OperandType::Empty) {
+        continue;
+      }
+      if (op == OpCode::ALLOCA) {
+        if (!slots.count(a1.asSymbol().get())) {
+          allocas.push_back(std::make_unique<Instruction>(
+              op, mapOp(a1), mapOp(a2), mapOp(res)));
+        }
+        continue;
+      }
+      if (op == OpCode::PHI) {
+        auto phi =
+            std::make_unique<Instruction>(Instruction::MakePhi(mapOp(res)));
+        for (const auto &pair : inst->getPhiArgs()) {
+          auto it = clones.find(pair.second);
+          if (it != clones.end()) {
+            phi->addPhiArg(mapOp(pair.first), it->second);
+          }
+        }
+        clone->addInstruction(std::move(phi));
+        continue;
+      }
+      if (op == OpCode::CALL) {
+        ++_callSites[inst->getCalleeName()];
+      }
+      clone->addInstruction(std::make_unique<Instruction>(
+          op, mapOp(a1), mapOp(a2), mapOp(res)));
+    }
+    if (returned) {
+      continue;
+    }
+    if (bb->next) {
+      clone->next = caller.getBlockSharedPtr(clones[bb->next.get()]);
+    }
+    if (bb->jumpTarget) {
+      clone->jumpTarget =
+          caller.getBlockSharedPtr(clones[bb->jumpTarget.get()]);
+    }
+    // a void function falling off its end
+    if (!bb->next && !bb->jumpTarget) {
+      returns.push_back({Operand(), clone});
+    }
+  }
+
+  // returns leave for the second half; the last copy falls into it
+  const Operand &result = call->getResult();
+  bool hasValue = result.getType() == OperandType::Temporary &&
+                  std::any_of(returns.begin(), returns.end(),
+                              [](const std::pair<Operand, BasicBlock *> &r) {
+                                return r.first.getType() !=
+                                       OperandType::Empty;
+                              });
+  if (hasValue && returns.size() > 1) {
+    auto phi = std::make_unique<Instruction>(Instruction::MakePhi(result));
+    for (const auto &ret : returns) {
+      phi->addPhiArg(ret.first.getType() == OperandType::Empty
+                         ? Operand::ConstantInt(0)
+                         : ret.first,
+                     ret.second);
+    }
+    cont->addInstruction(std::move(phi));
+  }
+  BasicBlock *last = clones[order.back()];
+  for (const auto &ret : returns) {
+    if (hasValue && returns.size() == 1) {
+      ret.second->addInstruction(std::make_unique<Instruction>(
+          Instruction::MakeAssign(ret.first, result)));
+    }
+    if (ret.second == last) {
+      ret.second->next = caller.getBlockSharedPtr(cont);
+    } else {
+      ret.second->addInstruction(std::make_unique<Instruction>(
+          Instruction::MakeGoto(Operand::Label(cont->getLabelId()))));
+      ret.second->jumpTarget = caller.getBlockSharedPtr(cont);
+    }
+  }
+
+  // the rest of the call block moves to the second half, along with its
+  // edges
+  size_t pos = argPos.empty() ? 0 : argPos.back();
+  while (insts[pos].get() != call) {
+    ++pos;
+  }
+  for (size_t i = pos + 1; i < insts.size(); ++i) {
+    insts[i]->setParent(cont);
+    cont->getInstructions().push_back(std::move(insts[i]));
+  }
+  insts.erase(insts.begin() + pos, insts.end());
+  for (auto it = argPos.rbegin(); it != argPos.rend(); ++it) {
+    insts.erase(insts.begin() + *it);
+  }
+  cont->next = block->next;
+  cont->jumpTarget = block->jumpTarget;
+  for (BasicBlock *succ : {cont->next.get(), cont->jumpTarget.get()}) {
+    if (!succ) {
+      continue;
+    }
+    for (auto &inst : succ->getInstructions()) {
+      if (inst->getOp() != OpCode::PHI) {
+        continue;
+      }
+      for (auto &pair : inst->getPhiArgs()) {
+        if (pair.second == block) {
+          pair.second = cont;
+        }
+      }
+    }
+  }
+  block->next = caller.getBlockSharedPtr(clones[order.front()]);
+  block->jumpTarget = nullptr;
+
+  std::vector<std::shared_ptr<BasicBlock>> added(blocks.begin() + firstNew,
+                                                 blocks.end());
+  blocks.erase(blocks.begin() + firstNew, blocks.end());
+  auto at = std::find_if(blocks.begin(), blocks.end(),
+                         [&](const std::shared_ptr<BasicBlock> &bb) {
+                           return bb.get() == block;
+                         });
+  blocks.insert(std::next(at), added.begin(), added.end());
+
+  // local arrays live in the caller's frame
+  BasicBlock *entry = blocks.front().get();
+  auto &entryInsts = entry->getInstructions();
+  auto into = entryInsts.begin();
+  while (into != entryInsts.end() && (*into)->getOp() == OpCode::LABEL) {
+    ++into;
+  }
+  for (auto &alloca : allocas) {
+    alloca->setParent(entry);
+  }
+  entryInsts.insert(into, std::make_move_iterator(allocas.begin()),
+                    std::make_move_iterator(allocas.end()));
+  --_callSites[callee.getName()];
+  return true;
+}
+
+bool InlinePass::run(std::vector<std::shared_ptr<Function>> &functions,
+                     AnalysisManager &am) {
+  std::unordered_map<std::string, Function *> byName;
+  std::unordered_map<std::string, std::vector<std::string>> callees;
+  _callSites.clear();
+  _nextSymbolId = 0;
+  for (const auto &fp : functions) {
+    byName[fp->getName()] = fp.get();
+    for (const auto &bb : fp->getBlocks()) {
+      for (const auto &inst : bb->getInstructions()) {
+        for (const Operand *op :
+             {&inst->getArg1(), &inst->getArg2(), &inst->getResult()}) {
+          if (op->getType() == OperandType::Variable) {
+            _nextSymbolId = std::max(_nextSymbolId, op->asSymbol()->id + 1);
+          }
+        }
+        if (inst->getOp() == OpCode::CALL) {
+          ++_callSites[inst->getCalleeName()];
+          callees[fp->getName()].push_back(inst->getCalleeName());
+        }
+      }
+    }
+  }
+
+  // strongly connected components of the call graph, callees first
+  std::vector<Function *> order;
+  std::unordered_set<std::string> recursive;
+  std::unordered_map<std::string, int> index;
+  std::unordered_map<std::string, int> low;
+  std::vector<std::string> stack;
+  std::unordered_set<std::string> onStack;
+  std::function<void(const std::string &)> visit =
+      [&](const std::string &name) {
+        index[name] = low[name] = static_cast<int>(index.size());
+        stack.push_back(name);
+        onStack.insert(name);
+        for (const std::string &callee : callees[name]) {
+          if (!byName.count(callee)) {
+            continue;
+          }
+          if (callee == name) {
+            recursive.insert(name);
+          }
+          if (!index.count(callee)) {
+            visit(callee);
+            low[name] = std::min(low[name], low[callee]);
+          } else if (onStack.count(callee)) {
+            low[name] = std::min(low[name], index[callee]);
+          }
+        }
+        if (low[name] != index[name]) {
+          return;
+        }
+        std::vector<std::string> component;
+        do {
+          component.push_back(stack.back());
+          onStack.erase(stack.back());
+          stack.pop_back();
+        } while (component.back() != name);
+        if (component.size() > 1) {
+          recursive.insert(component.begin(), component.end());
+        }
+        for (const std::string &member : component) {
+          order.push_back(byName[member]);
+        }
+      };
+  for (const auto &fp : functions) {
+    if (!index.count(fp->getName())) {
+      visit(fp->getName());
+    }
+  }
+
+  bool changed = false;
+  for (Function *caller : order) {
+    // call sites with the number of loops around them, taken before the
+    // copies change the blocks
+    std::vector<std::pair<Instruction *, int>> sites;
+    const auto &loops = am.getLoops(*caller);
+    for (const auto &bb : caller->getBlocks()) {
+      int depth = 0;
+      for (const auto &loop : loops) {
+        depth += loop.blocks.count(bb.get()) > 0;
+      }
+      for (const auto &inst : bb->getInstructions()) {
+        if (inst->getOp() == OpCode::CALL) {
+          sites.push_back({inst.get(), depth});
+        }
+      }
+    }
+    int size = sizeOf(*caller);
+    bool inlined = false;
+    for (const auto &site : sites) {
+      auto it = byName.find(site.first->getCalleeName());
+      if (it == byName.end() || it->second == caller ||
+          recursive.count(it->first) || it->first == "main") {
+        continue;
+      }
+      const Function &callee = *it->second;
+      bool loops = !am.getLoops(*it->second).empty();
+      if (!isInlinable(callee) ||
+          !shouldInline(callee, *site.first, site.second, size, loops)) {
+        continue;
+      }
+      int calleeSize = sizeOf(callee);
+      if (inlineCall(*caller, site.first, callee)) {
+        size += calleeSize;
+        inlined = true;
+      }
+    }
+    if (inlined) {
+      am.invalidate(*caller, PreservedAnalyses::none());
+      changed = true;
+    }
+  }
+
+  // callees whose every call was inlined
+  functions.erase(
+      std::remove_if(functions.begin(), functions.end(),
+                     [&](const std::shared_ptr<Function> &fp) {
+                       if (fp->getName() == "main" ||
+                           _callSites[fp->getName()] > 0) {
+                         return false;
+                       }
+                       am.invalidate(*fp, PreservedAnalyses::none());
+                       return true;
+                     }),
+      functions.end());
+  return changed;
+}
@@ -0,0 +1,746 @@
+#include "optimize/JumpThreading.hpp"
+#include "codegen/Instruction.hpp"
+#include <algorithm>
+#include <climits>
+#include <set>
+
+namespace {
+
+/**
+ * @brief instructions other than labels, phis and the branch a threaded
+ * block may hold; each thread copies them once
+ */
+constexpr size_t MAX_THREADED_SIZE = 6;
+
+/**
+ * @brief edges threaded in one run, bounding the code added per round
+ */
+constexpr int MAX_THREADS_PER_RUN = 16;
+
+/**
+ * @brief relations between two values as a set of {<, =, >}
+ */
+constexpr int REL_LT = 1;
+constexpr int REL_EQ = 2;
+constexpr int REL_GT = 4;
+
+std::vector<BasicBlock *> getSuccessors(BasicBlock *bb) {
+  std::vector<BasicBlock *> succs;
+  auto &insts = bb->getInstructions();
+  OpCode last = insts.empty() ? OpCode::NOP : insts.back()->getOp();
+  if (last == OpCode::RETURN) {
+    return succs;
+  }
+  if ((last == OpCode::GOTO || last == OpCode::IF) && bb->jumpTarget) {
+    succs.push_back(bb->jumpTarget.get());
+  }
+  if (last != OpCode::GOTO && bb->next &&
+      std::find(succs.begin(), succs.end(), bb->next.get()) == succs.end()) {
+    succs.push_back(bb->next.get());
+  }
+  return succs;
+}
+
+bool definesTemp(const Instruction &inst) {
+  OpCode op = inst.getOp();
+  return op != OpCode::STORE && op != OpCode::RETURN &&
+         op != OpCode::ALLOCA && op != OpCode::LABEL && op != OpCode::IF &&
+         op != OpCode::GOTO &&
+         inst.getResult().getType() == OperandType::Temporary;
+}
+
+bool isCompare(OpCode op) {
+  switch (op) {
+  case OpCode::EQ:
+  case OpCode::NEQ:
+  case OpCode::LT:
+  case OpCode::LE:
+  case OpCode::GT:
+  case OpCode::GE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+int relationOf(OpCode op) {
+  switch (op) {
+  case OpCode::EQ:
+    return REL_EQ;
+  case OpCode::NEQ:
+    return REL_LT | REL_GT;
+  case OpCode::LT:
+    return REL_LT;
+  case OpCode::LE:
+    return REL_LT | REL_EQ;
+  case OpCode::GT:
+    return REL_GT;
+  case OpCode::GE:
+    return REL_GT | REL_EQ;
+  default:
+    return REL_LT | REL_EQ | REL_GT;
+  }
+}
+
+/**
+ * @brief the relation of b to a, given that of a to b
+ */
+int mirror(int rel) {
+  return (rel & REL_EQ) | (rel & REL_LT ? REL_GT : 0) |
+         (rel & REL_GT ? REL_LT : 0);
+}
+
+OpCode negate(OpCode op) {
+  switch (op) {
+  case OpCode::EQ:
+    return OpCode::NEQ;
+  case OpCode::NEQ:
+    return OpCode::EQ;
+  case OpCode::LT:
+    return OpCode::GE;
+  case OpCode::LE:
+    return OpCode::GT;
+  case OpCode::GT:
+    return OpCode::LE;
+  default:
+    return OpCode::LT;
+  }
+}
+
+/**
+ * @brief constant value of `x op y`, with 32-bit wraparound
+ */
+bool fold(OpCode op, int x, int y, int &out) {
+  uint32_t ux = static_cast<uint32_t>(x);
+  uint32_t uy = static_cast<uint32_t>(y);
+  switch (op) {
+  case OpCode::ASSIGN:
+    out = x;
+    return true;
+  case OpCode::ADD:
+    out = static_cast<int>(ux + uy);
+    return true;
+  case OpCode::SUB:
+    out = static_cast<int>(ux - uy);
+    return true;
+  case OpCode::MUL:
+    out = static_cast<int>(ux * uy);
+    return true;
+  case OpCode::NEG:
+    out = static_cast<int>(0u - ux);
+    return true;
+  case OpCode::NOT:
+    out = !x;
+    return true;
+  case OpCode::AND:
+    out = x != 0 && y != 0;
+    return true;
+  case OpCode::OR:
+    out = x != 0 || y != 0;
+    return true;
+  case OpCode::EQ:
+    out = x == y;
+    return true;
+  case OpCode::NEQ:
+    out = x != y;
+    return true;
+  case OpCode::LT:
+    out = x < y;
+    return true;
+  case OpCode::LE:
+    out = x <= y;
+    return true;
+  case OpCode::GT:
+    out = x > y;
+    return true;
+  case OpCode::GE:
+    out = x >= y;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief position after the labels and phis of bb
+ */
+std::vector<std::unique_ptr<Instruction>>::iterator
+firstInsertionPoint(BasicBlock *bb) {
+  auto &insts = bb->getInstructions();
+  auto it = insts.begin();
+  while (it != insts.end() && ((*it)->getOp() == OpCode::LABEL ||
+                               (*it)->getOp() == OpCode::PHI)) {
+    ++it;
+  }
+  return it;
+}
+
+/**
+ * @brief position of the branch ending bb, or its end
+ */
+std::vector<std::unique_ptr<Instruction>>::iterator
+terminatorPosition(BasicBlock *bb) {
+  auto &insts = bb->getInstructions();
+  if (!insts.empty() && (insts.back()->getOp() == OpCode::GOTO ||
+                         insts.back()->getOp() == OpCode::IF)) {
+    return insts.end() - 1;
+  }
+  return insts.end();
+}
+
+} // namespace
+
+bool JumpThreadingPass::run(Function &func) {
+  if (func.getBlocks().empty()) {
+    return false;
+  }
+  _nextSymbolId = 0;
+  for (const auto &bb : func.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      for (const Operand *op :
+           {&inst->getArg1(), &inst->getArg2(), &inst->getResult()}) {
+        if (op->getType() == OperandType::Variable) {
+          _nextSymbolId = std::max(_nextSymbolId, op->asSymbol()->id + 1);
+        }
+      }
+    }
+  }
+  analyze(func);
+  bool changed = propagate(func);
+  for (int i = 0; i < MAX_THREADS_PER_RUN; ++i) {
+    if (i > 0) {
+      analyze(func);
+    }
+    if (!threadOne(func)) {
+      break;
+    }
+    changed = true;
+  }
+  return changed;
+}
+
+void JumpThreadingPass::analyze(Function &func) {
+  _defCount.clear();
+  _defInst.clear();
+  _preds.clear();
+  _facts.clear();
+  for (const auto &bb : func.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      if (definesTemp(*inst)) {
+        _defCount[inst->getResult().asInt()]++;
+        _defInst[inst->getResult().asInt()] = inst.get();
+      }
+    }
+  }
+  _DT.run(func);
+  for (BasicBlock *bb : _DT.getReversePostOrder()) {
+    for (BasicBlock *succ : getSuccessors(bb)) {
+      _preds[succ].push_back(bb);
+    }
+  }
+  // a predicate of an edge into a block with no other predecessor holds in
+  // every block that block dominates; single-def values never change there
+  for (BasicBlock *bb : _DT.getReversePostOrder()) {
+    BasicBlock *idom = _DT.getImmediateDominator(bb);
+    Facts facts = idom ? _facts[idom] : Facts();
+    const auto &preds = _preds[bb];
+    if (preds.size() == 1 && preds.front() != bb) {
+      addEdgeFacts(preds.front(), bb, facts);
+    }
+    _facts[bb] = std::move(facts);
+  }
+}
+
+bool JumpThreadingPass::isValue(const Operand &op) const {
+  if (op.getType() == OperandType::ConstantInt) {
+    return true;
+  }
+  if (op.getType() != OperandType::Temporary) {
+    return false;
+  }
+  auto it = _defCount.find(op.asInt());
+  return it != _defCount.end() && it->second == 1;
+}
+
+void JumpThreadingPass::addEdgeFacts(BasicBlock *from, BasicBlock *to,
+                                     Facts &facts) const {
+  auto &insts = from->getInstructions();
+  if (insts.empty() || insts.back()->getOp() != OpCode::IF ||
+      !from->jumpTarget || !from->next || from->jumpTarget == from->next) {
+    return;
+  }
+  const Operand &cond = insts.back()->getArg1();
+  if (cond.getType() != OperandType::Temporary || !isValue(cond)) {
+    return;
+  }
+  bool taken = from->jumpTarget.get() == to;
+  facts.push_back(
+      {taken ? OpCode::NEQ : OpCode::EQ, cond, Operand::ConstantInt(0)});
+  const Instruction *def = _defInst.at(cond.asInt());
+  if (isCompare(def->getOp()) && isValue(def->getArg1()) &&
+      isValue(def->getArg2())) {
+    facts.push_back({taken ? def->getOp() : negate(def->getOp()),
+                     def->getArg1(), def->getArg2()});
+  }
+}
+
+int JumpThreadingPass::decide(OpCode op, const Operand &a, const Operand &b,
+                              const Facts &facts) const {
+  if (!isCompare(op) || !isValue(a) || !isValue(b)) {
+    return -1;
+  }
+  bool constA = a.getType() == OperandType::ConstantInt;
+  bool constB = b.getType() == OperandType::ConstantInt;
+  if (constA && constB) {
+    int out = 0;
+    fold(op, a.asInt(), b.asInt(), out);
+    return out;
+  }
+  int known = REL_LT | REL_EQ | REL_GT;
+  if (a == b) {
+    known = REL_EQ;
+  } else if (!constA && !constB) {
+    for (const Fact &f : facts) {
+      if (f.a == a && f.b == b) {
+        known &= relationOf(f.op);
+      } else if (f.a == b && f.b == a) {
+        known &= mirror(relationOf(f.op));
+      }
+    }
+  } else {
+    // the range of x against constants, then where c falls in it
+    const Operand &x = constA ? b : a;
+    long long c = constA ? a.asInt() : b.asInt();
+    long long lo = INT_MIN;
+    long long hi = INT_MAX;
+    std::set<long long> excluded;
+    for (const Fact &f : facts) {
+      int rel = 0;
+      long long k = 0;
+      if (f.a == x && f.b.getType() == OperandType::ConstantInt) {
+        rel = relationOf(f.op);
+        k = f.b.asInt();
+      } else if (f.b == x && f.a.getType() == OperandType::ConstantInt) {
+        rel = mirror(relationOf(f.op));
+        k = f.a.asInt();
+      } else {
+        continue;
+      }
+      if (rel == (REL_LT | REL_GT)) {
+        excluded.insert(k);
+        continue;
+      }
+      if (!(rel & REL_GT)) {
+        hi = std::min(hi, rel & REL_EQ ? k : k - 1);
+      }
+      if (!(rel & REL_LT)) {
+        lo = std::max(lo, rel & REL_EQ ? k : k + 1);
+      }
+    }
+    known = 0;
+    if (lo < c) {
+      known |= REL_LT;
+    }
+    if (hi > c) {
+      known |= REL_GT;
+    }
+    if (lo <= c && c <= hi && !excluded.count(c)) {
+      known |= REL_EQ;
+    }
+    if (constA) {
+      known = mirror(known);
+    }
+  }
+  int query = relationOf(op);
+  // no relation left: the block is unreachable, leave it alone
+  if (known == 0) {
+    return -1;
+  }
+  if ((known & ~query) == 0) {
+    return 1;
+  }
+  if ((known & query) == 0) {
+    return 0;
+  }
+  return -1;
+}
+
+bool JumpThreadingPass::propagate(Function &func) {
+  bool changed = false;
+  for (const auto &bb : func.getBlocks()) {
+    auto factsIt = _facts.find(bb.get());
+    if (factsIt == _facts.end() || factsIt->second.empty()) {
+      continue;
+    }
+    const Facts &facts = factsIt->second;
+    // a value pinned by `x == k`
+    auto pinned = [&](const Operand &op, Operand &value) {
+      if (op.getType() != OperandType::Temporary || !isValue(op)) {
+        return false;
+      }
+      for (const Fact &f : facts) {
+        if (f.op != OpCode::EQ) {
+          continue;
+        }
+        if (f.a == op && f.b.getType() == OperandType::ConstantInt) {
+          value = f.b;
+          return true;
+        }
+        if (f.b == op && f.a.getType() == OperandType::ConstantInt) {
+          value = f.a;
+          return true;
+        }
+      }
+      return false;
+    };
+    for (auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op == OpCode::PHI || op == OpCode::LABEL || op == OpCode::PARAM ||
+          op == OpCode::ALLOCA) {
+        continue;
+      }
+      Operand value;
+      if (pinned(inst->getArg1(), value)) {
+        inst->setArg1(value);
+        changed = true;
+      }
+      if (pinned(inst->getArg2(), value)) {
+        inst->setArg2(value);
+        changed = true;
+      }
+      if ((op == OpCode::STORE || op == OpCode::RETURN) &&
+          pinned(inst->getResult(), value)) {
+        inst->setResult(value);
+        changed = true;
+      }
+      if (isCompare(op) && inst->getResult().getType() ==
+                               OperandType::Temporary) {
+        int known = decide(op, inst->getArg1(), inst->getArg2(), facts);
+        if (known >= 0) {
+          inst->setOp(OpCode::ASSIGN);
+          inst->setArg1(Operand::ConstantInt(known));
+          inst->setArg2(Operand());
+          changed = true;
+        }
+      } else if (op == OpCode::IF &&
+                 inst->getArg1().getType() == OperandType::Temporary) {
+        int known =
+            decide(OpCode::NEQ, inst->getArg1(), Operand::ConstantInt(0),
+                   facts);
+        if (known >= 0) {
+          inst->setArg1(Operand::ConstantInt(known));
+          changed = true;
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+BasicBlock *JumpThreadingPass::knownSuccessor(BasicBlock *bb,
+                                              BasicBlock *pred) const {
+  // values of bb as seen on the edge from pred
+  std::unordered_map<int, Operand> env;
+  auto valueOf = [&](const Operand &op) {
+    if (op.getType() == OperandType::Temporary) {
+      auto it = env.find(op.asInt());
+      if (it != env.end()) {
+        return it->second;
+      }
+    }
+    return op;
+  };
+  Facts facts = _facts.at(pred);
+  addEdgeFacts(pred, bb, facts);
+  for (auto &inst : bb->getInstructions()) {
+    OpCode op = inst->getOp();
+    if (op == OpCode::LABEL) {
+      continue;
+    }
+    if (op == OpCode::PHI) {
+      bool found = false;
+      for (const auto &pair : inst->getPhiArgs()) {
+        if (pair.second == pred) {
+          env[inst->getResult().asInt()] = pair.first;
+          found = true;
+        }
+      }
+      if (!found) {
+        return nullptr;
+      }
+      continue;
+    }
+    Operand a = valueOf(inst->getArg1());
+    Operand b = valueOf(inst->getArg2());
+    if (op == OpCode::IF) {
+      int known = a.getType() == OperandType::ConstantInt
+                      ? a.asInt() != 0
+                      : decide(OpCode::NEQ, a, Operand::ConstantInt(0), facts);
+      if (known < 0) {
+        return nullptr;
+      }
+      return known ? bb->jumpTarget.get() : bb->next.get();
+    }
+    if (!definesTemp(*inst)) {
+      continue;
+    }
+    int out = 0;
+    bool unary = op == OpCode::ASSIGN || op == OpCode::NEG ||
+                 op == OpCode::NOT;
+    if (a.getType() == OperandType::ConstantInt &&
+        (unary || b.getType() == OperandType::ConstantInt) &&
+        fold(op, a.asInt(), unary ? 0 : b.asInt(), out)) {
+      env[inst->getResult().asInt()] = Operand::ConstantInt(out);
+    } else if (op == OpCode::ASSIGN) {
+      env[inst->getResult().asInt()] = a;
+    } else if (isCompare(op)) {
+      int known = decide(op, a, b, facts);
+      if (known >= 0) {
+        env[inst->getResult().asInt()] = Operand::ConstantInt(known);
+      }
+    }
+  }
+  return nullptr;
+}
+
+bool JumpThreadingPass::threadOne(Function &func) {
+  for (const auto &bbPtr : func.getBlocks()) {
+    BasicBlock *bb = bbPtr.get();
+    auto &insts = bb->getInstructions();
+    if (!_DT.isReachable(bb) || insts.empty() ||
+        insts.back()->getOp() != OpCode::IF || !bb->jumpTarget ||
+        !bb->next || bb->jumpTarget == bb->next) {
+      continue;
+    }
+    const auto &preds = _preds[bb];
+    if (preds.size() < 2) {
+      continue;
+    }
+    bool header = false;
+    for (BasicBlock *pred : preds) {
+      header = header || _DT.dominates(bb, pred);
+    }
+    size_t size = 0;
+    bool copyable = true;
+    for (auto &inst : insts) {
+      OpCode op = inst->getOp();
+      if (op == OpCode::LABEL || op == OpCode::PHI || op == OpCode::IF) {
+        continue;
+      }
+      size++;
+      if (op == OpCode::ALLOCA || op == OpCode::PARAM ||
+          (definesTemp(*inst) && _defCount[inst->getResult().asInt()] != 1)) {
+        copyable = false;
+      }
+    }
+    for (auto &inst : insts) {
+      if (inst->getOp() == OpCode::PHI &&
+          (inst->getResult().getType() != OperandType::Temporary ||
+           _defCount[inst->getResult().asInt()] != 1)) {
+        copyable = false;
+      }
+    }
+    if (header || !copyable || size > MAX_THREADED_SIZE) {
+      continue;
+    }
+    for (BasicBlock *pred : preds) {
+      if (pred->jumpTarget.get() == bb && pred->next.get() == bb) {
+        continue;
+      }
+      BasicBlock *succ = knownSuccessor(bb, pred);
+      if (succ) {
+        thread(func, bb, pred, succ);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void JumpThreadingPass::thread(Function &func, BasicBlock *bb,
+                               BasicBlock *pred, BasicBlock *succ) {
+  auto &blocks = func.getBlocks();
+  auto copyPtr = func.createBlock();
+  BasicBlock *copy = copyPtr.get();
+  OpCode predLast = pred->getInstructions().empty()
+                        ? OpCode::NOP
+                        : pred->getInstructions().back()->getOp();
+  bool fallthrough = predLast != OpCode::GOTO &&
+                     predLast != OpCode::RETURN && pred->next.get() == bb;
+  // a fallthrough predecessor needs the copy right behind it
+  if (fallthrough) {
+    blocks.pop_back();
+    auto predPos = std::find_if(blocks.begin(), blocks.end(),
+                                [&](const std::shared_ptr<BasicBlock> &p) {
+                                  return p.get() == pred;
+                                });
+    blocks.insert(predPos + 1, copyPtr);
+  }
+  int copyLabel = func.allocateLabel();
+  copy->addInstruction(std::make_unique<Instruction>(
+      Instruction::MakeLabel(Operand::Label(copyLabel))));
+
+  // phis take the value of the edge, definitions get new temps
+  std::unordered_map<int, Operand> map;
+  std::vector<int> defined;
+  for (auto &inst : bb->getInstructions()) {
+    if (inst->getOp() == OpCode::PHI) {
+      for (const auto &pair : inst->getPhiArgs()) {
+        if (pair.second == pred) {
+          map[inst->getResult().asInt()] = pair.first;
+        }
+      }
+      defined.push_back(inst->getResult().asInt());
+    } else if (definesTemp(*inst)) {
+      map[inst->getResult().asInt()] =
+          Operand::Temporary(func.allocateTemp());
+      defined.push_back(inst->getResult().asInt());
+    }
+  }
+  auto mapped = [&](const Operand &op) {
+    if (op.getType() == OperandType::Temporary) {
+      auto it = map.find(op.asInt());
+      if (it != map.end()) {
+        return it->second;
+      }
+    }
+    return op;
+  };
+  for (auto &inst : bb->getInstructions()) {
+    OpCode op = inst->getOp();
+    if (op == OpCode::LABEL || op == OpCode::PHI || op == OpCode::IF) {
+      continue;
+    }
+    copy->addInstruction(std::make_unique<Instruction>(
+        op, mapped(inst->getArg1()), mapped(inst->getArg2()),
+        mapped(inst->getResult())));
+  }
+  if (succ->getLabelId() < 0) {
+    succ->getInstructions().insert(
+        succ->getInstructions().begin(),
+        std::make_unique<Instruction>(
+            Instruction::MakeLabel(Operand::Label(func.allocateLabel()))));
+  }
+  copy->addInstruction(std::make_unique<Instruction>(
+      Instruction::MakeGoto(Operand::Label(succ->getLabelId()))));
+  copy->jumpTarget = func.getBlockSharedPtr(succ);
+
+  for (auto &inst : succ->getInstructions()) {
+    if (inst->getOp() != OpCode::PHI) {
+      continue;
+    }
+    for (size_t i = 0, n = inst->getPhiArgs().size(); i < n; ++i) {
+      auto pair = inst->getPhiArgs()[i];
+      if (pair.second == bb) {
+        inst->addPhiArg(mapped(pair.first), copy);
+      }
+    }
+  }
+  for (auto &inst : bb->getInstructions()) {
+    if (inst->getOp() != OpCode::PHI) {
+      continue;
+    }
+    auto &args = inst->getPhiArgs();
+    args.erase(std::remove_if(args.begin(), args.end(),
+                              [&](const std::pair<Operand, BasicBlock *> &p) {
+                                return p.second == pred;
+                              }),
+               args.end());
+    if (args.size() == 1) {
+      inst->setOp(OpCode::ASSIGN);
+      inst->setArg1(args.front().first);
+      args.clear();
+    }
+  }
+  if (fallthrough) {
+    pred->next = copyPtr;
+  } else {
+    pred->getInstructions().back()->setResult(Operand::Label(copyLabel));
+    pred->jumpTarget = copyPtr;
+  }
+
+  // values of bb read elsewhere now come from bb or the copy: both store
+  // them to a local, and every other reader loads it
+  BasicBlock *entry = blocks.front().get();
+  for (int t : defined) {
+    Operand value = Operand::Temporary(t);
+    std::vector<std::pair<Instruction *, BasicBlock *>> readers;
+    for (const auto &other : blocks) {
+      if (other.get() == bb || other.get() == copy) {
+        continue;
+      }
+      for (auto &inst : other->getInstructions()) {
+        if (inst->getOp() == OpCode::PHI) {
+          for (const auto &pair : inst->getPhiArgs()) {
+            if (pair.first == value && pair.second != bb &&
+                pair.second != copy) {
+              readers.push_back({inst.get(), other.get()});
+              break;
+            }
+          }
+          continue;
+        }
+        bool resultIsUse = inst->getOp() == OpCode::STORE ||
+                           inst->getOp() == OpCode::RETURN;
+        if (inst->getArg1() == value || inst->getArg2() == value ||
+            (resultIsUse && inst->getResult() == value)) {
+          readers.push_back({inst.get(), other.get()});
+        }
+      }
+    }
+    if (readers.empty()) {
+      continue;
+    }
+    auto sym = std::make_shared<Symbol>(_nextSymbolId++, "jt",
+                                        Type::getIntType(), 0);
+    Operand local = Operand::Variable(sym);
+    entry->getInstructions().insert(
+        firstInsertionPoint(entry),
+        std::make_unique<Instruction>(
+            Instruction::MakeAlloca(local, Operand::ConstantInt(1))));
+    for (BasicBlock *def : {bb, copy}) {
+      def->getInstructions().insert(
+          terminatorPosition(def),
+          std::make_unique<Instruction>(Instruction::MakeAssign(
+              def == bb ? value : mapped(value), local)));
+    }
+    auto load = [&](BasicBlock *at,
+                    std::vector<std::unique_ptr<Instruction>>::iterator pos) {
+      Operand tmp = Operand::Temporary(func.allocateTemp());
+      at->getInstructions().insert(
+          pos, std::make_unique<Instruction>(
+                   Instruction::MakeAssign(local, tmp)));
+      return tmp;
+    };
+    for (auto &reader : readers) {
+      Instruction *inst = reader.first;
+      BasicBlock *at = reader.second;
+      if (inst->getOp() == OpCode::PHI) {
+        for (auto &pair : inst->getPhiArgs()) {
+          if (pair.first == value && pair.second != bb &&
+              pair.second != copy) {
+            pair.first = load(pair.second, terminatorPosition(pair.second));
+          }
+        }
+        continue;
+      }
+      auto &atInsts = at->getInstructions();
+      auto pos = std::find_if(atInsts.begin(), atInsts.end(),
+                              [&](const std::unique_ptr<Instruction> &p) {
+                                return p.get() == inst;
+                              });
+      Operand tmp = load(at, pos);
+      if (inst->getArg1() == value) {
+        inst->setArg1(tmp);
+      }
+      if (inst->getArg2() == value) {
+        inst->setArg2(tmp);
+      }
+      if ((inst->getOp() == OpCode::STORE ||
+           inst->getOp() == OpCode::RETURN) &&
+          inst->getResult() == value) {
+        inst->setResult(tmp);
+      }
+    }
+  }
+}
@@ -54,8 +54,18 @@ BasicBlock *LICMPass::getOrCreatePreheader(const LoopInfo &loop, Function &F) {
     }
   }
 
-  // need to create a new preheader
+  // need to create a new preheader, right in front of the header: the last
+  // block of a void function may fall off its end
+  auto &blocks = F.getBlocks();
   auto newBlockPtr = F.createBlock();
+  blocks.pop_back();
+  auto headerPos = std::find_if(blocks.begin(), blocks.end(),
+                                [&](const std::shared_ptr<BasicBlock> &p) {
+                                  return p.get() == header;
+                                });
+  BasicBlock *layoutPred =
+      headerPos == blocks.begin() ? nullptr : std::prev(headerPos)->get();
+  blocks.insert(headerPos, newBlockPtr);
   BasicBlock *preheader = newBlockPtr.get();
   // allocate new label for new preheader
   int preHeaderLabelId = F.allocateLabel();
@@ -64,6 +74,14 @@ BasicBlock *LICMPass::getOrCreatePreheader(const LoopInfo &loop, Function &F) {
   preheader->addInstruction(std::make_unique<Instruction>(
       Instruction::MakeGoto(Operand::Label(header->getLabelId()))));
   preheader->jumpTarget = F.getBlockSharedPtr(header);
+  // a latch that fell through into the header now needs the jump
+  if (layoutPred && layoutPred->next.get() == header &&
+      loop.blocks.count(layoutPred) &&
+      (layoutPred->getInstructions().empty() ||
+       layoutPred->getInstructions().back()->getOp() != OpCode::GOTO)) {
+    layoutPred->addInstruction(std::make_unique<Instruction>(
+        Instruction::MakeGoto(Operand::Label(header->getLabelId()))));
+  }
 
   int targetLabelId = header->getLabelId();
   for (BasicBlock *pred : outsidePreds) {
@@ -98,6 +116,9 @@ BasicBlock *LICMPass::getOrCreatePreheader(const LoopInfo &loop, Function &F) {
 
   // update phi node in header
   for (auto &inst : header->getInstructions()) {
+    if (inst->getOp() == OpCode::LABEL) {
+      continue;
+    }
     if (inst->getOp() != OpCode::PHI) {
       break;
     }
@@ -141,6 +162,14 @@ BasicBlock *LICMPass::getOrCreatePreheader(const LoopInfo &loop, Function &F) {
   return preheader;
 }
 
+static bool isArraySymbol(const Operand &op) {
+  if (op.getType() != OperandType::Variable) {
+    return false;
+  }
+  const auto &sym = op.asSymbol();
+  return sym && sym->type && sym->type->category == Type::Category::Array;
+}
+
 static bool isSafeToSpeculate(OpCode op) {
   if (op == OpCode::DIV || op == OpCode::MOD) {
     return false;
@@ -148,16 +177,149 @@ static bool isSafeToSpeculate(OpCode op) {
   return true;
 }
 
-bool LICMPass::isLoopInvariant(const Instruction *inst, const LoopInfo &loop,
+bool LICMPass::isInvariantLoad(const Instruction *inst, BasicBlock *block,
+                               const LoopMemory &memory, DominatorTree &DT) {
+  const Operand &base = inst->getArg1();
+  const Operand &idx = inst->getArg2();
+  // an address, the pointer in a parameter's slot (set once on entry), or
+  // a scalar left to the operand checks
+  if (base.getType() == OperandType::Variable &&
+      idx.getType() == OperandType::Empty) {
+    return true;
+  }
+  MemoryLocation loc = AA.getLocation(base, idx);
+  for (const Instruction *call : memory.calls) {
+    if (modRef.mayWrite(*call, loc, AA)) {
+      return false;
+    }
+  }
+  for (const MemoryLocation &store : memory.stores) {
+    if (AA.alias(loc, store) != AliasResult::NoAlias) {
+      return false;
+    }
+  }
+  if (loc.object && loc.base == -1 && loc.index == -1 && loc.offset >= 0 &&
+      loc.offset / 4 < AA.getSize(loc.object)) {
+    return true;
+  }
+  if (memory.exiting.empty()) {
+    return false;
+  }
+  for (BasicBlock *exiting : memory.exiting) {
+    if (!DT.dominates(block, exiting)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief the ARGs of a call, in order; false when they are not all in its
+ * block
+ */
+static bool getCallArgs(BasicBlock *block, const Instruction *call,
+                        std::vector<Instruction *> &args) {
+  auto &insts = block->getInstructions();
+  auto it = std::find_if(insts.begin(), insts.end(),
+                         [&](const std::unique_ptr<Instruction> &inst) {
+                           return inst.get() == call;
+                         });
+  size_t argc = call->getArg1().asInt();
+  args.clear();
+  while (args.size() < argc && it != insts.begin()) {
+    --it;
+    if ((*it)->getOp() == OpCode::CALL) {
+      break;
+    }
+    if ((*it)->getOp() == OpCode::ARG) {
+      args.push_back(it->get());
+    }
+  }
+  std::reverse(args.begin(), args.end());
+  return args.size() == argc;
+}
+
+bool LICMPass::isInvariantCall(const Instruction *call, BasicBlock *block,
+                               const std::vector<Instruction *> &args,
+                               const std::set<int> &modifiedVars,
+                               const LoopMemory &memory, DominatorTree &DT) {
+  if (!modRef.isReadOnly(*call) ||
+      call->getResult().getType() != OperandType::Temporary) {
+    return false;
+  }
+  // nothing the callee reads may change in the loop
+  const ModRefAnalysis::Effects &effects = modRef.getEffects(*call);
+  std::vector<const Symbol *> arrays;
+  for (const Symbol *sym : effects.reads) {
+    if (modifiedVars.count(sym->id)) {
+      return false;
+    }
+    if (sym->type && sym->type->category == Type::Category::Array) {
+      arrays.push_back(sym);
+      continue;
+    }
+    for (const Instruction *other : memory.calls) {
+      if (modRef.mayWrite(*other, sym)) {
+        return false;
+      }
+    }
+  }
+  if (effects.readsParams) {
+    const auto &type = call->getArg2().asSymbol()->type;
+    for (size_t i = 0; i < args.size(); ++i) {
+      if (type && i < type->params.size() &&
+          type->params[i]->category != Type::Category::Array) {
+        continue;
+      }
+      arrays.push_back(AA.getUnderlyingObject(args[i]->getArg1()));
+    }
+  }
+  for (const Symbol *object : arrays) {
+    for (const MemoryLocation &store : memory.stores) {
+      if (AA.mayAliasObjects(object, store.object)) {
+        return false;
+      }
+    }
+    MemoryLocation loc{object, MemoryLocation::Unknown,
+                       MemoryLocation::Unknown, 0};
+    for (const Instruction *other : memory.calls) {
+      if (modRef.mayWrite(*other, loc, AA)) {
+        return false;
+      }
+    }
+  }
+  // the callee may fault or never return, so it must have run anyway
+  if (memory.exiting.empty()) {
+    return false;
+  }
+  for (BasicBlock *exiting : memory.exiting) {
+    if (!DT.dominates(block, exiting)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LICMPass::isLoopInvariant(const Instruction *inst, BasicBlock *block,
+                               const LoopInfo &loop,
                                const std::map<int, DefInfo> &defMap,
                                const std::set<const Instruction *> &invariants,
-                               const std::set<int> &modifiedVars, bool hasCall,
-                               DominatorTree &DT) {
+                               const std::set<int> &modifiedVars,
+                               const LoopMemory &memory, DominatorTree &DT) {
   OpCode op = inst->getOp();
-  if (op == OpCode::STORE || op == OpCode::CALL || op == OpCode::RETURN ||
+  std::vector<Instruction *> args;
+  if (op == OpCode::CALL &&
+      (!getCallArgs(block, inst, args) ||
+       !isInvariantCall(inst, block, args, modifiedVars, memory, DT))) {
+    return false;
+  }
+  if (op == OpCode::STORE || op == OpCode::RETURN ||
       op == OpCode::IF || op == OpCode::GOTO || op == OpCode::LABEL ||
-      op == OpCode::ALLOCA || op == OpCode::PHI || op == OpCode::LOAD ||
-      op == OpCode::ARG || op == OpCode::PARAM) {
+      op == OpCode::ALLOCA || op == OpCode::PHI || op == OpCode::ARG ||
+      op == OpCode::PARAM) {
+    return false;
+  }
+  if (op == OpCode::LOAD && !isInvariantLoad(inst, block, memory, DT)) {
     return false;
   }
   // ban any instruction that defines a variable
@@ -173,8 +335,10 @@ bool LICMPass::isLoopInvariant(const Instruction *inst, const LoopInfo &loop,
       if (op.asSymbol() && modifiedVars.count(op.asSymbol()->id)) {
         return false;
       }
-      if (hasCall)
-        return false;
+      for (const Instruction *call : memory.calls) {
+        if (modRef.mayWrite(*call, op.asSymbol().get()))
+          return false;
+      }
       return true;
     }
     if (op.getType() != OperandType::Temporary) {
@@ -198,10 +362,22 @@ bool LICMPass::isLoopInvariant(const Instruction *inst, const LoopInfo &loop,
     return false;
   };
 
-  if (!checkOp(inst->getArg1()))
+  // an array is not a value: its address never changes and its elements
+  // are checked above; only a parameter's slot is ever stored to
+  if (op == OpCode::LOAD && isArraySymbol(inst->getArg1())) {
+    if (inst->getArg2().getType() == OperandType::Empty &&
+        modifiedVars.count(inst->getArg1().asSymbol()->id))
+      return false;
+  } else if (!checkOp(inst->getArg1()))
     return false;
   if (!checkOp(inst->getArg2()))
     return false;
+  // an array argument is an address
+  for (const Instruction *arg : args) {
+    if (!isArraySymbol(arg->getArg1()) && !checkOp(arg->getArg1())) {
+      return false;
+    }
+  }
 
   return true;
 }
@@ -209,6 +385,7 @@ void LICMPass::run(Function &F, DominatorTree &DT,
                    const std::vector<LoopInfo> &loops) {
   if (loops.empty())
     return;
+  AA.run(F);
   std::map<int, DefInfo> defInfoMap;
 
   for (auto &bb_ptr : F.getBlocks()) {
@@ -221,26 +398,12 @@ void LICMPass::run(Function &F, DominatorTree &DT,
   }
 
   for (auto &loop : loops) {
-    BasicBlock *preheader = getOrCreatePreheader(loop, F);
-    if (!preheader) {
-      continue;
-    }
-    // CFG changes, update dom
-    DT.run(F);
-
-    for (auto &inst : preheader->getInstructions()) {
-      const Operand &res = inst->getResult();
-      if (res.getType() == OperandType::Temporary) {
-        defInfoMap[res.asInt()] = {inst.get(), preheader};
-      }
-    }
     std::set<int> modifiedVars;
-    // flag for function call inside the loop
-    bool hasCall = false;
+    LoopMemory memory;
     for (BasicBlock *bb : loop.blocks) {
       for (auto &inst : bb->getInstructions()) {
         if (inst->getOp() == OpCode::CALL) {
-          hasCall = true;
+          memory.calls.push_back(inst.get());
         }
         const Operand &res = inst->getResult();
         if (res.getType() == OperandType::Variable && res.asSymbol()) {
@@ -252,6 +415,18 @@ void LICMPass::run(Function &F, DominatorTree &DT,
           if (base.getType() == OperandType::Variable && base.asSymbol()) {
             modifiedVars.insert(base.asSymbol()->id);
           }
+          MemoryLocation loc = AA.getLocation(base, res);
+          if (res.getType() == OperandType::Empty && isArraySymbol(base)) {
+            // the slot of an array parameter: the whole array moves
+            loc.base = MemoryLocation::Unknown;
+          }
+          memory.stores.push_back(loc);
+        }
+      }
+      for (BasicBlock *succ : {bb->next.get(), bb->jumpTarget.get()}) {
+        if (succ && !loop.blocks.count(succ)) {
+          memory.exiting.push_back(bb);
+          break;
         }
       }
     }
@@ -268,8 +443,18 @@ void LICMPass::run(Function &F, DominatorTree &DT,
           if (invariantInstructions.count(inst))
             continue;
 
-          if (isLoopInvariant(inst, loop, defInfoMap, invariantInstructions,
-                              modifiedVars, hasCall, DT)) {
+          if (isLoopInvariant(inst, bb, loop, defInfoMap,
+                              invariantInstructions, modifiedVars, memory,
+                              DT)) {
+            // a call moves together with its ARGs, right in front of it
+            std::vector<Instruction *> args;
+            if (inst->getOp() == OpCode::CALL &&
+                getCallArgs(bb, inst, args)) {
+              for (Instruction *arg : args) {
+                invariantInstructions.insert(arg);
+                orderedInvariants.push_back(arg);
+              }
+            }
             invariantInstructions.insert(inst);
             orderedInvariants.push_back(inst);
             changed = true;
@@ -280,6 +465,20 @@ void LICMPass::run(Function &F, DominatorTree &DT,
     if (invariantInstructions.empty()) {
       continue;
     }
+    BasicBlock *preheader = getOrCreatePreheader(loop, F);
+    if (!preheader) {
+      continue;
+    }
+    // a freshly created preheader is not in the tree yet
+    if (!DT.isReachable(preheader)) {
+      DT.insertBlockBefore(preheader, loop.header);
+    }
+    for (auto &inst : preheader->getInstructions()) {
+      const Operand &res = inst->getResult();
+      if (res.getType() == OperandType::Temporary) {
+        defInfoMap[res.asInt()] = {inst.get(), preheader};
+      }
+    }
     // hoisting
     std::vector<std::unique_ptr<Instruction>> toMove;
 
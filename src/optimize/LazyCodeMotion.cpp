@@ -0,0 +1,423 @@
+#include "optimize/LazyCodeMotion.hpp"
+#include "codegen/Instruction.hpp"
+#include <algorithm>
+#include <set>
+
+namespace {
+
+std::vector<BasicBlock *> getSuccessors(BasicBlock *bb) {
+  std::vector<BasicBlock *> succs;
+  auto &insts = bb->getInstructions();
+  OpCode last = insts.empty() ? OpCode::NOP : insts.back()->getOp();
+  if (last == OpCode::RETURN) {
+    return succs;
+  }
+  if ((last == OpCode::GOTO || last == OpCode::IF) && bb->jumpTarget) {
+    succs.push_back(bb->jumpTarget.get());
+  }
+  if (last != OpCode::GOTO && bb->next &&
+      std::find(succs.begin(), succs.end(), bb->next.get()) == succs.end()) {
+    succs.push_back(bb->next.get());
+  }
+  return succs;
+}
+
+/**
+ * @brief whether the result operand of op is written rather than read
+ */
+bool definesResult(OpCode op) {
+  switch (op) {
+  case OpCode::STORE:
+  case OpCode::IF:
+  case OpCode::GOTO:
+  case OpCode::LABEL:
+  case OpCode::ARG:
+  case OpCode::RETURN:
+  case OpCode::ALLOCA:
+  case OpCode::NOP:
+    return false;
+  default:
+    return true;
+  }
+}
+
+bool isPowerOfTwo(int v) { return v > 0 && (v & (v - 1)) == 0; }
+
+/**
+ * @brief position after the labels and phis of bb
+ */
+std::vector<std::unique_ptr<Instruction>>::iterator
+firstInsertionPoint(BasicBlock *bb) {
+  auto &insts = bb->getInstructions();
+  auto it = insts.begin();
+  while (it != insts.end() && ((*it)->getOp() == OpCode::LABEL ||
+                               (*it)->getOp() == OpCode::PHI)) {
+    ++it;
+  }
+  return it;
+}
+
+/**
+ * @brief position of the branch ending bb, or its end
+ */
+std::vector<std::unique_ptr<Instruction>>::iterator
+terminatorPosition(BasicBlock *bb) {
+  auto &insts = bb->getInstructions();
+  if (!insts.empty() && (insts.back()->getOp() == OpCode::GOTO ||
+                         insts.back()->getOp() == OpCode::IF)) {
+    return insts.end() - 1;
+  }
+  return insts.end();
+}
+
+/**
+ * @brief greatest solution of a system of boolean equations over blocks,
+ * evaluated until nothing changes
+ */
+template <typename Eq> void solve(std::vector<bool> &value, Eq equation) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t b = 0; b < value.size(); ++b) {
+      bool v = equation(b);
+      if (v != value[b]) {
+        value[b] = v;
+        changed = true;
+      }
+    }
+  }
+}
+
+} // namespace
+
+bool LazyCodeMotionPass::run(Function &func) {
+  buildCFG(func);
+  _nextSymbolId = 0;
+  for (BasicBlock *bb : _blocks) {
+    for (const auto &inst : bb->getInstructions()) {
+      for (const Operand *op :
+           {&inst->getArg1(), &inst->getArg2(), &inst->getResult()}) {
+        if (op->getType() == OperandType::Variable) {
+          _nextSymbolId = std::max(_nextSymbolId, op->asSymbol()->id + 1);
+        }
+      }
+    }
+  }
+  std::vector<Expression> exprs;
+  findExpressions(exprs);
+  bool changed = false;
+  for (const Expression &e : exprs) {
+    if (moveExpression(func, e)) {
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+void LazyCodeMotionPass::buildCFG(Function &func) {
+  _blocks.clear();
+  _index.clear();
+  _succs.clear();
+  _preds.clear();
+  _defBlock.clear();
+  auto &blocks = func.getBlocks();
+  if (blocks.empty()) {
+    return;
+  }
+  std::unordered_map<const BasicBlock *, bool> reachable;
+  std::vector<BasicBlock *> stack{blocks.front().get()};
+  reachable[blocks.front().get()] = true;
+  while (!stack.empty()) {
+    BasicBlock *bb = stack.back();
+    stack.pop_back();
+    for (BasicBlock *succ : getSuccessors(bb)) {
+      if (!reachable[succ]) {
+        reachable[succ] = true;
+        stack.push_back(succ);
+      }
+    }
+  }
+  for (const auto &bb : blocks) {
+    if (reachable[bb.get()]) {
+      _index[bb.get()] = static_cast<int>(_blocks.size());
+      _blocks.push_back(bb.get());
+    }
+  }
+  _succs.resize(_blocks.size());
+  _preds.resize(_blocks.size());
+  _preds[0].push_back(-1);
+  std::unordered_map<int, int> defCount;
+  for (size_t b = 0; b < _blocks.size(); ++b) {
+    for (BasicBlock *succ : getSuccessors(_blocks[b])) {
+      int s = _index[succ];
+      _succs[b].push_back(s);
+      _preds[s].push_back(static_cast<int>(b));
+    }
+    for (const auto &inst : _blocks[b]->getInstructions()) {
+      const Operand &res = inst->getResult();
+      if (definesResult(inst->getOp()) &&
+          res.getType() == OperandType::Temporary) {
+        defCount[res.asInt()]++;
+        _defBlock[res.asInt()] = static_cast<int>(b);
+      }
+    }
+  }
+  for (const auto &kv : defCount) {
+    if (kv.second != 1) {
+      _defBlock.erase(kv.first);
+    }
+  }
+}
+
+void LazyCodeMotionPass::findExpressions(std::vector<Expression> &exprs) const {
+  auto isOperand = [&](const Operand &op) {
+    return op.getType() == OperandType::ConstantInt ||
+           (op.getType() == OperandType::Temporary &&
+            _defBlock.count(op.asInt()));
+  };
+  std::set<std::vector<long long>> seen;
+  for (BasicBlock *bb : _blocks) {
+    for (const auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op != OpCode::MUL && op != OpCode::DIV && op != OpCode::MOD) {
+        continue;
+      }
+      Operand a = inst->getArg1();
+      Operand b = inst->getArg2();
+      if (inst->getResult().getType() != OperandType::Temporary ||
+          !isOperand(a) || !isOperand(b) ||
+          (a.getType() == OperandType::ConstantInt &&
+           b.getType() == OperandType::ConstantInt)) {
+        continue;
+      }
+      if (op == OpCode::MUL) {
+        // a shift, as cheap as the copy that would replace it
+        if ((a.getType() == OperandType::ConstantInt &&
+             isPowerOfTwo(a.asInt())) ||
+            (b.getType() == OperandType::ConstantInt &&
+             isPowerOfTwo(b.asInt()))) {
+          continue;
+        }
+        if (std::make_pair(a.getType(), a.asInt()) >
+            std::make_pair(b.getType(), b.asInt())) {
+          std::swap(a, b);
+        }
+      }
+      std::vector<long long> key{static_cast<long long>(op),
+                                 static_cast<long long>(a.getType()), a.asInt(),
+                                 static_cast<long long>(b.getType()),
+                                 b.asInt()};
+      if (seen.insert(key).second) {
+        exprs.push_back({op, a, b});
+      }
+    }
+  }
+}
+
+bool LazyCodeMotionPass::matches(const Instruction &inst,
+                                 const Expression &e) const {
+  if (inst.getOp() != e.op ||
+      inst.getResult().getType() != OperandType::Temporary) {
+    return false;
+  }
+  if (inst.getArg1() == e.a && inst.getArg2() == e.b) {
+    return true;
+  }
+  return e.op == OpCode::MUL && inst.getArg1() == e.b && inst.getArg2() == e.a;
+}
+
+bool LazyCodeMotionPass::moveExpression(Function &func, const Expression &e) {
+  size_t n = _blocks.size();
+  auto definesOperand = [&](const Instruction &inst) {
+    const Operand &res = inst.getResult();
+    return definesResult(inst.getOp()) &&
+           (res == e.a || res == e.b);
+  };
+
+  // local properties; first is the occurrence before any operand
+  // definition, last the one after all of them
+  std::vector<bool> transp(n, true), antloc(n, false), comp(n, false);
+  std::vector<Instruction *> first(n, nullptr), last(n, nullptr);
+  for (size_t b = 0; b < n; ++b) {
+    bool defined = false;
+    for (const auto &inst : _blocks[b]->getInstructions()) {
+      if (matches(*inst, e)) {
+        if (!defined && !first[b]) {
+          first[b] = inst.get();
+        }
+        last[b] = inst.get();
+      }
+      if (definesOperand(*inst)) {
+        defined = true;
+        last[b] = nullptr;
+      }
+    }
+    transp[b] = !defined;
+    antloc[b] = first[b] != nullptr;
+    comp[b] = last[b] != nullptr;
+  }
+
+  // availability and anticipability
+  std::vector<bool> avOut(n, true), antIn(n, true), antOut(n, false);
+  solve(avOut, [&](size_t b) {
+    bool in = true;
+    for (int p : _preds[b]) {
+      in = in && p >= 0 && avOut[p];
+    }
+    return comp[b] || (in && transp[b]);
+  });
+  solve(antIn, [&](size_t b) {
+    bool out = !_succs[b].empty();
+    for (int s : _succs[b]) {
+      out = out && antIn[s];
+    }
+    antOut[b] = out;
+    return antloc[b] || (out && transp[b]);
+  });
+
+  // earliest placement on edges, then delayed as long as no path
+  // computes the expression on the way
+  auto earliest = [&](int p, size_t b) {
+    if (p < 0) {
+      return static_cast<bool>(antIn[b]);
+    }
+    return antIn[b] && !avOut[p] && (!transp[p] || !antOut[p]);
+  };
+  std::vector<bool> laterIn(n, true);
+  auto later = [&](int p, size_t b) {
+    return earliest(p, b) || (p >= 0 && laterIn[p] && !antloc[p]);
+  };
+  solve(laterIn, [&](size_t b) {
+    bool in = true;
+    for (int p : _preds[b]) {
+      in = in && later(p, b);
+    }
+    return in;
+  });
+
+  std::vector<bool> deleted(n, false), atEnd(n, false), atStart(n, false);
+  bool any = false;
+  for (size_t b = 0; b < n; ++b) {
+    deleted[b] = antloc[b] && !laterIn[b];
+    any = any || deleted[b];
+  }
+  if (!any) {
+    return false;
+  }
+  for (size_t b = 0; b < n; ++b) {
+    for (int p : _preds[b]) {
+      if (!later(p, b) || laterIn[b]) {
+        continue;
+      }
+      // a critical edge would need a new block
+      if (p >= 0 && _succs[p].size() == 1) {
+        atEnd[p] = true;
+      } else if (_preds[b].size() == 1) {
+        atStart[b] = true;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  // h must hold the value from each remaining computation to the
+  // occurrences it replaces
+  std::vector<bool> defines(n, false);
+  for (size_t b = 0; b < n; ++b) {
+    defines[b] = comp[b] && !(deleted[b] && last[b] == first[b]);
+  }
+  std::vector<bool> liveIn(n, false), liveOut(n, false);
+  auto liveAfterStart = [&](size_t b) {
+    return deleted[b] || (liveOut[b] && !defines[b]);
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = n; i-- > 0;) {
+      bool out = false;
+      if (!atEnd[i]) {
+        for (int s : _succs[i]) {
+          out = out || liveIn[s];
+        }
+      }
+      liveOut[i] = out;
+      bool in = !atStart[i] && liveAfterStart(i);
+      if (in != liveIn[i]) {
+        liveIn[i] = in;
+        changed = true;
+      }
+    }
+  }
+  std::vector<bool> saves(n, false);
+  for (size_t b = 0; b < n; ++b) {
+    saves[b] = defines[b] && liveOut[b];
+    if (atEnd[b]) {
+      atEnd[b] = liveIn[_succs[b].front()];
+    }
+    if (atStart[b]) {
+      atStart[b] = liveAfterStart(b);
+    }
+  }
+
+  // every replaced occurrence must see the current value on all paths
+  std::vector<bool> validOut(n, true);
+  auto validIn = [&](size_t b) {
+    if (atStart[b]) {
+      return true;
+    }
+    bool in = true;
+    for (int p : _preds[b]) {
+      in = in && p >= 0 && validOut[p];
+    }
+    return in;
+  };
+  solve(validOut, [&](size_t b) {
+    return atEnd[b] || saves[b] || (validIn(b) && transp[b]);
+  });
+  for (size_t b = 0; b < n; ++b) {
+    if (deleted[b] && !validIn(b)) {
+      return false;
+    }
+  }
+
+  auto sym = std::make_shared<Symbol>(_nextSymbolId++, "pre",
+                                      Type::getIntType(), 0);
+  Operand h = Operand::Variable(sym);
+  auto compute = [&](BasicBlock *bb,
+                     std::vector<std::unique_ptr<Instruction>>::iterator pos) {
+    Operand tmp = Operand::Temporary(func.allocateTemp());
+    auto &insts = bb->getInstructions();
+    pos = insts.insert(pos, std::make_unique<Instruction>(
+                                Instruction::MakeBinary(e.op, e.a, e.b, tmp)));
+    insts.insert(pos + 1, std::make_unique<Instruction>(
+                              Instruction::MakeAssign(tmp, h)));
+  };
+  for (size_t b = 0; b < n; ++b) {
+    BasicBlock *bb = _blocks[b];
+    auto &insts = bb->getInstructions();
+    if (saves[b]) {
+      auto it = std::find_if(insts.begin(), insts.end(), [&](const auto &p) {
+        return p.get() == last[b];
+      });
+      insts.insert(it + 1, std::make_unique<Instruction>(Instruction::MakeAssign(
+                               last[b]->getResult(), h)));
+    }
+    if (deleted[b]) {
+      first[b]->setOp(OpCode::ASSIGN);
+      first[b]->setArg1(h);
+      first[b]->setArg2(Operand());
+    }
+    if (atStart[b]) {
+      compute(bb, firstInsertionPoint(bb));
+    }
+    if (atEnd[b]) {
+      compute(bb, terminatorPosition(bb));
+    }
+  }
+  BasicBlock *entry = _blocks.front();
+  entry->getInstructions().insert(
+      firstInsertionPoint(entry),
+      std::make_unique<Instruction>(
+          Instruction::MakeAlloca(h, Operand::ConstantInt(1))));
+  return true;
+}
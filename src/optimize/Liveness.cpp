@@ -0,0 +1,106 @@
+#include "optimize/Liveness.hpp"
+#include "codegen/Instruction.hpp"
+#include "codegen/Operand.hpp"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+void Liveness::computeUseDef(Function &F) {
+  for (auto &block : F.getBlocks()) {
+    BasicBlock *bb = block.get();
+    LiveSet &use = _use[bb];
+    LiveSet &def = _def[bb];
+    for (auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op == OpCode::NOP) {
+        continue;
+      }
+      if (op == OpCode::PHI) {
+        if (inst->getResult().getType() == OperandType::Temporary) {
+          def.insert(inst->getResult().asInt());
+        }
+        for (auto &arg : inst->getPhiArgs()) {
+          if (arg.first.getType() == OperandType::Temporary && arg.second) {
+            _phiUse[arg.second].insert(arg.first.asInt());
+          }
+        }
+        continue;
+      }
+      auto checkUse = [&](const Operand &opnd) {
+        if (opnd.getType() == OperandType::Temporary) {
+          _temps.insert(opnd.asInt());
+          if (!def.count(opnd.asInt())) {
+            use.insert(opnd.asInt());
+          }
+        }
+      };
+      checkUse(inst->getArg1());
+      checkUse(inst->getArg2());
+      if (op == OpCode::STORE || op == OpCode::RETURN) {
+        // result of STORE is index, is use, not def
+        checkUse(inst->getResult());
+      } else if (inst->getResult().getType() == OperandType::Temporary) {
+        def.insert(inst->getResult().asInt());
+        _temps.insert(inst->getResult().asInt());
+      }
+    }
+  }
+}
+
+void Liveness::run(Function &F) {
+  _use.clear();
+  _def.clear();
+  _phiUse.clear();
+  _liveIn.clear();
+  _liveOut.clear();
+  _temps.clear();
+  computeUseDef(F);
+
+  std::vector<BasicBlock *> blocks;
+  for (auto &block : F.getBlocks()) {
+    blocks.push_back(block.get());
+    _liveIn[block.get()];
+    _liveOut[block.get()];
+  }
+  std::reverse(blocks.begin(), blocks.end());
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (BasicBlock *block : blocks) {
+      LiveSet newLiveOut = _phiUse[block];
+      for (BasicBlock *succ : {block->next.get(), block->jumpTarget.get()}) {
+        if (!succ) {
+          continue;
+        }
+        const LiveSet &in = _liveIn[succ];
+        newLiveOut.insert(in.begin(), in.end());
+      }
+      if (newLiveOut != _liveOut[block]) {
+        _liveOut[block] = std::move(newLiveOut);
+        changed = true;
+      }
+
+      LiveSet newLiveIn = _use[block];
+      std::set_difference(_liveOut[block].begin(), _liveOut[block].end(),
+                          _def[block].begin(), _def[block].end(),
+                          std::inserter(newLiveIn, newLiveIn.end()));
+      if (newLiveIn != _liveIn[block]) {
+        _liveIn[block] = std::move(newLiveIn);
+        changed = true;
+      }
+    }
+  }
+}
+
+const Liveness::LiveSet &Liveness::getLiveIn(const BasicBlock *B) const {
+  static const LiveSet empty;
+  auto it = _liveIn.find(B);
+  return it == _liveIn.end() ? empty : it->second;
+}
+
+const Liveness::LiveSet &Liveness::getLiveOut(const BasicBlock *B) const {
+  static const LiveSet empty;
+  auto it = _liveOut.find(B);
+  return it == _liveOut.end() ? empty : it->second;
+}
@@ -1,4 +1,5 @@
 #include "optimize/LoopAnalysis.hpp"
+#include <map>
 #include <set>
 #include <stack>
 
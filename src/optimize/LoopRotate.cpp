@@ -0,0 +1,405 @@
+#include "optimize/LoopRotate.hpp"
+#include "codegen/Instruction.hpp"
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+
+static std::vector<BasicBlock *> getPredecessors(BasicBlock *BB, Function &F) {
+  std::vector<BasicBlock *> predecessors;
+  for (const auto &b_ptr : F.getBlocks()) {
+    BasicBlock *pred = b_ptr.get();
+    if (pred->next.get() == BB || pred->jumpTarget.get() == BB) {
+      predecessors.push_back(pred);
+    }
+  }
+  return predecessors;
+}
+
+static bool definesTemp(const Instruction &inst) {
+  return inst.getOp() != OpCode::STORE && inst.getOp() != OpCode::RETURN &&
+         inst.getResult().getType() == OperandType::Temporary;
+}
+
+/**
+ * @brief rewrite the temps inst reads through map; the result of STORE and
+ * RETURN is a use
+ */
+static void replaceUses(Instruction &inst,
+                        const std::unordered_map<int, Operand> &map) {
+  auto lookup = [&](const Operand &op) {
+    if (op.getType() == OperandType::Temporary) {
+      auto it = map.find(op.asInt());
+      if (it != map.end()) {
+        return it->second;
+      }
+    }
+    return op;
+  };
+  if (inst.getOp() == OpCode::PHI) {
+    for (auto &pair : inst.getPhiArgs()) {
+      pair.first = lookup(pair.first);
+    }
+    return;
+  }
+  inst.setArg1(lookup(inst.getArg1()));
+  inst.setArg2(lookup(inst.getArg2()));
+  if (inst.getOp() == OpCode::STORE || inst.getOp() == OpCode::RETURN) {
+    inst.setResult(lookup(inst.getResult()));
+  }
+}
+
+/**
+ * @brief temps read by inst; the result of STORE and RETURN is a use
+ */
+static std::vector<int> usedTemps(const Instruction &inst) {
+  std::vector<int> uses;
+  auto add = [&](const Operand &op) {
+    if (op.getType() == OperandType::Temporary) {
+      uses.push_back(op.asInt());
+    }
+  };
+  if (inst.getOp() == OpCode::PHI) {
+    for (const auto &pair : inst.getPhiArgs()) {
+      add(pair.first);
+    }
+    return uses;
+  }
+  add(inst.getArg1());
+  add(inst.getArg2());
+  if (inst.getOp() == OpCode::STORE || inst.getOp() == OpCode::RETURN) {
+    add(inst.getResult());
+  }
+  return uses;
+}
+
+bool LoopRotatePass::run(Function &func, const std::vector<LoopInfo> &loops) {
+  bool changed = false;
+  for (const auto &loop : loops) {
+    // block sets of enclosing loops go stale once an inner loop is rotated
+    bool innermost = true;
+    for (const auto &other : loops) {
+      if (other.header != loop.header && loop.blocks.count(other.header)) {
+        innermost = false;
+        break;
+      }
+    }
+    if (innermost && rotateLoop(func, loop)) {
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool LoopRotatePass::rotateLoop(Function &func, const LoopInfo &loop) {
+  BasicBlock *header = loop.header;
+  auto &headerInsts = header->getInstructions();
+  if (headerInsts.empty() || headerInsts.back()->getOp() != OpCode::IF ||
+      !header->jumpTarget || !header->next) {
+    return false;
+  }
+  // IF enters the body, the fallthrough leaves the loop
+  BasicBlock *body = header->jumpTarget.get();
+  BasicBlock *exit = header->next.get();
+  if (body == header || !loop.blocks.count(body) || loop.blocks.count(exit)) {
+    return false;
+  }
+
+  BasicBlock *latch = nullptr;
+  for (BasicBlock *pred : getPredecessors(header, func)) {
+    if (loop.blocks.count(pred)) {
+      if (latch) {
+        return false;
+      }
+      latch = pred;
+    }
+  }
+  if (!latch || latch->next || latch->jumpTarget.get() != header ||
+      latch->getInstructions().back()->getOp() != OpCode::GOTO) {
+    return false;
+  }
+  if (getPredecessors(body, func).size() != 1) {
+    return false;
+  }
+  for (auto &inst : body->getInstructions()) {
+    if (inst->getOp() == OpCode::PHI) {
+      return false;
+    }
+  }
+  // the exit is a block of its own that jumps on
+  auto exitPreds = getPredecessors(exit, func);
+  if (exitPreds.size() != 1 || exit->next || !exit->jumpTarget ||
+      exit->getInstructions().empty() ||
+      exit->getInstructions().back()->getOp() != OpCode::GOTO) {
+    return false;
+  }
+  BasicBlock *after = exit->jumpTarget.get();
+  if (after == header || loop.blocks.count(after)) {
+    return false;
+  }
+  for (BasicBlock *bb : loop.blocks) {
+    if (bb == header) {
+      continue;
+    }
+    if ((bb->next && !loop.blocks.count(bb->next.get())) ||
+        (bb->jumpTarget && !loop.blocks.count(bb->jumpTarget.get()))) {
+      return false;
+    }
+  }
+
+  // header phis and the other header values
+  std::vector<Instruction *> phis;
+  std::vector<Operand> backs;
+  std::vector<int> headerTemps;
+  std::set<int> headerDefs;
+  for (auto &inst : headerInsts) {
+    OpCode op = inst->getOp();
+    if (op == OpCode::ALLOCA || op == OpCode::PARAM) {
+      return false;
+    }
+    if (op == OpCode::PHI) {
+      if (inst->getResult().getType() != OperandType::Temporary) {
+        return false;
+      }
+      Operand back;
+      bool hasBack = false;
+      for (auto &pair : inst->getPhiArgs()) {
+        if (pair.second == latch) {
+          back = pair.first;
+          hasBack = true;
+        }
+      }
+      if (!hasBack) {
+        return false;
+      }
+      phis.push_back(inst.get());
+      backs.push_back(back);
+    } else if (definesTemp(*inst)) {
+      headerTemps.push_back(inst->getResult().asInt());
+    }
+    if (definesTemp(*inst) && !headerDefs.insert(inst->getResult().asInt())
+                                   .second) {
+      return false;
+    }
+  }
+  for (const auto &bb : func.getBlocks()) {
+    if (bb.get() == header) {
+      continue;
+    }
+    for (auto &inst : bb->getInstructions()) {
+      if (definesTemp(*inst) && headerDefs.count(inst->getResult().asInt())) {
+        return false;
+      }
+    }
+  }
+
+  // body: header values it reads become phis of the new header
+  std::set<int> usedInBody;
+  for (BasicBlock *bb : loop.blocks) {
+    if (bb == header) {
+      continue;
+    }
+    for (auto &inst : bb->getInstructions()) {
+      for (int t : usedTemps(*inst)) {
+        if (headerDefs.count(t)) {
+          usedInBody.insert(t);
+        }
+      }
+    }
+  }
+  for (const Operand &back : backs) {
+    if (back.getType() == OperandType::Temporary &&
+        headerDefs.count(back.asInt())) {
+      usedInBody.insert(back.asInt());
+    }
+  }
+  std::unordered_map<int, Operand> inBody;
+  for (int t : usedInBody) {
+    inBody[t] = Operand::Temporary(func.allocateTemp());
+  }
+  for (BasicBlock *bb : loop.blocks) {
+    if (bb == header) {
+      continue;
+    }
+    for (auto &inst : bb->getInstructions()) {
+      replaceUses(*inst, inBody);
+    }
+  }
+  // the latch: header values of the next iteration
+  std::unordered_map<int, Operand> inLatch;
+  for (size_t i = 0; i < phis.size(); ++i) {
+    Operand back = backs[i];
+    if (back.getType() == OperandType::Temporary &&
+        inBody.count(back.asInt())) {
+      back = inBody[back.asInt()];
+    }
+    inLatch[phis[i]->getResult().asInt()] = back;
+  }
+  for (int t : headerTemps) {
+    inLatch[t] = Operand::Temporary(func.allocateTemp());
+  }
+  auto mapLatch = [&](const Operand &op) {
+    if (op.getType() == OperandType::Temporary && inLatch.count(op.asInt())) {
+      return inLatch[op.asInt()];
+    }
+    return op;
+  };
+
+  auto &latchInsts = latch->getInstructions();
+  latchInsts.pop_back();
+  for (auto &inst : headerInsts) {
+    OpCode op = inst->getOp();
+    if (op == OpCode::LABEL || op == OpCode::PHI) {
+      continue;
+    }
+    latch->addInstruction(std::make_unique<Instruction>(
+        op, mapLatch(inst->getArg1()), mapLatch(inst->getArg2()),
+        op == OpCode::IF ? inst->getResult() : mapLatch(inst->getResult())));
+  }
+  latch->jumpTarget = header->jumpTarget;
+
+  // phis of the new header
+  auto &bodyInsts = body->getInstructions();
+  auto pos = bodyInsts.begin();
+  while (pos != bodyInsts.end() && (*pos)->getOp() == OpCode::LABEL) {
+    ++pos;
+  }
+  std::vector<int> headerValues;
+  for (Instruction *phi : phis) {
+    headerValues.push_back(phi->getResult().asInt());
+  }
+  headerValues.insert(headerValues.end(), headerTemps.begin(),
+                      headerTemps.end());
+  for (int t : headerValues) {
+    if (!inBody.count(t)) {
+      continue;
+    }
+    auto phi = std::make_unique<Instruction>(Instruction::MakePhi(inBody[t]));
+    phi->addPhiArg(Operand::Temporary(t), header);
+    phi->addPhiArg(inLatch[t], latch);
+    phi->setParent(body);
+    pos = bodyInsts.insert(pos, std::move(phi)) + 1;
+  }
+
+  // the guard no longer takes the back edge
+  for (Instruction *phi : phis) {
+    auto &args = phi->getPhiArgs();
+    args.erase(std::remove_if(args.begin(), args.end(),
+                              [&](const std::pair<Operand, BasicBlock *> &p) {
+                                return p.second == latch;
+                              }),
+               args.end());
+    if (args.size() == 1) {
+      phi->setOp(OpCode::ASSIGN);
+      phi->setArg1(args.front().first);
+      args.clear();
+    }
+  }
+
+  // the latch leaves through a block of its own into a merge block, both
+  // right behind it, so the exit copies stay off the back edge
+  auto &blocks = func.getBlocks();
+  auto latchPos = std::find_if(blocks.begin(), blocks.end(),
+                               [&](const std::shared_ptr<BasicBlock> &bb) {
+                                 return bb.get() == latch;
+                               });
+  bool afterFollowsLatch =
+      latchPos + 1 != blocks.end() && (latchPos + 1)->get() == after;
+  auto latchExitPtr = func.createBlock();
+  auto mergePtr = func.createBlock();
+  BasicBlock *latchExit = latchExitPtr.get();
+  BasicBlock *merge = mergePtr.get();
+  blocks.resize(blocks.size() - 2);
+  latchPos = std::find_if(blocks.begin(), blocks.end(),
+                          [&](const std::shared_ptr<BasicBlock> &bb) {
+                            return bb.get() == latch;
+                          });
+  blocks.insert(latchPos + 1, {latchExitPtr, mergePtr});
+  latchExit->addInstruction(std::make_unique<Instruction>(
+      Instruction::MakeLabel(Operand::Label(func.allocateLabel()))));
+  int mergeLabel = func.allocateLabel();
+  merge->addInstruction(std::make_unique<Instruction>(
+      Instruction::MakeLabel(Operand::Label(mergeLabel))));
+  latch->next = latchExitPtr;
+  latchExit->next = mergePtr;
+  exit->getInstructions().back()->setResult(Operand::Label(mergeLabel));
+  exit->jumpTarget = mergePtr;
+  // code of the exit block runs on both ways out, so it moves to the merge
+  std::vector<std::unique_ptr<Instruction>> exitCode;
+  auto &exitInsts = exit->getInstructions();
+  for (auto it = exitInsts.begin(); it + 1 != exitInsts.end();) {
+    if ((*it)->getOp() == OpCode::LABEL) {
+      ++it;
+      continue;
+    }
+    exitCode.push_back(std::move(*it));
+    it = exitInsts.erase(it);
+  }
+
+  // code after the loop reads header values through phis of the merge block
+  std::set<int> usedAfter;
+  for (const auto &bb : blocks) {
+    if (loop.blocks.count(bb.get()) || bb.get() == exit) {
+      continue;
+    }
+    for (auto &inst : bb->getInstructions()) {
+      for (int t : usedTemps(*inst)) {
+        if (headerDefs.count(t)) {
+          usedAfter.insert(t);
+        }
+      }
+    }
+  }
+  for (auto &inst : exitCode) {
+    for (int t : usedTemps(*inst)) {
+      if (headerDefs.count(t)) {
+        usedAfter.insert(t);
+      }
+    }
+  }
+  std::unordered_map<int, Operand> afterLoop;
+  for (int t : usedAfter) {
+    afterLoop[t] = Operand::Temporary(func.allocateTemp());
+  }
+  for (int t : headerValues) {
+    if (!afterLoop.count(t)) {
+      continue;
+    }
+    auto phi =
+        std::make_unique<Instruction>(Instruction::MakePhi(afterLoop[t]));
+    phi->addPhiArg(Operand::Temporary(t), exit);
+    phi->addPhiArg(inLatch[t], latchExit);
+    merge->addInstruction(std::move(phi));
+  }
+  for (const auto &bb : blocks) {
+    if (loop.blocks.count(bb.get()) || bb.get() == exit ||
+        bb.get() == latchExit || bb.get() == merge) {
+      continue;
+    }
+    for (auto &inst : bb->getInstructions()) {
+      replaceUses(*inst, afterLoop);
+    }
+  }
+  for (auto &inst : exitCode) {
+    replaceUses(*inst, afterLoop);
+    inst->setParent(merge);
+    merge->addInstruction(std::move(inst));
+  }
+  for (auto &inst : after->getInstructions()) {
+    if (inst->getOp() != OpCode::PHI) {
+      continue;
+    }
+    for (auto &pair : inst->getPhiArgs()) {
+      if (pair.second == exit) {
+        pair.second = merge;
+      }
+    }
+  }
+  if (afterFollowsLatch) {
+    merge->next = func.getBlockSharedPtr(after);
+  } else {
+    merge->addInstruction(std::make_unique<Instruction>(
+        Instruction::MakeGoto(Operand::Label(after->getLabelId()))));
+    merge->jumpTarget = func.getBlockSharedPtr(after);
+  }
+  return true;
+}
@@ -0,0 +1,766 @@
+#include "optimize/LoopStrengthReduce.hpp"
+#include "codegen/Instruction.hpp"
+#include <algorithm>
+#include <climits>
+#include <set>
+
+namespace {
+
+/**
+ * @brief bytes a pointer compared against its end value may run past the
+ * last element accessed, so it stays far from the signed overflow at the top
+ * of the stack
+ */
+constexpr long long MAX_POINTER_OVERSHOOT = 2048;
+
+/**
+ * @brief header phis beyond which a multiplication is left alone: every
+ * recurrence holds a register across the loop, and the backend has eight
+ */
+constexpr int MAX_LOOP_CARRIED = 5;
+
+/**
+ * @brief increments followed from an induction variable back to its phi
+ */
+constexpr size_t MAX_CHAIN = 64;
+
+/**
+ * @brief successors along the edges the instructions actually take
+ */
+std::vector<BasicBlock *> getSuccessors(BasicBlock *bb) {
+  std::vector<BasicBlock *> succs;
+  auto &insts = bb->getInstructions();
+  OpCode last = insts.empty() ? OpCode::NOP : insts.back()->getOp();
+  if (last == OpCode::RETURN) {
+    return succs;
+  }
+  if ((last == OpCode::GOTO || last == OpCode::IF) && bb->jumpTarget) {
+    succs.push_back(bb->jumpTarget.get());
+  }
+  if (last != OpCode::GOTO && bb->next) {
+    succs.push_back(bb->next.get());
+  }
+  return succs;
+}
+
+/**
+ * @brief computes its result from its operands and nothing else
+ */
+bool isPure(OpCode op) {
+  switch (op) {
+  case OpCode::ADD:
+  case OpCode::SUB:
+  case OpCode::MUL:
+  case OpCode::NEG:
+  case OpCode::EQ:
+  case OpCode::NEQ:
+  case OpCode::LT:
+  case OpCode::LE:
+  case OpCode::GT:
+  case OpCode::GE:
+  case OpCode::AND:
+  case OpCode::OR:
+  case OpCode::NOT:
+  case OpCode::ASSIGN:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool fitsInt(long long v) { return v >= INT_MIN && v <= INT_MAX; }
+
+bool isPowerOfTwo(long long v) { return v > 0 && (v & (v - 1)) == 0; }
+
+/**
+ * @brief position before the terminating branch of bb
+ */
+std::vector<std::unique_ptr<Instruction>>::iterator
+terminatorPosition(BasicBlock *bb) {
+  auto &insts = bb->getInstructions();
+  if (!insts.empty() && (insts.back()->getOp() == OpCode::GOTO ||
+                         insts.back()->getOp() == OpCode::IF)) {
+    return insts.end() - 1;
+  }
+  return insts.end();
+}
+
+} // namespace
+
+bool LoopStrengthReducePass::run(Function &func, DominatorTree &DT,
+                                 const std::vector<LoopInfo> &loops) {
+  std::vector<const LoopInfo *> order;
+  for (const auto &loop : loops) {
+    order.push_back(&loop);
+  }
+  // inner loops first: their preheader code is then reduced by the outer one
+  std::stable_sort(order.begin(), order.end(),
+                   [](const LoopInfo *a, const LoopInfo *b) {
+                     return a->blocks.size() < b->blocks.size();
+                   });
+  bool changed = false;
+  for (const LoopInfo *loop : order) {
+    _tempDefs.clear();
+    _constants.clear();
+    for (const auto &bb : func.getBlocks()) {
+      for (const auto &inst : bb->getInstructions()) {
+        if (inst->getOp() != OpCode::STORE &&
+            inst->getOp() != OpCode::RETURN &&
+            inst->getResult().getType() == OperandType::Temporary) {
+          _tempDefs[inst->getResult().asInt()].push_back(bb.get());
+        }
+      }
+    }
+    findConstants(func);
+    changed |= reduceLoop(func, DT, *loop);
+  }
+  return changed;
+}
+
+void LoopStrengthReducePass::findConstants(const Function &func) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto &bb : func.getBlocks()) {
+      for (const auto &inst : bb->getInstructions()) {
+        OpCode op = inst->getOp();
+        const Operand &res = inst->getResult();
+        if ((op != OpCode::ASSIGN && op != OpCode::ADD && op != OpCode::SUB &&
+             op != OpCode::MUL) ||
+            res.getType() != OperandType::Temporary ||
+            _constants.count(res.asInt()) ||
+            _tempDefs[res.asInt()].size() != 1) {
+          continue;
+        }
+        Operand a = constantOf(inst->getArg1());
+        Operand b = constantOf(inst->getArg2());
+        if (a.getType() != OperandType::ConstantInt ||
+            (op != OpCode::ASSIGN && b.getType() != OperandType::ConstantInt)) {
+          continue;
+        }
+        long long v = a.asInt();
+        if (op == OpCode::ADD) {
+          v += b.asInt();
+        } else if (op == OpCode::SUB) {
+          v -= b.asInt();
+        } else if (op == OpCode::MUL) {
+          v *= b.asInt();
+        }
+        _constants[res.asInt()] = static_cast<int>(static_cast<unsigned>(v));
+        changed = true;
+      }
+    }
+  }
+}
+
+Operand LoopStrengthReducePass::constantOf(const Operand &op) const {
+  if (op.getType() != OperandType::Temporary) {
+    return op;
+  }
+  auto it = _constants.find(op.asInt());
+  auto defs = _tempDefs.find(op.asInt());
+  if (it == _constants.end() || defs->second.size() != 1) {
+    return op;
+  }
+  return Operand::ConstantInt(it->second);
+}
+
+bool LoopStrengthReducePass::isInvariant(const LoopState &ls,
+                                         const Operand &op) const {
+  if (constantOf(op).getType() == OperandType::ConstantInt) {
+    return true;
+  }
+  if (op.getType() != OperandType::Temporary) {
+    return false;
+  }
+  auto it = _tempDefs.find(op.asInt());
+  if (it == _tempDefs.end()) {
+    return false;
+  }
+  return std::none_of(
+      it->second.begin(), it->second.end(),
+      [&](BasicBlock *bb) { return ls.loop->blocks.count(bb) > 0; });
+}
+
+void LoopStrengthReducePass::findInductionVars(LoopState &ls) {
+  std::unordered_map<int, Instruction *> defs;
+  for (BasicBlock *bb : ls.loop->blocks) {
+    for (auto &inst : bb->getInstructions()) {
+      if (inst->getResult().getType() == OperandType::Temporary &&
+          inst->getOp() != OpCode::STORE && inst->getOp() != OpCode::RETURN) {
+        defs[inst->getResult().asInt()] = inst.get();
+      }
+    }
+  }
+  for (auto &inst : ls.loop->header->getInstructions()) {
+    if (inst->getOp() == OpCode::LABEL) {
+      continue;
+    }
+    if (inst->getOp() != OpCode::PHI) {
+      break;
+    }
+    const Operand &res = inst->getResult();
+    auto &args = inst->getPhiArgs();
+    if (res.getType() != OperandType::Temporary || args.size() != 2 ||
+        _tempDefs[res.asInt()].size() != 1) {
+      continue;
+    }
+    InductionVar iv;
+    iv.phi = inst.get();
+    Operand back;
+    for (auto &pair : args) {
+      if (pair.second == ls.preheader) {
+        iv.init = pair.first;
+      } else if (pair.second == ls.latch) {
+        back = pair.first;
+      }
+    }
+    if (iv.init.getType() != OperandType::ConstantInt &&
+        !isInvariant(ls, iv.init)) {
+      continue;
+    }
+    if (back.getType() != OperandType::Temporary ||
+        _tempDefs[back.asInt()].size() != 1 || !defs.count(back.asInt())) {
+      continue;
+    }
+    // next = i + step, possibly through a chain of increments left by
+    // unrolling
+    iv.next = defs[back.asInt()];
+    Operand cur = back;
+    long long step = 0;
+    while (cur != res && defs.count(cur.asInt()) &&
+           iv.chain.size() < MAX_CHAIN) {
+      Instruction *link = defs[cur.asInt()];
+      const Operand &a1 = link->getArg1();
+      Operand a2 = constantOf(link->getArg2());
+      Operand prev;
+      if (link->getOp() == OpCode::ADD &&
+          a2.getType() == OperandType::ConstantInt) {
+        step += a2.asInt();
+        prev = a1;
+      } else if (link->getOp() == OpCode::ADD &&
+                 constantOf(a1).getType() == OperandType::ConstantInt) {
+        step += constantOf(a1).asInt();
+        prev = link->getArg2();
+      } else if (link->getOp() == OpCode::SUB &&
+                 a2.getType() == OperandType::ConstantInt) {
+        step -= a2.asInt();
+        prev = a1;
+      } else if (link->getOp() == OpCode::ASSIGN) {
+        prev = a1;
+      } else {
+        break;
+      }
+      if (prev.getType() != OperandType::Temporary ||
+          _tempDefs[prev.asInt()].size() != 1) {
+        break;
+      }
+      iv.chain.insert(iv.chain.begin(), link);
+      cur = prev;
+    }
+    if (cur != res || step == 0 || !fitsInt(step)) {
+      continue;
+    }
+    iv.step = static_cast<int>(step);
+    ls.ivs.push_back(iv);
+  }
+}
+
+void LoopStrengthReducePass::computeAffine(LoopState &ls) {
+  for (size_t k = 0; k < ls.ivs.size(); ++k) {
+    ls.affine[ls.ivs[k].phi->getResult().asInt()] = {
+        k, Operand::ConstantInt(1), Operand::Empty(), 0};
+  }
+  auto lookup = [&](const Operand &op) -> const Affine * {
+    if (op.getType() != OperandType::Temporary) {
+      return nullptr;
+    }
+    auto it = ls.affine.find(op.asInt());
+    return it == ls.affine.end() ? nullptr : &it->second;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (BasicBlock *bb : ls.loop->blocks) {
+      for (auto &inst : bb->getInstructions()) {
+        const Operand &res = inst->getResult();
+        OpCode op = inst->getOp();
+        if (res.getType() != OperandType::Temporary ||
+            ls.affine.count(res.asInt()) ||
+            _tempDefs[res.asInt()].size() != 1) {
+          continue;
+        }
+        const Operand &a1 = inst->getArg1();
+        const Operand &a2 = inst->getArg2();
+        const Affine *x = lookup(a1);
+        Operand other = constantOf(a2);
+        if (!x && (op == OpCode::ADD || op == OpCode::MUL)) {
+          x = lookup(a2);
+          other = constantOf(a1);
+        }
+        if (!x) {
+          continue;
+        }
+        Affine r = *x;
+        bool ok = false;
+        bool constOther = other.getType() == OperandType::ConstantInt;
+        if (op == OpCode::ASSIGN) {
+          ok = true;
+        } else if (op == OpCode::ADD && constOther) {
+          r.c += other.asInt();
+          ok = true;
+        } else if (op == OpCode::ADD && isInvariant(ls, other) &&
+                   r.inv.getType() == OperandType::Empty) {
+          r.inv = other;
+          ok = true;
+        } else if (op == OpCode::SUB && constOther) {
+          r.c -= other.asInt();
+          ok = true;
+        } else if (op == OpCode::MUL && constOther &&
+                   r.scale.getType() == OperandType::ConstantInt &&
+                   r.inv.getType() == OperandType::Empty) {
+          long long scale = 1LL * r.scale.asInt() * other.asInt();
+          r.c *= other.asInt();
+          r.scale = Operand::ConstantInt(static_cast<int>(scale));
+          ok = scale != 0 && fitsInt(scale);
+        } else if (op == OpCode::MUL && isInvariant(ls, other) &&
+                   r.scale == Operand::ConstantInt(1) &&
+                   r.inv.getType() == OperandType::Empty && r.c == 0) {
+          r.scale = other;
+          ok = true;
+        }
+        if (ok && fitsInt(r.c)) {
+          ls.affine[res.asInt()] = r;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+Operand LoopStrengthReducePass::emitInPreheader(Function &func,
+                                                LoopState &ls, OpCode op,
+                                                const Operand &a,
+                                                const Operand &b) {
+  bool ca = a.getType() == OperandType::ConstantInt;
+  bool cb = b.getType() == OperandType::ConstantInt;
+  if (op == OpCode::ASSIGN && a.getType() != OperandType::Variable) {
+    return a;
+  }
+  if (op == OpCode::ADD || op == OpCode::SUB) {
+    if (ca && cb) {
+      long long v = op == OpCode::ADD ? 1LL * a.asInt() + b.asInt()
+                                      : 1LL * a.asInt() - b.asInt();
+      return Operand::ConstantInt(static_cast<int>(static_cast<unsigned>(v)));
+    }
+    if (cb && b.asInt() == 0) {
+      return a;
+    }
+    if (op == OpCode::ADD && ca && a.asInt() == 0) {
+      return b;
+    }
+  }
+  if (op == OpCode::MUL) {
+    if (ca && cb) {
+      return Operand::ConstantInt(static_cast<int>(
+          static_cast<unsigned>(1LL * a.asInt() * b.asInt())));
+    }
+    if ((ca && a.asInt() == 0) || (cb && b.asInt() == 0)) {
+      return Operand::ConstantInt(0);
+    }
+    if (ca && a.asInt() == 1) {
+      return b;
+    }
+    if (cb && b.asInt() == 1) {
+      return a;
+    }
+  }
+  Operand dst = Operand::Temporary(func.allocateTemp());
+  auto inst = std::make_unique<Instruction>(
+      op == OpCode::ASSIGN ? Instruction::MakeAssign(a, dst)
+                           : Instruction::MakeBinary(op, a, b, dst));
+  inst->setParent(ls.preheader);
+  ls.preheader->getInstructions().insert(terminatorPosition(ls.preheader),
+                                         std::move(inst));
+  _tempDefs[dst.asInt()].push_back(ls.preheader);
+  return dst;
+}
+
+LoopStrengthReducePass::Recurrence
+LoopStrengthReducePass::makeRecurrence(Function &func, LoopState &ls,
+                                       size_t iv, const Operand &start,
+                                       const Operand &stride) {
+  Recurrence rec{Operand::Temporary(func.allocateTemp()),
+                 Operand::Temporary(func.allocateTemp())};
+  BasicBlock *header = ls.loop->header;
+  auto phi = std::make_unique<Instruction>(Instruction::MakePhi(rec.value));
+  phi->addPhiArg(start, ls.preheader);
+  phi->addPhiArg(rec.next, ls.latch);
+  phi->setParent(header);
+  auto &headerInsts = header->getInstructions();
+  auto pos = headerInsts.begin();
+  while (pos != headerInsts.end() && (*pos)->getOp() == OpCode::LABEL) {
+    ++pos;
+  }
+  headerInsts.insert(pos, std::move(phi));
+
+  Instruction *ivNext = ls.ivs[iv].next;
+  BasicBlock *bb = ivNext->getParent();
+  auto &insts = bb->getInstructions();
+  auto it = std::find_if(insts.begin(), insts.end(),
+                         [&](const std::unique_ptr<Instruction> &inst) {
+                           return inst.get() == ivNext;
+                         });
+  auto step = std::make_unique<Instruction>(
+      Instruction::MakeBinary(OpCode::ADD, rec.value, stride, rec.next));
+  step->setParent(bb);
+  insts.insert(it + 1, std::move(step));
+  _tempDefs[rec.value.asInt()].push_back(header);
+  _tempDefs[rec.next.asInt()].push_back(bb);
+  return rec;
+}
+
+bool LoopStrengthReducePass::reduceLoop(Function &func, DominatorTree &DT,
+                                        const LoopInfo &loop) {
+  LoopState ls;
+  ls.loop = &loop;
+  for (const auto &bb : func.getBlocks()) {
+    if (!DT.isReachable(bb.get())) {
+      continue;
+    }
+    for (BasicBlock *succ : getSuccessors(bb.get())) {
+      if (succ != loop.header) {
+        continue;
+      }
+      BasicBlock *&slot =
+          loop.blocks.count(bb.get()) ? ls.latch : ls.preheader;
+      if (slot) {
+        return false;
+      }
+      slot = bb.get();
+    }
+  }
+  if (!ls.preheader || !ls.latch) {
+    return false;
+  }
+  // the parent links of the increments' blocks must be right
+  for (BasicBlock *bb : loop.blocks) {
+    for (auto &inst : bb->getInstructions()) {
+      inst->setParent(bb);
+    }
+  }
+  findInductionVars(ls);
+  if (ls.ivs.empty()) {
+    return false;
+  }
+  computeAffine(ls);
+
+  bool changed = false;
+  // array accesses at affine indices share a pointer per (base, iv, scale,
+  // inv)
+  struct Group {
+    Operand base;
+    Affine form;
+    std::vector<Instruction *> accesses;
+    Operand baseAddr;
+    Recurrence rec;
+    bool everyIteration = false;
+    long long maxOffset = 0;
+  };
+  std::vector<Group> groups;
+  std::vector<BasicBlock *> blocks;
+  for (const auto &bb : func.getBlocks()) {
+    if (loop.blocks.count(bb.get())) {
+      blocks.push_back(bb.get());
+    }
+  }
+  for (BasicBlock *bb : blocks) {
+    for (auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op != OpCode::LOAD && op != OpCode::STORE) {
+        continue;
+      }
+      const Operand &base = op == OpCode::LOAD ? inst->getArg1()
+                                               : inst->getArg2();
+      const Operand &index =
+          op == OpCode::LOAD ? inst->getArg2() : inst->getResult();
+      if (index.getType() != OperandType::Temporary ||
+          !ls.affine.count(index.asInt())) {
+        continue;
+      }
+      bool arrayBase = base.getType() == OperandType::Variable &&
+                       base.asSymbol()->type &&
+                       base.asSymbol()->type->category ==
+                           Type::Category::Array;
+      if (!arrayBase && (base.getType() != OperandType::Temporary ||
+                         !isInvariant(ls, base))) {
+        continue;
+      }
+      const Affine &form = ls.affine[index.asInt()];
+      if (form.c * 4 < -32768 || form.c * 4 > 32767) {
+        continue;
+      }
+      auto g = std::find_if(groups.begin(), groups.end(), [&](const Group &g) {
+        return g.base == base && g.form.iv == form.iv &&
+               g.form.scale == form.scale && g.form.inv == form.inv;
+      });
+      if (g == groups.end()) {
+        Group group;
+        group.base = base;
+        group.form = form;
+        groups.push_back(std::move(group));
+        g = groups.end() - 1;
+      }
+      g->accesses.push_back(inst.get());
+      g->everyIteration |= DT.dominates(bb, ls.latch);
+      g->maxOffset = std::max(g->maxOffset, std::abs(form.c) * 4);
+    }
+  }
+  for (Group &g : groups) {
+    const InductionVar &iv = ls.ivs[g.form.iv];
+    Operand stride;
+    if (g.form.scale.getType() == OperandType::ConstantInt) {
+      long long bytes = 4LL * g.form.scale.asInt() * iv.step;
+      if (!fitsInt(bytes)) {
+        continue;
+      }
+      stride = Operand::ConstantInt(static_cast<int>(bytes));
+    } else {
+      stride = emitInPreheader(func, ls, OpCode::MUL, g.form.scale,
+                               Operand::ConstantInt(4 * iv.step));
+    }
+    g.baseAddr = emitInPreheader(func, ls, OpCode::ASSIGN, g.base, {});
+    Operand offset =
+        emitInPreheader(func, ls, OpCode::MUL, g.form.scale, iv.init);
+    if (g.form.inv.getType() != OperandType::Empty) {
+      offset = emitInPreheader(func, ls, OpCode::ADD, offset, g.form.inv);
+    }
+    offset = emitInPreheader(func, ls, OpCode::MUL, offset,
+                             Operand::ConstantInt(4));
+    Operand start =
+        emitInPreheader(func, ls, OpCode::ADD, g.baseAddr, offset);
+    g.rec = makeRecurrence(func, ls, g.form.iv, start, stride);
+    for (Instruction *inst : g.accesses) {
+      const Operand &index = inst->getOp() == OpCode::LOAD ? inst->getArg2()
+                                                           : inst->getResult();
+      Operand c =
+          Operand::ConstantInt(static_cast<int>(ls.affine[index.asInt()].c));
+      if (inst->getOp() == OpCode::LOAD) {
+        inst->setArg1(g.rec.value);
+        inst->setArg2(c);
+      } else {
+        inst->setArg2(g.rec.value);
+        inst->setResult(c);
+      }
+    }
+    changed = true;
+  }
+
+  // values nothing reads any more, such as the old indices
+  std::unordered_map<int, int> useCount;
+  auto countUses = [&](const Instruction &inst, int delta) {
+    auto use = [&](const Operand &op) {
+      if (op.getType() == OperandType::Temporary) {
+        useCount[op.asInt()] += delta;
+      }
+    };
+    if (inst.getOp() == OpCode::PHI) {
+      for (const auto &pair : inst.getPhiArgs()) {
+        use(pair.first);
+      }
+      return;
+    }
+    use(inst.getArg1());
+    use(inst.getArg2());
+    if (inst.getOp() == OpCode::STORE || inst.getOp() == OpCode::RETURN) {
+      use(inst.getResult());
+    }
+  };
+  std::unordered_map<int, Instruction *> loopDefs;
+  for (const auto &bb : func.getBlocks()) {
+    for (auto &inst : bb->getInstructions()) {
+      countUses(*inst, 1);
+      if (loop.blocks.count(bb.get()) && isPure(inst->getOp()) &&
+          inst->getResult().getType() == OperandType::Temporary &&
+          _tempDefs[inst->getResult().asInt()].size() == 1) {
+        loopDefs[inst->getResult().asInt()] = inst.get();
+      }
+    }
+  }
+  std::set<Instruction *> dead;
+  std::vector<int> worklist;
+  for (const auto &entry : loopDefs) {
+    worklist.push_back(entry.first);
+  }
+  while (!worklist.empty()) {
+    int t = worklist.back();
+    worklist.pop_back();
+    auto it = loopDefs.find(t);
+    if (it == loopDefs.end() || useCount[t] != 0 || dead.count(it->second)) {
+      continue;
+    }
+    dead.insert(it->second);
+    countUses(*it->second, -1);
+    for (const Operand *op : {&it->second->getArg1(), &it->second->getArg2()}) {
+      if (op->getType() == OperandType::Temporary) {
+        worklist.push_back(op->asInt());
+      }
+    }
+  }
+
+  // multiplications still needed become recurrences; by a power of two the
+  // backend already shifts
+  std::vector<Instruction *> products;
+  for (BasicBlock *bb : blocks) {
+    if (!DT.dominates(bb, ls.latch)) {
+      continue;
+    }
+    for (auto &inst : bb->getInstructions()) {
+      if (inst->getOp() == OpCode::MUL && !dead.count(inst.get()) &&
+          ls.affine.count(inst->getResult().asInt())) {
+        products.push_back(inst.get());
+      }
+    }
+  }
+  // products differing only in c share one recurrence
+  std::vector<std::pair<Affine, Recurrence>> shared;
+  int carried = 0;
+  for (auto &inst : loop.header->getInstructions()) {
+    carried += inst->getOp() == OpCode::PHI;
+  }
+  for (Instruction *inst : products) {
+    Affine form = ls.affine[inst->getResult().asInt()];
+    const InductionVar &iv = ls.ivs[form.iv];
+    auto same = std::find_if(
+        shared.begin(), shared.end(),
+        [&](const std::pair<Affine, Recurrence> &entry) {
+          return entry.first.iv == form.iv &&
+                 entry.first.scale == form.scale &&
+                 entry.first.inv == form.inv &&
+                 fitsInt(form.c - entry.first.c);
+        });
+    if (same != shared.end()) {
+      countUses(*inst, -1);
+      inst->setOp(OpCode::ADD);
+      inst->setArg1(same->second.value);
+      inst->setArg2(
+          Operand::ConstantInt(static_cast<int>(form.c - same->first.c)));
+      useCount[same->second.value.asInt()]++;
+      changed = true;
+      continue;
+    }
+    if (carried >= MAX_LOOP_CARRIED) {
+      break;
+    }
+    Operand stride;
+    if (form.scale.getType() == OperandType::ConstantInt) {
+      long long s = std::abs(1LL * form.scale.asInt());
+      long long bytes = 1LL * form.scale.asInt() * iv.step;
+      if (isPowerOfTwo(s) || !fitsInt(bytes)) {
+        continue;
+      }
+      stride = Operand::ConstantInt(static_cast<int>(bytes));
+    } else {
+      stride = emitInPreheader(func, ls, OpCode::MUL, form.scale,
+                               Operand::ConstantInt(iv.step));
+    }
+    Operand start =
+        emitInPreheader(func, ls, OpCode::MUL, form.scale, iv.init);
+    if (form.inv.getType() != OperandType::Empty) {
+      start = emitInPreheader(func, ls, OpCode::ADD, start, form.inv);
+    }
+    start = emitInPreheader(func, ls, OpCode::ADD, start,
+                            Operand::ConstantInt(static_cast<int>(form.c)));
+    Recurrence rec = makeRecurrence(func, ls, form.iv, start, stride);
+    shared.push_back({form, rec});
+    ++carried;
+    countUses(*inst, -1);
+    inst->setOp(OpCode::ASSIGN);
+    inst->setArg1(rec.value);
+    inst->setArg2(Operand::Empty());
+    useCount[rec.value.asInt()]++;
+    useCount[rec.next.asInt()]++;
+    changed = true;
+  }
+
+  // an induction variable only the exit test reads is replaced by a pointer:
+  // the test in the latch of a rotated loop, which is the only exit
+  bool singleExit = true;
+  for (BasicBlock *bb : loop.blocks) {
+    for (BasicBlock *succ : getSuccessors(bb)) {
+      singleExit &= bb == ls.latch || loop.blocks.count(succ);
+    }
+  }
+  auto &latchInsts = ls.latch->getInstructions();
+  Instruction *branch = latchInsts.empty() ? nullptr : latchInsts.back().get();
+  if (singleExit && branch && branch->getOp() == OpCode::IF &&
+      branch->getArg1().getType() == OperandType::Temporary &&
+      useCount[branch->getArg1().asInt()] == 1) {
+    int cond = branch->getArg1().asInt();
+    Instruction *cmp = nullptr;
+    for (auto &inst : latchInsts) {
+      if (inst->getResult() == Operand::Temporary(cond)) {
+        cmp = inst.get();
+      }
+    }
+    OpCode op = cmp ? cmp->getOp() : OpCode::NOP;
+    for (size_t k = 0; cmp && k < ls.ivs.size(); ++k) {
+      const InductionVar &iv = ls.ivs[k];
+      const Operand &next = iv.next->getResult();
+      bool nextLeft = cmp->getArg1() == next;
+      Operand limit = constantOf(nextLeft ? cmp->getArg2() : cmp->getArg1());
+      bool onlyChain = useCount[iv.phi->getResult().asInt()] == 1;
+      for (size_t c = 0; c + 1 < iv.chain.size(); ++c) {
+        onlyChain &= useCount[iv.chain[c]->getResult().asInt()] == 1;
+      }
+      if ((!nextLeft && cmp->getArg2() != next) || !isInvariant(ls, limit) ||
+          !onlyChain || useCount[next.asInt()] != 2) {
+        continue;
+      }
+      // the iv moves towards the limit of the test
+      bool up = (op == OpCode::LT || op == OpCode::LE) == nextLeft;
+      bool down = (op == OpCode::GT || op == OpCode::GE) == nextLeft;
+      bool ordered = op == OpCode::LT || op == OpCode::LE ||
+                     op == OpCode::GT || op == OpCode::GE;
+      if (!(ordered && ((up && iv.step > 0) || (down && iv.step < 0))) &&
+          op != OpCode::NEQ) {
+        continue;
+      }
+      auto g = std::find_if(groups.begin(), groups.end(), [&](const Group &g) {
+        return g.form.iv == k && g.everyIteration &&
+               g.rec.value.getType() == OperandType::Temporary &&
+               g.form.scale.getType() == OperandType::ConstantInt &&
+               g.form.scale.asInt() > 0 &&
+               g.maxOffset + std::abs(4LL * g.form.scale.asInt() * iv.step) <=
+                   MAX_POINTER_OVERSHOOT;
+      });
+      if (g == groups.end()) {
+        continue;
+      }
+      Operand end =
+          emitInPreheader(func, ls, OpCode::MUL, limit, g->form.scale);
+      if (g->form.inv.getType() != OperandType::Empty) {
+        end = emitInPreheader(func, ls, OpCode::ADD, end, g->form.inv);
+      }
+      end = emitInPreheader(func, ls, OpCode::MUL, end,
+                            Operand::ConstantInt(4));
+      end = emitInPreheader(func, ls, OpCode::ADD, g->baseAddr, end);
+      cmp->setArg1(nextLeft ? g->rec.next : end);
+      cmp->setArg2(nextLeft ? end : g->rec.next);
+      dead.insert(iv.phi);
+      dead.insert(iv.chain.begin(), iv.chain.end());
+      changed = true;
+      break;
+    }
+  }
+
+  for (BasicBlock *bb : loop.blocks) {
+    auto &insts = bb->getInstructions();
+    insts.erase(std::remove_if(insts.begin(), insts.end(),
+                               [&](const std::unique_ptr<Instruction> &inst) {
+                                 return dead.count(inst.get()) > 0;
+                               }),
+                insts.end());
+  }
+  return changed || !dead.empty();
+}
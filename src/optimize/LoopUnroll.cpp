@@ -1,14 +1,121 @@
 #include "optimize/LoopUnroll.hpp"
 #include "codegen/Instruction.hpp"
+#include <algorithm>
+#include <climits>
 #include <map>
+#include <set>
+#include <unordered_map>
+
+static std::vector<BasicBlock *> getPredecessors(BasicBlock *BB, Function &F) {
+  std::vector<BasicBlock *> predecessors;
+  for (const auto &b_ptr : F.getBlocks()) {
+    BasicBlock *pred = b_ptr.get();
+    if (pred->next.get() == BB || pred->jumpTarget.get() == BB) {
+      predecessors.push_back(pred);
+    }
+  }
+  return predecessors;
+}
+
+/**
+ * @brief temps read by inst; the result of STORE and RETURN is a use
+ */
+static std::vector<int> usedTemps(const Instruction &inst) {
+  std::vector<int> uses;
+  auto add = [&](const Operand &op) {
+    if (op.getType() == OperandType::Temporary) {
+      uses.push_back(op.asInt());
+    }
+  };
+  if (inst.getOp() == OpCode::PHI) {
+    for (const auto &pair : inst.getPhiArgs()) {
+      add(pair.first);
+    }
+    return uses;
+  }
+  add(inst.getArg1());
+  add(inst.getArg2());
+  if (inst.getOp() == OpCode::STORE || inst.getOp() == OpCode::RETURN) {
+    add(inst.getResult());
+  }
+  return uses;
+}
+
+static bool definesTemp(const Instruction &inst) {
+  return inst.getOp() != OpCode::STORE && inst.getOp() != OpCode::RETURN &&
+         inst.getResult().getType() == OperandType::Temporary;
+}
+
+static bool countsTowardSize(const Instruction &inst) {
+  return inst.getOp() != OpCode::LABEL && inst.getOp() != OpCode::PHI &&
+         inst.getOp() != OpCode::NOP;
+}
+
+static OpCode swapCompare(OpCode op) {
+  switch (op) {
+  case OpCode::LT:
+    return OpCode::GT;
+  case OpCode::LE:
+    return OpCode::GE;
+  case OpCode::GT:
+    return OpCode::LT;
+  case OpCode::GE:
+    return OpCode::LE;
+  default:
+    return op;
+  }
+}
+
+static OpCode negateCompare(OpCode op) {
+  switch (op) {
+  case OpCode::LT:
+    return OpCode::GE;
+  case OpCode::LE:
+    return OpCode::GT;
+  case OpCode::GT:
+    return OpCode::LE;
+  case OpCode::GE:
+    return OpCode::LT;
+  default:
+    return op;
+  }
+}
+
+/**
+ * @brief point the edges of from that lead to oldSucc at newSucc
+ */
+static void retargetEdge(Function &F, BasicBlock *from, BasicBlock *oldSucc,
+                         BasicBlock *newSucc) {
+  if (from->next.get() == oldSucc) {
+    from->next = F.getBlockSharedPtr(newSucc);
+  }
+  if (from->jumpTarget.get() == oldSucc) {
+    from->jumpTarget = F.getBlockSharedPtr(newSucc);
+    Instruction *term = from->getInstructions().back().get();
+    term->setResult(Operand::Label(newSucc->getLabelId()));
+  }
+}
 
 bool LoopUnrollPass::run(Function &func, const std::vector<LoopInfo> &loops) {
+  bool changed = false;
+  growth = 0;
   for (const auto &loop : loops) {
-    if (tryUnrollLoop(func, loop)) {
-      return true;
+    // only innermost loops, so the loops unrolled here never share blocks
+    bool innermost = true;
+    for (const auto &other : loops) {
+      if (other.header != loop.header && loop.blocks.count(other.header)) {
+        innermost = false;
+        break;
+      }
+    }
+    if (!innermost) {
+      continue;
+    }
+    if (tryUnrollLoop(func, loop) || tryUnrollCountedLoop(func, loop)) {
+      changed = true;
     }
   }
-  return false;
+  return changed;
 }
 
 bool LoopUnrollPass::isSimpleLoop(const LoopInfo &loop, int &tripCount,
@@ -168,6 +275,10 @@ bool LoopUnrollPass::tryUnrollLoop(Function &func, const LoopInfo &loop) {
       continue;
     body.push_back(inst.get());
   }
+  long long added = static_cast<long long>(tripCount) * body.size();
+  if (added > budget.maxFullUnrollSize || growth + added > budget.maxGrowth) {
+    return false;
+  }
 
   BasicBlock *exitBlock = nullptr;
   std::shared_ptr<BasicBlock> exitBlockPtr = nullptr;
@@ -245,6 +356,541 @@ bool LoopUnrollPass::tryUnrollLoop(Function &func, const LoopInfo &loop) {
       Instruction::MakeGoto(Operand::Label(exitBlock->getLabelId()))));
   currentBlock->next = nullptr;
   currentBlock->jumpTarget = exitBlockPtr;
+  growth += static_cast<int>(added);
 
   return true;
 }
+
+bool LoopUnrollPass::matchCountedLoop(Function &func, const LoopInfo &loop,
+                                      CountedLoop &cl) {
+  BasicBlock *header = loop.header;
+  auto &headerInsts = header->getInstructions();
+  if (headerInsts.empty() || headerInsts.back()->getOp() != OpCode::IF ||
+      !header->next || !header->jumpTarget || header->getLabelId() == -1) {
+    return false;
+  }
+  bool targetInLoop = loop.blocks.count(header->jumpTarget.get()) > 0;
+  bool nextInLoop = loop.blocks.count(header->next.get()) > 0;
+  if (targetInLoop == nextInLoop) {
+    return false;
+  }
+  cl.bodyEntry =
+      targetInLoop ? header->jumpTarget.get() : header->next.get();
+  if (cl.bodyEntry == header) {
+    return false;
+  }
+
+  // one preheader flowing only into the header, one latch jumping back
+  for (BasicBlock *pred : getPredecessors(header, func)) {
+    BasicBlock *&slot = loop.blocks.count(pred) ? cl.latch : cl.preheader;
+    if (slot && slot != pred) {
+      return false;
+    }
+    slot = pred;
+  }
+  BasicBlock *pre = cl.preheader;
+  BasicBlock *latch = cl.latch;
+  if (!pre || !latch || pre == header) {
+    return false;
+  }
+  if ((pre->next && pre->next.get() != header) ||
+      (pre->jumpTarget && pre->jumpTarget.get() != header)) {
+    return false;
+  }
+  if (pre->jumpTarget) {
+    OpCode op = pre->getInstructions().empty()
+                    ? OpCode::NOP
+                    : pre->getInstructions().back()->getOp();
+    if (op != OpCode::GOTO && op != OpCode::IF) {
+      return false;
+    }
+  }
+  if (latch->next || latch->jumpTarget.get() != header ||
+      latch->getInstructions().empty() ||
+      latch->getInstructions().back()->getOp() != OpCode::GOTO) {
+    return false;
+  }
+
+  // the header test is the only way out, nothing falls into the header
+  for (BasicBlock *bb : loop.blocks) {
+    for (auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op == OpCode::RETURN || op == OpCode::ALLOCA ||
+          op == OpCode::PARAM) {
+        return false;
+      }
+    }
+    if (bb == header) {
+      continue;
+    }
+    if (bb->next &&
+        (bb->next.get() == header || !loop.blocks.count(bb->next.get()))) {
+      return false;
+    }
+    if (bb->jumpTarget && !loop.blocks.count(bb->jumpTarget.get())) {
+      return false;
+    }
+  }
+
+  // header phis, each fed by the preheader and the latch
+  for (auto &inst : headerInsts) {
+    if (inst->getOp() != OpCode::PHI) {
+      continue;
+    }
+    if (inst->getResult().getType() != OperandType::Temporary ||
+        inst->getPhiArgs().size() != 2) {
+      return false;
+    }
+    Operand init, back;
+    bool hasInit = false, hasBack = false;
+    for (auto &pair : inst->getPhiArgs()) {
+      OperandType type = pair.first.getType();
+      if (type != OperandType::Temporary && type != OperandType::ConstantInt) {
+        return false;
+      }
+      if (pair.second == pre && !hasInit) {
+        init = pair.first;
+        hasInit = true;
+      } else if (pair.second == latch && !hasBack) {
+        back = pair.first;
+        hasBack = true;
+      }
+    }
+    if (!hasInit || !hasBack) {
+      return false;
+    }
+    cl.phis.push_back(inst.get());
+    cl.inits.push_back(init);
+    cl.backs.push_back(back);
+  }
+
+  // temps defined in the loop, split by header and body
+  std::set<int> headerDefs, bodyDefs;
+  std::unordered_map<int, Instruction *> defInst;
+  for (BasicBlock *bb : loop.blocks) {
+    for (auto &inst : bb->getInstructions()) {
+      if (!definesTemp(*inst)) {
+        continue;
+      }
+      int t = inst->getResult().asInt();
+      bool inHeader = bb == header;
+      if ((inHeader && bodyDefs.count(t)) ||
+          (!inHeader && headerDefs.count(t))) {
+        return false;
+      }
+      (inHeader ? headerDefs : bodyDefs).insert(t);
+      defInst[t] = inst.get();
+    }
+  }
+  for (const Operand &init : cl.inits) {
+    if (init.getType() == OperandType::Temporary &&
+        (headerDefs.count(init.asInt()) || bodyDefs.count(init.asInt()))) {
+      return false;
+    }
+  }
+  // body values stay inside the body: neither the header test nor code
+  // after the loop may read them, nor may they live across iterations
+  // outside the header phis
+  for (const auto &bb : func.getBlocks()) {
+    bool inBody = loop.blocks.count(bb.get()) && bb.get() != header;
+    for (auto &inst : bb->getInstructions()) {
+      if (bb.get() == header && inst->getOp() == OpCode::PHI) {
+        continue;
+      }
+      if (!inBody && definesTemp(*inst) &&
+          (bodyDefs.count(inst->getResult().asInt()) ||
+           (!loop.blocks.count(bb.get()) &&
+            headerDefs.count(inst->getResult().asInt())))) {
+        return false;
+      }
+      if (inBody) {
+        continue;
+      }
+      for (int t : usedTemps(*inst)) {
+        if (bodyDefs.count(t)) {
+          return false;
+        }
+      }
+    }
+  }
+
+  // the test: iv compared with a loop-invariant limit
+  const Operand &cond = headerInsts.back()->getArg1();
+  if (cond.getType() != OperandType::Temporary ||
+      !headerDefs.count(cond.asInt())) {
+    return false;
+  }
+  Instruction *cmpInst = defInst[cond.asInt()];
+  OpCode cmp = cmpInst->getOp();
+  if (cmp != OpCode::LT && cmp != OpCode::LE && cmp != OpCode::GT &&
+      cmp != OpCode::GE) {
+    return false;
+  }
+  Operand lhs = cmpInst->getArg1();
+  Operand rhs = cmpInst->getArg2();
+  auto phiIndex = [&](const Operand &op) -> int {
+    for (size_t i = 0; i < cl.phis.size(); ++i) {
+      if (cl.phis[i]->getResult() == op) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  };
+  if (phiIndex(lhs) < 0) {
+    std::swap(lhs, rhs);
+    cmp = swapCompare(cmp);
+  }
+  int ivIdx = phiIndex(lhs);
+  if (ivIdx < 0) {
+    return false;
+  }
+  if (header->next.get() == cl.bodyEntry) {
+    // IF jumps out when the test holds
+    cmp = negateCompare(cmp);
+  }
+  if (rhs.getType() == OperandType::Temporary) {
+    if (headerDefs.count(rhs.asInt()) || bodyDefs.count(rhs.asInt())) {
+      return false;
+    }
+  } else if (rhs.getType() != OperandType::ConstantInt) {
+    return false;
+  }
+  cl.iv = static_cast<size_t>(ivIdx);
+  cl.cmp = cmp;
+  cl.limit = rhs;
+
+  // iv advances by a constant once per iteration
+  const Operand &next = cl.backs[cl.iv];
+  if (next.getType() != OperandType::Temporary ||
+      !defInst.count(next.asInt())) {
+    return false;
+  }
+  Instruction *update = defInst[next.asInt()];
+  BasicBlock *updateBlock = func.findBlockOf(update);
+  if (updateBlock != latch && updateBlock != header) {
+    return false;
+  }
+  const Operand &ivOp = cl.phis[cl.iv]->getResult();
+  Operand stepOp;
+  if (update->getOp() == OpCode::ADD && update->getArg1() == ivOp) {
+    stepOp = update->getArg2();
+  } else if (update->getOp() == OpCode::ADD && update->getArg2() == ivOp) {
+    stepOp = update->getArg1();
+  } else if (update->getOp() == OpCode::SUB && update->getArg1() == ivOp &&
+             update->getArg2().getType() == OperandType::ConstantInt &&
+             update->getArg2().asInt() != INT_MIN) {
+    stepOp = Operand::ConstantInt(-update->getArg2().asInt());
+  } else {
+    return false;
+  }
+  if (stepOp.getType() != OperandType::ConstantInt || stepOp.asInt() == 0) {
+    return false;
+  }
+  cl.step = stepOp.asInt();
+  bool upward = cmp == OpCode::LT || cmp == OpCode::LE;
+  if (upward != (cl.step > 0)) {
+    return false;
+  }
+
+  cl.size = 0;
+  for (BasicBlock *bb : loop.blocks) {
+    for (auto &inst : bb->getInstructions()) {
+      if (countsTowardSize(*inst)) {
+        cl.size++;
+      }
+    }
+  }
+
+  const Operand &init = cl.inits[cl.iv];
+  if (init.getType() == OperandType::ConstantInt &&
+      rhs.getType() == OperandType::ConstantInt) {
+    long long from = init.asInt();
+    long long to = rhs.asInt();
+    long long step = cl.step;
+    switch (cmp) {
+    case OpCode::LT:
+      cl.tripCount = from < to ? (to - from + step - 1) / step : 0;
+      break;
+    case OpCode::LE:
+      cl.tripCount = from <= to ? (to - from) / step + 1 : 0;
+      break;
+    case OpCode::GT:
+      cl.tripCount = from > to ? (from - to - step - 1) / -step : 0;
+      break;
+    default:
+      cl.tripCount = from >= to ? (from - to) / -step + 1 : 0;
+      break;
+    }
+  }
+  return true;
+}
+
+bool LoopUnrollPass::tryUnrollCountedLoop(Function &func,
+                                          const LoopInfo &loop) {
+  CountedLoop cl;
+  if (!matchCountedLoop(func, loop, cl) || cl.tripCount == 0) {
+    return false;
+  }
+  if (cl.tripCount > 0) {
+    long long added = cl.tripCount * cl.size;
+    if (added <= budget.maxFullUnrollSize &&
+        growth + added <= budget.maxGrowth) {
+      unrollCountedLoop(func, loop, cl, static_cast<int>(cl.tripCount),
+                        false);
+      growth += static_cast<int>(added);
+      return true;
+    }
+  }
+
+  int factor = budget.factor;
+  if (factor < 2 || (cl.tripCount > 0 && cl.tripCount < factor)) {
+    return false;
+  }
+  long long added = static_cast<long long>(factor) * cl.size;
+  if (added > budget.maxUnrolledSize || growth + added > budget.maxGrowth) {
+    return false;
+  }
+  if (cl.limit.getType() == OperandType::ConstantInt) {
+    // a limit so close to the end of the range that no group of iterations
+    // fits: the copies would never run
+    long long adjusted = static_cast<long long>(cl.limit.asInt()) -
+                         static_cast<long long>(factor - 1) * cl.step;
+    if (adjusted < INT_MIN || adjusted > INT_MAX) {
+      return false;
+    }
+  }
+  unrollCountedLoop(func, loop, cl, factor, true);
+  growth += static_cast<int>(added);
+  return true;
+}
+
+void LoopUnrollPass::unrollCountedLoop(Function &func, const LoopInfo &loop,
+                                       const CountedLoop &cl, int copies,
+                                       bool guarded) {
+  BasicBlock *header = loop.header;
+  BasicBlock *pre = cl.preheader;
+  auto &blocks = func.getBlocks();
+  size_t firstNew = blocks.size();
+
+  std::vector<BasicBlock *> bodyOrder;
+  std::vector<int> loopTemps;
+  for (auto &bb : blocks) {
+    if (!loop.blocks.count(bb.get())) {
+      continue;
+    }
+    if (bb.get() != header) {
+      bodyOrder.push_back(bb.get());
+    }
+    for (auto &inst : bb->getInstructions()) {
+      if (definesTemp(*inst) &&
+          (bb.get() != header || inst->getOp() != OpCode::PHI)) {
+        loopTemps.push_back(inst->getResult().asInt());
+      }
+    }
+  }
+
+  auto newBlock = [&]() {
+    BasicBlock *bb = func.createBlock().get();
+    bb->addInstruction(std::make_unique<Instruction>(
+        Instruction::MakeLabel(Operand::Label(func.allocateLabel()))));
+    return bb;
+  };
+  auto jumpTo = [&](BasicBlock *from, BasicBlock *to) {
+    from->addInstruction(std::make_unique<Instruction>(
+        Instruction::MakeGoto(Operand::Label(to->getLabelId()))));
+    from->jumpTarget = func.getBlockSharedPtr(to);
+  };
+
+  std::vector<Operand> current = cl.inits;
+  BasicBlock *guard = nullptr;
+  BasicBlock *guardExit = nullptr;
+  Operand guardCond;
+  std::vector<Instruction *> guardPhis;
+  if (guarded) {
+    // adjusted limit: the iv passes it iff the next copies iterations all
+    // pass the original test
+    long long delta = static_cast<long long>(copies - 1) * cl.step;
+    Operand adjusted;
+    if (cl.limit.getType() == OperandType::ConstantInt) {
+      adjusted = Operand::ConstantInt(
+          static_cast<int>(cl.limit.asInt() - delta));
+    } else {
+      // limit - delta, saturated at the end of the range when it wraps:
+      // adjusted = d - wrapped * (d - bound) with bound INT_MIN or INT_MAX
+      std::vector<std::unique_ptr<Instruction>> seq;
+      auto emit = [&](OpCode op, const Operand &a, const Operand &b) {
+        Operand dst = Operand::Temporary(func.allocateTemp());
+        seq.push_back(std::make_unique<Instruction>(op, a, b, dst));
+        return dst;
+      };
+      bool upward = cl.step > 0;
+      Operand d = emit(OpCode::SUB, cl.limit,
+                       Operand::ConstantInt(static_cast<int>(delta)));
+      Operand wrapped =
+          emit(upward ? OpCode::GT : OpCode::LT, d, cl.limit);
+      // d - INT_MIN == d + INT_MIN and d - INT_MAX == d + INT_MIN + 1
+      Operand offset =
+          emit(OpCode::ADD, d,
+               Operand::ConstantInt(upward ? INT_MIN : INT_MIN + 1));
+      Operand scaled = emit(OpCode::MUL, wrapped, offset);
+      adjusted = emit(OpCode::SUB, d, scaled);
+      auto &preInsts = pre->getInstructions();
+      auto pos = preInsts.end();
+      if (pre->jumpTarget.get() == header) {
+        --pos;
+      }
+      for (auto &inst : seq) {
+        inst->setParent(pre);
+      }
+      preInsts.insert(pos, std::make_move_iterator(seq.begin()),
+                      std::make_move_iterator(seq.end()));
+    }
+
+    guard = newBlock();
+    for (size_t i = 0; i < cl.phis.size(); ++i) {
+      Operand res = Operand::Temporary(func.allocateTemp());
+      auto phi = std::make_unique<Instruction>(Instruction::MakePhi(res));
+      phi->addPhiArg(cl.inits[i], pre);
+      guardPhis.push_back(phi.get());
+      guard->addInstruction(std::move(phi));
+      current[i] = res;
+    }
+    // the guard keeps the header's shape: IF into the copies, and a block
+    // of its own leaving for the original loop, so no edge is critical
+    guardCond = Operand::Temporary(func.allocateTemp());
+    guard->addInstruction(std::make_unique<Instruction>(
+        cl.cmp, current[cl.iv], adjusted, guardCond));
+    guardExit = newBlock();
+    guard->next = func.getBlockSharedPtr(guardExit);
+    jumpTo(guardExit, header);
+  }
+
+  BasicBlock *entry = guard;
+  BasicBlock *prevLatch = nullptr;
+  for (int copy = 0; copy < copies; ++copy) {
+    std::unordered_map<int, Operand> temps;
+    std::unordered_map<int, int> labels;
+    std::unordered_map<BasicBlock *, BasicBlock *> clones;
+    for (size_t i = 0; i < cl.phis.size(); ++i) {
+      temps[cl.phis[i]->getResult().asInt()] = current[i];
+    }
+    for (int t : loopTemps) {
+      temps[t] = Operand::Temporary(func.allocateTemp());
+    }
+    auto mapOp = [&](const Operand &op) {
+      if (op.getType() == OperandType::Temporary && temps.count(op.asInt())) {
+        return temps[op.asInt()];
+      }
+      if (op.getType() == OperandType::Label && labels.count(op.asInt())) {
+        return Operand::Label(labels[op.asInt()]);
+      }
+      return op;
+    };
+    auto cloneInst = [&](const Instruction &inst, BasicBlock *to) {
+      to->addInstruction(std::make_unique<Instruction>(
+          inst.getOp(), mapOp(inst.getArg1()), mapOp(inst.getArg2()),
+          mapOp(inst.getResult())));
+    };
+
+    // the header without its test, then the body in layout order
+    BasicBlock *headerCopy = newBlock();
+    clones[header] = headerCopy;
+    if (!entry) {
+      entry = headerCopy;
+    }
+    if (prevLatch) {
+      jumpTo(prevLatch, headerCopy);
+    } else if (guard) {
+      guard->addInstruction(std::make_unique<Instruction>(Instruction::MakeIf(
+          guardCond, Operand::Label(headerCopy->getLabelId()))));
+      guard->jumpTarget = func.getBlockSharedPtr(headerCopy);
+    }
+    for (BasicBlock *bb : bodyOrder) {
+      BasicBlock *clone = newBlock();
+      clones[bb] = clone;
+      if (bb->getLabelId() != -1) {
+        labels[bb->getLabelId()] = clone->getLabelId();
+      }
+    }
+
+    for (auto &inst : header->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op != OpCode::LABEL && op != OpCode::PHI && op != OpCode::IF) {
+        cloneInst(*inst, headerCopy);
+      }
+    }
+    if (bodyOrder.front() == cl.bodyEntry) {
+      headerCopy->next = func.getBlockSharedPtr(clones[cl.bodyEntry]);
+    } else {
+      jumpTo(headerCopy, clones[cl.bodyEntry]);
+    }
+
+    for (BasicBlock *bb : bodyOrder) {
+      BasicBlock *clone = clones[bb];
+      for (auto &inst : bb->getInstructions()) {
+        OpCode op = inst->getOp();
+        if (op == OpCode::LABEL || (bb == cl.latch && op == OpCode::GOTO)) {
+          continue;
+        }
+        if (op == OpCode::PHI) {
+          auto phi = std::make_unique<Instruction>(
+              Instruction::MakePhi(mapOp(inst->getResult())));
+          for (auto &pair : inst->getPhiArgs()) {
+            phi->addPhiArg(mapOp(pair.first), clones[pair.second]);
+          }
+          clone->addInstruction(std::move(phi));
+          continue;
+        }
+        cloneInst(*inst, clone);
+      }
+      if (bb == cl.latch) {
+        continue;
+      }
+      if (bb->next) {
+        clone->next = func.getBlockSharedPtr(clones[bb->next.get()]);
+      }
+      if (bb->jumpTarget) {
+        clone->jumpTarget =
+            func.getBlockSharedPtr(clones[bb->jumpTarget.get()]);
+      }
+    }
+
+    std::vector<Operand> next;
+    for (const Operand &back : cl.backs) {
+      next.push_back(mapOp(back));
+    }
+    current = std::move(next);
+    prevLatch = clones[cl.latch];
+  }
+
+  // the last copy goes back to the guard, or on to the original loop, which
+  // runs whatever iterations are left
+  if (guarded) {
+    jumpTo(prevLatch, guard);
+    for (size_t i = 0; i < cl.phis.size(); ++i) {
+      guardPhis[i]->addPhiArg(current[i], prevLatch);
+    }
+  } else {
+    prevLatch->next = func.getBlockSharedPtr(header);
+  }
+  for (size_t i = 0; i < cl.phis.size(); ++i) {
+    for (auto &pair : cl.phis[i]->getPhiArgs()) {
+      if (pair.second == pre) {
+        pair.first = guarded ? guardPhis[i]->getResult() : current[i];
+        pair.second = guarded ? guardExit : prevLatch;
+      }
+    }
+  }
+  retargetEdge(func, pre, header, entry);
+
+  // the copies sit right in front of the header, so a preheader falling
+  // into the header now falls into them, and the last copy into the header
+  std::vector<std::shared_ptr<BasicBlock>> added(blocks.begin() + firstNew,
+                                                 blocks.end());
+  blocks.erase(blocks.begin() + firstNew, blocks.end());
+  auto pos = std::find_if(blocks.begin(), blocks.end(),
+                          [&](const std::shared_ptr<BasicBlock> &bb) {
+                            return bb.get() == header;
+                          });
+  blocks.insert(pos, added.begin(), added.end());
+}
@@ -2,29 +2,9 @@
 #include "codegen/Instruction.hpp"
 #include "codegen/Operand.hpp"
 
-static std::map<BasicBlock *, std::vector<BasicBlock *>>
-buildPredMap(Function &F) {
-  std::map<BasicBlock *, std::vector<BasicBlock *>> preds;
-  for (auto &bb_ptr : F.getBlocks()) {
-    BasicBlock *bb = bb_ptr.get();
-    std::vector<BasicBlock *> successors;
-    if (bb->jumpTarget) {
-      successors.push_back(bb->jumpTarget.get());
-    }
-    if (bb->next) {
-      successors.push_back(bb->next.get());
-    }
-    // fill in the pred map
-    for (BasicBlock *succ : successors) {
-      preds[succ].push_back(bb);
-    }
-  }
-  return preds;
-}
-
-bool Mem2RegPass::run(Function &F, DominatorTree &DT) {
+bool Mem2RegPass::run(Function &F, DominatorTree &DT,
+                      const DominanceFrontier &DF) {
   _allocas.clear();
-  _domFrontiers.clear();
   _phiToVarId.clear();
   _varStacks.clear();
 
@@ -32,8 +12,8 @@ bool Mem2RegPass::run(Function &F, DominatorTree &DT) {
   if (_allocas.empty()) {
     return false;
   }
-  computeDominanceFrontiers(F, DT);
-  insertPhiNodes(F);
+  computeLiveInBlocks(F);
+  insertPhiNodes(F, DF);
   if (!F.getBlocks().empty()) {
     renameVariables(F.getBlocks().front().get(), DT, F);
   }
@@ -119,27 +99,90 @@ void Mem2RegPass::collectPromotableAllocas(Function &F) {
   }
 }
 
-void Mem2RegPass::computeDominanceFrontiers(Function &F, DominatorTree &DT) {
-  auto predsMap = buildPredMap(F);
-  for (auto &bb_ptr : F.getBlocks()) {
-    BasicBlock *bb = bb_ptr.get();
-    auto &preds = predsMap[bb];
-    if (preds.size() >= 2) {
-      for (BasicBlock *p : preds) {
-        BasicBlock *runner = p;
-        while (runner != DT.getImmediateDominator(bb)) {
-          _domFrontiers[runner].insert(bb);
-          runner = DT.getImmediateDominator(runner);
-          if (!runner) {
-            break;
-          }
+void Mem2RegPass::computeLiveInBlocks(Function &F) {
+  std::map<BasicBlock *, std::vector<BasicBlock *>> preds;
+  for (auto &bb : F.getBlocks()) {
+    if (bb->jumpTarget) {
+      preds[bb->jumpTarget.get()].push_back(bb.get());
+    }
+    if (bb->next) {
+      preds[bb->next.get()].push_back(bb.get());
+    }
+  }
+
+  // scan every block once with the same use/def positions renameVariables
+  // rewrites: a variable read before any write in the block is upward
+  // exposed there
+  std::map<int, std::vector<BasicBlock *>> upwardUses;
+  for (auto &bb : F.getBlocks()) {
+    std::set<int> defined;
+    std::set<int> exposed;
+    auto use = [&](const Operand &op) {
+      if (op.getType() != OperandType::Variable) {
+        return;
+      }
+      int id = op.asSymbol()->id;
+      if (_allocas.count(id) && !defined.count(id) &&
+          exposed.insert(id).second) {
+        upwardUses[id].push_back(bb.get());
+      }
+    };
+    auto def = [&](const Operand &op) {
+      if (op.getType() == OperandType::Variable &&
+          _allocas.count(op.asSymbol()->id)) {
+        defined.insert(op.asSymbol()->id);
+      }
+    };
+    for (auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op == OpCode::PHI || op == OpCode::ALLOCA) {
+        continue;
+      }
+      if (op == OpCode::STORE) {
+        use(inst->getArg1());
+        use(inst->getResult());
+        Operand index = inst->getResult();
+        bool isScalar =
+            index.getType() == OperandType::Empty ||
+            (index.getType() == OperandType::ConstantInt && index.asInt() == 0);
+        if (isScalar) {
+          def(inst->getArg2());
+        }
+        continue;
+      }
+      use(inst->getArg1());
+      if (op != OpCode::ASSIGN) {
+        use(inst->getArg2());
+      }
+      if (op == OpCode::RETURN) {
+        use(inst->getResult());
+      }
+      def(inst->getResult());
+    }
+  }
+
+  // a variable is live into a block if it is upward exposed there, or live
+  // into a successor and not written in the block
+  for (auto &entry : _allocas) {
+    AllocaInfo &info = entry.second;
+    info.liveInBlocks.clear();
+    std::vector<BasicBlock *> worklist = upwardUses[entry.first];
+    info.liveInBlocks.insert(worklist.begin(), worklist.end());
+    while (!worklist.empty()) {
+      BasicBlock *bb = worklist.back();
+      worklist.pop_back();
+      for (BasicBlock *pred : preds[bb]) {
+        if (info.defBlocks.count(pred) || info.liveInBlocks.count(pred)) {
+          continue;
         }
+        info.liveInBlocks.insert(pred);
+        worklist.push_back(pred);
       }
     }
   }
 }
 
-void Mem2RegPass::insertPhiNodes(Function &F) {
+void Mem2RegPass::insertPhiNodes(Function &F, const DominanceFrontier &DF) {
   for (auto &entry : _allocas) {
     int varId = entry.first;
     AllocaInfo &info = entry.second;
@@ -155,7 +198,12 @@ void Mem2RegPass::insertPhiNodes(Function &F) {
     size_t i = 0;
     while (i < worklist.size()) {
       BasicBlock *X = worklist[i++];
-      for (BasicBlock *Y : _domFrontiers[X]) {
+      for (BasicBlock *Y : DF.getFrontier(X)) {
+        // pruned SSA: a phi where the variable is dead would only be
+        // removed again by DCE, or turn into copies after phi elimination
+        if (!info.liveInBlocks.count(Y)) {
+          continue;
+        }
         if (hasPhi.find(Y) == hasPhi.end()) {
           Operand phiRes = Operand::Temporary(F.allocateTemp());
           auto phi =
@@ -0,0 +1,333 @@
+#include "optimize/Memoize.hpp"
+#include "codegen/Instruction.hpp"
+#include "optimize/LoopAnalysis.hpp"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_set>
+
+namespace {
+
+bool isCallTo(const Instruction &inst, const std::string &name) {
+  return inst.getOp() == OpCode::CALL &&
+         inst.getArg2().getType() == OperandType::Variable &&
+         inst.getCalleeName() == name;
+}
+
+/**
+ * @brief index of the first instruction of the entry past its labels,
+ * PARAMs and allocas
+ */
+size_t entryPrefix(const BasicBlock &entry) {
+  const auto &insts = entry.getInstructions();
+  size_t prefix = 0;
+  while (prefix < insts.size() &&
+         (insts[prefix]->getOp() == OpCode::LABEL ||
+          insts[prefix]->getOp() == OpCode::PARAM ||
+          insts[prefix]->getOp() == OpCode::ALLOCA)) {
+    ++prefix;
+  }
+  return prefix;
+}
+
+/**
+ * @brief PARAM temps by parameter index
+ */
+std::map<int, int> paramTemps(const BasicBlock &entry) {
+  std::map<int, int> params;
+  for (const auto &inst : entry.getInstructions()) {
+    if (inst->getOp() == OpCode::PARAM &&
+        inst->getResult().getType() == OperandType::Temporary) {
+      params[inst->getArg1().asInt()] = inst->getResult().asInt();
+    }
+  }
+  return params;
+}
+
+} // namespace
+
+bool MemoizePass::isCandidate(const Function &func, bool loopCalls) const {
+  const auto &blocks = func.getBlocks();
+  if (func.getName() == "main" || blocks.empty()) {
+    return false;
+  }
+  const BasicBlock *entry = blocks.front().get();
+  size_t prefix = entryPrefix(*entry);
+  std::map<int, int> params = paramTemps(*entry);
+  if (params.empty() || static_cast<int>(params.size()) > budget.maxParams) {
+    return false;
+  }
+  std::unordered_set<int> paramSet;
+  for (const auto &param : params) {
+    paramSet.insert(param.second);
+  }
+
+  int selfCalls = 0;
+  for (const auto &bb : blocks) {
+    if (bb->next.get() == entry || bb->jumpTarget.get() == entry) {
+      return false;
+    }
+    const auto &insts = bb->getInstructions();
+    for (size_t i = 0; i < insts.size(); ++i) {
+      const Instruction &inst = *insts[i];
+      switch (inst.getOp()) {
+      case OpCode::PARAM:
+        // every PARAM in the entry, none of them an array
+        if (bb.get() != entry || i >= prefix) {
+          return false;
+        }
+        break;
+      case OpCode::STORE:
+        if (inst.getResult().getType() == OperandType::Empty &&
+            inst.getArg1().getType() == OperandType::Temporary &&
+            paramSet.count(inst.getArg1().asInt())) {
+          return false;
+        }
+        break;
+      case OpCode::RETURN:
+        if (inst.getResult().getType() == OperandType::Empty) {
+          return false;
+        }
+        break;
+      case OpCode::CALL:
+        if (isCallTo(inst, func.getName())) {
+          if (!_modRef.isPure(inst)) {
+            return false;
+          }
+          ++selfCalls;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  return selfCalls >= budget.minSelfCalls || (selfCalls > 0 && loopCalls);
+}
+
+void MemoizePass::memoize(Function &func,
+                          std::vector<std::unique_ptr<Instruction>> &globals) {
+  auto &blocks = func.getBlocks();
+  BasicBlock *entry = blocks.front().get();
+  std::map<int, int> params = paramTemps(*entry);
+
+  // the same range for every parameter, a power of two when there are
+  // several so the row index is a shift
+  int dim = budget.maxEntries;
+  if (params.size() > 1) {
+    dim = 1;
+    auto fits = [&](long long d) {
+      long long total = 1;
+      for (size_t i = 0; i < params.size(); ++i) {
+        total *= d;
+      }
+      return total <= budget.maxEntries;
+    };
+    while (fits(dim * 2LL)) {
+      dim *= 2;
+    }
+  }
+  int total = 1;
+  for (size_t i = 0; i < params.size(); ++i) {
+    total *= dim;
+  }
+
+  // value and filled flag of each entry, plus the slot of out-of-range
+  // calls
+  auto makeTable = [&](const std::string &name) {
+    auto sym = std::make_shared<Symbol>(
+        _nextSymbolId++, name,
+        Type::create_array_type(Type::getIntType(), total + 1), 0);
+    sym->globalName = name;
+    globals.push_back(std::make_unique<Instruction>(Instruction::MakeAlloca(
+        Operand::Variable(sym), Operand::ConstantInt(total + 1))));
+    return Operand::Variable(sym);
+  };
+  Operand memo = makeTable("_M_" + func.getName());
+  Operand filled = makeTable("_M_" + func.getName() + "_set");
+
+  auto temp = [&]() { return Operand::Temporary(func.allocateTemp()); };
+  auto append = [](BasicBlock *bb, Instruction inst) {
+    bb->addInstruction(std::make_unique<Instruction>(std::move(inst)));
+  };
+  auto newBlock = [&]() {
+    BasicBlock *bb = func.createBlock().get();
+    append(bb, Instruction::MakeLabel(Operand::Label(func.allocateLabel())));
+    return bb;
+  };
+
+  // the rest of the entry becomes the body
+  BasicBlock *body = newBlock();
+  auto &entryInsts = entry->getInstructions();
+  size_t prefix = entryPrefix(*entry);
+  for (size_t i = prefix; i < entryInsts.size(); ++i) {
+    entryInsts[i]->setParent(body);
+    body->getInstructions().push_back(std::move(entryInsts[i]));
+  }
+  entryInsts.erase(entryInsts.begin() + prefix, entryInsts.end());
+  body->next = entry->next;
+  body->jumpTarget = entry->jumpTarget;
+  for (BasicBlock *succ : {body->next.get(), body->jumpTarget.get()}) {
+    if (!succ) {
+      continue;
+    }
+    for (auto &inst : succ->getInstructions()) {
+      if (inst->getOp() != OpCode::PHI) {
+        continue;
+      }
+      for (auto &pair : inst->getPhiArgs()) {
+        if (pair.second == entry) {
+          pair.second = body;
+        }
+      }
+    }
+  }
+
+  // every return fills the entry, or the extra slot
+  Operand index = temp();
+  for (const auto &bb : blocks) {
+    auto &insts = bb->getInstructions();
+    for (size_t i = 0; i < insts.size(); ++i) {
+      if (insts[i]->getOp() != OpCode::RETURN) {
+        continue;
+      }
+      const Operand value = insts[i]->getResult();
+      auto store = [&](const Operand &v, const Operand &table) {
+        auto inst = std::make_unique<Instruction>(
+            Instruction::MakeStore(v, table, index));
+        inst->setParent(bb.get());
+        return inst;
+      };
+      insts.insert(insts.begin() + i, store(value, memo));
+      insts.insert(insts.begin() + i + 1,
+                   store(Operand::ConstantInt(1), filled));
+      i += 2;
+    }
+  }
+
+  // E: arguments out of range skip the table
+  Operand out;
+  for (const auto &param : params) {
+    Operand p = Operand::Temporary(param.second);
+    Operand below = temp();
+    Operand above = temp();
+    Operand either = temp();
+    append(entry, Instruction::MakeBinary(OpCode::LT, p,
+                                          Operand::ConstantInt(0), below));
+    append(entry, Instruction::MakeBinary(OpCode::GE, p,
+                                          Operand::ConstantInt(dim), above));
+    append(entry, Instruction::MakeBinary(OpCode::OR, below, above, either));
+    if (out.getType() != OperandType::Empty) {
+      Operand both = temp();
+      append(entry, Instruction::MakeBinary(OpCode::OR, out, either, both));
+      either = both;
+    }
+    out = either;
+  }
+  append(entry, Instruction::MakeIf(out, Operand::Label(body->getLabelId())));
+
+  // C: a filled entry is returned at once
+  BasicBlock *check = newBlock();
+  Operand key;
+  for (const auto &param : params) {
+    Operand p = Operand::Temporary(param.second);
+    if (key.getType() == OperandType::Empty) {
+      key = p;
+      continue;
+    }
+    Operand row = temp();
+    Operand sum = temp();
+    append(check, Instruction::MakeBinary(OpCode::MUL, key,
+                                          Operand::ConstantInt(dim), row));
+    append(check, Instruction::MakeBinary(OpCode::ADD, row, p, sum));
+    key = sum;
+  }
+  Operand isFilled = temp();
+  append(check, Instruction::MakeLoad(filled, key, isFilled));
+  BasicBlock *hit = newBlock();
+  append(check, Instruction::MakeIf(isFilled,
+                                    Operand::Label(hit->getLabelId())));
+
+  // H: the remembered value
+  Operand remembered = temp();
+  append(hit, Instruction::MakeLoad(memo, key, remembered));
+  append(hit, Instruction::MakeReturn(remembered));
+
+  // B: where returns store
+  auto phi = std::make_unique<Instruction>(Instruction::MakePhi(index));
+  phi->addPhiArg(Operand::ConstantInt(total), entry);
+  phi->addPhiArg(key, check);
+  phi->setParent(body);
+  body->getInstructions().insert(body->getInstructions().begin() + 1,
+                                 std::move(phi));
+
+  auto checkPtr = func.getBlockSharedPtr(check);
+  auto bodyPtr = func.getBlockSharedPtr(body);
+  auto hitPtr = func.getBlockSharedPtr(hit);
+  entry->next = checkPtr;
+  entry->jumpTarget = bodyPtr;
+  check->next = bodyPtr;
+  check->jumpTarget = hitPtr;
+
+  // E, C, B and the old blocks; H goes last
+  blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                              [&](const std::shared_ptr<BasicBlock> &bb) {
+                                return bb == checkPtr || bb == bodyPtr ||
+                                       bb == hitPtr;
+                              }),
+               blocks.end());
+  blocks.insert(blocks.begin() + 1, {checkPtr, bodyPtr});
+  blocks.push_back(hitPtr);
+}
+
+bool MemoizePass::run(std::vector<std::shared_ptr<Function>> &functions,
+                      std::vector<std::unique_ptr<Instruction>> &globals,
+                      AnalysisManager &am) {
+  if (budget.maxEntries <= 0) {
+    return false;
+  }
+  _nextSymbolId = 0;
+  for (const auto &inst : globals) {
+    for (const Operand *op :
+         {&inst->getArg1(), &inst->getArg2(), &inst->getResult()}) {
+      if (op->getType() == OperandType::Variable) {
+        _nextSymbolId = std::max(_nextSymbolId, op->asSymbol()->id + 1);
+      }
+    }
+  }
+  std::unordered_set<std::string> loopCalled;
+  for (const auto &fp : functions) {
+    for (const auto &bb : fp->getBlocks()) {
+      for (const auto &inst : bb->getInstructions()) {
+        for (const Operand *op :
+             {&inst->getArg1(), &inst->getArg2(), &inst->getResult()}) {
+          if (op->getType() == OperandType::Variable) {
+            _nextSymbolId = std::max(_nextSymbolId, op->asSymbol()->id + 1);
+          }
+        }
+      }
+    }
+    for (const auto &loop : am.getLoops(*fp)) {
+      for (const BasicBlock *bb : loop.blocks) {
+        for (const auto &inst : bb->getInstructions()) {
+          if (inst->getOp() == OpCode::CALL &&
+              inst->getArg2().getType() == OperandType::Variable &&
+              inst->getCalleeName() != fp->getName()) {
+            loopCalled.insert(inst->getCalleeName());
+          }
+        }
+      }
+    }
+  }
+
+  bool changed = false;
+  for (const auto &fp : functions) {
+    if (!isCandidate(*fp, loopCalled.count(fp->getName()) > 0)) {
+      continue;
+    }
+    memoize(*fp, globals);
+    am.invalidate(*fp, PreservedAnalyses::none());
+    changed = true;
+  }
+  return changed;
+}
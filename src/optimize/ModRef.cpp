@@ -0,0 +1,290 @@
+#include "optimize/ModRef.hpp"
+#include "codegen/Instruction.hpp"
+
+namespace {
+
+bool isArray(const Symbol *sym) {
+  return sym->type && sym->type->category == Type::Category::Array;
+}
+
+/**
+ * @brief string literals have no type
+ */
+bool isScalar(const Symbol *sym) {
+  return sym->type && sym->type->category == Type::Category::Basic;
+}
+
+/**
+ * @brief a call and the global arrays passed to it
+ */
+struct CallSite {
+  std::string callee;
+  std::vector<const Symbol *> passed;
+};
+
+} // namespace
+
+void ModRefAnalysis::run(
+    const std::vector<std::shared_ptr<Function>> &functions) {
+  _effects.clear();
+  _changed.clear();
+  _pointerWrites = false;
+  _unknown = Effects{};
+  _unknown.unknown = true;
+
+  std::unordered_map<std::string, std::vector<CallSite>> calls;
+  AliasAnalysis AA;
+  for (const auto &fp : functions) {
+    Effects &effects = _effects[fp->getName()];
+    std::vector<CallSite> &sites = calls[fp->getName()];
+    AA.run(*fp);
+    std::set<const Symbol *> locals;
+    for (const auto &bb : fp->getBlocks()) {
+      for (const auto &inst : bb->getInstructions()) {
+        if (inst->getOp() == OpCode::ALLOCA &&
+            inst->getArg1().getType() == OperandType::Variable) {
+          locals.insert(inst->getArg1().asSymbol().get());
+        }
+      }
+    }
+    // scalars by name; arrays as values are addresses
+    auto scalar = [&](const Operand &op, std::set<const Symbol *> &set) {
+      if (op.getType() != OperandType::Variable) {
+        return;
+      }
+      const Symbol *sym = op.asSymbol().get();
+      if (isScalar(sym) && !locals.count(sym)) {
+        set.insert(sym);
+      }
+    };
+    auto element = [&](const Operand &base, const Operand &idx, bool write) {
+      const Symbol *object = AA.getLocation(base, idx).object;
+      if (!object) {
+        effects.unknown = true;
+        _pointerWrites |= write;
+        return;
+      }
+      switch (AA.getKind(object)) {
+      case AliasAnalysis::ObjectKind::Local:
+        break;
+      case AliasAnalysis::ObjectKind::Parameter:
+        (write ? effects.writesParams : effects.readsParams) = true;
+        break;
+      case AliasAnalysis::ObjectKind::Global:
+        (write ? effects.writes : effects.reads).insert(object);
+        break;
+      }
+    };
+    std::vector<const Symbol *> passed;
+    for (const auto &bb : fp->getBlocks()) {
+      for (const auto &inst : bb->getInstructions()) {
+        OpCode op = inst->getOp();
+        const Operand &a1 = inst->getArg1();
+        const Operand &a2 = inst->getArg2();
+        const Operand &res = inst->getResult();
+        // an empty index on an array reads its address or fills the slot of
+        // a parameter
+        bool address = [&] {
+          const Operand &base = op == OpCode::LOAD ? a1 : a2;
+          const Operand &idx = op == OpCode::LOAD ? a2 : res;
+          return base.getType() == OperandType::Variable &&
+                 isArray(base.asSymbol().get()) &&
+                 idx.getType() == OperandType::Empty;
+        }();
+        switch (op) {
+        case OpCode::CALL: {
+          if (a2.getType() != OperandType::Variable) {
+            effects.unknown = true;
+          } else if (inst->callsBuiltin()) {
+            // the I/O runtime touches no program memory except through its
+            // arguments, which are never arrays
+            effects.io = true;
+          } else {
+            sites.push_back({inst->getCalleeName(), passed});
+          }
+          passed.clear();
+          break;
+        }
+        case OpCode::ARG:
+          scalar(a1, effects.reads);
+          if (const Symbol *object = AA.getUnderlyingObject(a1)) {
+            if (AA.getKind(object) == AliasAnalysis::ObjectKind::Global) {
+              passed.push_back(object);
+            }
+          }
+          break;
+        case OpCode::LOAD:
+          if (address) {
+            break;
+          }
+          if (a1.getType() == OperandType::Variable &&
+              !isArray(a1.asSymbol().get())) {
+            scalar(a1, effects.reads);
+          } else {
+            element(a1, a2, false);
+          }
+          scalar(a2, effects.reads);
+          break;
+        case OpCode::STORE:
+          scalar(a1, effects.reads);
+          if (address) {
+            break;
+          }
+          if (a2.getType() == OperandType::Variable &&
+              !isArray(a2.asSymbol().get())) {
+            scalar(a2, effects.writes);
+          } else {
+            element(a2, res, true);
+          }
+          scalar(res, effects.reads);
+          break;
+        case OpCode::PHI:
+          for (const auto &pair : inst->getPhiArgs()) {
+            scalar(pair.first, effects.reads);
+          }
+          break;
+        case OpCode::ALLOCA:
+        case OpCode::PARAM:
+          break;
+        default:
+          scalar(a1, effects.reads);
+          scalar(a2, effects.reads);
+          scalar(res, op == OpCode::RETURN ? effects.reads : effects.writes);
+          break;
+        }
+      }
+    }
+  }
+
+  // close the summaries over the call graph
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto &entry : calls) {
+      Effects &caller = _effects[entry.first];
+      for (const CallSite &site : entry.second) {
+        auto it = _effects.find(site.callee);
+        const Effects &callee = it == _effects.end() ? _unknown : it->second;
+        for (bool Effects::*flag :
+             {&Effects::readsParams, &Effects::writesParams, &Effects::io,
+              &Effects::unknown}) {
+          if (callee.*flag && !(caller.*flag)) {
+            caller.*flag = true;
+            changed = true;
+          }
+        }
+        for (const Symbol *sym : callee.reads) {
+          changed |= caller.reads.insert(sym).second;
+        }
+        for (const Symbol *sym : callee.writes) {
+          changed |= caller.writes.insert(sym).second;
+        }
+      }
+    }
+  }
+
+  for (const auto &entry : _effects) {
+    _changed.insert(entry.second.writes.begin(), entry.second.writes.end());
+  }
+  for (const auto &entry : calls) {
+    for (const CallSite &site : entry.second) {
+      auto it = _effects.find(site.callee);
+      const Effects &callee = it == _effects.end() ? _unknown : it->second;
+      if (callee.writesParams || callee.unknown) {
+        _changed.insert(site.passed.begin(), site.passed.end());
+      }
+    }
+  }
+}
+
+const ModRefAnalysis::Effects &
+ModRefAnalysis::getEffects(const Instruction &call) const {
+  static const Effects runtime = [] {
+    Effects effects;
+    effects.io = true;
+    return effects;
+  }();
+  const Operand &callee = call.getArg2();
+  if (callee.getType() != OperandType::Variable) {
+    return _unknown;
+  }
+  if (call.callsBuiltin()) {
+    return runtime;
+  }
+  auto it = _effects.find(call.getCalleeName());
+  return it == _effects.end() ? _unknown : it->second;
+}
+
+bool ModRefAnalysis::mayTouch(const std::set<const Symbol *> &globals,
+                              bool throughParams, const Symbol *object) {
+  if (!object) {
+    // a pointer may also point into any global array
+    if (throughParams) {
+      return true;
+    }
+    for (const Symbol *sym : globals) {
+      if (isArray(sym)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  return globals.count(object) || (throughParams && isArray(object));
+}
+
+bool ModRefAnalysis::mayRead(const Instruction &call,
+                             const Symbol *object) const {
+  const Effects &effects = getEffects(call);
+  return effects.unknown ||
+         mayTouch(effects.reads, effects.readsParams, object);
+}
+
+bool ModRefAnalysis::mayWrite(const Instruction &call,
+                              const Symbol *object) const {
+  const Effects &effects = getEffects(call);
+  return effects.unknown ||
+         mayTouch(effects.writes, effects.writesParams, object);
+}
+
+const Symbol *ModRefAnalysis::callerObject(const MemoryLocation &loc,
+                                           const AliasAnalysis &AA) {
+  if (loc.object &&
+      AA.getKind(loc.object) == AliasAnalysis::ObjectKind::Global) {
+    return loc.object;
+  }
+  return nullptr;
+}
+
+bool ModRefAnalysis::mayRead(const Instruction &call,
+                             const MemoryLocation &loc,
+                             const AliasAnalysis &AA) const {
+  return !AA.isLocal(loc.object) && mayRead(call, callerObject(loc, AA));
+}
+
+bool ModRefAnalysis::mayWrite(const Instruction &call,
+                              const MemoryLocation &loc,
+                              const AliasAnalysis &AA) const {
+  return !AA.isLocal(loc.object) && mayWrite(call, callerObject(loc, AA));
+}
+
+bool ModRefAnalysis::isConstant(const Symbol *global) const {
+  return !_changed.count(global) && !(_pointerWrites && isArray(global));
+}
+
+bool ModRefAnalysis::isReadOnly(const Instruction &call) const {
+  const Effects &effects = getEffects(call);
+  return !effects.unknown && !effects.io && effects.writes.empty() &&
+         !effects.writesParams;
+}
+
+bool ModRefAnalysis::isPure(const Instruction &call) const {
+  if (!isReadOnly(call) || getEffects(call).readsParams) {
+    return false;
+  }
+  for (const Symbol *sym : getEffects(call).reads) {
+    if (!isConstant(sym)) {
+      return false;
+    }
+  }
+  return true;
+}
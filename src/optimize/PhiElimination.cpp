@@ -1,10 +1,11 @@
 #include "optimize/PhiElimination.hpp"
 #include "codegen/BasicBlock.hpp"
 #include "codegen/Instruction.hpp"
+#include "optimize/Liveness.hpp"
 #include <map>
 #include <vector>
 
-void PhiEliminationPass::run(Function &F) {
+void PhiEliminationPass::run(Function &F, const Liveness &live) {
   // analyze CFG
   std::map<BasicBlock *, int> predCounts;
   std::map<BasicBlock *, int> succCounts;
@@ -54,6 +55,32 @@ void PhiEliminationPass::run(Function &F) {
     BasicBlock *insertBlock = nullptr;
     bool appendToEnd = false;
 
+    // a branch whose other successor ignores the copied values can do the
+    // copies before it, like the back edge of a bottom-tested loop
+    if (isCritical) {
+      BasicBlock *other =
+          pred->next.get() == succ ? pred->jumpTarget.get() : pred->next.get();
+      if (other && other != succ) {
+        const auto &otherLive = live.getLiveIn(other);
+        bool clobbers = false;
+        for (auto &copy : copies) {
+          int dest = copy.first.asInt();
+          if (otherLive.count(dest)) {
+            clobbers = true;
+          }
+          auto it = edgeCopies.find({pred, other});
+          if (it != edgeCopies.end()) {
+            for (auto &otherCopy : it->second) {
+              if (otherCopy.second == copy.first) {
+                clobbers = true;
+              }
+            }
+          }
+        }
+        isCritical = clobbers;
+      }
+    }
+
     if (!isCritical) {
       if (predCounts[succ] == 1) {
         insertBlock = succ;
@@ -121,16 +148,32 @@ void PhiEliminationPass::run(Function &F) {
     std::vector<std::unique_ptr<Instruction>> copyInsts;
     std::vector<Operand> temps;
 
-    for (auto &copy : copies) {
-      Operand t = Operand::Temporary(F.allocateTemp());
-      temps.push_back(t);
-      copyInsts.push_back(std::make_unique<Instruction>(
-          Instruction::MakeAssign(copy.second, t)));
+    // copies only need staging temps when one overwrites another's source
+    bool overlapping = false;
+    for (size_t i = 0; i < copies.size(); i++) {
+      for (size_t j = 0; j < copies.size(); j++) {
+        if (i != j && copies[j].second == copies[i].first) {
+          overlapping = true;
+        }
+      }
     }
+    if (!overlapping) {
+      for (auto &copy : copies) {
+        copyInsts.push_back(std::make_unique<Instruction>(
+            Instruction::MakeAssign(copy.second, copy.first)));
+      }
+    } else {
+      for (auto &copy : copies) {
+        Operand t = Operand::Temporary(F.allocateTemp());
+        temps.push_back(t);
+        copyInsts.push_back(std::make_unique<Instruction>(
+            Instruction::MakeAssign(copy.second, t)));
+      }
 
-    for (size_t i = 0; i < copies.size(); i++) {
-      copyInsts.push_back(std::make_unique<Instruction>(
-          Instruction::MakeAssign(temps[i], copies[i].first)));
+      for (size_t i = 0; i < copies.size(); i++) {
+        copyInsts.push_back(std::make_unique<Instruction>(
+            Instruction::MakeAssign(temps[i], copies[i].first)));
+      }
     }
     auto &targetInsts = insertBlock->getInstructions();
     auto it = targetInsts.begin();
@@ -0,0 +1,160 @@
+#include "optimize/PostDominatorTree.hpp"
+#include <algorithm>
+
+/**
+ * @brief CFG successors of a block: the jump edge of a GOTO/IF, and the
+ * fallthrough edge unless the block ends in GOTO/RETURN
+ */
+static std::vector<BasicBlock *> successorsOf(BasicBlock *BB) {
+  std::vector<BasicBlock *> succs;
+  auto &insts = BB->getInstructions();
+  OpCode last = insts.empty() ? OpCode::NOP : insts.back()->getOp();
+  if (last == OpCode::RETURN) {
+    return succs;
+  }
+  if ((last == OpCode::GOTO || last == OpCode::IF) && BB->jumpTarget) {
+    succs.push_back(BB->jumpTarget.get());
+  }
+  if (last != OpCode::GOTO && BB->next &&
+      std::find(succs.begin(), succs.end(), BB->next.get()) == succs.end()) {
+    succs.push_back(BB->next.get());
+  }
+  return succs;
+}
+
+bool PostDominatorTree::run(Function &F) {
+  _blocks.clear();
+  _number.clear();
+  _succs.clear();
+  _ipdom.clear();
+  if (F.getBlocks().empty()) {
+    return true;
+  }
+  std::unordered_map<BasicBlock *, bool> seen;
+  std::vector<BasicBlock *> stack{F.getBlocks().front().get()};
+  seen[stack.back()] = true;
+  while (!stack.empty()) {
+    BasicBlock *bb = stack.back();
+    stack.pop_back();
+    for (BasicBlock *succ : successorsOf(bb)) {
+      if (!seen[succ]) {
+        seen[succ] = true;
+        stack.push_back(succ);
+      }
+    }
+  }
+  for (const auto &bb : F.getBlocks()) {
+    if (seen[bb.get()]) {
+      _number[bb.get()] = static_cast<int>(_blocks.size());
+      _blocks.push_back(bb.get());
+    }
+  }
+
+  int n = static_cast<int>(_blocks.size());
+  int exit = n;
+  std::vector<std::vector<int>> succs(n + 1);
+  std::vector<std::vector<int>> preds(n + 1);
+  _succs.resize(n);
+  for (int b = 0; b < n; ++b) {
+    _succs[b] = successorsOf(_blocks[b]);
+    for (BasicBlock *succ : _succs[b]) {
+      succs[b].push_back(_number.at(succ));
+      preds[_number.at(succ)].push_back(b);
+    }
+    if (_succs[b].empty()) {
+      succs[b].push_back(exit);
+      preds[exit].push_back(b);
+    }
+  }
+
+  // postorder of the reverse CFG from the exit, iterative so deep CFGs do
+  // not overflow
+  std::vector<int> order;
+  std::vector<int> post(n + 1, -1);
+  std::vector<bool> visited(n + 1, false);
+  std::vector<std::pair<int, size_t>> dfs{{exit, 0}};
+  visited[exit] = true;
+  while (!dfs.empty()) {
+    auto &[b, i] = dfs.back();
+    if (i < preds[b].size()) {
+      int p = preds[b][i++];
+      if (!visited[p]) {
+        visited[p] = true;
+        dfs.push_back({p, 0});
+      }
+      continue;
+    }
+    post[b] = static_cast<int>(order.size());
+    order.push_back(b);
+    dfs.pop_back();
+  }
+  if (static_cast<int>(order.size()) != n + 1) {
+    _blocks.clear();
+    _number.clear();
+    _succs.clear();
+    return false;
+  }
+
+  // idoms of the reverse CFG by postorder numbers, the exit numbered last
+  std::vector<int> ipdom(n + 1, -1);
+  ipdom[post[exit]] = post[exit];
+  auto intersect = [&](int a, int b) {
+    while (a != b) {
+      while (a < b)
+        a = ipdom[a];
+      while (b < a)
+        b = ipdom[b];
+    }
+    return a;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = n - 1; i >= 0; --i) {
+      int newIpdom = -1;
+      for (int s : succs[order[i]]) {
+        if (ipdom[post[s]] == -1) {
+          continue;
+        }
+        newIpdom = newIpdom == -1 ? post[s] : intersect(post[s], newIpdom);
+      }
+      if (newIpdom != ipdom[i]) {
+        ipdom[i] = newIpdom;
+        changed = true;
+      }
+    }
+  }
+  _ipdom.assign(n, exit);
+  for (int b = 0; b < n; ++b) {
+    _ipdom[b] = order[ipdom[post[b]]];
+  }
+  return true;
+}
+
+const std::vector<BasicBlock *> &
+PostDominatorTree::getSuccessors(BasicBlock *B) const {
+  return _succs[_number.at(B)];
+}
+
+BasicBlock *PostDominatorTree::getImmediatePostDominator(BasicBlock *B) const {
+  int p = _ipdom[_number.at(B)];
+  return p == static_cast<int>(_blocks.size()) ? nullptr : _blocks[p];
+}
+
+bool PostDominatorTree::postDominates(BasicBlock *A, BasicBlock *B) const {
+  if (!A) {
+    return true;
+  }
+  auto itA = _number.find(A);
+  auto itB = _number.find(B);
+  if (itA == _number.end() || itB == _number.end()) {
+    return false;
+  }
+  int exit = static_cast<int>(_blocks.size());
+  for (int b = itB->second; b != exit; b = _ipdom[b]) {
+    if (b == itA->second) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,461 @@
+#include "optimize/ScalarPromotion.hpp"
+#include "codegen/Instruction.hpp"
+#include <algorithm>
+
+namespace {
+
+/**
+ * @brief locations promoted in one loop, each one keeps a register busy
+ */
+constexpr size_t MAX_PROMOTED_PER_LOOP = 8;
+
+bool isArray(const Symbol *sym) {
+  return sym->type && sym->type->category == Type::Category::Array;
+}
+
+bool isScalar(const Symbol *sym) {
+  return sym->type && sym->type->category == Type::Category::Basic;
+}
+
+bool hasSingleSuccessor(const BasicBlock *bb, const BasicBlock *succ) {
+  return (bb->next.get() == succ || !bb->next) &&
+         (bb->jumpTarget.get() == succ || !bb->jumpTarget);
+}
+
+/**
+ * @brief position after the labels and phis of bb
+ */
+std::vector<std::unique_ptr<Instruction>>::iterator
+firstInsertionPoint(BasicBlock *bb) {
+  auto &insts = bb->getInstructions();
+  auto it = insts.begin();
+  while (it != insts.end() && ((*it)->getOp() == OpCode::LABEL ||
+                               (*it)->getOp() == OpCode::PHI)) {
+    ++it;
+  }
+  return it;
+}
+
+} // namespace
+
+ScalarPromotionPass::ScalarPromotionPass(
+    const ModRefAnalysis &modRef,
+    const std::vector<std::unique_ptr<Instruction>> &globals)
+    : _modRef(modRef) {
+  for (const auto &inst : globals) {
+    recordArraySize(*inst);
+  }
+}
+
+void ScalarPromotionPass::classifyLocals(const Function &func) {
+  _locals.clear();
+  _pointerParams.clear();
+  _addressTaken.clear();
+  std::set<int> paramTemps;
+  for (const auto &bb : func.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      const Operand &a1 = inst->getArg1();
+      if (inst->getOp() == OpCode::ALLOCA &&
+          a1.getType() == OperandType::Variable) {
+        _locals.insert(a1.asSymbol().get());
+        recordArraySize(*inst);
+      } else if (inst->getOp() == OpCode::PARAM &&
+                 inst->getResult().getType() == OperandType::Temporary) {
+        paramTemps.insert(inst->getResult().asInt());
+      } else if (inst->getOp() == OpCode::STORE &&
+                 a1.getType() == OperandType::Temporary &&
+                 paramTemps.count(a1.asInt()) &&
+                 inst->getArg2().getType() == OperandType::Variable &&
+                 isArray(inst->getArg2().asSymbol().get())) {
+        _pointerParams.insert(inst->getArg2().asSymbol().get());
+      } else if (((inst->getOp() == OpCode::LOAD &&
+                   inst->getArg2().getType() == OperandType::Empty) ||
+                  inst->getOp() == OpCode::ASSIGN) &&
+                 a1.getType() == OperandType::Variable &&
+                 isArray(a1.asSymbol().get())) {
+        // the address of the array, which later loads and stores may go
+        // through
+        _addressTaken.insert(a1.asSymbol().get());
+      }
+    }
+  }
+}
+
+void ScalarPromotionPass::recordArraySize(const Instruction &inst) {
+  const Operand &sym = inst.getArg1();
+  const Operand &size = inst.getResult();
+  if (inst.getOp() == OpCode::ALLOCA &&
+      sym.getType() == OperandType::Variable && isArray(sym.asSymbol().get()) &&
+      size.getType() == OperandType::ConstantInt) {
+    _arrayWords[sym.asSymbol().get()] = size.asInt();
+  }
+}
+
+bool ScalarPromotionPass::run(Function &func, DominatorTree &DT,
+                              const std::vector<LoopInfo> &loops) {
+  classifyLocals(func);
+  _nextSymbolId = 0;
+  for (const auto &bb : func.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      for (const Operand *op :
+           {&inst->getArg1(), &inst->getArg2(), &inst->getResult()}) {
+        if (op->getType() == OperandType::Variable) {
+          _nextSymbolId = std::max(_nextSymbolId, op->asSymbol()->id + 1);
+        }
+      }
+    }
+  }
+  // a location promoted in an outer loop is a local in its inner loops
+  std::vector<const LoopInfo *> order;
+  for (const auto &loop : loops) {
+    order.push_back(&loop);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const LoopInfo *a, const LoopInfo *b) {
+                     return a->blocks.size() > b->blocks.size();
+                   });
+  bool changed = false;
+  for (const LoopInfo *loop : order) {
+    changed |= promoteLoop(func, DT, *loop);
+  }
+  return changed;
+}
+
+bool ScalarPromotionPass::promoteLoop(Function &func, DominatorTree &DT,
+                                      const LoopInfo &loop) {
+  // dead code behind a RETURN may still jump into the loop
+  std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> preds;
+  for (const auto &bb : func.getBlocks()) {
+    if (!DT.isReachable(bb.get())) {
+      continue;
+    }
+    if (bb->next) {
+      preds[bb->next.get()].push_back(bb.get());
+    }
+    if (bb->jumpTarget && bb->jumpTarget != bb->next) {
+      preds[bb->jumpTarget.get()].push_back(bb.get());
+    }
+  }
+  // the loop is entered only through a preheader, and the block set is
+  // not stale
+  BasicBlock *preheader = nullptr;
+  std::vector<BasicBlock *> latches;
+  for (BasicBlock *pred : preds[loop.header]) {
+    if (loop.blocks.count(pred)) {
+      latches.push_back(pred);
+    } else if (preheader) {
+      return false;
+    } else {
+      preheader = pred;
+    }
+  }
+  if (!preheader || !hasSingleSuccessor(preheader, loop.header)) {
+    return false;
+  }
+  for (BasicBlock *bb : loop.blocks) {
+    if (bb == loop.header) {
+      continue;
+    }
+    for (BasicBlock *pred : preds[bb]) {
+      if (!loop.blocks.count(pred)) {
+        return false;
+      }
+    }
+  }
+  // stores go at the start of every exit, so code after the loop must be
+  // reachable only through them
+  std::vector<BasicBlock *> exits;
+  std::set<BasicBlock *> exitSet;
+  for (const auto &bb : func.getBlocks()) {
+    if (loop.blocks.count(bb.get())) {
+      continue;
+    }
+    for (BasicBlock *pred : preds[bb.get()]) {
+      if (loop.blocks.count(pred)) {
+        exits.push_back(bb.get());
+        exitSet.insert(bb.get());
+        break;
+      }
+    }
+  }
+  for (BasicBlock *exit : exits) {
+    for (BasicBlock *pred : preds[exit]) {
+      if (!loop.blocks.count(pred) && !exitSet.count(pred)) {
+        return false;
+      }
+    }
+  }
+
+  std::unordered_map<int, std::vector<BasicBlock *>> tempDefs;
+  for (const auto &bb : func.getBlocks()) {
+    for (const auto &inst : bb->getInstructions()) {
+      if (inst->getOp() != OpCode::STORE && inst->getOp() != OpCode::RETURN &&
+          inst->getResult().getType() == OperandType::Temporary) {
+        tempDefs[inst->getResult().asInt()].push_back(bb.get());
+      }
+    }
+  }
+
+  struct Access {
+    Operand index;
+    bool isStore;
+    BasicBlock *block;
+  };
+  struct Uses {
+    std::shared_ptr<Symbol> sym;
+    bool bad = false;
+    bool written = false;
+    std::vector<Access> accesses;
+  };
+  std::vector<Uses> uses;
+  std::unordered_map<const Symbol *, size_t> useIndex;
+  auto usesOf = [&](const Operand &op) -> Uses * {
+    const Symbol *sym = op.asSymbol().get();
+    bool candidate = isArray(sym) ? !_pointerParams.count(sym)
+                                  : isScalar(sym) && !_locals.count(sym);
+    if (!candidate) {
+      return nullptr;
+    }
+    auto it = useIndex.find(sym);
+    if (it == useIndex.end()) {
+      it = useIndex.emplace(sym, uses.size()).first;
+      Uses use;
+      use.sym = op.asSymbol();
+      uses.push_back(std::move(use));
+    }
+    return &uses[it->second];
+  };
+  auto read = [&](const Operand &op) {
+    if (op.getType() != OperandType::Variable) {
+      return;
+    }
+    if (Uses *u = usesOf(op)) {
+      // an array read as a value escapes as an address
+      u->bad |= isArray(u->sym.get());
+    }
+  };
+
+  ModRefAnalysis::Effects calls;
+  // loads and stores through pointers, which may hit any global array
+  bool derefsPointers = false;
+  for (const auto &bbPtr : func.getBlocks()) {
+    BasicBlock *bb = bbPtr.get();
+    if (!loop.blocks.count(bb)) {
+      continue;
+    }
+    for (const auto &inst : bb->getInstructions()) {
+      OpCode op = inst->getOp();
+      if (op == OpCode::CALL) {
+        const ModRefAnalysis::Effects &callee = _modRef.getEffects(*inst);
+        calls.unknown |= callee.unknown;
+        calls.readsParams |= callee.readsParams;
+        calls.writesParams |= callee.writesParams;
+        calls.reads.insert(callee.reads.begin(), callee.reads.end());
+        calls.writes.insert(callee.writes.begin(), callee.writes.end());
+        continue;
+      }
+      if (op == OpCode::LOAD || op == OpCode::STORE) {
+        const Operand &base = op == OpCode::LOAD ? inst->getArg1()
+                                                 : inst->getArg2();
+        const Operand &index =
+            op == OpCode::LOAD ? inst->getArg2() : inst->getResult();
+        read(index);
+        if (op == OpCode::LOAD) {
+          if (inst->getResult().getType() == OperandType::Variable) {
+            if (Uses *u = usesOf(inst->getResult())) {
+              u->written = true;
+            }
+          }
+        } else {
+          read(inst->getArg1());
+        }
+        if (base.getType() != OperandType::Variable ||
+            _pointerParams.count(base.asSymbol().get())) {
+          derefsPointers = true;
+          continue;
+        }
+        if (Uses *u = usesOf(base)) {
+          if (!isArray(u->sym.get()) ||
+              index.getType() == OperandType::Empty) {
+            u->bad = true;
+          } else {
+            u->accesses.push_back({index, op == OpCode::STORE, bb});
+          }
+        }
+        continue;
+      }
+      if (op == OpCode::PHI) {
+        for (const auto &pair : inst->getPhiArgs()) {
+          read(pair.first);
+        }
+        continue;
+      }
+      read(inst->getArg1());
+      read(inst->getArg2());
+      const Operand &res = inst->getResult();
+      if (op == OpCode::RETURN) {
+        read(res);
+      } else if (res.getType() == OperandType::Variable) {
+        if (Uses *u = usesOf(res)) {
+          u->bad |= isArray(u->sym.get());
+          u->written = true;
+        }
+      }
+    }
+  }
+  if (calls.unknown) {
+    return false;
+  }
+
+  std::vector<Location> locations;
+  for (const Uses &u : uses) {
+    const Symbol *sym = u.sym.get();
+    bool stored = u.written ||
+                  std::any_of(u.accesses.begin(), u.accesses.end(),
+                              [](const Access &a) { return a.isStore; });
+    // a callee must not write the location, nor read what the loop wrote
+    if (u.bad || calls.writes.count(sym) ||
+        (stored && calls.reads.count(sym))) {
+      continue;
+    }
+    if (!isArray(sym)) {
+      locations.push_back({u.sym, Operand::Empty(), u.written});
+      continue;
+    }
+    // an array parameter may point to any global array, and a pointer
+    // to any local array whose address was taken
+    if (calls.writesParams || (stored && calls.readsParams) ||
+        (derefsPointers &&
+         (!_locals.count(sym) || _addressTaken.count(sym)))) {
+      continue;
+    }
+    std::vector<Operand> indices;
+    bool allConstant = true;
+    for (const Access &access : u.accesses) {
+      if (std::find(indices.begin(), indices.end(), access.index) ==
+          indices.end()) {
+        indices.push_back(access.index);
+      }
+      allConstant &= access.index.getType() == OperandType::ConstantInt;
+    }
+    auto writes = [&](const Operand &index) {
+      for (const Access &access : u.accesses) {
+        if (access.isStore && access.index == index) {
+          return true;
+        }
+      }
+      return false;
+    };
+    if (allConstant) {
+      // the preheader load runs even if the loop does not, so it must stay
+      // inside the array
+      auto size = _arrayWords.find(sym);
+      int words = size == _arrayWords.end() ? 0 : size->second;
+      for (const Operand &index : indices) {
+        if (index.asInt() >= 0 && index.asInt() < words) {
+          locations.push_back({u.sym, index, writes(index)});
+        }
+      }
+      continue;
+    }
+    if (indices.size() != 1 ||
+        indices[0].getType() != OperandType::Temporary) {
+      continue;
+    }
+    auto defs = tempDefs.find(indices[0].asInt());
+    if (defs != tempDefs.end() &&
+        std::any_of(defs->second.begin(), defs->second.end(),
+                    [&](BasicBlock *bb) { return loop.blocks.count(bb); })) {
+      continue;
+    }
+    // a computed index is only trusted if every iteration uses it
+    bool everyIteration = false;
+    for (const Access &access : u.accesses) {
+      everyIteration |= std::all_of(
+          latches.begin(), latches.end(),
+          [&](BasicBlock *latch) { return DT.dominates(access.block, latch); });
+    }
+    if (everyIteration) {
+      locations.push_back({u.sym, indices[0], writes(indices[0])});
+    }
+  }
+  if (locations.size() > MAX_PROMOTED_PER_LOOP) {
+    locations.resize(MAX_PROMOTED_PER_LOOP);
+  }
+  for (const Location &loc : locations) {
+    promote(func, loop, preheader, exits, loc);
+  }
+  return !locations.empty();
+}
+
+void ScalarPromotionPass::promote(Function &func, const LoopInfo &loop,
+                                  BasicBlock *preheader,
+                                  const std::vector<BasicBlock *> &exits,
+                                  const Location &loc) {
+  bool scalar = loc.index.getType() == OperandType::Empty;
+  Operand base = Operand::Variable(loc.base);
+  auto sym = std::make_shared<Symbol>(_nextSymbolId++, loc.base->name,
+                                      Type::getIntType(), loc.base->line);
+  Operand reg = Operand::Variable(sym);
+  _locals.insert(sym.get());
+
+  BasicBlock *entry = func.getBlocks().front().get();
+  entry->getInstructions().insert(
+      firstInsertionPoint(entry),
+      std::make_unique<Instruction>(
+          Instruction::MakeAlloca(reg, Operand::ConstantInt(1))));
+
+  auto &preInsts = preheader->getInstructions();
+  auto preIt = preInsts.end();
+  if (!preInsts.empty() && (preInsts.back()->getOp() == OpCode::GOTO ||
+                            preInsts.back()->getOp() == OpCode::IF)) {
+    --preIt;
+  }
+  preInsts.insert(preIt, std::make_unique<Instruction>(
+                             scalar ? Instruction::MakeAssign(base, reg)
+                                    : Instruction::MakeLoad(base, loc.index,
+                                                            reg)));
+
+  auto storeBack = [&]() {
+    return std::make_unique<Instruction>(
+        scalar ? Instruction::MakeAssign(reg, base)
+               : Instruction::MakeStore(reg, base, loc.index));
+  };
+  auto rename = [&](const Operand &op) { return op == base ? reg : op; };
+  for (BasicBlock *bb : loop.blocks) {
+    auto &insts = bb->getInstructions();
+    for (auto it = insts.begin(); it != insts.end(); ++it) {
+      Instruction &inst = **it;
+      if (scalar) {
+        if (inst.getOp() == OpCode::PHI) {
+          for (auto &pair : inst.getPhiArgs()) {
+            pair.first = rename(pair.first);
+          }
+        }
+        inst.setArg1(rename(inst.getArg1()));
+        inst.setArg2(rename(inst.getArg2()));
+        inst.setResult(rename(inst.getResult()));
+      } else if (inst.getOp() == OpCode::LOAD && inst.getArg1() == base &&
+                 inst.getArg2() == loc.index) {
+        inst.setOp(OpCode::ASSIGN);
+        inst.setArg1(reg);
+        inst.setArg2(Operand::Empty());
+      } else if (inst.getOp() == OpCode::STORE && inst.getArg2() == base &&
+                 inst.getResult() == loc.index) {
+        inst.setOp(OpCode::ASSIGN);
+        inst.setArg2(Operand::Empty());
+        inst.setResult(reg);
+      }
+      if (loc.written && inst.getOp() == OpCode::RETURN) {
+        it = insts.insert(it, storeBack());
+        ++it;
+      }
+    }
+  }
+  if (!loc.written) {
+    return;
+  }
+  for (BasicBlock *exit : exits) {
+    exit->getInstructions().insert(firstInsertionPoint(exit), storeBack());
+  }
+}
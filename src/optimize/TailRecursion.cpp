@@ -0,0 +1,266 @@
+#include "optimize/TailRecursion.hpp"
+#include "codegen/Instruction.hpp"
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief position of inst in its block
+ */
+size_t positionOf(const Instruction *inst) {
+  const auto &insts = inst->getParent()->getInstructions();
+  size_t pos = 0;
+  while (insts[pos].get() != inst) {
+    ++pos;
+  }
+  return pos;
+}
+
+/**
+ * @brief positions of the ARGs of a call, in order; false when they are not
+ * all in its block
+ */
+bool getCallArgs(const Instruction *call, std::vector<size_t> &positions) {
+  const auto &insts = call->getParent()->getInstructions();
+  size_t argc = call->getArg1().asInt();
+  positions.clear();
+  for (size_t i = positionOf(call); i-- > 0 && positions.size() < argc;) {
+    if (insts[i]->getOp() == OpCode::CALL) {
+      break;
+    }
+    if (insts[i]->getOp() == OpCode::ARG) {
+      positions.push_back(i);
+    }
+  }
+  std::reverse(positions.begin(), positions.end());
+  return positions.size() == argc;
+}
+
+/**
+ * @brief whether the function returns what call returns right after it:
+ * `t = CALL; RETURN t`, a bare `RETURN`, or falling off the end
+ */
+bool isTailPosition(const Instruction *call) {
+  BasicBlock *bb = call->getParent();
+  const auto &insts = bb->getInstructions();
+  size_t pos = positionOf(call) + 1;
+  while (pos < insts.size() && insts[pos]->getOp() == OpCode::NOP) {
+    ++pos;
+  }
+  if (pos == insts.size()) {
+    return !bb->next && !bb->jumpTarget;
+  }
+  const Instruction &ret = *insts[pos];
+  if (ret.getOp() != OpCode::RETURN) {
+    return false;
+  }
+  const Operand &value = ret.getResult();
+  return value.getType() == OperandType::Empty ||
+         (value.getType() == OperandType::Temporary &&
+          call->getResult().getType() == OperandType::Temporary &&
+          value.asInt() == call->getResult().asInt());
+}
+
+void renameTemp(Operand &op, int from, const Operand &to) {
+  if (op.getType() == OperandType::Temporary && op.asInt() == from) {
+    op = to;
+  }
+}
+
+} // namespace
+
+bool TailRecursionElimPass::run(Function &func) {
+  auto &blocks = func.getBlocks();
+  if (blocks.empty()) {
+    return false;
+  }
+  BasicBlock *entry = blocks.front().get();
+  for (const auto &bb : blocks) {
+    if (bb->next.get() == entry || bb->jumpTarget.get() == entry) {
+      return false;
+    }
+  }
+
+  // the entry up to the first real instruction: PARAMs, allocas and the
+  // stores filling array parameter slots
+  std::map<int, int> paramTemp;
+  std::unordered_map<int, int> paramOf;
+  std::unordered_map<int, const Symbol *> slots;
+  auto &entryInsts = entry->getInstructions();
+  size_t prefix = 0;
+  for (; prefix < entryInsts.size(); ++prefix) {
+    const Instruction &inst = *entryInsts[prefix];
+    OpCode op = inst.getOp();
+    if (op == OpCode::LABEL || op == OpCode::ALLOCA) {
+      continue;
+    }
+    if (op == OpCode::PARAM &&
+        inst.getResult().getType() == OperandType::Temporary) {
+      paramTemp[inst.getArg1().asInt()] = inst.getResult().asInt();
+      paramOf[inst.getResult().asInt()] = inst.getArg1().asInt();
+      continue;
+    }
+    if (op == OpCode::STORE &&
+        inst.getResult().getType() == OperandType::Empty &&
+        inst.getArg1().getType() == OperandType::Temporary &&
+        inst.getArg2().getType() == OperandType::Variable &&
+        paramOf.count(inst.getArg1().asInt())) {
+      int idx = paramOf[inst.getArg1().asInt()];
+      slots[idx] = inst.getArg2().asSymbol().get();
+      paramTemp.erase(idx);
+      continue;
+    }
+    break;
+  }
+
+  // array arguments are passed as copies of their address
+  std::unordered_map<int, const Symbol *> addressOf;
+  for (const auto &bb : blocks) {
+    for (const auto &inst : bb->getInstructions()) {
+      // a PARAM the prefix does not cover
+      if (inst->getOp() == OpCode::PARAM &&
+          (inst->getResult().getType() != OperandType::Temporary ||
+           !paramOf.count(inst->getResult().asInt()))) {
+        return false;
+      }
+      if (inst->getOp() == OpCode::ASSIGN &&
+          inst->getResult().getType() == OperandType::Temporary &&
+          inst->getArg1().getType() == OperandType::Variable) {
+        addressOf[inst->getResult().asInt()] =
+            inst->getArg1().asSymbol().get();
+      }
+    }
+  }
+  auto passesSlot = [&](const Operand &arg, const Symbol *slot) {
+    if (arg.getType() == OperandType::Variable) {
+      return arg.asSymbol().get() == slot;
+    }
+    auto it = arg.getType() == OperandType::Temporary
+                  ? addressOf.find(arg.asInt())
+                  : addressOf.end();
+    return it != addressOf.end() && it->second == slot;
+  };
+
+  std::vector<Instruction *> sites;
+  for (const auto &bb : blocks) {
+    for (const auto &inst : bb->getInstructions()) {
+      if (inst->getOp() != OpCode::CALL ||
+          inst->getArg2().getType() != OperandType::Variable ||
+          inst->getCalleeName() != func.getName() ||
+          !isTailPosition(inst.get())) {
+        continue;
+      }
+      std::vector<size_t> args;
+      if (!getCallArgs(inst.get(), args)) {
+        continue;
+      }
+      auto argOf = [&](int idx) -> const Operand & {
+        return bb->getInstructions()[args[idx]]->getArg1();
+      };
+      // scalars go to phis as values, arrays must stay in their slots
+      bool ok = true;
+      for (const auto &param : paramTemp) {
+        ok &= static_cast<size_t>(param.first) < args.size() &&
+              argOf(param.first).getType() != OperandType::Variable;
+      }
+      for (const auto &slot : slots) {
+        ok &= static_cast<size_t>(slot.first) < args.size() &&
+              passesSlot(argOf(slot.first), slot.second);
+      }
+      if (ok) {
+        sites.push_back(inst.get());
+      }
+    }
+  }
+  if (sites.empty()) {
+    return false;
+  }
+
+  // the rest of the entry becomes the loop header
+  BasicBlock *header = func.createBlock().get();
+  header->addInstruction(std::make_unique<Instruction>(
+      Instruction::MakeLabel(Operand::Label(func.allocateLabel()))));
+  for (size_t i = prefix; i < entryInsts.size(); ++i) {
+    entryInsts[i]->setParent(header);
+    header->getInstructions().push_back(std::move(entryInsts[i]));
+  }
+  entryInsts.erase(entryInsts.begin() + prefix, entryInsts.end());
+  header->next = entry->next;
+  header->jumpTarget = entry->jumpTarget;
+  for (BasicBlock *succ : {header->next.get(), header->jumpTarget.get()}) {
+    if (!succ) {
+      continue;
+    }
+    for (auto &inst : succ->getInstructions()) {
+      if (inst->getOp() != OpCode::PHI) {
+        continue;
+      }
+      for (auto &pair : inst->getPhiArgs()) {
+        if (pair.second == entry) {
+          pair.second = header;
+        }
+      }
+    }
+  }
+  auto headerPtr = blocks.back();
+  blocks.pop_back();
+  blocks.insert(blocks.begin() + 1, headerPtr);
+  entry->next = headerPtr;
+  entry->jumpTarget = nullptr;
+
+  // each scalar parameter is read through a phi of the header
+  std::vector<std::pair<int, std::unique_ptr<Instruction>>> phis;
+  for (const auto &param : paramTemp) {
+    Operand fresh = Operand::Temporary(func.allocateTemp());
+    for (const auto &bb : blocks) {
+      for (auto &inst : bb->getInstructions()) {
+        if (inst->getOp() == OpCode::PARAM) {
+          continue;
+        }
+        Operand a1 = inst->getArg1();
+        Operand a2 = inst->getArg2();
+        Operand res = inst->getResult();
+        renameTemp(a1, param.second, fresh);
+        renameTemp(a2, param.second, fresh);
+        renameTemp(res, param.second, fresh);
+        inst->setArg1(a1);
+        inst->setArg2(a2);
+        inst->setResult(res);
+        for (auto &pair : inst->getPhiArgs()) {
+          renameTemp(pair.first, param.second, fresh);
+        }
+      }
+    }
+    auto phi = std::make_unique<Instruction>(Instruction::MakePhi(fresh));
+    phi->addPhiArg(Operand::Temporary(param.second), entry);
+    phis.push_back({param.first, std::move(phi)});
+  }
+
+  // tail calls pass their arguments to the phis and jump back
+  for (Instruction *call : sites) {
+    BasicBlock *bb = call->getParent();
+    auto &insts = bb->getInstructions();
+    std::vector<size_t> args;
+    getCallArgs(call, args);
+    for (auto &phi : phis) {
+      phi.second->addPhiArg(insts[args[phi.first]]->getArg1(), bb);
+    }
+    insts.erase(insts.begin() + positionOf(call), insts.end());
+    for (auto it = args.rbegin(); it != args.rend(); ++it) {
+      insts.erase(insts.begin() + *it);
+    }
+    bb->addInstruction(std::make_unique<Instruction>(
+        Instruction::MakeGoto(Operand::Label(header->getLabelId()))));
+    bb->next = nullptr;
+    bb->jumpTarget = headerPtr;
+  }
+  auto &headerInsts = header->getInstructions();
+  for (auto it = phis.rbegin(); it != phis.rend(); ++it) {
+    it->second->setParent(header);
+    headerInsts.insert(headerInsts.begin() + 1, std::move(it->second));
+  }
+  return true;
+}
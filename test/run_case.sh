@@ -0,0 +1,33 @@
+#!/bin/bash
+# usage: run_case.sh <compiler> <case without extension>
+# Compiles <case>.sy, with the flags in <case>.args if present, and runs
+# mips.txt in MARS, or in $MIPS_SIM (called as `$MIPS_SIM mips.txt`, input
+# on stdin), comparing the output with <case>.out. Exits 77 when there is
+# no simulator.
+
+set -e
+
+compiler=$1
+case=$2
+root=$(cd "$(dirname "$0")/.." && pwd)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+flags=()
+if [ -f "$case.args" ]; then
+  read -r -a flags < "$case.args"
+fi
+cp "$case.sy" "$dir/testfile.txt"
+cd "$dir"
+"$compiler" "${flags[@]}"
+
+if [ -z "$MIPS_SIM" ]; then
+  command -v java >/dev/null || exit 77
+  MIPS_SIM="java -jar $root/MARS2025+.jar nc"
+fi
+input=/dev/null
+if [ -f "$case.in" ]; then
+  input=$case.in
+fi
+$MIPS_SIM mips.txt < "$input" > out.txt
+diff out.txt "$case.out"